@@ -0,0 +1,9 @@
+#version 450
+
+/*Full screen triangle of the deferred shading passes. The vertices come from gl_VertexIndex, no vertex buffer is read.
+  The fragment shaders take their inputs out of the G-buffer and write the depth themselves.*/
+
+void main() {
+    vec2 corner = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(corner.yx * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,55 @@
+#version 450
+
+/*FXAA pass of the fxaa anti-aliasing mode, drawn over the full screen triangle of fullscreen.vert. A light FXAA: the edge
+  direction is taken from the luma of the 4 diagonal neighbours and the scene color is blurred along it with bilinear taps,
+  falling back to the shorter blur when the longer one crosses the local luma range.*/
+
+#define FXAA_EDGE_THRESHOLD 0.125
+#define FXAA_EDGE_THRESHOLD_MIN 0.0312
+#define FXAA_REDUCE_MUL (1.0 / 8.0)
+#define FXAA_REDUCE_MIN (1.0 / 128.0)
+#define FXAA_SPAN_MAX 8.0
+
+layout(push_constant) uniform FxaaConstants {
+    vec2 inverseSize;       // 1 / extent of the scene color.
+} fxaa;
+
+layout(set = 0, binding = 0) uniform sampler2D scene;
+
+layout(location = 0) out vec4 outColor;
+
+
+float luma(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+
+void main() {
+    vec2 uv = gl_FragCoord.xy * fxaa.inverseSize;
+    vec3 colorM = texture(scene, uv).rgb;
+    float lumaM = luma(colorM);
+    float lumaNW = luma(texture(scene, uv + vec2(-0.5, -0.5) * fxaa.inverseSize).rgb);
+    float lumaNE = luma(texture(scene, uv + vec2(0.5, -0.5) * fxaa.inverseSize).rgb);
+    float lumaSW = luma(texture(scene, uv + vec2(-0.5, 0.5) * fxaa.inverseSize).rgb);
+    float lumaSE = luma(texture(scene, uv + vec2(0.5, 0.5) * fxaa.inverseSize).rgb);
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    /*No edge: left as is.*/
+    if (lumaMax - lumaMin < max(FXAA_EDGE_THRESHOLD_MIN, lumaMax * FXAA_EDGE_THRESHOLD)) {
+        outColor = vec4(colorM, 1.0);
+        return;
+    }
+
+    /*Along the edge, the wider the steeper it is.*/
+    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25 * FXAA_REDUCE_MUL), FXAA_REDUCE_MIN);
+    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+    dir = clamp(dir * rcpDirMin, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * fxaa.inverseSize;
+
+    vec3 colorA = 0.5 * (texture(scene, uv + dir * (1.0 / 3.0 - 0.5)).rgb + texture(scene, uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 colorB = colorA * 0.5 + 0.25 * (texture(scene, uv - dir * 0.5).rgb + texture(scene, uv + dir * 0.5).rgb);
+    float lumaB = luma(colorB);
+    outColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? colorA : colorB, 1.0);
+}
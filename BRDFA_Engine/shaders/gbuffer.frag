@@ -0,0 +1,28 @@
+#version 450
+
+/*G-buffer pass of the deferred mode: the surface of the nearest fragment, shaded later by the BRDF of its object (see the
+  BRDFA_DEFERRED part of main.frag). The position isn't stored, the shading passes rebuild it from the depth.*/
+
+layout(location = 0) out vec4 outSurface;       // Octahedral world normal, texture coordinates.
+layout(location = 1) out vec4 outColor;         // Vertex color.
+layout(location = 2) out uint outInstance;      // Visible instance entry, which leads to the draw record of the object.
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec3 vertPosition;
+layout(location = 4) flat in uint inInstance;
+
+/*Unit vector to the octahedron folded onto [-1, 1]^2. Decoded by octDecode() in main.frag and minimal.frag.*/
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : folded;
+}
+
+
+void main() {
+    outSurface = vec4(octEncode(normalize(inNormal)), fragTexCoord);
+    outColor = vec4(fragColor, 1.0);
+    outInstance = inInstance;
+}
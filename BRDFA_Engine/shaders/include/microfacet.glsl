@@ -0,0 +1,49 @@
+/*Shared microfacet terms. Use in a BRDF with: #include "microfacet.glsl"*/
+#ifndef MICROFACET_GLSL
+#define MICROFACET_GLSL
+
+#ifndef PI
+#define PI 3.14159265359
+#endif
+
+
+/*GGX (Trowbridge-Reitz) normal distribution. a: roughness*/
+float reitz_distribution_GGX(vec3 N, vec3 H, float a)
+{
+    float a2     = a*a;
+    float NdotH  = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH*NdotH;
+	
+    float nom    = a2;
+    float denom  = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom        = PI * denom * denom;
+	
+    return nom / denom;
+}
+
+
+/*Schlick-GGX geometry term of one direction.*/
+float schlick_geometry_GGX(vec3 N, vec3 V, float k)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float nom   = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+	
+    return nom / denom;
+}
+
+
+/*Smith geometry term: masking (V) times shadowing (L).*/
+float smith_schlick_geometry(vec3 N, vec3 V, vec3 L, float k)
+{
+    return schlick_geometry_GGX(N,V,k) *  schlick_geometry_GGX(N,L,k);
+}
+
+
+/*Schlick approximation of the Fresnel reflectance.*/
+vec3 schlick_frasnel(vec3 N, vec3 V, vec3 F0)
+{   
+    return F0 + (1.0 - F0) * pow(1.0 - dot(N,V), 5.0);
+}
+
+#endif
@@ -1,4 +1,7 @@
 #version 450
+#ifdef BRDFA_BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 #define PI 3.14159265359
 #define LI 8.
@@ -7,45 +10,181 @@
 /*Output variables. */
 layout(location = 0) out vec4 outcolor;
 
-/*Incoming variables*/
+/*Incoming variables. In deferred mode (BRDFA_DEFERRED) they are read out of the G-buffer by loadSurface() instead.*/
+#ifdef BRDFA_DEFERRED
+vec3 fragColor;
+vec2 fragTexCoord;
+vec3 inNormal;
+vec3 vertPosition;
+uint inInstance;
+#else
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 vertPosition;
+layout(location = 4) flat in uint inInstance;      // Bit 31: culled, drawn by the culling debug view.
+layout(location = 5) flat in uint inRecord;        // Draw record of the object.
+#endif
 
 /*Uniforms*/
-layout(binding = 0) uniform UniformBufferObject {
+layout(push_constant) uniform DrawConstants {
+    uint instanceBase;		// Deferred mode: batch of the draw.
+    uint record;			// Deferred mode: draw record of the object shaded, or DEFERRED_ANY_RECORD for every object of the batch.
+} draw;
+
+/*Per draw data of the object (see DrawRecord), read by loadRecord(). The draws of a batch cover several objects, so the
+  record (and the material index) may differ between the invocations of a subgroup.*/
+struct DrawRecord {
     mat4 model;
+    vec4 params0;			// iParameter0..3
+    vec4 params1;			// iParameter4..7
+    float param8;			// iParameter8
+    int samples;			// Light samples of the dynamic variant.
+    uint batch;				// Batch of the object, for the tile classification (classify.comp).
+    uint material;			// Record of the object in the material table (bindless mode).
+};
+
+layout(set = 2, binding = 2) readonly buffer DrawRecords {
+    DrawRecord data[];
+} records;
+
+DrawRecord object;
+
+layout(set = 0, binding = 0) uniform CameraUniforms {
     mat4 view;
     mat4 proj;
 	vec3 pos_c;				// camera position in space.
-	vec3 mat_p;				// material options (Roughness, anistropy)
-} env;
+	int sampleCap;			// Samples evaluated per frame by the governor, 0 for all. The rest come from the next frames.
+	int sampleOffset;		// Frame of the accumulation: it evaluates the block sampleOffset % (blocks of the object's sequence).
+	int adaptive;			// Adaptive sampling: 0 off, 1 on, 2 budget heatmap.
+	int adaptiveMax;		// Samples per pixel and frame at most.
+	mat4 inverseViewProj;	// Deferred mode: clip space back to the world.
+	vec4 viewport;			// Extent of the scene, and its reciprocal.
+} camera;
+
+
+layout(set = 0, binding = 1) uniform samplerCube skybox;
+
+/*Textures. With BRDFA_BINDLESS (descriptor indexing), the object's material record holds its texture count followed by
+  the indices of its textures in the bindless array; iTexture(i) takes any of them. iTexture0..3 work in both modes.*/
+#ifdef BRDFA_BINDLESS
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 1) readonly buffer MaterialTable {
+    uint records[];
+} materials;
+
+#define iTextureCount int(materials.records[object.material])
+#define iTexture(i) textures[nonuniformEXT(materials.records[object.material + 1u + min(uint(i), materials.records[object.material] - 1u)])]
+#define iTexture0 iTexture(0)
+#define iTexture1 iTexture(1)
+#define iTexture2 iTexture(2)
+#define iTexture3 iTexture(3)
+#else
+layout(set = 1, binding = 0) uniform sampler2D iTexture0;
+layout(set = 1, binding = 1) uniform sampler2D iTexture1;
+layout(set = 1, binding = 2) uniform sampler2D iTexture2;
+layout(set = 1, binding = 3) uniform sampler2D iTexture3;
 
+#define iTextureCount 4
+#endif
 
-layout(binding = 1) uniform samplerCube skybox;
-layout(binding = 2) uniform sampler2D iTexture0;
-layout(binding = 3) uniform sampler2D iTexture1;
-layout(binding = 4) uniform sampler2D iTexture2;
-layout(binding = 5) uniform sampler2D iTexture3;
+/*Instances of the object. The parameters an instance overrides replace those of the object (see loadParameters()).*/
+struct Instance {
+    mat4 transformation;
+    float params[9];
+    uint overrides;
+    uint record;
+};
 
-layout(binding = 6) uniform Parameters {
-    vec3 extra012;
-    vec3 extra345;
-    vec3 extra678;
-} params;
+layout(set = 2, binding = 0) readonly buffer InstanceTable {
+    Instance data[];
+} instances;
 
+#ifdef BRDFA_DEFERRED
+/*G-buffer (see gbuffer.frag). The batch draws the tiles holding its pixels (see tiles.vert) and keeps the pixels of its
+  objects, or of the pushed object alone.*/
+#define DEFERRED_ANY_RECORD 0xFFFFFFFFu
+layout(set = 3, binding = 0) uniform sampler2D gSurface;
+layout(set = 3, binding = 1) uniform sampler2D gColor;
+layout(set = 3, binding = 2) uniform usampler2D gInstance;
+layout(set = 3, binding = 3) uniform sampler2D gDepth;
 
-#define iParameter0 params.extra012.x
-#define iParameter1 params.extra012.y
-#define iParameter2 params.extra012.z
-#define iParameter3 params.extra345.x
-#define iParameter4 params.extra345.y
-#define iParameter5 params.extra345.z
-#define iParameter6 params.extra678.x
-#define iParameter7 params.extra678.y
-#define iParameter8 params.extra678.z
+/*Inverse of octEncode() in gbuffer.frag.*/
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+bool loadSurface() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint entry = texelFetch(gInstance, pixel, 0).x;
+    if (entry == 0xFFFFFFFFu) return false;
+    uint record = instances.data[entry & 0x7FFFFFFFu].record;
+    if (draw.record == DEFERRED_ANY_RECORD ? records.data[record].batch != draw.instanceBase : record != draw.record) return false;
+    object = records.data[record];
+    vec4 surface = texelFetch(gSurface, pixel, 0);
+    float depth = texelFetch(gDepth, pixel, 0).x;
+    vec4 world = camera.inverseViewProj * vec4(gl_FragCoord.xy * camera.viewport.zw * 2.0 - 1.0, depth, 1.0);
+    vertPosition = world.xyz / world.w;
+    inNormal = octDecode(surface.xy);
+    fragTexCoord = surface.zw;
+    fragColor = texelFetch(gColor, pixel, 0).rgb;
+    inInstance = entry;
+
+    /*The depth of the surface, for the skybox and the Hi-Z pyramid.*/
+    gl_FragDepth = depth;
+    return true;
+}
+#endif
+
+#ifdef BRDFA_ADAPTIVE
+/*Adaptive sampling (see adaptive.comp). Each pixel keeps the running mean of its samples and the variance of their luminance,
+  and takes the samples the budget map gives it. The statistics must only see the visible surface: the depth test runs first
+  (the forward mode has its depth laid down by the pre-pass, the deferred mode keeps the pixels of its object only).*/
+#ifndef BRDFA_DEFERRED
+layout(early_fragment_tests) in;
+#endif
+layout(set = 4, binding = 0, rgba32f) uniform image2D adaptiveMean;              // Mean color, samples taken.
+layout(set = 4, binding = 1, rgba32f) uniform image2D adaptiveMoments;           // Mean luminance, sum of squared deviations, sample count of the object.
+layout(set = 4, binding = 2, r32ui) uniform readonly uimage2D adaptiveBudget;    // Samples of this frame.
+
+#define ADAPTIVE_MIN_SAMPLES 2
+
+/*Blue (few samples) to red (adaptiveMax), dark blue for the converged pixels.*/
+vec3 heatmap(int budget, float taken) {
+    if (budget == 0) return (taken > 0.0) ? vec3(0.0, 0.0, 0.2) : vec3(0.0);
+    float t = clamp(float(budget) / float(max(camera.adaptiveMax, 1)), 0.0, 1.0);
+    return clamp(vec3(2.0 * t - 0.5, 1.5 - abs(4.0 * t - 2.0), 1.5 - 2.0 * t), 0.0, 1.0);
+}
+#endif
 
+float iParameters[9];
+
+#define iParameter0 iParameters[0]
+#define iParameter1 iParameters[1]
+#define iParameter2 iParameters[2]
+#define iParameter3 iParameters[3]
+#define iParameter4 iParameters[4]
+#define iParameter5 iParameters[5]
+#define iParameter6 iParameters[6]
+#define iParameter7 iParameters[7]
+#define iParameter8 iParameters[8]
+
+void loadParameters() {
+    float pushed[9] = float[9](object.params0.x, object.params0.y, object.params0.z, object.params0.w,
+        object.params1.x, object.params1.y, object.params1.z, object.params1.w, object.param8);
+    uint instance = inInstance & 0x7FFFFFFFu;
+    uint overrides = instances.data[instance].overrides;
+    for (int i = 0; i < 9; i++)
+        iParameters[i] = ((overrides >> uint(i)) & 1u) != 0u ? instances.data[instance].params[i] : pushed[i];
+}
+
+
+/*Specialization constants. A sample count of 0 selects the dynamic variant which reads the count from object.samples*/
+layout(constant_id = 0) const int SAMPLE_COUNT = 0;
+layout(constant_id = 1) const int SAMPLE_STRIDE = 1;
 
 
 /*Functions*/
@@ -55,12 +194,42 @@ vec3 render(vec3 L, vec3 N, vec3 V, vec2 textureCord, mat3 worldToLocal);
 uint base_hash(uvec2 p);
 vec2 PseudoRandom2D(in int i);
 
+
+/*Scattered direction i of the sequence of the pixel, around N (the second axis).*/
+vec3 sampleDirection(int i, int bias, mat3 axis) {
+    vec2 hl = PseudoRandom2D(bias + i * SAMPLE_STRIDE);
+    float ourV_sqrt = sqrt(1. -  hl.y* hl.y);
+    return normalize( axis * vec3( ourV_sqrt*cos(2.*PI *  hl.x), hl.y, ourV_sqrt*sin(2.*PI *  hl.x)));
+}
+
+#ifdef BRDFA_ADAPTIVE
+float lumaSum = 0.0;
+float lumaSquares = 0.0;
+#endif
+
+/*One sample of the BRDF. The adaptive statistics see its luminance.*/
+vec3 sampleRadiance(vec3 L, vec3 N, vec3 V, mat3 inv_axis) {
+    vec3 radiance = render(L, N, V, fragTexCoord, inv_axis);   //texcol.xyz*L_c*(br.specular + br.diffuse ); //cook_torrance_schlik_brdf(L,V,N)*L_c*LN;//; 
+#ifdef BRDFA_ADAPTIVE
+    float luma = dot(radiance, vec3(0.2126, 0.7152, 0.0722));
+    lumaSum += luma;
+    lumaSquares += luma * luma;
+#endif
+    return radiance;
+}
+
 /*Main*/
 void main() {
+#ifdef BRDFA_DEFERRED
+	if (!loadSurface()) discard;
+#else
+	object = records.data[inRecord];
+#endif
+	loadParameters();
 	//outcolor = vec4(normalize(ubo.pos_c), 1.0f);
 	vec4 texcol = texture(iTexture0, fragTexCoord);
 	vec3 N = normalize(inNormal);
-	vec3 V = normalize(env.pos_c - vertPosition);
+	vec3 V = normalize(camera.pos_c - vertPosition);
 	// vec3 L = -normalize(reflect(V, N));
 
 
@@ -68,7 +237,7 @@ void main() {
 
 	/*Monte-Carlo Setup*/
     
-    const int scatterCount = int(env.mat_p.z); // Ray samples 
+    const int scatterCount = (SAMPLE_COUNT > 0) ? SAMPLE_COUNT : object.samples; // Ray samples 
     int bias = int(base_hash(floatBitsToUint(gl_FragCoord.xy))); // int(base_hash(floatBitsToUint(gl_FragCoord.xy)));
 
 	
@@ -82,18 +251,88 @@ void main() {
 
 	// vec3 c = envColor * brdfo.specular;   
     vec4 textureColor = texture(iTexture0, fragTexCoord);
-    vec3 accum = render(reflect(-V,N), N, V, fragTexCoord, inv_axis); // Starting of the accumalator with the perfect reflection direction.
-	for(int i = bias; i < scatterCount + bias - 1; i++){
-        /*Caculating Sample direction*/
-        vec2 hl = PseudoRandom2D(i);
-        float ourV_sqrt = sqrt(1. -  hl.y* hl.y);
-        vec3 L = normalize( axis * vec3( ourV_sqrt*cos(2.*PI *  hl.x), hl.y, ourV_sqrt*sin(2.*PI *  hl.x)));
-        accum += render(L, N, V, fragTexCoord, inv_axis);   //texcol.xyz*L_c*(br.specular + br.diffuse ); //cook_torrance_schlik_brdf(L,V,N)*L_c*LN;//; 
-    } 
+    /*Governed frames only evaluate a block of sampleCap samples of the sequence, the next block being the next frame's. The last
+      block holds what is left, so no sample counts twice. The alpha is the part of the sequence the frame took: the post pass
+      weighs the blocks by it, and the history is the mean of the samples.*/
+    bool partial = camera.sampleCap > 0 && camera.sampleCap < scatterCount;
+    int firstSample = 0;
+    int sampleCount = scatterCount;
+    float sequencePart = 1.0;
+    if (partial) {
+        uint blocks = uint((scatterCount + camera.sampleCap - 1) / camera.sampleCap);
+        firstSample = int(uint(camera.sampleOffset) % blocks) * camera.sampleCap;
+        sampleCount = min(camera.sampleCap, scatterCount - firstSample);
+        sequencePart = float(sampleCount) / float(scatterCount);
+    }
+
+#ifdef BRDFA_ADAPTIVE
+    /*The pixel carries on with its sequence where the previous frames stopped, up to the sample count of the object. Only the
+      fragment covering the first sample of the pixel keeps the statistics; the other ones at MSAA edges shade on their own.*/
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    bool adaptive = camera.adaptive != 0;
+    bool owner = (gl_SampleMaskIn[0] & 1) != 0;
+    vec4 state = vec4(0.0);
+    vec4 moments = vec4(0.0);
+    int budget = 0;
+    if (adaptive) {
+        state = imageLoad(adaptiveMean, pixel);
+        moments = imageLoad(adaptiveMoments, pixel);
+        budget = int(imageLoad(adaptiveBudget, pixel).r);
+        int taken = owner ? int(state.w) : 0;
+        if (taken == 0) budget = max(budget, ADAPTIVE_MIN_SAMPLES);     // Out of the budget: a first variance needs them.
+        firstSample = taken;
+        sampleCount = clamp(budget, 0, scatterCount - taken);
+        partial = true;
+        sequencePart = 1.0;                                             // The mean of the pixel is shown, not the block.
+    }
+#endif
+
+    vec3 accum = vec3(0.0);
+    if (!partial) {
+        /*The whole sequence: the perfect reflection direction, then the scattered samples. The loop count is a constant of the
+          fixed count variants.*/
+        accum = sampleRadiance(reflect(-V,N), N, V, inv_axis);
+        for(int i = 0; i < scatterCount - 1; i++)
+            accum += sampleRadiance(sampleDirection(i, bias, axis), N, V, inv_axis);
+    }
+    else {
+        /*A block of the sequence. Sample 0 is the perfect reflection direction.*/
+        for(int s = 0; s < sampleCount; s++){
+            int i = firstSample + s;
+            vec3 L = (i == 0) ? reflect(-V,N) : sampleDirection(i - 1, bias, axis);
+            accum += sampleRadiance(L, N, V, inv_axis);
+        }
+    }
 
     // Sphere colouring schemes
-    accum /= (float(scatterCount));
-    outcolor = vec4(accum, 1.0);
+    accum /= (float(max(sampleCount, 1)));
+
+#ifdef BRDFA_ADAPTIVE
+    /*The samples of the frame join the statistics of the pixel (the batch formula of Chan et al.), whose mean is shown.*/
+    if (adaptive && owner) {
+        if (sampleCount > 0) {
+            float taken = state.w;
+            float batch = float(sampleCount);
+            float total = taken + batch;
+            float batchMean = lumaSum / batch;
+            float delta = batchMean - moments.x;
+            float batchSquares = max(lumaSquares - lumaSum * batchMean, 0.0);
+            state = vec4((state.rgb * taken + accum * batch) / total, total);
+            moments = vec4(moments.x + delta * batch / total, moments.y + batchSquares + delta * delta * taken * batch / total,
+                float(scatterCount), 0.0);
+            imageStore(adaptiveMean, pixel, state);
+            imageStore(adaptiveMoments, pixel, moments);
+        }
+        accum = state.rgb;
+    }
+    if (camera.adaptive == 2)
+        accum = heatmap(budget, state.w);
+#endif
+    outcolor = vec4(accum, sequencePart);
+
+    /*Culling debug view*/
+    if ((inInstance & 0x80000000u) != 0u)
+        outcolor.rgb = mix(outcolor.rgb, vec3(1.0, 0.0, 0.0), 0.6);
 
 
 	//outcolor = vec4(brdfo.specular, 1.);//vec4(texture(texSampler, fragTexCoord));
@@ -1,13 +1,50 @@
 #version 450
 
 
-layout(binding = 0) uniform UniformBufferObject {
+/*Pushed with the draws (see DrawPushConstants). Shared with the fragment shaders.*/
+layout(push_constant) uniform DrawConstants {
+    uint instanceBase;      // Start of the object's visible instances, when the draw command can't carry it (firstInstance 0).
+    uint record;            // Deferred shading only.
+} draw;
+
+struct Instance {
+    mat4 transformation;    // Placement of the instance, applied before the transformation of the object.
+    float params[9];        // iParameter0..8 of the instance.
+    uint overrides;         // Bit i set: iParameter i comes from params, otherwise from the object.
+    uint record;            // Draw record of the object.
+};
+
+/*Per draw data of every object (see DrawRecord). Shared with the fragment shaders.*/
+struct DrawRecord {
     mat4 model;
+    vec4 params0;
+    vec4 params1;
+    float param8;
+    int samples;
+    uint batch;
+    uint material;
+};
+
+/*Instances of every object (see InstanceData). A single identity instance for the objects that aren't instanced.*/
+layout(set = 2, binding = 0) readonly buffer InstanceTable {
+    Instance data[];
+} instances;
+
+/*Instances left by the culling pass (cull.comp), drawn as gl_InstanceIndex: the draw command starts at the object's range.
+  Bit 31 marks the culled ones kept by the debug view.*/
+layout(set = 2, binding = 1) readonly buffer VisibleInstances {
+    uint data[];
+} visible;
+
+layout(set = 2, binding = 2) readonly buffer DrawRecords {
+    DrawRecord data[];
+} records;
+
+layout(set = 0, binding = 0) uniform CameraUniforms {
     mat4 view;
     mat4 proj;
     vec3 pos_c; // Camera position
-    vec3 mat_p; // Material parameters (Roughness, anistropy)
-} ubo;
+} camera;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -18,19 +55,33 @@ layout(location = 0) out vec3 outColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 outNormal;
 layout(location = 3) out vec3 outPosition;
+layout(location = 4) flat out uint outInstance;     // Instance, with the culled bit.
+layout(location = 5) flat out uint outRecord;       // Draw record of the object.
+
+/*Same depth in the pre-pass (depth only pipeline) and in the BRDF pipelines.*/
+invariant gl_Position;
 
 
 void main() {
 
 
-    vec4 vertInWorld = ubo.model * vec4(inPosition, 1.0f);
+    uint entry = visible.data[draw.instanceBase + gl_InstanceIndex];
+    uint record = instances.data[entry & 0x7FFFFFFFu].record;
+    mat4 model = records.data[record].model * instances.data[entry & 0x7FFFFFFFu].transformation;
+    vec4 vertInWorld = model * vec4(inPosition, 1.0f);
     outPosition = vec3(vertInWorld.xyz) / vertInWorld.w;
-    gl_Position = ubo.proj * ubo.view * vertInWorld;
+    gl_Position = camera.proj * camera.view * vertInWorld;
     
-    outNormal = transpose(inverse(mat3(ubo.model))) * inNormal;
+    /*Normal matrix: the cofactors of the model's 3x3 part, i.e. its inverse transpose up to the determinant. Only the sign
+      of the determinant matters since the normal is normalized later.*/
+    mat3 m = mat3(model);
+    mat3 cofactors = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    outNormal = sign(dot(m[0], cofactors[0])) * (cofactors * inNormal);
 
     outColor = inColor;
     fragTexCoord = inTexCoord;
+    outInstance = entry;
+    outRecord = record;
 
     
 }
\ No newline at end of file
@@ -1,38 +1,93 @@
 #version 450
+#ifdef BRDFA_BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 /*Output variables. */
 layout(location = 0) out vec4 outColor;
 
-/*Incoming variables*/
+/*Incoming variables. Read out of the G-buffer in deferred mode.*/
+#ifdef BRDFA_DEFERRED
+vec2 fragTexCoord;
+#else
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 vertPosition;
+layout(location = 5) flat in uint inRecord;
+#endif
 
 /*Uniforms*/
-layout(binding = 0) uniform UniformBufferObject {
+layout(push_constant) uniform DrawConstants {
+    uint instanceBase;		// Deferred mode: batch of the draw.
+    uint record;			// Deferred mode: draw record of the object shaded, or 0xFFFFFFFF for every object of the batch.
+} draw;
+
+struct DrawRecord {
     mat4 model;
-    mat4 view;
-    mat4 proj;
-	vec3 pos_c;				// camera position in space.
-	vec3 mat_p;				// material options (Roughness, anistropy)
-} env;
+    vec4 params0;			// iParameter0..3
+    vec4 params1;			// iParameter4..7
+    float param8;			// iParameter8
+    int samples;			// Light samples of the dynamic variant.
+    uint batch;				// Batch of the object, for the tile classification (classify.comp).
+    uint material;			// Record of the object in the material table (bindless mode).
+};
+
+layout(set = 2, binding = 2) readonly buffer DrawRecords {
+    DrawRecord data[];
+} records;
+
+DrawRecord object;
+
+layout(set = 0, binding = 1) uniform samplerCube skybox;
+#ifdef BRDFA_BINDLESS
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 1) readonly buffer MaterialTable {
+    uint records[];
+} materials;
+
+#define iTexture0 textures[nonuniformEXT(materials.records[object.material + 1u])]
+#else
+layout(set = 1, binding = 0) uniform sampler2D iTexture0;
+layout(set = 1, binding = 1) uniform sampler2D iTexture1;
+layout(set = 1, binding = 2) uniform sampler2D iTexture2;
+layout(set = 1, binding = 3) uniform sampler2D iTexture3;
+#endif
+
+
+
+#ifdef BRDFA_DEFERRED
+struct Instance {
+    mat4 transformation;
+    float params[9];
+    uint overrides;
+    uint record;
+};
 
-layout(binding = 1) uniform samplerCube skybox;
-layout(binding = 2) uniform sampler2D iTexture0;
-layout(binding = 3) uniform sampler2D iTexture1;
-layout(binding = 4) uniform sampler2D iTexture2;
-layout(binding = 5) uniform sampler2D iTexture3;
+layout(set = 2, binding = 0) readonly buffer InstanceTable {
+    Instance data[];
+} instances;
 
-layout(binding = 6) uniform Parameters {
-    vec3 extra012;
-    vec3 extra345;
-    vec3 extra678;
-} params;
+layout(set = 3, binding = 0) uniform sampler2D gSurface;
+layout(set = 3, binding = 2) uniform usampler2D gInstance;
+layout(set = 3, binding = 3) uniform sampler2D gDepth;
+#endif
 
 
 
 /*Main*/
 void main() {
-	outColor = vec4(texture(iTexture0, fragTexCoord));
+#ifdef BRDFA_DEFERRED
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uint entry = texelFetch(gInstance, pixel, 0).x;
+	if (entry == 0xFFFFFFFFu) discard;
+	uint record = instances.data[entry & 0x7FFFFFFFu].record;
+	if (draw.record == 0xFFFFFFFFu ? records.data[record].batch != draw.instanceBase : record != draw.record) discard;
+	object = records.data[record];
+	fragTexCoord = texelFetch(gSurface, pixel, 0).zw;
+	gl_FragDepth = texelFetch(gDepth, pixel, 0).x;
+#else
+	object = records.data[inRecord];
+#endif
+	outColor = vec4(texture(iTexture0, fragTexCoord).rgb, 1.0);     // The alpha is the part of the samples taken (main.frag): all of them.
 }
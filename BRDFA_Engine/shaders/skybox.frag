@@ -6,18 +6,8 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 outNormal;
 //layout(location = 3) in vec3 eyeDirection;
 
-// Textures.
-layout(binding = 1) uniform samplerCube skybox;
-layout(binding = 2) uniform sampler2D iTexture0;
-layout(binding = 3) uniform sampler2D iTexture1;
-layout(binding = 4) uniform sampler2D iTexture2;
-layout(binding = 5) uniform sampler2D iTexture3;
-
-layout(binding = 6) uniform Parameters {
-    vec3 extra012;
-    vec3 extra345;
-    vec3 extra678;
-} params;
+// Textures. The skybox only binds the frame set.
+layout(set = 0, binding = 1) uniform samplerCube skybox;
 
 
 // out variables
@@ -29,5 +19,5 @@ void main() {
     //outColor = vec4(outNormal, 1.0f);
     //outColor = texture(map, outNormal);
 
-    outColor = texture(skybox, inUVW);
+    outColor = vec4(texture(skybox, inUVW).rgb, 1.0);      // The alpha is the part of the samples taken (main.frag): all of them.
 }
\ No newline at end of file
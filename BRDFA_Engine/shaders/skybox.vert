@@ -1,12 +1,10 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(set = 0, binding = 0) uniform CameraUniforms {
     mat4 view;
     mat4 proj;
     vec3 pos_c; // camera position in space.
-    vec3 render_opt;		//rendering option, decides what method of rendering we want to use.
-} ubo;
+} camera;
 
 layout(location = 0) in vec3 inPos;
 layout(location = 1) in vec3 inColor;
@@ -21,8 +19,9 @@ layout(location = 2) out vec3 outNormal;
 
 void main() {
     outUVW = inPos.xyz;
-    vec3 final = mat3(ubo.view) * inPos;
-	gl_Position = ubo.proj * vec4(final.xyz, 1.0f);
+    vec3 final = mat3(camera.view) * inPos;
+	/*On the far plane (depth 1): the skybox is drawn last, behind every mesh.*/
+	gl_Position = (camera.proj * vec4(final.xyz, 1.0f)).xyww;
 }
 
 
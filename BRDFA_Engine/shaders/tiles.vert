@@ -0,0 +1,49 @@
+#version 450
+
+/*Tiles of the deferred shading passes: the vertices of the tiles classify.comp listed for the batch of the draw, 6 per tile.
+  No vertex buffer is read. The batches without a list (DEFERRED_MAX_BATCHES and after) draw a full screen triangle instead.
+  The fragment shaders take their inputs out of the G-buffer and write the depth themselves.*/
+
+#define DEFERRED_TILE_SIZE 8u           // DEFERRED_TILE_SIZE in brdfa_cons.hpp.
+#define DEFERRED_MAX_BATCHES 32u        // DEFERRED_MAX_BATCHES in brdfa_cons.hpp.
+
+/*See DrawPushConstants.*/
+layout(push_constant) uniform DrawConstants {
+    uint batch;             // Batch of the draw, i.e. its tile list.
+    uint record;
+} draw;
+
+layout(set = 0, binding = 0) uniform CameraUniforms {
+    mat4 view;
+    mat4 proj;
+    vec3 pos_c;
+    int sampleCap;
+    int sampleOffset;
+    int adaptive;
+    int adaptiveMax;
+    mat4 inverseViewProj;
+    vec4 viewport;          // Render extent of the scene, and its reciprocal.
+} camera;
+
+/*A list per batch, as long as the tile grid of the render extent (see classify.comp).*/
+layout(set = 3, binding = 5) readonly buffer TileLists {
+    uint data[];
+} tiles;
+
+/*Two triangles per tile, wound as the full screen triangle.*/
+const uvec2 TILE_CORNERS[6] = uvec2[6](uvec2(0, 0), uvec2(0, 1), uvec2(1, 0), uvec2(1, 0), uvec2(0, 1), uvec2(1, 1));
+
+
+void main() {
+    if (draw.batch >= DEFERRED_MAX_BATCHES) {
+        vec2 corner = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+        gl_Position = vec4(corner.yx * 2.0 - 1.0, 0.0, 1.0);
+        return;
+    }
+
+    uvec2 grid = (uvec2(camera.viewport.xy) + DEFERRED_TILE_SIZE - 1u) / DEFERRED_TILE_SIZE;
+    uint tile = tiles.data[draw.batch * grid.x * grid.y + uint(gl_VertexIndex) / 6u];
+    uvec2 corner = uvec2(tile & 0xFFFFu, tile >> 16) + TILE_CORNERS[uint(gl_VertexIndex) % 6u];
+    vec2 pixel = min(vec2(corner * DEFERRED_TILE_SIZE), camera.viewport.xy);
+    gl_Position = vec4(pixel * camera.viewport.zw * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,56 @@
+#version 450
+
+/*Upscale pass of the governed mode, drawn over the full screen triangle of fullscreen.vert. The scene was drawn into the corner
+  [0, scale] of the scene color; it is stretched over the swapchain image with bilinear taps, sharpened CAS-style (the less
+  contrast around a texel, the more it is sharpened), then blended into the accumulation history. The history adds up the
+  sample blocks of the frames when the governor caps the light samples, each weighed by the samples it took.*/
+
+layout(push_constant) uniform UpscaleConstants {
+    vec2 inverseSize;       // 1 / extent of the swapchain (and of the scene color).
+    vec2 scale;             // Render extent over the swapchain extent.
+    float sharpness;        // 0: bilinear only.
+    float weight;           // 1 drops the history, 0 blends each pixel by the samples its frame took.
+} upscale;
+
+layout(set = 0, binding = 0) uniform sampler2D scene;
+layout(set = 0, binding = 1) uniform sampler2D history;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec4 outHistory;
+
+
+void main() {
+    /*Half a texel inside the covered corner, so the bilinear taps never reach the part the scene pass left out.*/
+    vec2 texel = upscale.inverseSize;
+    vec2 low = 0.5 * texel;
+    vec2 high = upscale.scale - 0.5 * texel;
+    vec2 uv = clamp(gl_FragCoord.xy * upscale.inverseSize * upscale.scale, low, high);
+    vec4 frame = texture(scene, uv);
+    vec3 color = frame.rgb;
+
+    if (upscale.sharpness > 0.0) {
+        vec3 north = texture(scene, clamp(uv - vec2(0.0, texel.y), low, high)).rgb;
+        vec3 south = texture(scene, clamp(uv + vec2(0.0, texel.y), low, high)).rgb;
+        vec3 west = texture(scene, clamp(uv - vec2(texel.x, 0.0), low, high)).rgb;
+        vec3 east = texture(scene, clamp(uv + vec2(texel.x, 0.0), low, high)).rgb;
+
+        vec3 lowest = min(color, min(min(north, south), min(west, east)));
+        vec3 highest = max(color, max(max(north, south), max(west, east)));
+        vec3 amount = sqrt(clamp(min(lowest, 1.0 - highest) / max(highest, vec3(1e-4)), 0.0, 1.0));
+        vec3 ring = -amount / mix(8.0, 5.0, upscale.sharpness);
+        color = clamp((color + (north + south + west + east) * ring) / (1.0 + 4.0 * ring), 0.0, 1.0);
+    }
+
+    /*The history is swapchain sized: one texel per pixel. Its alpha is the part of the sample sequence it holds, the scene alpha
+      the part the frame took (main.frag). Blending by them keeps the history the mean of the samples whatever the size of the
+      blocks; once a whole sequence is in, the history is held at 1 - part and the oldest blocks fade out.*/
+    float part = clamp(frame.a, 1.0 / 255.0, 1.0);
+    float held = 0.0;
+    if (upscale.weight < 1.0) {
+        vec4 previous = texelFetch(history, ivec2(gl_FragCoord.xy), 0);
+        held = min(previous.a, 1.0 - part);
+        color = mix(previous.rgb, color, part / (held + part));
+    }
+    outColor = vec4(color, 1.0);
+    outHistory = vec4(color, held + part);
+}
@@ -13,6 +13,25 @@ static const std::vector<const char*> deviceExtensions = {
 };
 
 
+/*Enabled only if the device supports them. Used to link the BRDF pipelines from pre-built libraries.*/
+static const std::vector<const char*> pipelineLibraryExtensions = {
+    VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+    "VK_EXT_graphics_pipeline_library"              // VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME is not in the vendored headers.
+};
+
+
+/*Enabled only if the device supports them. Used by the bindless texture table.*/
+static const std::vector<const char*> descriptorIndexingExtensions = {
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+
+/*Enabled only if the device supports them. The indirect draws then read their draw count from a buffer.*/
+static const std::vector<const char*> drawIndirectCountExtensions = {
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
+};
+
+
 const std::string TEXTURE_PATH = "res/textures/viking_room.png";
 const std::string MODEL_PATH = "res/objects/sphere.obj";// "res/objects/viking_room.obj"; // //"res/objects/cube.obj" ;//
 const std::string CUBE_MODEL_PATH = "res/objects/cube.obj";
@@ -33,4 +52,38 @@ const std::array<std::string, 6> SKYMAP_PATHS = {
 
 
 const std::string SHADERS_PATH = "shaders";
-//const std::string SKYMAP_PATHS = "res/textures/skybox_1.png";
\ No newline at end of file
+const std::string PIPELINE_CACHE_PATH = "shaders/pipeline.cache";       // Driver pipeline cache data saved on close.
+const std::string SPIRV_ARCHIVE_PATH = "shaders/spirv.archive";         // Compiled BRDFs, keyed by their source. See helpers/cache_abs.cpp
+const std::string SHADER_INCLUDE_PATH = "shaders/include";               // Shared GLSL snippets resolved by #include "..." in the BRDFs.
+const float EDITOR_COMPILE_DEBOUNCE = 0.35f;                                 // Seconds without typing before the editor compiles in the background.
+const size_t EDITOR_SPIRV_MEMORY = 32;                                      // Editor compilations kept in memory (not archived), so undone edits aren't compiled again.
+const uint32_t MATERIAL_TABLE_CAPACITY = 64;                                // Records of the bindless material table at start. Doubled when full.
+const uint32_t BINDLESS_TEXTURE_CAPACITY = 4096;                            // Size of the bindless texture array (capped by the device limits).
+const uint32_t BINDLESS_MIN_TEXTURES = 64;                                  // Below this many slots, the fixed texture bindings are used instead.
+const uint32_t BINDLESS_RESERVED_SAMPLERS = 5;                              // Other samplers of the fragment stage: skybox and G-buffer.
+const uint32_t GEOMETRY_VERTEX_CAPACITY = 1 << 18;                         // Vertices of the shared vertex buffer at start. Doubled when full.
+const uint32_t GEOMETRY_INDEX_CAPACITY = 1 << 20;                           // Indices of the shared index buffer at start. Doubled when full.
+const uint32_t GEOMETRY_DRAW_CAPACITY = 256;                                // Indirect draw commands at start. Doubled when full.
+const uint32_t GEOMETRY_INSTANCE_CAPACITY = 1 << 12;                        // Instances of the shared instance table at start. Doubled when full.
+const float GEOMETRY_COMPACTION_THRESHOLD = 0.25f;                          // Part of the used geometry left free by deleted meshes before it is compacted.
+const uint32_t HIZ_MAX_LEVELS = 16;                                         // Levels of the Hi-Z pyramid at most (65536 pixels wide).
+const uint32_t CULL_GROUP_SIZE = 64;                                        // local_size_x of cull.comp.
+const uint32_t CULL_FLAG_FRUSTUM = 1;                                       // Culling pass flags (CullPushConstants::flags).
+const uint32_t CULL_FLAG_OCCLUSION = 2;
+const uint32_t CULL_FLAG_SHOW_CULLED = 4;                                   // Keep the culled instances, marked (bit 31), for the debug view.
+const uint32_t MATERIAL_RECORD_SIZE = 16;                                   // uints per material of the bindless material table: texture count, then the texture indices.
+const float GOVERNOR_MIN_SCALE = 0.5f;                                      // Smallest render scale of the frame-time governor (per axis).
+const float GOVERNOR_SCALE_STEP = 0.05f;                                    // Render scales are multiples of it.
+const uint32_t GOVERNOR_SETTLE_FRAMES = 20;                                 // Frames the governor waits after a change before the next one.
+const size_t GOVERNOR_LOG_SIZE = 64;                                        // Decisions kept for the Logs window.
+const size_t GOVERNOR_DECISION_LENGTH = 160;                                // Characters of a logged decision.
+const uint32_t ADAPTIVE_GROUP_SIZE = 8;                                     // local_size_x and local_size_y of adaptive.comp.
+const uint32_t DEFERRED_TILE_SIZE = 8;                                      // Pixels per side of the tiles classified by classify.comp (its local size).
+const uint32_t DEFERRED_MAX_BATCHES = 32;                                   // Batches with a tile list. The others shade the full screen.
+const uint32_t DEFERRED_ANY_RECORD = 0xFFFFFFFF;                            // Pushed record of a batch shading the pixels of all its meshes.
+const float ADAPTIVE_ERROR_SCALE = 256.0f;                                  // Fixed point of AdaptiveFrame::errorSum (ADAPTIVE_ERROR_SCALE in adaptive.comp).
+//const std::string SKYMAP_PATHS = "res/textures/skybox_1.png";
+
+
+/*Light sample counts that get their own specialized BRDF pipeline. Other counts use the dynamic pipeline.*/
+const std::array<int, 4> SPECIALIZED_SAMPLE_COUNTS = { 1, 16, 64, 256 };
@@ -43,6 +43,7 @@
 #include <filesystem>
 #include <thread>
 #include <future>
+#include <algorithm>
 
 
 
@@ -66,9 +67,18 @@ namespace brdfa {
 	/// <returns>True: if the engine started successfully. Otherwise, false.</returns>
 	bool BRDFA_Engine::init() {
 		try {
-			startWindow();
+			/*Headless, there is no window: the frames take the configured size, and every BRDF is built for runHeadless().*/
+			if (m_configuration.headless) {
+				m_width_w = m_configuration.width;
+				m_height_w = m_configuration.height;
+				m_configuration.hot_load = false;
+			}
+			else {
+				startWindow();
+			}
 			startVulkan();
-			startImgui();
+			if (!m_configuration.headless)
+				startImgui();
 		}
 		catch (const std::exception& e) {
 			std::cerr << e.what() << std::endl;
@@ -89,11 +99,25 @@ namespace brdfa {
 			m_active = false;
 			return false;
 		}
+
+		/*Allocations of the whole frame: events, UI, updates, recording, submission and present.*/
+		FrameAllocations allocationStart = allocationCounts(m_commander);
 		glfwPollEvents();
 
+		/*Anti-aliasing mode picked, or governor switched, in the UI during the last frame.*/
+		if (m_pendingAntiAliasing != m_graphicsPipelines.antiAliasing || m_governor.enabled != m_graphicsPipelines.scaled)
+			applyAntiAliasing(m_pendingAntiAliasing);
+		/*Shading mode picked in the UI during the last frame.*/
+		if (m_pendingDeferred != m_graphicsPipelines.deferred)
+			applyShadingMode(m_pendingDeferred);
+		publishReadyPipelines();
+		updateEditorCompiles();
+		maintainGeometry();
+
 
 		/*Waiting for the images in flight*/
 		vkWaitForFences(m_device.device, 1, &m_sync[m_currentFrame].f_inFlight, VK_TRUE, UINT64_MAX);
+		resetFrameContext(m_commander, m_device, m_currentFrame);
 		uint32_t imageIndex;
 		VkResult result = vkAcquireNextImageKHR(
 			m_device.device,
@@ -111,8 +135,14 @@ namespace brdfa {
 			throw std::runtime_error("ERROR: failed to acquire swap chain image!");
 		}
 
+		/*The previous frame of the image must be done before its uniforms and command buffers are touched.*/
+		if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+			vkWaitForFences(m_device.device, 1, &m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		}
+
 		update(imageIndex);
 		render(imageIndex);
+		m_frameAllocations = allocationsSince(allocationStart, m_commander);
 
 		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 		
@@ -120,23 +150,150 @@ namespace brdfa {
 	}
 
 
+	/// <summary>
+	/// Renders one headless frame: the steps of updateAndRender() without the window events, the acquire and the present.
+	/// Each frame in flight has its own offscreen image.
+	/// </summary>
+	/// <returns>Offscreen image the frame is rendered into</returns>
+	uint32_t BRDFA_Engine::renderOffscreen() {
+		FrameAllocations allocationStart = allocationCounts(m_commander);
+		publishReadyPipelines();
+		maintainGeometry();
+
+		vkWaitForFences(m_device.device, 1, &m_sync[m_currentFrame].f_inFlight, VK_TRUE, UINT64_MAX);
+		resetFrameContext(m_commander, m_device, m_currentFrame);
+		uint32_t imageIndex = static_cast<uint32_t>(m_currentFrame);
+
+		update(imageIndex);
+		render(imageIndex);
+		m_frameAllocations = allocationsSince(allocationStart, m_commander);
+
+		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		return imageIndex;
+	}
+
+
+	/// <summary>
+	/// Renders the job of a headless engine (BRDFAEngineConfiguration::job): each BRDF of the job in turn on all the objects,
+	/// HeadlessJob::frames frames each, the last one saved as [outputDir]/[brdf].png. Nothing is presented, so no vsync holds the
+	/// frames back: they are rendered as fast as the device goes.
+	/// </summary>
+	/// <returns>0 if all the images were written, 1 otherwise</returns>
+	int BRDFA_Engine::runHeadless() {
+		if (!m_active || !m_configuration.headless) {
+			std::cerr << "ERROR: runHeadless() needs an engine initialized with the headless configuration." << std::endl;
+			return 1;
+		}
+		const HeadlessJob& job = m_configuration.job;
+
+		try {
+			/*Every BRDF pipeline is built before the first frame.*/
+			joinPipelineWorkers();
+
+			/*The object of the job replaces the default one.*/
+			if (!job.model.empty()) {
+				if (!loadObject(job.model, { job.texture.empty() ? TEXTURE_PATH : job.texture }))
+					return 1;
+				deleteObject(0);
+			}
+			for (auto& mesh : m_meshes) {
+				if (job.samples > 0) mesh.samples = job.samples;
+			}
+			m_camera.position = job.eye;
+			if (glm::length(job.target - job.eye) > 0.0f)
+				m_camera.direction = glm::normalize(job.target - job.eye);
+			m_camera.updateViewMatrix();
+
+			/*All the loaded BRDFs by default, by name.*/
+			std::vector<std::string> brdfs = job.brdfs;
+			if (brdfs.empty()) {
+				for (const auto& it : m_graphicsPipelines.pipelines) {
+					if (it.first != "None") brdfs.push_back(it.first);
+				}
+				std::sort(brdfs.begin(), brdfs.end());
+			}
+
+			std::filesystem::create_directories(job.outputDir);
+			auto jobStart = std::chrono::high_resolution_clock::now();
+			size_t failures = 0;
+			std::vector<uint8_t> pixels;
+			for (const auto& brdfName : brdfs) {
+				if (m_graphicsPipelines.pipelines.find(brdfName) == m_graphicsPipelines.pipelines.end()) {
+					printf("[WARNING]: No pipeline for the BRDF \"%s\" (unknown or failed to compile). Skipped.\n", brdfName.c_str());
+					failures++;
+					continue;
+				}
+				for (size_t i = 0; i < m_meshes.size(); i++) {
+					m_meshes[i].renderOption = brdfName;
+					selectSampleVariant(i);
+					refreshObject(i);
+				}
+
+				auto start = std::chrono::high_resolution_clock::now();
+				uint32_t imageIndex = 0;
+				for (uint32_t frame = 0; frame < std::max(1u, job.frames); frame++)
+					imageIndex = renderOffscreen();
+				vkDeviceWaitIdle(m_device.device);
+				float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+				/*The alpha of the frames is not meant to be seen.*/
+				readbackImage(m_commander, m_device, m_swapChain, imageIndex, pixels);
+				for (size_t i = 3; i < pixels.size(); i += 4)
+					pixels[i] = 255;
+
+				std::string path = job.outputDir + "/" + brdfName + ".png";
+				int width = static_cast<int>(m_swapChain.extent.width);
+				int height = static_cast<int>(m_swapChain.extent.height);
+				if (stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4) == 0) {
+					printf("[ERROR]: Failed to write the image %s\n", path.c_str());
+					failures++;
+					continue;
+				}
+				printf("[INFO]: %s: %u frame(s) in %.2f ms, saved at %s\n", brdfName.c_str(), std::max(1u, job.frames), ms, path.c_str());
+			}
+
+			float total = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - jobStart).count();
+			printf("[INFO]: Headless job done: %zu/%zu image(s) (%ux%u) in %.2f ms\n", brdfs.size() - failures, brdfs.size(),
+				m_swapChain.extent.width, m_swapChain.extent.height, total);
+			return failures == 0 ? 0 : 1;
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+
 	/// <summary>
 	/// Shuts down the engine. Called after done using the engine. Closing the window of the engine will close it automatically. 
 	/// Therefore, you don't need to call this function unless you want to close the engine by having a callback functionality or whatsoever.
 	/// </summary>
 	void BRDFA_Engine::close() {
-		ImGui_ImplVulkan_DestroyFontUploadObjects();
-		vkDestroyDescriptorPool(m_device.device, m_imguiPool, nullptr);
-		ImGui_ImplVulkan_Shutdown();
-		ImGui_ImplGlfw_Shutdown();
-		ImGui::DestroyContext();
+		joinPipelineWorkers();
+		for (auto& write : m_archiveWrites) {
+			write.wait();
+		}
+		m_archiveWrites.clear();
+		stopCompileService(m_compiler);
+		if (!m_configuration.headless) {
+			ImGui_ImplVulkan_DestroyFontUploadObjects();
+			vkDestroyDescriptorPool(m_device.device, m_imguiPool, nullptr);
+			ImGui_ImplVulkan_Shutdown();
+			ImGui_ImplGlfw_Shutdown();
+			ImGui::DestroyContext();
+		}
 
 		cleanup();
+		destroyPostProcess(m_postProcess, m_device);
 		/* Clear the Meshes*/
 		for (auto& mesh : m_meshes) { destroyMesh(mesh, m_device); }
 		m_meshes.clear();
+		destroyGeometryArena(m_geometry, m_device);
+		destroyCulling(m_culling, m_device);
+		destroyAdaptiveSampling(m_adaptive, m_device);
+		destroyTileClassification(m_graphicsPipelines, m_device);
 
-		vkDestroyDescriptorSetLayout(m_device.device, m_descriptorData.layout, nullptr);
+		destroyDescriptors(m_descriptorData, m_device);
 
 		/*destorying Engine related stuff.*/
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -145,7 +302,26 @@ namespace brdfa {
 			vkDestroyFence(m_device.device, m_sync[i].f_inFlight, nullptr);
 		}
 
+		destroyFrameContexts(m_commander, m_device);
+		vkDestroyCommandPool(m_device.device, m_commander.uploadPool, nullptr);
 		vkDestroyCommandPool(m_device.device, m_commander.pool, nullptr);
+
+		vkDestroyShaderModule(m_device.device, m_graphicsPipelines.vertModule, nullptr);
+
+		/*The SPIR-V kept at session end: the latest build of each loaded BRDF. The other editor compilations are dropped.*/
+		for (const auto& it : m_loadedBrdfs) {
+			if (it.second.spirvKey != 0)
+				storeSpirv(m_spirvArchive, it.second.spirvKey, it.second.latest_spir_v);
+		}
+
+		/*Dropping the archived BRDFs that were not used by this (full) run.*/
+		if (!m_configuration.hot_load)
+			compactSpirvArchive(m_spirvArchive);
+		closeSpirvArchive(m_spirvArchive);
+
+		/*Persisting the pipeline cache for the next run.*/
+		savePipelineCache(m_device, m_graphicsPipelines.cache, PIPELINE_CACHE_PATH);
+		vkDestroyPipelineCache(m_device.device, m_graphicsPipelines.cache, nullptr);
 		vkDestroyDevice(m_device.device, nullptr);
 
 		/* destroying bebug util massenger.*/
@@ -156,11 +332,14 @@ namespace brdfa {
 			}
 		}
 
-		vkDestroySurfaceKHR(m_instance.instance, m_device.surface, nullptr);
+		if (m_device.surface != VK_NULL_HANDLE)
+			vkDestroySurfaceKHR(m_instance.instance, m_device.surface, nullptr);
 		vkDestroyInstance(m_instance.instance, nullptr);
 
-		glfwDestroyWindow(m_window);
-		glfwTerminate();
+		if (!m_configuration.headless) {
+			glfwDestroyWindow(m_window);
+			glfwTerminate();
+		}
 		m_active = false;
 	}
 
@@ -184,30 +363,23 @@ namespace brdfa {
 			return false;
 		}
 		vkDeviceWaitIdle(m_device.device);
+		finishCompaction();
 		
 		/*Adding the new mesh*/
-		m_meshes.push_back(loadMesh(m_commander, m_device, object_path, texture_paths, m_swapChain.images.size()));		// Loading veriaty of objects
-
-		/*Adding a new uniform buffer*/
-		size_t oldSize = m_uniformBuffers.size();
-		size_t finalSlotsCount = m_swapChain.images.size() * m_meshes.size();
-		m_uniformBuffers.resize(finalSlotsCount);	// Adding 1 extra empty slot..
-		for (size_t i = oldSize; i < finalSlotsCount; i++) {
-			createBuffer(
-				m_commander, m_device, VkDeviceSize(sizeof(MVPMatrices)),
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
-					| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				m_uniformBuffers[i]);
-		}
-		
-		/*Recreating the Descriptors sets*/
-		vkDestroyDescriptorPool(m_device.device, m_descriptorData.pool, nullptr);
-		initDescriptors(m_descriptorData, m_device, m_swapChain, m_uniformBuffers, m_meshes, m_skymap);
-		
-		/*Re-recording the command buffers*/
-		vkFreeCommandBuffers(m_device.device, m_commander.pool, static_cast<uint32_t>(m_commander.sceneBuffers.size()), m_commander.sceneBuffers.data());
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
+		m_meshes.push_back(loadMesh(m_commander, m_device, object_path, texture_paths));		// Loading veriaty of objects
+		m_meshes.back().uid = m_nextObjectId++;
+
+		/*Only the geometry, the instances and the material of the new mesh are written. Everything is re-recorded if the geometry
+		  arena or the bindless material table had to grow.*/
+		bool rewritten = uploadGeometry(m_geometry, m_commander, m_device, m_meshes.back());
+		rewritten |= uploadInstances(m_geometry, m_commander, m_device, m_meshes.back());
+		if (rewritten) {
+			writeCullingDescriptors(m_culling, m_device, m_geometry);
+			writeDrawDescriptors(m_descriptorData, m_device, m_geometry);
+		}
+		rewritten |= writeMaterialDescriptors(m_descriptorData, m_commander, m_device, m_meshes.back());
+		if (rewritten)
+			invalidateSceneCommands(m_commander, m_meshes);
 		return true;
 	}
 
@@ -223,27 +395,42 @@ namespace brdfa {
 			return true;
 		}
 		vkDeviceWaitIdle(m_device.device);
+		finishCompaction();
 
 		/*Deleting the mesh vulkan objects.*/
+		releaseMaterialDescriptors(m_descriptorData, this->m_meshes.at(idx));
+		releaseGeometry(m_geometry, this->m_meshes.at(idx));
 		destroyMesh(this->m_meshes.at(idx), m_device);
 		this->m_meshes.erase(this->m_meshes.begin() + idx);
+		return true;
+	}
 
-		/*Adding a new uniform buffer*/
-		size_t oldSize = m_uniformBuffers.size();
-		size_t finalSlotsCount = m_swapChain.images.size() * m_meshes.size();
-		for (size_t i = finalSlotsCount; i < oldSize; i++) {
-			vkDestroyBuffer(m_device.device, m_uniformBuffers[i].obj, nullptr);
-			vkFreeMemory(m_device.device, m_uniformBuffers[i].memory, nullptr);
-		}
-		m_uniformBuffers.resize(finalSlotsCount);	// Adding 1 extra empty slot..
 
-		/*Recreating the Descriptors sets*/
-		vkDestroyDescriptorPool(m_device.device, m_descriptorData.pool, nullptr);
-		initDescriptors(m_descriptorData, m_device, m_swapChain, m_uniformBuffers, m_meshes, m_skymap);
+	/// <summary>
+	/// Turns the ith object into a grid of instances sweeping two of its parameters, drawn in a single call. 
+	/// An empty grid (0 columns or rows) turns it back into a single object.
+	/// </summary>
+	/// <param name="idx"></param>
+	/// <param name="columns"></param>
+	/// <param name="rows"></param>
+	/// <param name="spacing">Distance between two neighbour instances</param>
+	/// <param name="parameters">Indices (0 to 8) of the parameters swept along the columns and the rows</param>
+	/// <returns></returns>
+	bool BRDFA_Engine::instanceObject(const size_t& idx, const uint32_t& columns, const uint32_t& rows, const float& spacing, const std::array<int, 2>& parameters) {
+		if (idx >= m_meshes.size() || parameters[0] < 0 || parameters[0] > 8 || parameters[1] < 0 || parameters[1] > 8)
+			return false;
+		vkDeviceWaitIdle(m_device.device);
+		finishCompaction();
 
-		/*Re-recording the command buffers*/
-		vkFreeCommandBuffers(m_device.device, m_commander.pool, static_cast<uint32_t>(m_commander.sceneBuffers.size()), m_commander.sceneBuffers.data());
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
+		Mesh& mesh = m_meshes[idx];
+		if (columns == 0 || rows == 0) mesh.instances.clear();
+		else generateInstanceGrid(mesh, columns, rows, spacing, parameters);
+		if (uploadInstances(m_geometry, m_commander, m_device, mesh)) {
+			writeDrawDescriptors(m_descriptorData, m_device, m_geometry);
+			invalidateSceneCommands(m_commander, m_meshes);
+		}
+		refreshObject(idx);
+		printf("[INFO]: Object_%zu drawn with %zu instance(s)\n", idx + 1, std::max<size_t>(1, mesh.instances.size()));
 		return true;
 	}
 
@@ -260,13 +447,11 @@ namespace brdfa {
 		/*Meshes dependent*/
 		loadEnvironmentMap(path);
 
-		/*Recreating the Descriptors sets*/
-		vkDestroyDescriptorPool(m_device.device, m_descriptorData.pool, nullptr);
-		initDescriptors(m_descriptorData, m_device, m_swapChain, m_uniformBuffers, m_meshes, m_skymap);
+		/*Only the frame sets hold the skymap.*/
+		writeFrameDescriptors(m_descriptorData, m_device, m_uniforms, m_skymap);
 
-		/*Recording the new skymap mesh */
-		vkFreeCommandBuffers(m_device.device, m_commander.pool, static_cast<uint32_t>(m_commander.sceneBuffers.size()), m_commander.sceneBuffers.data());
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
+		/*The frame sets changed, every object is re-recorded by the next frames.*/
+		invalidateSceneCommands(m_commander, m_meshes);
 		return true;
 	}
 
@@ -593,16 +778,316 @@ namespace brdfa {
 // ------------------------------------------------ MEMBER FUNCTIONS ---------------------------------------
 
 	/// <summary>
-	/// This is called to refresh a specific object. Refreshing means re-recording.
+	/// This is called to refresh a specific object: its draw record is written again and its pipeline looked up again by the next
+	/// frame. The batch of the object is only re-recorded if its pipeline changed. The other objects are left untouched.
 	/// </summary>
 	/// <param name="idx"></param>
 	void BRDFA_Engine::refreshObject(const size_t& idx) {
-		/*Waiting for the device to be free.*/
-		vkDeviceWaitIdle(m_device.device);
+		m_meshes[idx].drawVersion++;
+	}
+
+
+	/// <summary>
+	/// Refreshes the objects rendered with the given BRDF.
+	/// </summary>
+	/// <param name="brdfName"></param>
+	void BRDFA_Engine::refreshBRDFObjects(const std::string& brdfName) {
+		for (size_t j = 0; j < m_meshes.size(); j++) {
+			if (m_meshes[j].renderOption == brdfName || m_meshes[j].renderOption == "")
+				refreshObject(j);
+		}
+	}
+
+
+	/// <summary>
+	/// Selects the pipeline variant of the given object based on its light samples. Sample counts found in SPECIALIZED_SAMPLE_COUNTS
+	/// use a pipeline with the count baked in as a specialization constant, which is created on first use and kept in m_graphicsPipelines.variants.
+	/// Any other count (or a BRDF without SPIR-V) falls back to the dynamic pipeline.
+	/// </summary>
+	/// <param name="idx">Index of the object</param>
+	/// <returns>True if the object changed its variant and needs to be re-recorded.</returns>
+	bool BRDFA_Engine::selectSampleVariant(const size_t& idx) {
+		Mesh& mesh = m_meshes[idx];
+
+		/*Finding the SPIR-V of the BRDF used by the object*/
+		const std::vector<char>* spirv = nullptr;
+		if (m_loadedBrdfs.find(mesh.renderOption) != m_loadedBrdfs.end())
+			spirv = &m_loadedBrdfs.at(mesh.renderOption).latest_spir_v;
+		else if (m_costumBrdfs.find(mesh.renderOption) != m_costumBrdfs.end())
+			spirv = &m_costumBrdfs.at(mesh.renderOption).latest_spir_v;
+
+		bool isSpecialized = spirv != nullptr && !spirv->empty() &&
+			std::find(SPECIALIZED_SAMPLE_COUNTS.begin(), SPECIALIZED_SAMPLE_COUNTS.end(), mesh.samples) != SPECIALIZED_SAMPLE_COUNTS.end();
+		int target = isSpecialized ? mesh.samples : 0;
+
+		/*Lazily creating the specialized pipeline*/
+		std::string key = GPipeline::variantKey(mesh.renderOption, target);
+		if (isSpecialized && m_graphicsPipelines.variants.find(key) == m_graphicsPipelines.variants.end()) {
+			SampleSpecialization data = { target, 1 };
+			auto entries = SampleSpecialization::getMapEntries();
+			VkSpecializationInfo specInfo{};
+			specInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+			specInfo.pMapEntries = entries.data();
+			specInfo.dataSize = sizeof(SampleSpecialization);
+			specInfo.pData = &data;
+
+			m_graphicsPipelines.variants.insert({ key, VK_NULL_HANDLE });
+			auto start = std::chrono::high_resolution_clock::now();
+			createGraphicsPipeline(
+				m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
+				m_graphicsPipelines.variants.at(key), m_skymap_pipeline,
+				m_device, m_swapChain, m_descriptorData, m_vertSpirv, *spirv, false, &specInfo, m_graphicsPipelines.cache, m_graphicsPipelines.vertModule);
+			logPipelineTime(key, start);
+		}
+
+		bool changed = mesh.specializedSamples != target;
+		mesh.specializedSamples = target;
+		return changed;
+	}
+
+
+	/// <summary>
+	/// Forms the whole fragment shader of a BRDF: main.frag followed by the BRDF source (see assembleShader()).
+	/// </summary>
+	/// <param name="brdfSource"></param>
+	/// <param name="brdfName">Names the BRDF part in the compilation errors</param>
+	/// <returns></returns>
+	std::string BRDFA_Engine::assembleFragShader(const std::string& brdfSource, const std::string& brdfName) const {
+		return assembleShader(m_mainFragShader, "main.frag", brdfSource, brdfName + ".brdf");
+	}
+
+
+	/// <summary>
+	/// SPIR-V archive key of a BRDF fragment shader. Made of the main.frag hash and the BRDF source, so a lookup
+	/// doesn't need the shader to be assembled.
+	/// </summary>
+	/// <param name="brdfSource"></param>
+	/// <param name="brdfName"></param>
+	/// <param name="options">Compile options of the SPIR-V</param>
+	/// <returns></returns>
+	uint64_t BRDFA_Engine::fragShaderKey(const std::string& brdfSource, const std::string& brdfName, const ShaderCompileOptions& options) const {
+		return brdfSpirvKey(m_mainFragHash, brdfSource, brdfName, shaderOptionsKey(options));
+	}
+
+
+	/// <summary>
+	/// Compile options of the builds that go into the SPIR-V archive: the selected optimization level, without debug info.
+	/// </summary>
+	/// <returns></returns>
+	ShaderCompileOptions BRDFA_Engine::cachedShaderOptions() const {
+		ShaderCompileOptions options = m_shaderOptions;
+		options.debugInfo = false;
+		return options;
+	}
+
+
+	/// <summary>
+	/// SPIR-V of one of the engine shaders of the shaders directory. Taken from the SPIR-V archive, or compiled from its
+	/// GLSL and archived, so the engine shaders always match their sources.
+	/// </summary>
+	/// <param name="file">File name in the shaders directory</param>
+	/// <param name="vertexShader"></param>
+	/// <param name="defines">#define lines inserted after the #version line</param>
+	/// <returns></returns>
+	std::vector<char> BRDFA_Engine::loadEngineShader(const std::string& file, const bool& vertexShader, const std::string& defines) {
+		std::vector<char> code = readFile(SHADERS_PATH + "/" + file, false);
+		std::string source(code.begin(), code.end());
+		if (!defines.empty()) {
+			size_t versionEnd = source.find('\n');
+			source.insert(versionEnd == std::string::npos ? source.size() : versionEnd + 1, defines);
+		}
+		ShaderCompileOptions options = cachedShaderOptions();
+		uint64_t key = spirvKey(source, shaderOptionsKey(options), vertexShader);
+
+		std::vector<char> spirv;
+		if (findSpirv(m_spirvArchive, key, spirv)) return spirv;
+		spirv = compileShader(source, vertexShader, file, options);
+		archiveSpirv(key, spirv);
+		return spirv;
+	}
+
+
+	/// <summary>
+	/// Compiles the BRDF of an editor panel (main.frag + panel text) as an interactive job. Never waits for the compilation:
+	/// the result is applied by updateEditorCompiles(). Sources compiled before (e.g. an edit that was undone) are taken
+	/// from the recent editor compilations or the SPIR-V archive right away.
+	/// </summary>
+	/// <param name="panel"></param>
+	void BRDFA_Engine::requestBRDFCompile(BRDF_Panel& panel) {
+		panel.compilePending = false;
+		std::string brdfSource = panel.glslPanel.GetText();
+		uint64_t key = fragShaderKey(brdfSource, panel.brdfName, m_shaderOptions);
+		uint64_t generation = panel.generation->load();
+		bool cacheable = !m_shaderOptions.debugInfo;
+
+		CompileResult cached;
+		auto kept = m_editorSpirv.find(key);
+		if (cacheable && kept != m_editorSpirv.end())
+			cached.spirv = kept->second;
+		if (cacheable && (!cached.spirv.empty() || findSpirv(m_spirvArchive, key, cached.spirv))) {
+			cached.success = true;
+			m_editorCompiles.erase(panel.brdfName);
+			applyBRDFCompile(panel, cached, key, cacheable);
+			return;
+		}
+
+		/*The job is dropped if the panel was edited again before a worker picked it.*/
+		std::shared_ptr<std::atomic<uint64_t>> latest = panel.generation;
+		EditorCompile job;
+		job.generation = generation;
+		job.key = key;
+		job.cacheable = cacheable;
+		job.result = submitCompile(m_compiler, assembleFragShader(brdfSource, panel.brdfName), false, panel.brdfName, m_shaderOptions,
+			INTERACTIVE_PRIORITY, [latest, generation]() { return latest->load() != generation; });
+		m_editorCompiles[panel.brdfName] = std::move(job);
+		panel.compiling = true;
+	}
+
+
+	/// <summary>
+	/// Applies a compile result to its editor panel: diagnostics, error markers, SPIR-V, cost report and the optional hot-swap.
+	/// Nothing is archived here, the intermediate edits would fill the archive: the SPIR-V is kept in memory and archived once
+	/// its pipeline is published, or at session end.
+	/// </summary>
+	/// <param name="panel"></param>
+	/// <param name="result"></param>
+	/// <param name="key">Archive key of the compiled source</param>
+	/// <param name="cacheable">False for the debug info builds, which are never reused</param>
+	void BRDFA_Engine::applyBRDFCompile(BRDF_Panel& panel, CompileResult& result, const uint64_t& key, const bool& cacheable) {
+		panel.compiling = false;
+		panel.tested = result.success;
+		panel.log_e = result.log;
+		panel.compileTime = result.compileTime;
+		panel.editLatency = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - panel.lastEdit).count();
+		panel.glslPanel.SetErrorMarkers(errorLines(result.log, panel.brdfName + ".brdf"));
+		if (!result.success) return;
+
+		panel.latest_spir_v = std::move(result.spirv);
+		panel.spirvKey = cacheable ? key : 0;
+		if (cacheable) keepEditorSpirv(key, panel.latest_spir_v);
+		panel.previousCost = panel.cost;
+		panel.cost = analyzeShaderCost(panel.latest_spir_v);
+
+		/*Hot-swap. Only the loaded BRDFs own a pipeline.*/
+		bool loaded = m_loadedBrdfs.find(panel.brdfName) != m_loadedBrdfs.end() && &m_loadedBrdfs.at(panel.brdfName) == &panel;
+		if (panel.liveUpdate && loaded)
+			requestPipelineSwap(panel);
+	}
+
+
+	/// <summary>
+	/// Keeps the SPIR-V of an editor compilation in memory, up to EDITOR_SPIRV_MEMORY of them (oldest dropped first).
+	/// </summary>
+	/// <param name="key"></param>
+	/// <param name="spirv"></param>
+	void BRDFA_Engine::keepEditorSpirv(const uint64_t& key, const std::vector<char>& spirv) {
+		if (!m_editorSpirv.insert({ key, spirv }).second) return;
+		m_editorSpirvOrder.push_back(key);
+		if (m_editorSpirvOrder.size() > EDITOR_SPIRV_MEMORY) {
+			m_editorSpirv.erase(m_editorSpirvOrder.front());
+			m_editorSpirvOrder.pop_front();
+		}
+	}
+
+
+	/// <summary>
+	/// Stores the SPIR-V into the archive as a background job of the compile service, so the file writes don't stall the frame.
+	/// </summary>
+	/// <param name="key">Archive key. 0 for the builds that are not archived.</param>
+	/// <param name="spirv"></param>
+	void BRDFA_Engine::archiveSpirv(const uint64_t& key, const std::vector<char>& spirv) {
+		if (key == 0 || spirv.empty()) return;
+		m_archiveWrites.erase(std::remove_if(m_archiveWrites.begin(), m_archiveWrites.end(), [](const std::future<void>& write) {
+			return write.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
+		}), m_archiveWrites.end());
+		m_archiveWrites.push_back(submitTask(m_compiler, BACKGROUND_PRIORITY, [this, key, spirv]() {
+			storeSpirv(m_spirvArchive, key, spirv);
+		}));
+	}
+
+
+	/// <summary>
+	/// Called every frame. Submits the compilations of the panels that stopped changing (debounce) and applies the finished ones.
+	/// Results of an older text than the one in the panel are dropped.
+	/// </summary>
+	void BRDFA_Engine::updateEditorCompiles() {
+		auto now = std::chrono::high_resolution_clock::now();
+		for (auto* panels : { &m_loadedBrdfs, &m_costumBrdfs }) {
+			for (auto& it : *panels) {
+				if (it.second.compilePending && std::chrono::duration<float>(now - it.second.lastEdit).count() >= EDITOR_COMPILE_DEBOUNCE)
+					requestBRDFCompile(it.second);
+			}
+		}
+
+		for (auto it = m_editorCompiles.begin(); it != m_editorCompiles.end();) {
+			if (it->second.result.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready) {
+				it++;
+				continue;
+			}
+			CompileResult result = it->second.result.get();
+			BRDF_Panel* panel = nullptr;
+			if (m_loadedBrdfs.find(it->first) != m_loadedBrdfs.end()) panel = &m_loadedBrdfs.at(it->first);
+			else if (m_costumBrdfs.find(it->first) != m_costumBrdfs.end()) panel = &m_costumBrdfs.at(it->first);
+
+			if (panel && !result.cancelled && panel->generation->load() == it->second.generation)
+				applyBRDFCompile(*panel, result, it->second.key, it->second.cacheable);
+			it = m_editorCompiles.erase(it);
+		}
+	}
+
+
+	/// <summary>
+	/// Marks the panel as edited. It gets compiled once the text stops changing for EDITOR_COMPILE_DEBOUNCE.
+	/// </summary>
+	/// <param name="panel"></param>
+	void BRDFA_Engine::editedBRDF(BRDF_Panel& panel) {
+		panel.tested = false;
+		panel.generation->fetch_add(1);
+		panel.lastEdit = std::chrono::high_resolution_clock::now();
+		panel.compilePending = true;
+	}
+
 
-		/*Re-recording the command buffers*/
-		vkFreeCommandBuffers(m_device.device, m_commander.pool, static_cast<uint32_t>(m_commander.sceneBuffers.size()), m_commander.sceneBuffers.data());
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
+	/// <summary>
+	/// Cost report of the panel SPIR-V: instruction counts by class, with the change from the compilation before.
+	/// </summary>
+	/// <param name="panel"></param>
+	void BRDFA_Engine::drawUI_shaderCost(BRDF_Panel& panel) {
+		if (!panel.cost.valid && !panel.latest_spir_v.empty())
+			panel.cost = analyzeShaderCost(panel.latest_spir_v);
+		if (!panel.cost.valid)
+			return;
+
+		auto row = [](const char* label, const InstructionCounts& counts, const InstructionCounts& previous, const bool& hasPrevious) {
+			ImGui::Text("%-8s ALU %4u  Transc. %3u  Tex %2u  Branch %2u  Total %4u", label,
+				counts.alu, counts.transcendental, counts.texture, counts.branch, counts.total);
+			if (hasPrevious && previous.total != counts.total) {
+				ImGui::SameLine();
+				int delta = static_cast<int>(counts.total) - static_cast<int>(previous.total);
+				ImGui::TextColored(delta > 0 ? ImVec4(1, 0.4, 0.4, 1) : ImVec4(0.4, 1, 0.4, 1), "(%+d)", delta);
+			}
+		};
+
+		if (ImGui::TreeNode("Cost")) {
+			bool hasPrevious = panel.previousCost.valid;
+			if (panel.cost.renderFound) row("render()", panel.cost.render, panel.previousCost.render, hasPrevious);
+			else ImGui::TextDisabled("render() inlined by the optimizer");
+			row("Loop", panel.cost.loop, panel.previousCost.loop, hasPrevious);
+			row("Shader", panel.cost.shader, panel.previousCost.shader, hasPrevious);
+			ImGui::TreePop();
+		}
+	}
+
+
+	/// <summary>
+	/// Status line of a panel compilation, under the editor buttons.
+	/// </summary>
+	/// <param name="panel"></param>
+	void BRDFA_Engine::drawUI_compileStatus(BRDF_Panel& panel) {
+		if (panel.compilePending || panel.compiling)
+			ImGui::TextDisabled("Compiling...");
+		else if (panel.editLatency > 0.0f)
+			ImGui::TextDisabled("Compile: %.1f ms, edit to diagnostics: %.1f ms", panel.compileTime, panel.editLatency);
 	}
 
 
@@ -623,19 +1108,10 @@ namespace brdfa {
 		fileBRDF_text << m_loadedBrdfs.at(brdfName).glslPanel.GetText();
 		fileBRDF_text.close();
 
-		/*Cache it if needed*/
-		std::string cachePath = "shaders/cache/";
-		std::ofstream fileBRDF_spir;
-		if (cacheIt) {
-			fileBRDF_spir.open((cachePath + brdfName + std::string(".spv")), std::ofstream::out | std::ofstream::binary);
-			if (!fileBRDF_spir) {
-				std::cout << "ERROR: CAN'T CACHE BRDF" << std::endl;
-				return;
-			}
-			for (size_t i = 0; i < m_loadedBrdfs.at(brdfName).latest_spir_v.size(); i++) {
-				fileBRDF_spir << m_loadedBrdfs.at(brdfName).latest_spir_v.at(i);
-			}
-			fileBRDF_spir.close();
+		/*Cache it if needed. The key is the same one loadPipelines computes for the saved file.*/
+		const BRDF_Panel& panel = m_loadedBrdfs.at(brdfName);
+		if (cacheIt && panel.spirvKey != 0) {
+			archiveSpirv(panel.spirvKey, panel.latest_spir_v);
 		}
 		std::cout << "BRDFs have been saved." << std::endl;
 	}
@@ -655,15 +1131,26 @@ namespace brdfa {
 		else   // if not found then create a new one.
 			m_graphicsPipelines.pipelines.insert({ brdfName , VK_NULL_HANDLE });
 
+		/*Destroying the specialized variants built from the old SPIR-V*/
+		std::string variantPrefix = brdfName + "#";
+		for (auto it = m_graphicsPipelines.variants.begin(); it != m_graphicsPipelines.variants.end();) {
+			if (it->first.compare(0, variantPrefix.size(), variantPrefix) == 0) {
+				vkDestroyPipeline(m_device.device, it->second, nullptr);
+				it = m_graphicsPipelines.variants.erase(it);
+			}
+			else ++it;
+		}
+
 		/*Creating a new pipeline*/
-		createGraphicsPipeline(
-			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
-			m_graphicsPipelines.pipelines.at(brdfName), m_skymap_pipeline,
-			m_device, m_swapChain, m_descriptorData, m_vertSpirv, fragSpirv, false);
+		buildBRDFPipeline(brdfName, fragSpirv);
 
-		/*Re record the scene objects*/
-		for (size_t j = 0; j < m_meshes.size() & refreshObj; j++)
-			refreshObject(j);
+		/*Recreating the variants used by the objects*/
+		for (size_t j = 0; j < m_meshes.size(); j++)
+			if (m_meshes[j].renderOption == brdfName) selectSampleVariant(j);
+
+		/*Re record the objects using the BRDF*/
+		if (refreshObj)
+			refreshBRDFObjects(brdfName);
 	}
 
 
@@ -683,13 +1170,319 @@ namespace brdfa {
 		m_graphicsPipelines.pipelines.insert({ brdfName , VK_NULL_HANDLE });
 
 		/*Creating a new pipeline*/
-		createGraphicsPipeline(
-			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
-			m_graphicsPipelines.pipelines.at(brdfName), m_skymap_pipeline,
-			m_device, m_swapChain, m_descriptorData, m_vertSpirv, fragSpirv, false);
+		buildBRDFPipeline(brdfName, fragSpirv);
+
+		/*Re record the objects using the BRDF*/
+		refreshBRDFObjects(brdfName);
+	}
+
+
+	/// <summary>
+	/// Builds the pipeline of a BRDF into its (already existing) slot in m_graphicsPipelines.pipelines.
+	/// With graphics pipeline libraries, only the fragment library is compiled and quickly linked with the shared libraries.
+	/// An optimized link is then started in the background and swapped in by publishReadyPipelines().
+	/// Without them, a full pipeline is created.
+	/// </summary>
+	/// <param name="brdfName"></param>
+	/// <param name="fragSpirv"></param>
+	void BRDFA_Engine::buildBRDFPipeline(const std::string& brdfName, const std::vector<char>& fragSpirv) {
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!m_device.pipelineLibrary) {
+			createGraphicsPipeline(
+				m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
+				m_graphicsPipelines.pipelines.at(brdfName), m_skymap_pipeline,
+				m_device, m_swapChain, m_descriptorData, m_vertSpirv, fragSpirv, false, nullptr, m_graphicsPipelines.cache, m_graphicsPipelines.vertModule);
+			logPipelineTime(brdfName, start);
+			return;
+		}
+
+		/*Retiring the old fragment library. An optimized link might still be using it.*/
+		auto library = m_graphicsPipelines.fragmentLibraries.find(brdfName);
+		if (library != m_graphicsPipelines.fragmentLibraries.end()) {
+			m_retiredLibraries.push_back(library->second);
+			m_graphicsPipelines.fragmentLibraries.erase(library);
+		}
+
+		/*Fast link*/
+		VkPipeline fragmentLibrary = createFragmentLibrary(m_graphicsPipelines, m_device, fragSpirv, m_graphicsPipelines.cache);
+		m_graphicsPipelines.fragmentLibraries.insert({ brdfName, fragmentLibrary });
+		m_graphicsPipelines.pipelines.at(brdfName) = linkPipelineLibraries(m_graphicsPipelines, m_device, fragmentLibrary, false, m_graphicsPipelines.cache);
+		logPipelineTime(brdfName, start);
+
+		/*Optimized link in the background*/
+		uint64_t generation = ++m_pipelineGenerations[brdfName];
+		m_pipelineQueue.linking++;
+		m_linkWorkers.push_back(submitTask(m_compiler, BACKGROUND_PRIORITY, [this, brdfName, generation, fragmentLibrary]() {
+			threadLinkPipeline(brdfName, generation, fragmentLibrary, &m_graphicsPipelines, &m_device, &m_pipelineCacheSeed, &m_pipelineQueue);
+		}));
+	}
+
 
-		/*Re record the scene objects*/
-		for (size_t j = 0; j < m_meshes.size(); j++) refreshObject(j);
+	/// <summary>
+	/// Records and prints the time it took to create a pipeline. Used to compare cold and warm pipeline caches.
+	/// </summary>
+	/// <param name="name">Name of the pipeline</param>
+	/// <param name="start">Time point taken before the creation</param>
+	void BRDFA_Engine::logPipelineTime(const std::string& name, const std::chrono::high_resolution_clock::time_point& start) {
+		float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		m_pipelineTimes[name] = { elapsed, m_pipelineCacheWarm };
+		printf("[INFO]: Pipeline \"%s\" created in %.2f ms (%s cache)\n", name.c_str(), elapsed, m_pipelineCacheWarm ? "warm" : "cold");
+	}
+
+
+	/// <summary>
+	/// Compacts the geometry arena when the ranges freed by the deleted meshes take more than GEOMETRY_COMPACTION_THRESHOLD of it.
+	/// Done here rather than on deletion, so deleting several objects in a row compacts once. The copies run in the background
+	/// (see beginGeometryCompaction()): every frame checks their fence, and the buffers they replaced are destroyed once the frames
+	/// in flight are done with them. One compaction at a time.
+	/// </summary>
+	void BRDFA_Engine::maintainGeometry() {
+		if (m_geometry.compaction.retiring && m_frameNumber >= m_geometry.compaction.retiredAt + MAX_FRAMES_IN_FLIGHT) {
+			destroyRetiredGeometry(m_geometry, m_device);
+			releaseRetiredDrawSet(m_descriptorData);
+		}
+		if (m_geometry.compaction.fence != VK_NULL_HANDLE) {
+			finishCompaction();
+			return;
+		}
+		if (m_geometry.compaction.retiring || geometryFragmentation(m_geometry) <= GEOMETRY_COMPACTION_THRESHOLD)
+			return;
+		beginGeometryCompaction(m_geometry, m_commander, m_device, geometryMeshes());
+	}
+
+
+	/// <summary>
+	/// Swaps in the packed geometry once the copies of the compaction are done. The frames in flight still bind the draw set of the
+	/// old instance heap, so a new set is written rather than the current one. The culling set is left as is: it only points at the
+	/// draw commands and counts, which a compaction keeps. Also called by the edits of the scene, after waiting for the device, so
+	/// the ranges they change are those of the packed buffers.
+	/// </summary>
+	/// <returns>If a compaction was finished</returns>
+	bool BRDFA_Engine::finishCompaction() {
+		if (!finishGeometryCompaction(m_geometry, m_commander, m_device, geometryMeshes(), m_frameNumber))
+			return false;
+		renewDrawDescriptors(m_descriptorData, m_device, m_geometry);
+
+		/*The shared buffers changed, every object is re-recorded by the next frames.*/
+		invalidateSceneCommands(m_commander, m_meshes);
+		return true;
+	}
+
+
+	/// <summary>
+	/// The skymap and the meshes, in the order the compactions take them.
+	/// </summary>
+	/// <returns></returns>
+	std::vector<Mesh*> BRDFA_Engine::geometryMeshes() {
+		std::vector<Mesh*> meshes = { &m_skymap_mesh };
+		for (auto& mesh : m_meshes) meshes.push_back(&mesh);
+		return meshes;
+	}
+
+
+	/// <summary>
+	/// Publishes the BRDF pipelines built by the workers of loadPipelines(). Called every frame, so each pipeline
+	/// becomes selectable as soon as it is ready while the scene keeps rendering with the ones already published.
+	/// </summary>
+	void BRDFA_Engine::publishReadyPipelines() {
+		destroyRetiredPipelines(false);
+
+		/*Nothing is ready in most frames. The queues below are only made then (a std::queue allocates even empty).*/
+		{
+			std::lock_guard<std::mutex> lock(m_pipelineQueue.mutex);
+			if (m_pipelineQueue.ready.empty() && m_pipelineQueue.linked.empty()) return;
+		}
+
+		std::queue<ReadyPipeline> ready;
+		std::queue<LinkedPipeline> linked;
+		{
+			std::lock_guard<std::mutex> lock(m_pipelineQueue.mutex);
+			std::swap(ready, m_pipelineQueue.ready);
+			std::swap(linked, m_pipelineQueue.linked);
+		}
+
+		while (!ready.empty()) {
+			ReadyPipeline& it = ready.front();
+			const std::string& brdfName = it.panel.brdfName;
+			m_pipelineQueue.pending--;
+
+			if (it.cache != VK_NULL_HANDLE) {
+				std::vector<VkPipelineCache> caches = { it.cache };
+				mergePipelineCaches(m_device, m_graphicsPipelines.cache, caches);
+			}
+
+			if (it.swapGeneration != 0) {
+				swapBRDFPipeline(it);
+			}
+			else if (it.pipeline != VK_NULL_HANDLE) {
+				if (it.compiled)
+					archiveSpirv(it.spirvKey, it.panel.latest_spir_v);
+				m_graphicsPipelines.pipelines.insert({ brdfName, it.pipeline });
+				it.panel.cost = analyzeShaderCost(it.panel.latest_spir_v);
+				m_loadedBrdfs.insert({ brdfName, it.panel });
+				m_pipelineTimes[brdfName] = { it.creationTime, m_pipelineCacheWarm };
+				printf("[INFO]: Pipeline \"%s\" published (%.2f ms, %s cache)\n", brdfName.c_str(), it.creationTime, m_pipelineCacheWarm ? "warm" : "cold");
+			}
+			ready.pop();
+		}
+
+		/*Swapping in the optimized pipelines. Links started before the latest edit of a BRDF are dropped.*/
+		while (!linked.empty()) {
+			LinkedPipeline& it = linked.front();
+			m_pipelineQueue.linking--;
+
+			if (it.cache != VK_NULL_HANDLE) {
+				std::vector<VkPipelineCache> caches = { it.cache };
+				mergePipelineCaches(m_device, m_graphicsPipelines.cache, caches);
+			}
+
+			auto generation = m_pipelineGenerations.find(it.brdfName);
+			bool current = it.pipeline != VK_NULL_HANDLE && generation != m_pipelineGenerations.end() && generation->second == it.generation
+				&& m_graphicsPipelines.pipelines.find(it.brdfName) != m_graphicsPipelines.pipelines.end();
+			if (current) {
+				retirePipeline(m_graphicsPipelines.pipelines.at(it.brdfName));
+				m_graphicsPipelines.pipelines.at(it.brdfName) = it.pipeline;
+				refreshBRDFObjects(it.brdfName);
+				if (m_editStart.find(it.brdfName) != m_editStart.end())
+					m_editLatency[it.brdfName].second = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - m_editStart.at(it.brdfName)).count();
+				printf("[INFO]: Optimized pipeline \"%s\" swapped in (link: %.2f ms)\n", it.brdfName.c_str(), it.linkTime);
+			}
+			else if (it.pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(m_device.device, it.pipeline, nullptr);
+			}
+			linked.pop();
+		}
+
+		/*All the loading workers are done.*/
+		if (m_pipelineQueue.pending == 0 && !compilationPool.empty()) {
+			for (auto& job : compilationPool) {
+				job.wait();
+			}
+			compilationPool.clear();
+			m_pipelineCacheWarm = true;		// From now on the in-memory cache holds all the loaded pipelines.
+		}
+
+		/*All the optimized links are done. No one uses the retired fragment libraries anymore.*/
+		if (m_pipelineQueue.linking == 0 && !m_linkWorkers.empty()) {
+			for (auto& job : m_linkWorkers) {
+				job.wait();
+			}
+			m_linkWorkers.clear();
+			for (auto& library : m_retiredLibraries) {
+				vkDestroyPipeline(m_device.device, library, nullptr);
+			}
+			m_retiredLibraries.clear();
+		}
+	}
+
+
+	/// <summary>
+	/// Hot-swap of an edited BRDF. The pipeline is built from the panel SPIR-V as a job of the compile service, like the loading
+	/// builds, and swapped in by publishReadyPipelines(). Neither the build nor the device is waited for.
+	/// </summary>
+	/// <param name="panel">Loaded BRDF panel holding the new SPIR-V</param>
+	void BRDFA_Engine::requestPipelineSwap(const BRDF_Panel& panel) {
+		if (panel.latest_spir_v.empty()) return;
+		m_editStart[panel.brdfName] = std::chrono::high_resolution_clock::now();
+		uint64_t generation = ++m_pipelineSwaps[panel.brdfName];
+		ShaderCompileOptions options = m_shaderOptions;
+
+		m_pipelineQueue.pending++;
+		compilationPool.push_back(submitTask(m_compiler, INTERACTIVE_PRIORITY, [this, panel, options, generation]() {
+			threadBuildPipeline("", panel.spirvKey, options, panel,
+				&m_graphicsPipelines, &m_device, &m_swapChain, &m_descriptorData,
+				&m_pipelineCacheSeed, &m_compiler, &m_pipelineQueue, generation);
+		}));
+	}
+
+
+	/// <summary>
+	/// Swaps in a pipeline built by requestPipelineSwap(). The replaced pipeline and its specialized variants are retired, the
+	/// frames in flight may still draw with them. Builds of an older edit than the latest requested swap are dropped.
+	/// </summary>
+	/// <param name="ready"></param>
+	void BRDFA_Engine::swapBRDFPipeline(ReadyPipeline& ready) {
+		const std::string& brdfName = ready.panel.brdfName;
+		auto current = m_graphicsPipelines.pipelines.find(brdfName);
+		if (m_pipelineSwaps[brdfName] != ready.swapGeneration || current == m_graphicsPipelines.pipelines.end()) {
+			if (ready.pipeline != VK_NULL_HANDLE)
+				vkDestroyPipeline(m_device.device, ready.pipeline, nullptr);
+			return;
+		}
+		if (ready.pipeline == VK_NULL_HANDLE) {
+			auto panel = m_loadedBrdfs.find(brdfName);
+			if (panel != m_loadedBrdfs.end()) panel->second.log_e = ready.panel.log_e;
+			return;
+		}
+
+		retirePipeline(current->second);
+		current->second = ready.pipeline;
+		std::string variantPrefix = brdfName + "#";
+		for (auto it = m_graphicsPipelines.variants.begin(); it != m_graphicsPipelines.variants.end();) {
+			if (it->first.compare(0, variantPrefix.size(), variantPrefix) == 0) {
+				retirePipeline(it->second);
+				it = m_graphicsPipelines.variants.erase(it);
+			}
+			else ++it;
+		}
+
+		/*The swapped in pipeline is complete: the fragment library of the old one is dropped, and so is its optimized link.*/
+		auto library = m_graphicsPipelines.fragmentLibraries.find(brdfName);
+		if (library != m_graphicsPipelines.fragmentLibraries.end()) {
+			m_retiredLibraries.push_back(library->second);
+			m_graphicsPipelines.fragmentLibraries.erase(library);
+		}
+		m_pipelineGenerations[brdfName]++;
+
+		archiveSpirv(ready.spirvKey, ready.panel.latest_spir_v);
+		for (size_t j = 0; j < m_meshes.size(); j++)
+			if (m_meshes[j].renderOption == brdfName) selectSampleVariant(j);
+		refreshBRDFObjects(brdfName);
+		m_pipelineTimes[brdfName] = { ready.creationTime, m_pipelineCacheWarm };
+		m_awaitingVisible.push_back(brdfName);
+		printf("[INFO]: Pipeline \"%s\" hot-swapped (%.2f ms)\n", brdfName.c_str(), ready.creationTime);
+	}
+
+
+	/// <summary>
+	/// Hands a replaced pipeline over to destroyRetiredPipelines().
+	/// </summary>
+	/// <param name="pipeline"></param>
+	void BRDFA_Engine::retirePipeline(const VkPipeline& pipeline) {
+		if (pipeline != VK_NULL_HANDLE)
+			m_retiredPipelines.push_back({ pipeline, m_frameNumber });
+	}
+
+
+	/// <summary>
+	/// Destroys the retired pipelines no frame uses anymore. A pipeline retired after F submitted frames was last drawn by frame F - 1,
+	/// whose fence has been waited for once F + MAX_FRAMES_IN_FLIGHT frames were submitted.
+	/// </summary>
+	/// <param name="all">The device is idle: destroys all of them.</param>
+	void BRDFA_Engine::destroyRetiredPipelines(const bool& all) {
+		for (auto it = m_retiredPipelines.begin(); it != m_retiredPipelines.end();) {
+			if (all || m_frameNumber >= it->second + MAX_FRAMES_IN_FLIGHT) {
+				vkDestroyPipeline(m_device.device, it->first, nullptr);
+				it = m_retiredPipelines.erase(it);
+			}
+			else ++it;
+		}
+	}
+
+
+	/// <summary>
+	/// Waits for all the pipeline workers (loading and optimized links) and publishes their pipelines.
+	/// Must be called before destroying anything the workers use.
+	/// </summary>
+	void BRDFA_Engine::joinPipelineWorkers() {
+		if (compilationPool.empty() && m_linkWorkers.empty()) return;
+		for (auto& job : compilationPool) {
+			job.wait();
+		}
+		for (auto& job : m_linkWorkers) {
+			job.wait();
+		}
+		publishReadyPipelines();
 	}
 
 
@@ -697,7 +1490,9 @@ namespace brdfa {
 	/// Load all the needed pipelines. 
 	///		* We load the cached BRDFs first. Cached means pre-compiled BRDFs.
 	///		* We load all the source codes of the BRDFs second.
-	///		* We create graphics pipelines from the cached spir-v shaders.
+	///		* We create graphics pipelines from the cached spir-v shaders. Each BRDF is loaded/compiled and built as a background job of the compile service,
+	///		  and published by publishReadyPipelines() when ready. The "None" and skymap pipelines are built right away, so the first
+	///		  frames render with them while the others are still building.
 	///		* Configurations can be: 
 	///				1) Hot-Start: which only uses the cache without compiling and building the rest of the BRDFs.		
 	///				2) Full Load: Which will load all the BRDFs that are not cached, compile them, cache them and then build the graphics pipelines.  
@@ -714,21 +1509,32 @@ namespace brdfa {
 		std::string mainShader_f = (SHADERS_PATH + "/main.frag");
 		std::string mainShader_v = (SHADERS_PATH + "/main.vert");
 		std::string brdfs = (SHADERS_PATH + "/brdfs");
-		std::string cache = (SHADERS_PATH + "/cache");
 
-		/*Loading the basic.spv (basic rendering.)*/
-		m_vertSpirv = readFile(SHADERS_PATH + "/vert.spv", true);
-		auto frag_main_shader_code = readFile(SHADERS_PATH + "/basic.spv", true);
+		/*Loading the minimal shaders (basic rendering.)*/
+		m_vertSpirv = loadEngineShader("main.vert", true);
+		/*In deferred mode the BRDF pipelines draw the tiles of their batch. main.vert stays the vertex shader of the pre-pass.*/
+		m_graphicsPipelines.vertModule = createShaderModule(m_device, m_graphicsPipelines.deferred ? loadEngineShader("tiles.vert", true) : m_vertSpirv);
+		if (m_device.pipelineLibrary)
+			createPipelineLibraries(m_graphicsPipelines, m_device, m_swapChain, m_graphicsPipelines.cache);
+		auto frag_main_shader_code = loadEngineShader("minimal.frag", false);
 		m_graphicsPipelines.pipelines.insert({ "None" , {} });
 		createGraphicsPipeline(
 			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
 			m_graphicsPipelines.pipelines.at("None"), m_skymap_pipeline,
-			m_device, m_swapChain, m_descriptorData, m_vertSpirv, frag_main_shader_code, false);
+			m_device, m_swapChain, m_descriptorData, m_vertSpirv, frag_main_shader_code, false, nullptr, m_graphicsPipelines.cache, m_graphicsPipelines.vertModule);
+
+		/*Snapshot of the engine cache. The worker caches start from it.*/
+		size_t seedSize = 0;
+		vkGetPipelineCacheData(m_device.device, m_graphicsPipelines.cache, &seedSize, nullptr);
+		m_pipelineCacheSeed.resize(seedSize);
+		if (seedSize > 0 && vkGetPipelineCacheData(m_device.device, m_graphicsPipelines.cache, &seedSize, m_pipelineCacheSeed.data()) != VK_SUCCESS)
+			m_pipelineCacheSeed.clear();
 
 		/*Loading the extra BRDFs*/
 		frag_main_shader_code.clear();
 		frag_main_shader_code = readFile(SHADERS_PATH + "/main.frag", false);
 		m_mainFragShader = std::string(frag_main_shader_code.begin(), frag_main_shader_code.end());
+		m_mainFragHash = sourceHash(m_mainFragShader);
 
 		for (const auto& entry : std::filesystem::directory_iterator(brdfs)) {
 			std::string temp = entry.path().string();
@@ -745,23 +1551,6 @@ namespace brdfa {
 				std::string shaderPath = brdfFilePath + "/" + brdfFileName;
 				printf("[INFO]: Loading BRDF: %s\n", brdfFileName.c_str());
 
-				/*Check if current file exist in cache. And if it exists, load it from there.*/
-				bool loadCache = false;
-				for (const auto& entry_c : std::filesystem::directory_iterator(cache)) {
-					if (m_configuration.no_cache_load) break;
-					temp = entry_c.path().string();
-					found = temp.find_last_of("/\\");		// Finding splitters
-					std::string cacheFilePath = temp.substr(0, found);
-					std::string cacheFileName = temp.substr(found + 1);
-					extInd = cacheFileName.find(".spv");
-					std::string cacheName(cacheFileName.begin(), cacheFileName.begin() + extInd);
-					if (cacheName == brdfName) {
-						loadCache = true;
-						printf("[INFO]: Loading \"%s\" BRDF from its Cache\n", brdfName.c_str());
-						break;
-					}
-				}
-
 				/*Check if the pipeline with the name exists.*/
 				if (m_graphicsPipelines.pipelines.find(brdfName) != m_graphicsPipelines.pipelines.end()) {
 					printf("[WARNING]: BRDF Pipeline already created.\n");
@@ -772,14 +1561,6 @@ namespace brdfa {
 				auto brdf_shader_code = readFile(shaderPath, false);
 				std::string brdf_s(brdf_shader_code.begin(), brdf_shader_code.end());
 				//std::string mc(frag_main_shader_code.begin(), frag_main_shader_code.end());
-				
-				/*Concatenating the source code with filtering the terminations*/
-				std::string concat;
-				concat.reserve(brdf_s.length() + m_mainFragShader.length());
-				for (int i = 0; i < m_mainFragShader.size(); i++)			
-					concat = (m_mainFragShader[i] == '\0') ? concat : concat + m_mainFragShader[i];
-				for (int i = 0; i < brdf_s.size(); i++)		
-					concat = (brdf_s[i] == '\0') ? concat : concat + brdf_s[i];
 
 				/*If we reach this point, it means that we will insert the loaded brdf into our loaded brdfs panel*/
 				
@@ -792,41 +1573,46 @@ namespace brdfa {
 						m_loadedBrdfs.insert({ brdfName, lp });
 						continue;
 					}
-					std::string cacheFileName = cache + "/" + brdfName + ".spv";
-					/*Insert a new pipeline.*/
-					m_graphicsPipelines.pipelines.insert({ brdfName , {} });
-					if (loadCache) {
-						compilationPool.push_back(std::thread(threadAddSpirv, cacheFileName, lp, &m_loadedBrdfs));
+
+					/*Look the BRDF up in the SPIR-V archive. A hit skips the assembly and the compilation. The editor text is used,
+					  so the keys match the ones of the editor tests and saves.*/
+					std::string brdfText = lp.glslPanel.GetText();
+					ShaderCompileOptions options = cachedShaderOptions();
+					uint64_t key = fragShaderKey(brdfText, brdfName, options);
+					lp.spirvKey = key;
+					std::string concat;
+					if (!m_configuration.no_cache_load && findSpirv(m_spirvArchive, key, lp.latest_spir_v)) {
+						printf("[INFO]: Loading \"%s\" BRDF from the SPIR-V archive\n", brdfName.c_str());
 					}
 					else {
-						compilationPool.push_back(std::thread(threadCompileGLSL, concat, lp, &m_loadedBrdfs, false));
+						concat = assembleFragShader(brdfText, brdfName);
 					}
+
+					/*Build the pipeline on the compile service. It is published by publishReadyPipelines() once ready.*/
+					m_pipelineQueue.pending++;
+					compilationPool.push_back(submitTask(m_compiler, BACKGROUND_PRIORITY, [this, concat, key, options, lp]() {
+						threadBuildPipeline(concat, key, options, lp,
+							&m_graphicsPipelines, &m_device, &m_swapChain, &m_descriptorData,
+							&m_pipelineCacheSeed, &m_compiler, &m_pipelineQueue);
+					}));
 				}
 			}
 		}
-			
-		for (auto & t : compilationPool) {
-			t.join();
-		}
-		compilationPool.clear();
-
-		for (const auto& it : m_loadedBrdfs) {
-			createGraphicsPipeline(
-				m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
-				m_graphicsPipelines.pipelines.at(it.second.brdfName), m_skymap_pipeline,
-				m_device, m_swapChain, m_descriptorData, m_vertSpirv, it.second.latest_spir_v, false);
-		}
-		
 
 
 		/*Creation of skymap pipelines*/
-		auto vert_sky_shader_code = readFile(SHADERS_PATH + "/skybox.vert.spv", true);
-		auto frag_sky_shader_code = readFile(SHADERS_PATH + "/skybox.frag.spv", true);
+		auto vert_sky_shader_code = loadEngineShader("skybox.vert", true);
+		auto frag_sky_shader_code = loadEngineShader("skybox.frag", false);
 		createGraphicsPipeline(
 			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
 			m_graphicsPipelines.pipelines.begin()->second, m_skymap_pipeline,
 			m_device, m_swapChain, m_descriptorData, 
-			vert_sky_shader_code, frag_sky_shader_code, true);
+			vert_sky_shader_code, frag_sky_shader_code, true, nullptr, m_graphicsPipelines.cache);
+
+		/*Depth pre-pass pipeline, or the G-buffer one in deferred mode*/
+		createDepthPipeline(m_graphicsPipelines, m_device, m_swapChain, m_vertSpirv, m_graphicsPipelines.cache);
+		if (m_graphicsPipelines.deferred)
+			createGBufferPipeline(m_graphicsPipelines, m_device, m_swapChain, m_vertSpirv, loadEngineShader("gbuffer.frag", false), m_graphicsPipelines.cache);
 	}
 
 
@@ -857,40 +1643,102 @@ namespace brdfa {
 	/// </summary>
 	void BRDFA_Engine::startVulkan()
 	{
-		createInstance("BRDFA Engine", m_configuration.validationLayersEnabled, m_instance);
+		createInstance("BRDFA Engine", m_configuration.validationLayersEnabled, m_instance, m_configuration.headless);
 
-		if (glfwCreateWindowSurface(m_instance.instance, m_window, nullptr, &m_device.surface) != VK_SUCCESS) {
+		/*Headless, the device is picked without a surface: nothing is presented.*/
+		if (!m_configuration.headless && glfwCreateWindowSurface(m_instance.instance, m_window, nullptr, &m_device.surface) != VK_SUCCESS) {
 			throw std::runtime_error("ERROR: failed to create window surface!");
 		}
 
 		/*Initializing the engine.*/
 		pickPhysicalDevice(m_instance.instance, m_device);
-		createLogicalDevice(m_device, m_configuration.validationLayersEnabled);
-		createSwapChain(m_swapChain, m_device, m_width_w, m_height_w);
+		createLogicalDevice(m_device, m_configuration.validationLayersEnabled, !m_configuration.no_bindless);
+		m_shaderOptions.bindless = m_device.descriptorIndexing;		// The shaders read the textures the way the descriptors hold them.
+		m_shaderOptions.deferred = m_configuration.deferred;
+		m_shaderOptions.adaptive = m_device.fragmentStores;			// The scene pass keeps the statistics of the adaptive sampling.
+		m_graphicsPipelines.deferred = m_configuration.deferred;
+		m_pendingDeferred = m_configuration.deferred;
+		m_graphicsPipelines.antiAliasing = m_configuration.antiAliasing;
+		m_pendingAntiAliasing = m_configuration.antiAliasing;
+		m_device.msaaSamples = antiAliasingSamples(m_configuration.antiAliasing, m_device);
+		m_governor.enabled = m_configuration.frameTarget > 0.0f;
+		if (!m_configuration.headless) {
+			const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+			if (videoMode != nullptr && videoMode->refreshRate > 0)
+				m_governor.refreshMs = 1000.0f / static_cast<float>(videoMode->refreshRate);
+		}
+		if (m_governor.enabled)
+			m_governor.targetMs = m_configuration.frameTarget;
+		m_graphicsPipelines.scaled = m_governor.enabled;
+		if (m_configuration.headless)
+			createOffscreenSwapChain(m_swapChain, m_commander, m_device, m_width_w, m_height_w, MAX_FRAMES_IN_FLIGHT);
+		else
+			createSwapChain(m_swapChain, m_device, m_width_w, m_height_w);
 		createRenderPass(m_graphicsPipelines, m_device, m_swapChain);
-		createDescriptorSetLayout(m_descriptorData, m_device, m_swapChain);
+		if (m_graphicsPipelines.deferred)
+			createGBufferRenderPass(m_graphicsPipelines, m_device);
+		createDescriptors(m_descriptorData, m_commander, m_device);
 		// auto vertShaderCode = readFile("shaders/main.vert", false);
 		// auto fragShaderCode = readFile("shaders/main.frag", false);
 		// auto spirVShaderCode_vert = compileShader(vertShaderCode, true, "vertexShader");
 		// auto spirVShaderCode_frag = compileShader(fragShaderCode, false, "FragmentSHader");
 		// createGraphicsPipeline(m_graphicsPipeline, m_skymap_pipeline, m_device, m_swapChain, m_descriptorData, spirVShaderCode_vert, spirVShaderCode_frag);
+		m_graphicsPipelines.cache = createPipelineCache(m_device, PIPELINE_CACHE_PATH, m_pipelineCacheWarm);
+		openSpirvArchive(m_spirvArchive, SPIRV_ARCHIVE_PATH);
+		loadShaderIncludes(SHADER_INCLUDE_PATH);
+		startCompileService(m_compiler);
 		this->loadPipelines();
 		createCommandPool(m_commander.pool, m_device);
+		createCommandPool(m_commander.uploadPool, m_device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		createFrameContexts(m_commander, m_device, MAX_FRAMES_IN_FLIGHT);
 		createFramebuffers(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+		createPostProcess(m_postProcess, m_device, loadEngineShader("fullscreen.vert", true), loadEngineShader("fxaa.frag", false),
+			loadEngineShader("upscale.frag", false));
+		if (m_graphicsPipelines.antiAliasing == AA_FXAA || m_graphicsPipelines.scaled)
+			createPostTargets(m_postProcess, m_commander, m_device, m_swapChain, m_graphicsPipelines.scaled, m_graphicsPipelines.cache);
+		m_antiAliasingCosts[m_graphicsPipelines.antiAliasing].first = sceneAttachmentsMB();
+		if (m_graphicsPipelines.deferred) {
+			createGBuffer(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+			writeGBufferDescriptors(m_descriptorData, m_device, m_swapChain);
+			createTileClassification(m_graphicsPipelines, m_device, m_descriptorData, loadEngineShader("classify.comp", false), m_graphicsPipelines.cache);
+		}
 		createSyncObjects(m_sync, m_imagesInFlight, m_device, m_swapChain, MAX_FRAMES_IN_FLIGHT);
 
 		/*SCENE Initalization. Related functionalities.*/
-		m_meshes.push_back(loadMesh(m_commander, m_device, MODEL_PATH, TEXTURE_PATH, m_swapChain.images.size() ));		// Loading veriaty of objects
-		loadVertices(m_skymap_mesh, m_commander, m_device, CUBE_MODEL_PATH);				// Loading skymap vertices (CUBE)
+		createGeometryArena(m_geometry, m_commander, m_device);
+		m_meshes.push_back(loadMesh(m_commander, m_device, MODEL_PATH, TEXTURE_PATH));		// Loading veriaty of objects
+		m_meshes.back().uid = m_nextObjectId++;
+		uploadGeometry(m_geometry, m_commander, m_device, m_meshes.back());
+		uploadInstances(m_geometry, m_commander, m_device, m_meshes.back());
+		loadVertices(m_skymap_mesh, CUBE_MODEL_PATH);				// Loading skymap vertices (CUBE)
+		uploadGeometry(m_geometry, m_commander, m_device, m_skymap_mesh);
+
+		/*GPU culling of the meshes' instances, feeding the draw commands of the arena.*/
+		createCulling(m_culling, m_commander, m_device, m_descriptorData, loadEngineShader("cull.comp", false),
+			loadEngineShader("hiz.comp", false, m_device.maxMsaaSamples != VK_SAMPLE_COUNT_1_BIT ? "#define HIZ_MULTISAMPLED\n" : ""),
+			loadEngineShader("hiz.comp", false), m_graphicsPipelines.cache, MAX_FRAMES_IN_FLIGHT);
+		createHiZ(m_culling, m_commander, m_device, m_swapChain);
+		writeCullingDescriptors(m_culling, m_device, m_geometry);
+
+		/*Adaptive sampling: the light samples of a frame go to the pixels that did not converge yet.*/
+		if (m_descriptorData.adaptiveSet != VK_NULL_HANDLE) {
+			createAdaptiveSampling(m_adaptive, m_commander, m_device, m_descriptorData, loadEngineShader("adaptive.comp", false),
+				loadEngineShader("adaptive.comp", false, "#define ADAPTIVE_BUDGET\n"), m_graphicsPipelines.cache, MAX_FRAMES_IN_FLIGHT);
+			createAdaptiveTargets(m_adaptive, m_commander, m_device, m_swapChain);
+			writeAdaptiveDescriptors(m_descriptorData, m_device, m_adaptive);
+			m_adaptive.enabled = m_configuration.adaptiveSampling;
+		}
+		else if (m_configuration.adaptiveSampling) {
+			printf("[WARNING]: Adaptive sampling needs fragmentStoresAndAtomics, rendering every sample instead\n");
+		}
 		loadEnvironmentMap(SKYMAP_PATHS);
 		m_camera = Camera(m_swapChain.extent.width, m_swapChain.extent.height, 0.1f, 100.0f, 45.0f);
 
-		createUniformBuffers(m_uniformBuffers, m_commander, m_device, m_swapChain, m_meshes.size());
-		initDescriptors(m_descriptorData, m_device, m_swapChain, m_uniformBuffers, m_meshes, m_skymap);
+		createUniformArena(m_uniforms, m_commander, m_device, static_cast<uint32_t>(m_swapChain.images.size()));
+		writeFrameDescriptors(m_descriptorData, m_device, m_uniforms, m_skymap);
+		writeMaterialDescriptors(m_descriptorData, m_commander, m_device, m_meshes.back());
+		writeDrawDescriptors(m_descriptorData, m_device, m_geometry);
 		
-		/*Recording the command buffers.*/
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
-
 		/*Engine is ready!*/
 		m_active = true;
 	}
@@ -930,13 +1778,21 @@ namespace brdfa {
 		}
 
 		// 2: initialize imgui library
-		//this initializes the core structures of imgui
+		//this initializes the core structures of imgui. Its allocations are counted apart from the heap ones (Logs window).
+		ImGui::SetAllocatorFunctions(imguiAllocate, imguiFree);
 		ImGui::CreateContext();
 		//this initializes imgui for GLFW_VULKAN
 		bool initGLFW_V = ImGui_ImplGlfw_InitForVulkan(m_window, true);
-		QueueFamilyIndices families = findQueueFamilies(m_device);
+		startImguiVulkan();
+		return true;
+	}
 
-		//this initializes imgui for Vulkan
+
+	/// <summary>
+	/// Initializes the Vulkan backend of Imgui. Its pipeline is created for the UI render pass, so it is initialized again when
+	/// the pass changes (see applyAntiAliasing).
+	/// </summary>
+	void BRDFA_Engine::startImguiVulkan() {
 		ImGui_ImplVulkan_InitInfo init_info = {};
 		init_info.Instance = m_instance.instance;
 		init_info.PhysicalDevice = m_device.physicalDevice;
@@ -947,13 +1803,12 @@ namespace brdfa {
 		init_info.ImageCount = m_swapChain.images.size();
 		init_info.MSAASamples = m_device.msaaSamples;
 
-		bool initV = ImGui_ImplVulkan_Init(&init_info, m_graphicsPipelines.sceneRenderPass);
+		bool initV = ImGui_ImplVulkan_Init(&init_info, m_graphicsPipelines.uiRenderpass);
 
 		//execute a gpu command to upload imgui font textures
 		VkCommandBuffer cmd = beginSingleTimeCommands(m_commander, m_device);
 		bool createTV = ImGui_ImplVulkan_CreateFontsTexture(cmd);
 		endSingleTimeCommands(m_commander, m_device);
-		return true;
 	}
 
 
@@ -969,8 +1824,8 @@ namespace brdfa {
 		float timeDelta = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastTime).count();
 
 
-		/*Update the camera iff none of the imgui windows are focused.*/
-		if (!m_uistate.focused) { // update camera
+		/*Update the camera iff none of the imgui windows are focused. Headless, the camera of the job stays.*/
+		if (!m_uistate.focused && !m_configuration.headless) { // update camera
 			double xpos, ypos;
 			glfwGetCursorPos(m_window, &xpos, &ypos);
 
@@ -989,62 +1844,117 @@ namespace brdfa {
 		} // end update camera system
 		
 
-		for (size_t i = 0; i < m_meshes.size(); i++) { // setup ubos for meshes
-			size_t ind = i * m_swapChain.images.size() + currentImage;
-			MVPMatrices ubo{};
-			ubo.model = m_meshes[i].getFinalTransformation();			//glm::rotate(modelTr, time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-			ubo.view = m_camera.transformation;				//glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-			ubo.proj = m_camera.projection;					//glm::perspective(glm::radians(45.0f), m_swapChain.extent.width / (float)m_swapChain.extent.height, 0.1f, 10.0f);
-			ubo.pos_c = m_camera.position;
-			ubo.render_opt = glm::vec3(m_meshes[i].extra[0], m_meshes[i].extra[1], static_cast<float>(m_meshes[i].samples));
-
-			void* data;
-			vkMapMemory(m_device.device, m_uniformBuffers[ind].memory, 0, sizeof(ubo), 0, &data);
-			memcpy(data, &ubo, sizeof(ubo));
-			vkUnmapMemory(m_device.device, m_uniformBuffers[ind].memory);
-
-			vkMapMemory(m_device.device, m_meshes[i].paramsBuffer[currentImage].memory, 0, sizeof(m_meshes[i].params), 0, &data);
-			memcpy(data, &m_meshes[i].params, sizeof(m_meshes[i].params));
-			vkUnmapMemory(m_device.device, m_meshes[i].paramsBuffer[currentImage].memory);
-		}// end setup ubos 
+		/*Camera block of the frame*/
+		CameraUniforms camera{};
+		camera.view = m_camera.transformation;				//glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		camera.proj = m_camera.projection;					//glm::perspective(glm::radians(45.0f), m_swapChain.extent.width / (float)m_swapChain.extent.height, 0.1f, 10.0f);
+		camera.pos_c = m_camera.position;
+
+		/*Moving the camera or re-recording an object changes the picture: the history of the governor and the statistics of
+		  the adaptive sampling start over.*/
+		glm::mat4 viewProj = camera.proj * camera.view;
+		if (viewProj != m_lastViewProj || m_commander.recordedSecondaries != m_lastSecondaries) {
+			resetAccumulation(m_governor);
+			m_adaptive.reset = true;
+		}
+		m_lastViewProj = viewProj;
+		m_lastSecondaries = m_commander.recordedSecondaries;
+
+		stepGovernor(camera, timeDelta * 1000.0f);
+		if (m_adaptive.enabled && !m_graphicsPipelines.deferred)
+			m_commander.depthPrepass = true;				// Only the visible fragments may write the statistics.
+		camera.adaptive = m_adaptive.enabled ? (m_adaptive.heatmap ? 2 : 1) : 0;
+		camera.adaptiveMax = m_adaptive.maxSamples;
+		/*The deferred passes rebuild the world positions out of the G-buffer depth and their pixel in the scene extent.*/
+		VkExtent2D sceneExtent = (m_commander.renderExtent.width > 0 && m_commander.renderExtent.height > 0) ? m_commander.renderExtent : m_swapChain.extent;
+		camera.inverseViewProj = glm::inverse(viewProj);
+		camera.viewport = glm::vec4(sceneExtent.width, sceneExtent.height, 1.0f / sceneExtent.width, 1.0f / sceneExtent.height);
+		writeCameraUniforms(m_uniforms, currentImage, camera);
+		beginCullFrame(m_culling, m_currentFrame, viewProj);
+		beginAdaptiveFrame(m_adaptive, m_currentFrame);
+		/*The objects have nothing to write here: their draw records are updated by the scene buffer (see recordDrawData()).*/
 		
 		lastTime = currentTime;
 	}
 
 
+	/// <summary>
+	/// Steps the frame-time governor with the time of the last frame. A new render scale re-records the scene secondaries, which
+	/// set their viewport from it. The adaptive sampling owns the samples of the pixels: the governor has no sample cap to lower then.
+	/// </summary>
+	/// <param name="camera">Camera block of the frame, gets the sample block to evaluate</param>
+	/// <param name="frameMs">Interval between the last two frames in milliseconds. Used without GPU timestamps only.</param>
+	void BRDFA_Engine::stepGovernor(CameraUniforms& camera, const float& frameMs) {
+		m_governor.maxSamples = 1;
+		if (!m_adaptive.enabled) {
+			for (const auto& mesh : m_meshes)
+				m_governor.maxSamples = std::max(m_governor.maxSamples, mesh.samples);
+		}
+
+		/*The governor holds the GPU time of the scene buffer: the work its scale and samples change. Without timestamps it takes
+		  the interval between the frames, which includes the wait for the display under FIFO, so no target below the refresh
+		  period is taken then (it could never be reached, whatever the scale and samples).*/
+		bool gpuTimed = m_commander.timestamps != VK_NULL_HANDLE;
+		bool vsync = m_swapChain.presentMode == VK_PRESENT_MODE_FIFO_KHR || m_swapChain.presentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		m_governor.minTargetMs = (!gpuTimed && vsync) ? m_governor.refreshMs : 0.0f;
+		m_governor.targetMs = std::max(m_governor.targetMs, m_governor.minTargetMs);
+
+		bool scaled = m_graphicsPipelines.scaled;
+		if (scaled)
+			updateGovernor(m_governor, gpuTimed ? m_commander.gpuFrameMs : frameMs);
+
+		VkExtent2D extent = scaled ? governedExtent(m_governor, m_swapChain.extent) : VkExtent2D{ 0, 0 };
+		if (extent.width != m_commander.renderExtent.width || extent.height != m_commander.renderExtent.height) {
+			m_commander.renderExtent = extent;
+			m_culling.renderScale = scaled ? m_governor.scale : 1.0f;
+			invalidateSceneCommands(m_commander, m_meshes);
+		}
+
+		camera.sampleCap = scaled ? m_governor.sampleCap : 0;
+		camera.sampleOffset = static_cast<int32_t>(m_governor.sampleOffset);
+	}
+
+
 	/// <summary>
 	/// private member function to render.
 	/// </summary>
 	/// <param name="imageIndex">The image Index currently being processed. (Inflag image)</param>
 	void BRDFA_Engine::render(uint32_t imageIndex) {
 		auto startTime = std::chrono::high_resolution_clock::now();
-		this->drawUI(imageIndex);
-		
-		if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-			vkWaitForFences(m_device.device, 1, &m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
-		}
+		bool headless = m_configuration.headless;
+		if (!headless)
+			this->drawUI(imageIndex);
+
+		/*Recording and submitting the frame. Like the rest of the frame, it must not allocate anything in the steady state.*/
 		m_imagesInFlight[imageIndex] = m_sync[m_currentFrame].f_inFlight;
 
+		/*The previous submission of the image is done: re-recording the objects that changed since.*/
+		recordSceneCommands(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_geometry, m_culling, m_swapChain, m_postProcess, m_governor, m_adaptive, m_meshes, m_skymap_mesh, m_skymap_pipeline, imageIndex, m_currentFrame);
+		if (!headless)
+			updateUICommandBuffers(m_commander, m_graphicsPipelines, m_swapChain, m_postProcess, imageIndex, m_currentFrame);
+
+		/*Headless, the image is not acquired nor presented: the scene buffer is submitted alone, without semaphores.*/
 		VkSemaphore waitSemaphores[] = { m_sync[m_currentFrame].s_imageAvailable };
 		VkSemaphore signalSemaphores[] = { m_sync[m_currentFrame].s_renderFinished };
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
-		std::vector<VkCommandBuffer> commands = { m_commander.sceneBuffers[imageIndex], m_commander.uiBuffers[imageIndex] };
+		VkCommandBuffer commands[] = { m_commander.frames[m_currentFrame].sceneBuffer, m_commander.frames[m_currentFrame].uiBuffer };
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
-		submitInfo.commandBufferCount = static_cast<uint32_t>(commands.size());
-		submitInfo.pCommandBuffers = commands.data();
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.commandBufferCount = headless ? 1 : 2;
+		submitInfo.pCommandBuffers = commands;
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
 		vkResetFences(m_device.device, 1, &m_sync[m_currentFrame].f_inFlight);
 		if (vkQueueSubmit(m_device.graphicsQueue, 1, &submitInfo, m_sync[m_currentFrame].f_inFlight) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		m_frameNumber++;
 
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1056,7 +1966,7 @@ namespace brdfa {
 		presentInfo.pSwapchains = swapChains;
 		presentInfo.pImageIndices = &imageIndex;		
 
-		VkResult result = vkQueuePresentKHR(m_device.presentQueue, &presentInfo);
+		VkResult result = headless ? VK_SUCCESS : vkQueuePresentKHR(m_device.presentQueue, &presentInfo);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_frameBufferResized) {
 			m_frameBufferResized = false;
 			recreate();
@@ -1065,12 +1975,20 @@ namespace brdfa {
 			throw std::runtime_error("failed to present swap chain image!");
 		}
 
+		/*The edited BRDFs are on screen now.*/
+		for (const auto& brdfName : m_awaitingVisible) {
+			m_editLatency[brdfName] = { std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - m_editStart.at(brdfName)).count(), 0.0f };
+		}
+		m_awaitingVisible.clear();
+
 		if (this->saveShot)
 			record(m_currentFrame);
 
 		auto endtime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float, std::chrono::seconds::period>(endtime - startTime).count();
 		m_uistate.timePerFrame = (m_uistate.timePerFrame > 0.0f)? (m_uistate.timePerFrame + time * 1000.0f) / 2.0f : time * 1000.0f;
+		m_antiAliasingCosts[m_graphicsPipelines.antiAliasing].second = m_uistate.timePerFrame;
+		m_shadingCosts[m_graphicsPipelines.deferred ? 1 : 0] = m_uistate.timePerFrame;
 	}
 
 	/// <summary>
@@ -1299,7 +2217,6 @@ namespace brdfa {
 
 		// Update the m_uistate and checks if any of the imgui windows are focused.
 		m_uistate.focused = ImGui::IsWindowFocused(ImGuiFocusedFlags_AnyWindow);
-		updateUICommandBuffers(m_commander, m_device, m_graphicsPipelines, m_swapChain, imageIndex);
 	}
 
 
@@ -1308,17 +2225,29 @@ namespace brdfa {
 	/// </summary>
 	void BRDFA_Engine::cleanup() {
 		vkDeviceWaitIdle(m_device.device);
+		destroyRetiredPipelines(true);
 
 		/*Clearing up the swapchain resources.*/
 		/*clearn the depth Image buffer*/
 		vkDestroyImageView(m_device.device, m_swapChain.depthImage.view, nullptr);
 		vkDestroyImage(m_device.device, m_swapChain.depthImage.obj, nullptr);
 		vkFreeMemory(m_device.device, m_swapChain.depthImage.memory, nullptr);
+		destroyHiZ(m_culling, m_device);					// Built from the depth image.
+		destroyAdaptiveTargets(m_adaptive, m_device);		// Sized as the swapchain.
+		destroyGBuffer(m_swapChain, m_device);
+		destroyPostTargets(m_postProcess, m_device);		// Reads the color image.
 
 		/*clearn the color Image buffer*/
 		vkDestroyImageView(m_device.device, m_swapChain.colorImage.view, nullptr);
 		vkDestroyImage(m_device.device, m_swapChain.colorImage.obj, nullptr);
 		vkFreeMemory(m_device.device, m_swapChain.colorImage.memory, nullptr);
+		m_swapChain.colorImage = Image();						// Not allocated when anti-aliasing is off.
+		if (m_swapChain.sceneImage.obj != VK_NULL_HANDLE) {
+			vkDestroyImageView(m_device.device, m_swapChain.sceneImage.view, nullptr);
+			vkDestroyImage(m_device.device, m_swapChain.sceneImage.obj, nullptr);
+			vkFreeMemory(m_device.device, m_swapChain.sceneImage.memory, nullptr);
+			m_swapChain.sceneImage = Image();
+		}
 		/*Clearing framebuffers*/
 		for (auto framebuffer : m_swapChain.framebuffers) {
 			vkDestroyFramebuffer(m_device.device, framebuffer, nullptr);
@@ -1326,41 +2255,50 @@ namespace brdfa {
 
 
 		/*Deleting all the current allocated command buffers*/
-		vkFreeCommandBuffers(m_device.device, m_commander.pool, static_cast<uint32_t>(m_commander.sceneBuffers.size()), m_commander.sceneBuffers.data());
-		m_commander.sceneBuffers.clear();
+		freeSceneCommandBuffers(m_commander, m_device);
 
 		/*Clearing the Graphics pipeline*/
 		for (auto& it : m_graphicsPipelines.pipelines) {
 			vkDestroyPipeline(m_device.device, it.second , nullptr);
 		}
 		m_graphicsPipelines.pipelines.clear();
+		for (auto& it : m_graphicsPipelines.variants) {
+			vkDestroyPipeline(m_device.device, it.second, nullptr);
+		}
+		m_graphicsPipelines.variants.clear();
+		destroyPipelineLibraries(m_graphicsPipelines, m_device);
 
 		vkDestroyPipeline(m_device.device, m_skymap_pipeline, nullptr);
+		vkDestroyPipeline(m_device.device, m_graphicsPipelines.depthPipeline, nullptr);
+		vkDestroyPipeline(m_device.device, m_graphicsPipelines.gbufferPipeline, nullptr);
+		m_graphicsPipelines.gbufferPipeline = VK_NULL_HANDLE;
 		
 		vkDestroyPipelineLayout(m_device.device, m_graphicsPipelines.layout, nullptr);
 		vkDestroyRenderPass(m_device.device, m_graphicsPipelines.sceneRenderPass, nullptr);
+		vkDestroyRenderPass(m_device.device, m_graphicsPipelines.uiRenderpass, nullptr);
+		vkDestroyRenderPass(m_device.device, m_graphicsPipelines.gbufferRenderPass, nullptr);
+		m_graphicsPipelines.gbufferRenderPass = VK_NULL_HANDLE;
 
 		/*Delete the remaining swapchain objects*/
-		for (auto imageView : m_swapChain.imageViews) {
-			vkDestroyImageView(m_device.device, imageView, nullptr);
+		if (m_configuration.headless) {
+			destroyOffscreenSwapChain(m_swapChain, m_device);
+		}
+		else {
+			for (auto imageView : m_swapChain.imageViews) {
+				vkDestroyImageView(m_device.device, imageView, nullptr);
+			}
+			vkDestroySwapchainKHR(m_device.device, m_swapChain.swapChain, nullptr);
 		}
-		vkDestroySwapchainKHR(m_device.device, m_swapChain.swapChain, nullptr);
 
 		/*Clearing the Objects related data to recreate them.*/
-		/*Deleting the uniform buffers.*/
-		for (size_t i = 0; i < m_swapChain.images.size() * m_meshes.size(); i++) {
-			vkDestroyBuffer(m_device.device, m_uniformBuffers[i].obj, nullptr);
-			vkFreeMemory(m_device.device, m_uniformBuffers[i].memory, nullptr);
-		}
+		/*Deleting the uniform arena. The object slots are kept.*/
+		destroyUniformArena(m_uniforms, m_device);
 
 		/*Cleaning the skymap image*/
 		vkDestroyImageView(m_device.device, m_skymap.view, nullptr);
 		vkDestroyImage(m_device.device, m_skymap.obj, nullptr);
 		vkFreeMemory(m_device.device, m_skymap.memory, nullptr);
 		vkDestroySampler(m_device.device, m_skymap.sampler, nullptr);
-
-
-		vkDestroyDescriptorPool(m_device.device, m_descriptorData.pool, nullptr);
 	}
 
 
@@ -1375,13 +2313,15 @@ namespace brdfa {
 			glfwWaitEvents();
 		}
 		vkDeviceWaitIdle(m_device.device);
+		joinPipelineWorkers();
 
 		cleanup();
 
 		/*Vulkan Re-initialization.*/
 		createSwapChain(m_swapChain, m_device, m_width_w, m_height_w);
 		createRenderPass(m_graphicsPipelines, m_device, m_swapChain);
-		createDescriptorSetLayout(m_descriptorData, m_device, m_swapChain);
+		if (m_graphicsPipelines.deferred)
+			createGBufferRenderPass(m_graphicsPipelines, m_device);
 		// auto vertShaderCode = readFile("shaders/main.vert", false);
 		// auto fragShaderCode = readFile("shaders/main.frag", false);
 		// auto spirVShaderCode_vert = compileShader(vertShaderCode, true, "vertexShader");
@@ -1390,48 +2330,270 @@ namespace brdfa {
 		// loadPipelines();
 		createPipelineLayout(m_graphicsPipelines, m_device, m_descriptorData);
 		createFramebuffers(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+		if (m_graphicsPipelines.antiAliasing == AA_FXAA || m_graphicsPipelines.scaled)
+			createPostTargets(m_postProcess, m_commander, m_device, m_swapChain, m_graphicsPipelines.scaled, m_graphicsPipelines.cache);
+		resetAccumulation(m_governor);						// The history images are new.
+		m_antiAliasingCosts[m_graphicsPipelines.antiAliasing].first = sceneAttachmentsMB();
+		createHiZ(m_culling, m_commander, m_device, m_swapChain);
+		if (m_adaptive.supported) {
+			createAdaptiveTargets(m_adaptive, m_commander, m_device, m_swapChain);
+			writeAdaptiveDescriptors(m_descriptorData, m_device, m_adaptive);
+		}
+		if (m_graphicsPipelines.deferred) {
+			createGBuffer(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+			writeGBufferDescriptors(m_descriptorData, m_device, m_swapChain);
+		}
 
 
 		/*Meshes dependent*/
 		this->loadEnvironmentMap(SKYMAP_PATHS);
 
-		createUniformBuffers(m_uniformBuffers, m_commander, m_device, m_swapChain, m_meshes.size());
-		initDescriptors(m_descriptorData, m_device, m_swapChain, m_uniformBuffers, m_meshes, m_skymap);
+		createUniformArena(m_uniforms, m_commander, m_device, static_cast<uint32_t>(m_swapChain.images.size()));
+
+		/*The material sets are kept. The frame sets point at the new arena (and skymap).*/
+		writeFrameDescriptors(m_descriptorData, m_device, m_uniforms, m_skymap);
 
 		/*Loading the main pipeline*/
-		m_vertSpirv = readFile(SHADERS_PATH + "/vert.spv", true);
-		auto frag_main_shader_code = readFile(SHADERS_PATH + "/basic.spv", true);
+		m_vertSpirv = loadEngineShader("main.vert", true);
+		createScenePipelines();
+		if (m_graphicsPipelines.deferred)
+			createGBufferPipeline(m_graphicsPipelines, m_device, m_swapChain, m_vertSpirv, loadEngineShader("gbuffer.frag", false), m_graphicsPipelines.cache);
+
+		invalidateSceneCommands(m_commander, m_meshes);
+
+
+
+		/*Syncronization objects re-initialization.*/
+		m_imagesInFlight.resize(m_swapChain.images.size(), VK_NULL_HANDLE);
+
+		if (this->m_latest_skymap.size() > 0)
+			this->reloadSkymap(this->m_latest_skymap);
+	}
+
+
+
+	/// <summary>
+	/// Creates the pipelines drawn in the scene render pass: the pipeline libraries, the "None", skymap and depth pre-pass pipelines,
+	/// and the BRDF pipelines (with the variants of the objects) out of their latest SPIR-V. The render pass and layout must exist.
+	/// </summary>
+	void BRDFA_Engine::createScenePipelines() {
+		if (m_device.pipelineLibrary)
+			createPipelineLibraries(m_graphicsPipelines, m_device, m_swapChain, m_graphicsPipelines.cache);
+
+		auto frag_main_shader_code = loadEngineShader("minimal.frag", false);
 		m_graphicsPipelines.pipelines.insert({ "None" , {} });
 		createGraphicsPipeline(
 			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
 			m_graphicsPipelines.pipelines.at("None"), m_skymap_pipeline,
-			m_device, m_swapChain, m_descriptorData, m_vertSpirv, frag_main_shader_code, false);
+			m_device, m_swapChain, m_descriptorData, m_vertSpirv, frag_main_shader_code, false, nullptr, m_graphicsPipelines.cache, m_graphicsPipelines.vertModule);
 
 		/*Reloading the skymap pipeline*/
-		auto vert_sky_shader_code = readFile(SHADERS_PATH + "/skybox.vert.spv", true);
-		auto frag_sky_shader_code = readFile(SHADERS_PATH + "/skybox.frag.spv", true);
+		auto vert_sky_shader_code = loadEngineShader("skybox.vert", true);
+		auto frag_sky_shader_code = loadEngineShader("skybox.frag", false);
 		createGraphicsPipeline(
 			m_graphicsPipelines.layout, m_graphicsPipelines.sceneRenderPass,
 			m_graphicsPipelines.pipelines.begin()->second, m_skymap_pipeline,
 			m_device, m_swapChain, m_descriptorData,
-			vert_sky_shader_code, frag_sky_shader_code, true);
+			vert_sky_shader_code, frag_sky_shader_code, true, nullptr, m_graphicsPipelines.cache);
+		createDepthPipeline(m_graphicsPipelines, m_device, m_swapChain, m_vertSpirv, m_graphicsPipelines.cache);
 
+		/*BRDFs without a SPIR-V (hot-loaded, or failing to compile for the shading mode) have no pipeline.*/
 		for (const auto& brdf : m_loadedBrdfs) {
-			recreatePipeline(brdf.first, brdf.second.latest_spir_v, false);
+			if (!brdf.second.latest_spir_v.empty())
+				recreatePipeline(brdf.first, brdf.second.latest_spir_v, false);
 		}
 		for (const auto& brdf : m_costumBrdfs) {
-			recreatePipeline(brdf.first, brdf.second.latest_spir_v, false);
+			if (!brdf.second.latest_spir_v.empty())
+				recreatePipeline(brdf.first, brdf.second.latest_spir_v, false);
 		}
+	}
 
-		recordCommandBuffers(m_commander, m_device, m_graphicsPipelines, m_descriptorData, m_swapChain, m_meshes, m_skymap_mesh, m_skymap_pipeline);
 
+	/// <summary>
+	/// Device memory of the scene attachments the current mode allocated: the color attachment (none when off), the depth attachment
+	/// and the MSAA resolve target of the governed scene.
+	/// </summary>
+	/// <returns>Megabytes</returns>
+	float BRDFA_Engine::sceneAttachmentsMB() const {
+		VkDeviceSize bytes = m_swapChain.colorImage.size + m_swapChain.depthImage.size + m_swapChain.sceneImage.size;
+		return static_cast<float>(bytes) / (1024.0f * 1024.0f);
+	}
 
 
-		/*Syncronization objects re-initialization.*/
-		m_imagesInFlight.resize(m_swapChain.images.size(), VK_NULL_HANDLE);
+	/// <summary>
+	/// Switches the anti-aliasing mode, and moves the scene offscreen (or back) when the governor is switched. Only what depends on
+	/// the sample count or on the targets of the scene pass is rebuilt: the color and depth attachments, the framebuffers, the Hi-Z
+	/// pyramid, the post pass targets, the scene and UI render passes and the pipelines drawn in them. The swapchain, descriptors,
+	/// uniforms, G-buffer and environment map are kept.
+	/// </summary>
+	/// <param name="mode"></param>
+	void BRDFA_Engine::applyAntiAliasing(const AntiAliasing& mode) {
+		vkDeviceWaitIdle(m_device.device);
+		joinPipelineWorkers();
 
-		if (this->m_latest_skymap.size() > 0)
-			this->reloadSkymap(this->m_latest_skymap);
+		/*Sample dependent resources*/
+		destroyPostTargets(m_postProcess, m_device);
+		destroyHiZ(m_culling, m_device);
+		vkDestroyImageView(m_device.device, m_swapChain.depthImage.view, nullptr);
+		vkDestroyImage(m_device.device, m_swapChain.depthImage.obj, nullptr);
+		vkFreeMemory(m_device.device, m_swapChain.depthImage.memory, nullptr);
+		vkDestroyImageView(m_device.device, m_swapChain.colorImage.view, nullptr);
+		vkDestroyImage(m_device.device, m_swapChain.colorImage.obj, nullptr);
+		vkFreeMemory(m_device.device, m_swapChain.colorImage.memory, nullptr);
+		m_swapChain.colorImage = Image();						// Not allocated when anti-aliasing is off.
+		if (m_swapChain.sceneImage.obj != VK_NULL_HANDLE) {
+			vkDestroyImageView(m_device.device, m_swapChain.sceneImage.view, nullptr);
+			vkDestroyImage(m_device.device, m_swapChain.sceneImage.obj, nullptr);
+			vkFreeMemory(m_device.device, m_swapChain.sceneImage.memory, nullptr);
+			m_swapChain.sceneImage = Image();
+		}
+		for (auto framebuffer : m_swapChain.framebuffers) {
+			vkDestroyFramebuffer(m_device.device, framebuffer, nullptr);
+		}
+
+		/*Pipelines of the scene pass*/
+		for (auto& it : m_graphicsPipelines.pipelines) {
+			vkDestroyPipeline(m_device.device, it.second, nullptr);
+		}
+		m_graphicsPipelines.pipelines.clear();
+		for (auto& it : m_graphicsPipelines.variants) {
+			vkDestroyPipeline(m_device.device, it.second, nullptr);
+		}
+		m_graphicsPipelines.variants.clear();
+		destroyPipelineLibraries(m_graphicsPipelines, m_device);
+		vkDestroyPipeline(m_device.device, m_skymap_pipeline, nullptr);
+		vkDestroyPipeline(m_device.device, m_graphicsPipelines.depthPipeline, nullptr);
+		vkDestroyRenderPass(m_device.device, m_graphicsPipelines.sceneRenderPass, nullptr);
+		vkDestroyRenderPass(m_device.device, m_graphicsPipelines.uiRenderpass, nullptr);
+
+		/*Governed or not, the scale and samples start from the full ones.*/
+		if (m_governor.enabled != m_graphicsPipelines.scaled) {
+			resetGovernor(m_governor);
+			printf("[INFO]: Frame-time governor %s\n", m_governor.enabled ? "on" : "off");
+		}
+		m_graphicsPipelines.scaled = m_governor.enabled;
+		m_graphicsPipelines.antiAliasing = mode;
+		m_device.msaaSamples = antiAliasingSamples(mode, m_device);
+		createRenderPass(m_graphicsPipelines, m_device, m_swapChain);
+		createFramebuffers(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+		if (mode == AA_FXAA || m_graphicsPipelines.scaled)
+			createPostTargets(m_postProcess, m_commander, m_device, m_swapChain, m_graphicsPipelines.scaled, m_graphicsPipelines.cache);
+		resetAccumulation(m_governor);
+		m_adaptive.reset = true;							// The samples of a pixel are not the same ones.
+		createHiZ(m_culling, m_commander, m_device, m_swapChain);
+		createScenePipelines();
+		invalidateSceneCommands(m_commander, m_meshes);
+
+		/*The UI pipeline follows the UI render pass. No UI when headless.*/
+		if (!m_configuration.headless) {
+			ImGui_ImplVulkan_Shutdown();
+			startImguiVulkan();
+			ImGui_ImplVulkan_DestroyFontUploadObjects();
+		}
+
+		/*The frame time of the new mode is measured from scratch.*/
+		m_antiAliasingCosts[mode].first = sceneAttachmentsMB();
+		m_uistate.timePerFrame = 0.0f;
+		printf("[INFO]: Anti-aliasing: %s (%d samples)\n", antiAliasingName(mode), static_cast<int>(m_device.msaaSamples));
+	}
+
+
+
+	/// <summary>
+	/// Switches between forward and deferred shading. The G-buffer, its render pass and pipeline and the tile classification are
+	/// created (or destroyed), and the scene pipelines are rebuilt: their vertex shader and the BRDF fragment shaders (compiled with
+	/// BRDFA_DEFERRED or without) differ between the modes. The render passes, targets and descriptors of the scene are kept.
+	/// </summary>
+	/// <param name="deferred"></param>
+	void BRDFA_Engine::applyShadingMode(const bool& deferred) {
+		vkDeviceWaitIdle(m_device.device);
+		joinPipelineWorkers();
+
+		/*Pipelines of the scene pass and of the pre-pass*/
+		for (auto& it : m_graphicsPipelines.pipelines) {
+			vkDestroyPipeline(m_device.device, it.second, nullptr);
+		}
+		m_graphicsPipelines.pipelines.clear();
+		for (auto& it : m_graphicsPipelines.variants) {
+			vkDestroyPipeline(m_device.device, it.second, nullptr);
+		}
+		m_graphicsPipelines.variants.clear();
+		destroyPipelineLibraries(m_graphicsPipelines, m_device);
+		vkDestroyPipeline(m_device.device, m_skymap_pipeline, nullptr);
+		vkDestroyPipeline(m_device.device, m_graphicsPipelines.depthPipeline, nullptr);
+		vkDestroyPipeline(m_device.device, m_graphicsPipelines.gbufferPipeline, nullptr);
+		m_graphicsPipelines.gbufferPipeline = VK_NULL_HANDLE;
+		vkDestroyShaderModule(m_device.device, m_graphicsPipelines.vertModule, nullptr);
+
+		m_graphicsPipelines.deferred = deferred;
+		m_shaderOptions.deferred = deferred;
+		if (deferred) {
+			createGBufferRenderPass(m_graphicsPipelines, m_device);
+			createGBuffer(m_swapChain, m_commander, m_device, m_graphicsPipelines);
+			writeGBufferDescriptors(m_descriptorData, m_device, m_swapChain);
+			createTileClassification(m_graphicsPipelines, m_device, m_descriptorData, loadEngineShader("classify.comp", false), m_graphicsPipelines.cache);
+		}
+		else {
+			destroyTileClassification(m_graphicsPipelines, m_device);
+			destroyGBuffer(m_swapChain, m_device);
+			vkDestroyRenderPass(m_device.device, m_graphicsPipelines.gbufferRenderPass, nullptr);
+			m_graphicsPipelines.gbufferRenderPass = VK_NULL_HANDLE;
+		}
+		m_graphicsPipelines.vertModule = createShaderModule(m_device, deferred ? loadEngineShader("tiles.vert", true) : m_vertSpirv);
+
+		/*The editor compilations still running were started with the options of the other mode. Dropped, and requested again.*/
+		for (auto* panels : { &m_loadedBrdfs, &m_costumBrdfs }) {
+			for (auto& it : *panels) {
+				if (m_editorCompiles.find(it.first) == m_editorCompiles.end()) continue;
+				it.second.generation->fetch_add(1);
+				it.second.compiling = false;
+				it.second.compilePending = true;
+			}
+		}
+		m_editorCompiles.clear();
+
+		/*The BRDFs that own a SPIR-V are rebuilt for the mode, from the archive or on the compile service workers.*/
+		ShaderCompileOptions options = cachedShaderOptions();
+		std::vector<std::pair<BRDF_Panel*, std::future<CompileResult>>> compiles;
+		for (auto* panels : { &m_loadedBrdfs, &m_costumBrdfs }) {
+			for (auto& it : *panels) {
+				BRDF_Panel& panel = it.second;
+				if (panel.latest_spir_v.empty()) continue;
+				std::string brdfText = panel.glslPanel.GetText();
+				panel.spirvKey = fragShaderKey(brdfText, panel.brdfName, options);
+				if (findSpirv(m_spirvArchive, panel.spirvKey, panel.latest_spir_v)) continue;
+				compiles.push_back({ &panel, submitCompile(m_compiler, assembleFragShader(brdfText, panel.brdfName), false, panel.brdfName, options, INTERACTIVE_PRIORITY) });
+			}
+		}
+		for (auto& it : compiles) {
+			BRDF_Panel& panel = *it.first;
+			CompileResult result = it.second.get();
+			panel.log_e = result.log;
+			if (!result.success) {
+				printf("[WARNING]: BRDF \"%s\" does not compile for %s shading. It is not drawn.\n", panel.brdfName.c_str(), deferred ? "deferred" : "forward");
+				panel.latest_spir_v.clear();
+				panel.spirvKey = 0;
+				continue;
+			}
+			panel.latest_spir_v = std::move(result.spirv);
+			archiveSpirv(panel.spirvKey, panel.latest_spir_v);
+		}
+		for (auto* panels : { &m_loadedBrdfs, &m_costumBrdfs }) {
+			for (auto& it : *panels) {
+				if (!it.second.latest_spir_v.empty())
+					it.second.cost = analyzeShaderCost(it.second.latest_spir_v);
+			}
+		}
+
+		createScenePipelines();
+		if (deferred)
+			createGBufferPipeline(m_graphicsPipelines, m_device, m_swapChain, m_vertSpirv, loadEngineShader("gbuffer.frag", false), m_graphicsPipelines.cache);
+		invalidateSceneCommands(m_commander, m_meshes);
+		m_adaptive.reset = true;
+
+		/*The frame time of the new mode is measured from scratch.*/
+		m_uistate.timePerFrame = 0.0f;
+		printf("[INFO]: Shading: %s\n", deferred ? "deferred" : "forward");
 	}
 
 
@@ -1453,16 +2615,18 @@ namespace brdfa {
 
 		// Rendering Meshes data. (Per mesh.)
 		for (int i = 0; i < m_meshes.size(); i++) {
-			std::string curObj = "Object_" + std::to_string(i + 1);
+			char curObj[32];
+			snprintf(curObj, sizeof(curObj), "Object_%d", i + 1);
 			const char* current_item = m_meshes[i].renderOption.c_str(); //m_uistate.optionLabels[m_meshes[i].renderOption];
 
 			// Starting the section of the object
 			//
-			ImGui::BeginChild(curObj.data(), ImVec2(0.0f, button_sz * (12.0f + float(m_meshes[i].shownParameters)*1.2f)), false);
+			ImGui::BeginChild(curObj, ImVec2(0.0f, button_sz * (18.0f + float(m_meshes[i].shownParameters)*1.2f)), false);
+			bool edited = false;		// The object is re-recorded when one of its values changes.
 
 			{// Tab menu of the object
-				ImGui::BeginTabBar(curObj.data());
-				ImGui::BeginTabItem(curObj.data());
+				ImGui::BeginTabBar(curObj);
+				ImGui::BeginTabItem(curObj);
 				ImGui::EndTabItem();
 				ImGui::EndTabBar();
 			} // Tab menu of the object
@@ -1484,29 +2648,31 @@ namespace brdfa {
 							}
 						}
 					}
-					if (refreshEngine)
+					if (refreshEngine) {
+						selectSampleVariant(i);
 						refreshObject(i);
+					}
 					ImGui::EndCombo();
 				}
 			} // Rendering_options rendered
 			ImGui::Separator();
 			{ // Object Translation option
 				float trans[3] = { m_meshes[i].translation[0] , m_meshes[i].translation[1], m_meshes[i].translation[2] };
-				ImGui::DragFloat3("Translation", trans, 0.01f);
+				edited |= ImGui::DragFloat3("Translation", trans, 0.01f);
 				m_meshes[i].translation[0] = trans[0];
 				m_meshes[i].translation[1] = trans[1];
 				m_meshes[i].translation[2] = trans[2];
 			} // Object Translation option
 			{ // Object Scale option
 				float trans[3] = { m_meshes[i].scale[0] , m_meshes[i].scale[1], m_meshes[i].scale[2] };
-				ImGui::DragFloat3("Scaler", trans, 0.01f);
+				edited |= ImGui::DragFloat3("Scaler", trans, 0.01f);
 				m_meshes[i].scale[0] = trans[0];
 				m_meshes[i].scale[1] = trans[1];
 				m_meshes[i].scale[2] = trans[2];
 			} // Object scale option
 			{ // Object Scale option
 				float trans[3] = { m_meshes[i].rotation[0] , m_meshes[i].rotation[1], m_meshes[i].rotation[2] };
-				ImGui::DragFloat3("Rotation", trans, 0.05f);
+				edited |= ImGui::DragFloat3("Rotation", trans, 0.05f);
 				m_meshes[i].rotation = glm::vec3(trans[0], trans[1], trans[2]);
 			} // Object scale option
 			ImGui::Separator();
@@ -1521,8 +2687,9 @@ namespace brdfa {
 				ImGui::PushItemWidth(iw * 0.5);
 				/*Draw the extra parameters inputs*/
 				for (int j = 0; j < m_meshes[i].shownParameters; j++) {
-					std::string label = std::string("iParameter") + std::to_string(j);
-					ImGui::DragFloat(label.c_str(), &prms[j], 0.001f, 0.0f, 1.0f, "%.4f", 1.0f);
+					char label[16];
+					snprintf(label, sizeof(label), "iParameter%d", j);
+					edited |= ImGui::DragFloat(label, &prms[j], 0.001f, 0.0f, 1.0f, "%.4f", 1.0f);
 				}
 
 				/*Add/delete parameters buttons*/
@@ -1530,6 +2697,7 @@ namespace brdfa {
 					if (ImGui::Button("-", ImVec2(50, 0))) {
 						prms[m_meshes[i].shownParameters - 1] = 0.0;
 						m_meshes[i].shownParameters--;
+						edited = true;
 					}
 				}
 				if (m_meshes[i].shownParameters > 0 && m_meshes[i].shownParameters < 9) 
@@ -1548,9 +2716,39 @@ namespace brdfa {
 			} // Object extra parameters
 			ImGui::Separator();
 			{
-				ImGui::InputInt("Light Samples", &m_meshes[i].samples, 1, 10);
+				if (ImGui::InputInt("Light Samples", &m_meshes[i].samples, 1, 10)) {
+					edited = true;
+					selectSampleVariant(i);
+				}
 				ImGui::PopItemWidth();
 			}
+			if (edited) refreshObject(i);		// The transformation, parameters and samples are in the draw record of the object.
+			ImGui::Separator();
+			{ // Instance grid: copies of the object drawn in one call, sweeping two parameters
+				const char* parameterLabels[] = { "iParameter0", "iParameter1", "iParameter2", "iParameter3", "iParameter4",
+					"iParameter5", "iParameter6", "iParameter7", "iParameter8" };
+				float iw = ImGui::CalcItemWidth();
+				ImGui::PushItemWidth(iw * 0.5f);
+				ImGui::InputInt2("Grid Columns/Rows", m_meshes[i].instanceGrid);
+				m_meshes[i].instanceGrid[0] = std::clamp(m_meshes[i].instanceGrid[0], 1, 100);
+				m_meshes[i].instanceGrid[1] = std::clamp(m_meshes[i].instanceGrid[1], 1, 100);
+				ImGui::Combo("Column Sweep", &m_meshes[i].gridParameters[0], parameterLabels, IM_ARRAYSIZE(parameterLabels));
+				ImGui::Combo("Row Sweep", &m_meshes[i].gridParameters[1], parameterLabels, IM_ARRAYSIZE(parameterLabels));
+				ImGui::DragFloat("Grid Spacing", &m_meshes[i].gridSpacing, 0.01f, 0.0f, 100.0f);
+				ImGui::PopItemWidth();
+
+				if (ImGui::Button("Generate Instances")) {
+					instanceObject(i, m_meshes[i].instanceGrid[0], m_meshes[i].instanceGrid[1], m_meshes[i].gridSpacing,
+						{ m_meshes[i].gridParameters[0], m_meshes[i].gridParameters[1] });
+				}
+				if (!m_meshes[i].instances.empty()) {
+					ImGui::SameLine();
+					if (ImGui::Button("Clear Instances"))
+						instanceObject(i, 0, 0, 0.0f, { 0, 0 });
+					ImGui::SameLine();
+					ImGui::Text("%zu instances", m_meshes[i].instances.size());
+				}
+			} // Instance grid
 			{ // Object deletion button
 				ImGui::NewLine();
 				if (ImGui::Button("Delete")) {
@@ -1631,6 +2829,7 @@ namespace brdfa {
 				ImGui::TextWrapped("Here you can create a new BRDF, or edit the pre-existing saved ones.");
 				ImGui::TextWrapped("\t* To create a new BRDF please click on the costum BRDF drop down.Then insert a new BRDF name and click the + button.After that, a temporary BRDF template will be created.The temporary BRDF will not be saved unless it is tested, then can be loaded to the main BRDFs. ");
 				ImGui::TextWrapped("\t* To edit an existed BRDF, you can open the Loaded BRDFs panel and edit the BRDF that you are interested in changing. The changes will not occur, unless you test them first. After testing them, you can view them (Update the Rendering Options). You can save the BRDF to a file and cache it with the save button. The files can be found in the \"./shaders/brdfs\"");
+				ImGui::TextWrapped("\t* The BRDFs are compiled in the background once you stop typing (Test compiles right away). The errors are marked in the code. Check \"Live update\" to view every successful compilation right away.");
 				ImGui::TreePop();
 			}// end Editting BRDFs panel
 			if (ImGui::TreeNode("Shader Globals")) {
@@ -1645,6 +2844,15 @@ namespace brdfa {
 		}
 		ImGui::Separator();
 		if (ImGui::CollapsingHeader("BRDFs Editor")){
+
+			/*Compile options of the editor compilations. The loading and saved builds never keep the debug info.*/
+			const char* optimizations[] = { "None", "Size", "Performance" };
+			int optimization = static_cast<int>(m_shaderOptions.optimization);
+			ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+			if (ImGui::Combo("Optimization", &optimization, optimizations, IM_ARRAYSIZE(optimizations)))
+				m_shaderOptions.optimization = static_cast<ShaderOptimization>(optimization);
+			ImGui::SameLine();
+			ImGui::Checkbox("Debug info (not cached)", &m_shaderOptions.debugInfo);
 			
 			if (ImGui::TreeNode("Loaded BRDFs")){ // Loaded BRDFs
 				for (auto& it : m_loadedBrdfs)
@@ -1655,7 +2863,7 @@ namespace brdfa {
 						// Starting the section of the object
 						float bs = ImGui::GetFrameHeight();
 						float w = ImGui::GetColumnWidth();
-						float len = (it.second.log_e.size() > 0) ? 12.0f : 10.0f;
+						float len = (it.second.log_e.size() > 0) ? 14.0f : 12.0f;
 
 						ImGui::BeginChild(it.first.c_str(), ImVec2(0.0f, bs * len), true);
 
@@ -1667,7 +2875,7 @@ namespace brdfa {
 						ImGui::NewLine();
 
 						if (it.second.glslPanel.IsTextChanged())
-							it.second.tested = false;
+							editedBRDF(it.second);
 						
 						/*Buttons rendering*/
 						ImVec4 col = (it.second.tested) ? ImVec4(0, 0.7, 0, 1) : ImVec4(0.7, 0, 0, 1);
@@ -1681,6 +2889,10 @@ namespace brdfa {
 						bool save = ImGui::Button("Save", ImVec2(w / 4, 0));
 						ImGui::PopStyleColor();
 						if (!it.second.tested) ImGui::PopStyleColor();
+						ImGui::Checkbox("Live update", &it.second.liveUpdate);
+						ImGui::SameLine();
+						drawUI_compileStatus(it.second);
+						drawUI_shaderCost(it.second);
 						
 						/*Logging the errors of the Test*/
 						if (it.second.log_e.size() > 0) {
@@ -1690,29 +2902,10 @@ namespace brdfa {
 						}
 
 						if (test) {
-							std::string concat;
-							std::string brdf_s = it.second.glslPanel.GetText();
-							concat.reserve(brdf_s.length() + m_mainFragShader.length());
-							for (int i = 0; i < m_mainFragShader.size(); i++)
-								concat = (m_mainFragShader[i] == '\0') ? concat : concat + m_mainFragShader[i];
-							for (int i = 0; i < brdf_s.size(); i++)
-								concat = (brdf_s[i] == '\0') ? concat : concat + brdf_s[i];
-
-							/*Compile the concatenated fragment shader.*/
-							try {
-								auto frag_spirv = compileShader(concat, false, it.second.brdfName);
-								it.second.tested = true;
-								it.second.log_e = "";
-								it.second.latest_spir_v = frag_spirv;
-							}
-							catch (const std::exception& exp) {
-								it.second.log_e = exp.what();
-								it.second.tested = false;
-								//std::cout << "[ERROR]: Compilation Error for the given shader" << std::endl;
-							}
+							requestBRDFCompile(it.second);
 						}
 						if (push && it.second.tested) {
-							recreatePipeline(it.second.brdfName, it.second.latest_spir_v);
+							requestPipelineSwap(it.second);
 						}
 
 						if (save && it.second.tested) {
@@ -1738,7 +2931,7 @@ namespace brdfa {
 						float bs = ImGui::GetFrameHeight();
 						float w = ImGui::GetColumnWidth();
 
-						float len = (it.second.log_e.size() > 0) ? 12.0f : 10.0f;
+						float len = (it.second.log_e.size() > 0) ? 14.0f : 12.0f;
 						ImGui::BeginChild(it.first.c_str(), ImVec2(0.0f, bs* len), true);
 
 						/*Code window*/
@@ -1747,7 +2940,7 @@ namespace brdfa {
 						ImGui::SetWindowFontScale(1.0);
 						ImGui::NewLine();
 						if (it.second.glslPanel.IsTextChanged())
-							it.second.tested = false;
+							editedBRDF(it.second);
 
 						/*Buttons rendering*/
 						ImVec4 col = (it.second.tested) ? ImVec4(0, 0.7, 0, 1) : ImVec4(0.7, 0, 0, 1);
@@ -1757,6 +2950,8 @@ namespace brdfa {
 						ImGui::PopStyleColor();
 						ImGui::SameLine(0, w / 9);
 						bool add = ImGui::Button("Add", ImVec2(w / 3, 0));
+						drawUI_compileStatus(it.second);
+						drawUI_shaderCost(it.second);
 
 						/*Logging the errors of the Test*/
 						if (it.second.log_e.size() > 0) {
@@ -1766,28 +2961,11 @@ namespace brdfa {
 						}
 
 						if (test) {
-							std::string concat;
-							std::string brdf_s = it.second.glslPanel.GetText();
-							concat.reserve(brdf_s.length() + m_mainFragShader.length());
-							for (int i = 0; i < m_mainFragShader.size(); i++)
-								concat = (m_mainFragShader[i] == '\0') ? concat : concat + m_mainFragShader[i];
-							for (int i = 0; i < brdf_s.size(); i++)
-								concat = (brdf_s[i] == '\0') ? concat : concat + brdf_s[i];
-
-							/*Compile the concatenated fragment shader.*/
-							try {
-								auto frag_spirv = compileShader(concat, false, it.second.brdfName);
-								it.second.tested = true;
-								it.second.log_e = "";
-								it.second.latest_spir_v = frag_spirv;
-							}
-							catch (const std::exception& exp) {
-								it.second.tested = false;
-								it.second.log_e = exp.what();
-								//std::cout << "[ERROR]: Compilation Error for the given shader" << std::endl;
-							}
+							requestBRDFCompile(it.second);
 						}
 						if (add && it.second.tested) {
+							m_editStart[it.second.brdfName] = std::chrono::high_resolution_clock::now();
+							m_awaitingVisible.push_back(it.second.brdfName);
 							m_loadedBrdfs.insert({ it.first, it.second });
 							addPipeline(it.second.brdfName, it.second.latest_spir_v);
 							deletedInd.push_back(it.first);
@@ -1830,7 +3008,6 @@ namespace brdfa {
 
 	void BRDFA_Engine::drawUI_logger(){
 		if (!m_uistate.logWindowActive) return;
-		static VkPresentModeKHR presentMode = chooseSwapPresentMode(querySwapChainSupport(m_device).presentModes);
 		static int fps = 0;
 		static int lastfps = fps;
 		static auto startTime = std::chrono::high_resolution_clock::now();
@@ -1861,8 +3038,174 @@ namespace brdfa {
 		}
 		ImGui::Text("Vertices Count: %d vertices", vsum);
 
+		/*Drawn instances. An instanced object is a single draw command, whatever its instance count, and the commands of the objects
+		  sharing a pipeline are a single batch.*/
+		size_t instanceSum = 0;
+		for (const auto& mesh : this->m_meshes) {
+			instanceSum += std::max<size_t>(1, mesh.instances.size());
+		}
+		ImGui::Text("Instances Drawn: %zu in %zu commands, %u batches", instanceSum, this->m_meshes.size(), this->m_commander.batchCount);
+
+		/*Binds and draws executed by the scene buffer, and the state of the shared geometry.*/
+		ImGui::Text("Binds/Draws Per Frame: %zu/%zu (%s)", this->m_commander.frameBinds, this->m_commander.frameDraws,
+			!this->m_device.multiDrawIndirect ? "draw per mesh" : this->m_device.cmdDrawIndexedIndirectCount != nullptr ? "multi draw, indirect count" : "multi draw");
+		ImGui::Text("Geometry: %u/%u vertices, %u/%u indices", this->m_geometry.vertices.top, this->m_geometry.vertices.capacity,
+			this->m_geometry.indices.top, this->m_geometry.indices.capacity);
+		ImGui::Text("Geometry Fragmentation: %.0f%% (%zu compactions)", 100.0f * geometryFragmentation(this->m_geometry), this->m_geometry.compactions);
+
+		/*Shading mode (--deferred at start), applied before the next frame, the depth pre-pass of the forward mode, and the fragment
+		  shader invocations of the scene they save (counted by the GPU). The frame time is the latest measured in each mode, so
+		  switching between them compares the two on the same scene.*/
+		ImGui::Checkbox("Deferred Shading", &this->m_pendingDeferred);
+		ImGui::SameLine();
+		ImGui::Text("(%s)", this->m_graphicsPipelines.deferred ? "G-buffer, one BRDF evaluation per pixel" : "forward");
+		if (ImGui::TreeNode("Shading Costs")) {
+			const char* shadingNames[] = { "Forward", "Deferred" };
+			for (int i = 0; i < 2; i++) {
+				if (m_shadingCosts[i] > 0.0f)
+					ImGui::Text("%s: %.2f ms", shadingNames[i], m_shadingCosts[i]);
+				else
+					ImGui::Text("%s: not measured", shadingNames[i]);
+			}
+			ImGui::TreePop();
+		}
+		if (!this->m_graphicsPipelines.deferred && this->m_adaptive.enabled)
+			ImGui::Text("Depth Pre-pass: on (adaptive sampling)");
+		else if (!this->m_graphicsPipelines.deferred)
+			ImGui::Checkbox("Depth Pre-pass", &this->m_commander.depthPrepass);
+		if (this->m_commander.statistics != VK_NULL_HANDLE)
+			ImGui::Text("Fragment Shader Invocations: %llu", static_cast<unsigned long long>(this->m_commander.fragmentInvocations));
+		else
+			ImGui::Text("Fragment Shader Invocations: not supported by the device");
+
+		/*Anti-aliasing mode, applied before the next frame. The memory is the one of the scene color and depth attachments, the frame
+		  time the latest measured in the mode, so switching between the modes compares them on the same scene.*/
+		int antiAliasing = static_cast<int>(m_pendingAntiAliasing);
+		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+		if (ImGui::Combo("Anti-aliasing", &antiAliasing, [](void*, int idx, const char** out) { *out = antiAliasingName(static_cast<AntiAliasing>(idx)); return true; }, nullptr, AA_MODE_COUNT))
+			m_pendingAntiAliasing = static_cast<AntiAliasing>(antiAliasing);
+		ImGui::SameLine();
+		ImGui::Text("(%d samples)", static_cast<int>(m_device.msaaSamples));
+		if (ImGui::TreeNode("Anti-aliasing Costs")) {
+			for (int i = 0; i < AA_MODE_COUNT; i++) {
+				const auto& cost = m_antiAliasingCosts[i];
+				if (cost.first > 0.0f)
+					ImGui::Text("%s: %.1f MB, %.2f ms", antiAliasingName(static_cast<AntiAliasing>(i)), cost.first, cost.second);
+				else
+					ImGui::Text("%s: not measured", antiAliasingName(static_cast<AntiAliasing>(i)));
+			}
+			ImGui::TreePop();
+		}
+
+		/*Frame-time governor. Holds the target by lowering the render scale, then the light samples per frame (accumulated over the
+		  next frames). Switching it rebuilds the scene pass like the anti-aliasing mode does.*/
+		ImGui::Checkbox("Frame-time Governor", &m_governor.enabled);
+		if (m_graphicsPipelines.scaled) {
+			ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+			ImGui::SliderFloat("Target (ms)", &m_governor.targetMs, std::max(4.0f, m_governor.minTargetMs), 50.0f, "%.1f");
+			ImGui::SameLine();
+			ImGui::Checkbox("Sharpen", &m_governor.sharpen);
+			VkExtent2D extent = governedExtent(m_governor, m_swapChain.extent);
+			ImGui::Text("Frame (%s): %.2f ms, Scale: %d%% (%ux%u), Samples per Frame: %d, Accumulated Frames: %u",
+				m_commander.timestamps != VK_NULL_HANDLE ? "GPU" : "interval", m_governor.frameMs,
+				static_cast<int>(m_governor.scale * 100.0f + 0.5f), extent.width, extent.height,
+				m_governor.sampleCap > 0 ? m_governor.sampleCap : m_governor.maxSamples, m_governor.accumulated);
+			if (ImGui::TreeNode("Governor Decisions")) {
+				size_t shown = std::min(m_governor.decisionCount, GOVERNOR_LOG_SIZE);
+				for (size_t i = 1; i <= shown; i++)
+					ImGui::TextUnformatted(m_governor.decisions[(m_governor.decisionCount - i) % GOVERNOR_LOG_SIZE].c_str());
+				ImGui::TreePop();
+			}
+		}
+
+		/*Adaptive sampling. The budget is shared between the pixels over the error target, in proportion to their error; the converged
+		  ones keep their mean. Counted by the passes of the last finished frame.*/
+		if (m_adaptive.supported) {
+			if (ImGui::Checkbox("Adaptive Sampling", &m_adaptive.enabled))
+				m_adaptive.reset = true;
+			ImGui::SameLine();
+			ImGui::Checkbox("Budget Heatmap", &m_adaptive.heatmap);
+			if (m_adaptive.enabled) {
+				ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+				ImGui::SliderFloat("Budget (samples/pixel)", &m_adaptive.budget, 1.0f, 64.0f, "%.1f");
+				ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+				ImGui::SliderFloat("Error Target", &m_adaptive.targetError, 0.001f, 0.1f, "%.3f");
+				ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+				if (ImGui::SliderInt("Max Samples/Pixel", &m_adaptive.maxSamples, 1, 256))
+					m_adaptive.reset = true;
+				const AdaptiveFrame& adaptive = m_adaptive.stats;
+				uint32_t covered = adaptive.activePixels + adaptive.convergedPixels;
+				ImGui::Text("Active Pixels: %u, Converged: %u (%.0f%%), Samples: %u (%.2f per active pixel)", adaptive.activePixels,
+					adaptive.convergedPixels, covered > 0 ? 100.0f * adaptive.convergedPixels / covered : 0.0f, adaptive.budget,
+					adaptive.activePixels > 0 ? static_cast<float>(adaptive.budget) / adaptive.activePixels : 0.0f);
+				if (adaptive.claimed > adaptive.budget)
+					ImGui::Text("Over the budget: %u samples asked for were cut", adaptive.claimed - adaptive.budget);
+			}
+		}
+		else {
+			ImGui::Text("Adaptive Sampling: not supported by the device");
+		}
+
+		/*GPU culling. Counted by the culling pass of the last finished frame; the fragments are estimated from the bounds.*/
+		ImGui::Checkbox("GPU Culling", &this->m_culling.enabled);
+		ImGui::SameLine();
+		ImGui::Checkbox("Occlusion Culling", &this->m_culling.occlusion);
+		ImGui::SameLine();
+		ImGui::Checkbox("Show Culled", &this->m_culling.showCulled);
+		const CullFrame& culled = this->m_culling.stats;
+		ImGui::Text("Culled Instances: %u/%u (%u frustum, %u occlusion), %u objects", culled.frustumCulled + culled.occlusionCulled,
+			culled.testedInstances, culled.frustumCulled, culled.occlusionCulled, culled.culledObjects);
+		ImGui::Text("Culled Triangles: %u, Fragments Saved: ~%u", culled.culledTriangles, culled.savedFragments);
+
+		/*Secondary command buffers recorded since the start. Stays still unless an object changes.*/
+		ImGui::Text("Recorded Object Buffers: %zu", this->m_commander.recordedSecondaries);
+		ImGui::Text("Descriptor Sets Written: %zu", this->m_descriptorData.setWrites);
+		if (this->m_descriptorData.bindless)
+			ImGui::Text("Bindless Textures: %u/%u slots", this->m_descriptorData.usedTextures - static_cast<uint32_t>(this->m_descriptorData.freeTextures.size()), this->m_descriptorData.textureCapacity);
+
+		/*Allocations of the whole last frame, UI and updates included. All stay at 0 unless something changes (an object, a mode,
+		  a window opened for the first time).*/
+		ImGui::Text("Frame Allocations: %zu heap, %zu vulkan, %zu imgui", this->m_frameAllocations.heap, this->m_frameAllocations.vulkan,
+			this->m_frameAllocations.imgui);
+
+		/*Pipeline creation times*/
+		if (ImGui::TreeNode("Pipeline Creation Times")) {
+			for (const auto& it : this->m_pipelineTimes)
+				ImGui::Text("%s: %.2f ms (%s cache)", it.first.c_str(), it.second.first, it.second.second ? "warm" : "cold");
+			ImGui::TreePop();
+		}
+
+		/*Time from applying a BRDF edit (View/Add) to the first frame presenting it*/
+		if (ImGui::TreeNode("Edit To Visible Latency")) {
+			ImGui::Text("Pipeline path: %s", m_device.pipelineLibrary ? "Graphics pipeline libraries" : "Full pipeline creation");
+			for (const auto& it : this->m_editLatency) {
+				if (it.second.second > 0.0f)
+					ImGui::Text("%s: %.2f ms (optimized after %.2f ms)", it.first.c_str(), it.second.first, it.second.second);
+				else
+					ImGui::Text("%s: %.2f ms", it.first.c_str(), it.second.first);
+			}
+			ImGui::TreePop();
+		}
+
+		/*Compile service load*/
+		if (ImGui::TreeNode("Compile Service")) {
+			ImGui::Text("Workers: %zu", this->m_compiler.workers.size());
+			ImGui::Text("Queue depth: %zu", compileQueueDepth(this->m_compiler));
+			ImGui::Text("Mean compile latency: %.2f ms", meanCompileTime(this->m_compiler));
+			ImGui::TreePop();
+		}
+
+		/*Pipeline variant used by each object*/
+		for (size_t i = 0; i < this->m_meshes.size(); i++) {
+			const Mesh& mesh = this->m_meshes[i];
+			if (mesh.specializedSamples > 0)
+				ImGui::Text("Object_%zu: %s (specialized: %d samples)", i + 1, mesh.renderOption.c_str(), mesh.specializedSamples);
+			else
+				ImGui::Text("Object_%zu: %s (dynamic: %d samples)", i + 1, mesh.renderOption.c_str(), mesh.samples);
+		}
+
 		/*Current Rendering mode*/
-		switch (presentMode) {
+		switch (m_swapChain.presentMode) {
 		case VK_PRESENT_MODE_IMMEDIATE_KHR:
 			ImGui::Text("Buffer Strategy: Immediate");
 			break;
@@ -1946,10 +3289,8 @@ namespace brdfa {
 			ImGui::Begin("Test Result", &showLog);
 			ImGui::BulletText("BRDF Test Logs: ");
 			for (const auto& it : m_loadedBrdfs) {
-				std::string lg = it.second.brdfName;
-				ImGui::Text("\t[%s]:", lg.c_str());
-				lg = (it.second.log_e == "") ? std::string("is good and flawless!"): it.second.log_e;
-				ImGui::TextWrapped("\t%s\n", lg.c_str());
+				ImGui::Text("\t[%s]:", it.second.brdfName.c_str());
+				ImGui::TextWrapped("\t%s\n", it.second.log_e.empty() ? "is good and flawless!" : it.second.log_e.c_str());
 				ImGui::Separator();
 			}
 			ImGui::End();
@@ -1981,15 +3322,27 @@ namespace brdfa {
 
 			/*Check the sum of the completed tests*/
 			for (auto& t : futurePool) {
-				std::future_status status = t.wait_for(std::chrono::milliseconds(0));
+				std::future_status status = t.second.wait_for(std::chrono::milliseconds(0));
 				if (status == std::future_status::ready) {
 					cur++;
 				}
 			}
 
-			/*If all threads had terminated successfully, we terminate them.*/
+			/*If all the compilations are done, their results are applied to the panels.*/
 			if (cur == sum) {
-				for (auto& t : futurePool) t.get();
+				for (auto& t : futurePool) {
+					CompileResult result = t.second.get();
+					auto panel = m_loadedBrdfs.find(t.first);
+					if (panel == m_loadedBrdfs.end()) continue;
+					panel->second.log_e = result.log;
+					if (result.success) {
+						panel->second.tested = true;
+						panel->second.latest_spir_v = std::move(result.spirv);
+						panel->second.spirvKey = 0;
+						panel->second.cost = analyzeShaderCost(panel->second.latest_spir_v);
+					}
+					printf("[INFO]: Test compilation of BRDF (%s): %.2f ms (queued %.2f ms)\n", t.first.c_str(), result.compileTime, result.waitTime);
+				}
 				futurePool.clear();
 				testing = false;
 				showLog = true;
@@ -2010,23 +3363,10 @@ namespace brdfa {
 				if (!it.second.requireTest) continue;
 				testing = true;
 
-				std::string concat;
-				std::string brdf_s = it.second.glslPanel.GetText();
-				concat.reserve(brdf_s.length() + m_mainFragShader.length());
-				for (int i = 0; i < m_mainFragShader.size(); i++)
-					concat = (m_mainFragShader[i] == '\0') ? concat : concat + m_mainFragShader[i];
-				for (int i = 0; i < brdf_s.size(); i++)
-					concat = (brdf_s[i] == '\0') ? concat : concat + brdf_s[i];
+				std::string concat = assembleFragShader(it.second.glslPanel.GetText(), it.second.brdfName);
 
 				/*Compiling the code asynchronysly*/
-				BRDF_Panel& lp = it.second;
-				auto loadedBRDFs = &m_loadedBrdfs;
-				futurePool.push_back(
-					std::async(std::launch::async, [concat, &lp, loadedBRDFs] {
-						threadCompileGLSL(concat, lp, loadedBRDFs, true);
-						return true;
-					})
-				);
+				futurePool.push_back({ it.first, submitCompile(m_compiler, concat, false, it.second.brdfName, m_shaderOptions, INTERACTIVE_PRIORITY) });
 
 			}
 		}
@@ -2106,8 +3446,9 @@ namespace brdfa {
 
 
 		for (int j = 0; j < m_uistate.extraTexturesCount; j++) {
-			std::string label = std::string("iTexture") + std::to_string(j + 1);
-			ImGui::InputText(label.c_str(), m_uistate.extra_tex_paths[j], 100, ImGuiInputTextFlags_AlwaysOverwrite);
+			char label[16];
+			snprintf(label, sizeof(label), "iTexture%d", j + 1);
+			ImGui::InputText(label, m_uistate.extra_tex_paths[j], 100, ImGuiInputTextFlags_AlwaysOverwrite);
 		}
 
 		if (m_uistate.extraTexturesCount < 3 && ImGui::Button("+", ImVec2(50, 0)))
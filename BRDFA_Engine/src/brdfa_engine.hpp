@@ -10,9 +10,11 @@
 #include <string>
 #include <array>
 #include <queue>
+#include <deque>
 #include <vector>
 #include <thread>
 #include <future>
+#include <chrono>
 #include "brdfa_structs.hpp"
 
 
@@ -22,6 +24,18 @@ namespace brdfa {
 
 	// ----------------------------- Configuration Struct ------------------------------------------
 
+	/*What a headless run renders (see BRDFA_Engine::runHeadless): one image per BRDF, of the scene seen from the camera.*/
+	struct HeadlessJob {
+		std::string						model;								// Object of the scene. Empty keeps the default one.
+		std::string						texture;							// Texture of the object. Empty uses the default one.
+		std::vector<std::string>		brdfs;								// BRDFs rendered, in order. Empty renders all the loaded ones.
+		glm::vec3						eye = glm::vec3(0.0f, 0.0f, 50.0f);	// Camera position (the default camera of the engine).
+		glm::vec3						target = glm::vec3(0.0f);			// Point the camera looks at.
+		int								samples = 0;						// Light samples of the objects. 0 keeps their own.
+		uint32_t						frames = 4;							// Frames rendered per image, the last one is saved. More let the adaptive sampling converge.
+		std::string						outputDir = "res/headless";			// Directory of the images (<brdf>.png).
+	};
+
 	struct BRDFAEngineConfiguration {
 		uint16_t						width, height;						// Window initial width and height.
 		uint16_t						ups = 60;							// Updates per second (30, 60 or 120).
@@ -29,6 +43,13 @@ namespace brdfa {
 		bool							validationLayersEnabled;			// Enable Validation layers for logging.
 		bool							hot_load = false;
 		bool							no_cache_load = false;
+		bool							no_bindless = false;				// Keep the fixed texture bindings even if descriptor indexing is supported.
+		bool							deferred = false;					// Shade out of a G-buffer, once per pixel (see deferred_abs.cpp).
+		AntiAliasing					antiAliasing = AA_MSAA_4X;			// Initial anti-aliasing mode. Can be changed at runtime (Logs window).
+		float							frameTarget = 0.0f;					// Frame time (ms) held by the governor from the start. 0 leaves it off.
+		bool							adaptiveSampling = false;			// Start with the adaptive sampling on, if the device supports it.
+		bool							headless = false;					// No window, surface nor swapchain: offscreen images driven by runHeadless().
+		HeadlessJob						job;								// Rendered by runHeadless().
 	};
 
 
@@ -50,7 +71,7 @@ namespace brdfa {
 
 
 		/*GFLW stuff*/
-		GLFWwindow*										m_window;						// window handler.
+		GLFWwindow*										m_window = nullptr;				// window handler. None when headless.
 		bool											m_frameBufferResized;			// If frame buffer is resized or not.
 
 		/*Vulkan objects*/
@@ -60,15 +81,28 @@ namespace brdfa {
         Descriptor										m_descriptorData;               // Holds Descriptor pool and its relative layout and sets.
 		GPipeline										m_graphicsPipelines;				// Holds the Graphics pipeline data.
 		Commander										m_commander;					// Handles the command pool and its related command buffers.
+		FrameAllocations								m_frameAllocations;				// Allocations made by the last frame, from its events to its present.
 		std::vector<SyncCollection>						m_sync;							// Fences per swapchain image. CPU/GPU signals, Semaphores per swapchain image. GPU/GPU signals.
 		std::vector<VkFence>							m_imagesInFlight;
+		PostProcess										m_postProcess;					// FXAA pass of the AA_FXAA mode, upscale of the governed mode.
+		Governor										m_governor;						// Frame-time governor. Switched in the Logs window.
+		AdaptiveSampling								m_adaptive;						// Per pixel sample budget from the variance of the pixels. Switched in the Logs window.
+		glm::mat4										m_lastViewProj = glm::mat4(1.f);	// Camera of the last frame. The samples accumulated over the frames are dropped when it moves.
+		size_t											m_lastSecondaries = 0;			// Commander::recordedSecondaries seen by the last frame.
+		AntiAliasing									m_pendingAntiAliasing = AA_MSAA_4X;	// Mode picked in the UI. Applied before the next frame.
+		std::array<std::pair<float, float>, AA_MODE_COUNT>	m_antiAliasingCosts{};		// Scene attachments memory (MB) and frame time (ms) measured in each mode.
+		bool											m_pendingDeferred = false;		// Shading mode picked in the UI. Applied before the next frame.
+		std::array<float, 2>							m_shadingCosts{};				// Frame time (ms) measured in forward [0] and deferred [1] shading.
 		
 
 
 		/*Engine Scene variables*/
 		Camera											m_camera;
 		std::vector<Mesh>								m_meshes;						// Scene meshes.
-		std::vector<Buffer>								m_uniformBuffers;				// Scene Uniform buffers. Camera transformation is a such.
+		uint32_t										m_nextObjectId = 1;				// Mesh::uid of the next loaded mesh.
+		UniformArena									m_uniforms;						// Camera uniforms of all the frames. Persistently mapped.
+		GeometryArena									m_geometry;						// Vertices, indices and indirect draw commands of all the meshes.
+		Culling											m_culling;						// GPU frustum and occlusion culling of the instances, writing the draw commands.
 		Mesh											m_skymap_mesh;					// Mesh that defines the skymap to be rendered. It is rendered on a seperate pipeline
 		Image											m_skymap;						// Skybox image
 		VkPipeline										m_skymap_pipeline;				// Pipeline that holds the Skymap Shaders info.
@@ -86,13 +120,36 @@ namespace brdfa {
 
 
 		std::string										m_mainFragShader;
+		uint64_t										m_mainFragHash = 0;				// sourceHash() of main.frag. Part of the BRDF keys.
+		ShaderCompileOptions							m_shaderOptions;				// Optimization level and debug info of the BRDF compilations.
+		SpirvArchive									m_spirvArchive;					// Compiled BRDFs keyed by their assembled source.
 		std::vector<char>								m_vertSpirv;
 
+		/*Pipeline creation statistics*/
+		bool											m_pipelineCacheWarm = false;	// True if the pipeline cache holds data from previous creations (disk or this session).
+		std::unordered_map<std::string, std::pair<float, bool>>	m_pipelineTimes;		// Latest creation time (ms) of each pipeline, and whether the cache was warm.
+		std::vector<char>								m_pipelineCacheSeed;			// Engine cache data the worker caches are initialized with.
+		PipelineQueue									m_pipelineQueue;				// Pipelines built by the loading workers, waiting to be published.
+		std::vector<std::future<void>>					m_linkWorkers;					// Optimized link jobs (graphics pipeline libraries).
+		std::vector<VkPipeline>							m_retiredLibraries;				// Replaced fragment libraries. Destroyed once no link is running.
+		std::unordered_map<std::string, uint64_t>		m_pipelineGenerations;			// Incremented on every BRDF rebuild. Drops outdated optimized links.
+		std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point>	m_editStart;	// When the latest edit of a BRDF was applied.
+		std::vector<std::string>						m_awaitingVisible;				// Edited BRDFs that have not been presented yet.
+		std::unordered_map<std::string, std::pair<float, float>>	m_editLatency;		// Edit to visible latency and edit to optimized swap latency in ms.
+		std::unordered_map<std::string, uint64_t>		m_pipelineSwaps;				// Incremented on every hot-swap request of a BRDF. Drops outdated swaps.
+		std::vector<std::pair<VkPipeline, uint64_t>>	m_retiredPipelines;				// Replaced pipelines and the frame they were replaced at.
+		uint64_t										m_frameNumber = 0;				// Frames submitted so far.
+		std::unordered_map<uint64_t, std::vector<char>>	m_editorSpirv;					// SPIR-V of the latest editor compilations by key. Not archived.
+		std::deque<uint64_t>							m_editorSpirvOrder;				// Keys of m_editorSpirv, oldest first.
+		std::vector<std::future<void>>					m_archiveWrites;				// SPIR-V archive stores running on the compile service.
+
 		const uint8_t									MAX_FRAMES_IN_FLIGHT = 2;
 
 		/*Parallalism utilitities*/
-		std::vector<std::thread>						compilationPool;				// Holds all the threads that are being used to compile the glsl at the moment.
-		std::vector<std::future<bool>>					futurePool;						// Another threading utility for helping us create threads that return values
+		CompileService									m_compiler;						// Bounded pool running the shader compilations and pipeline builds.
+		std::vector<std::future<void>>					compilationPool;				// Loading jobs (compile + pipeline build) that are running at the moment.
+		std::vector<std::pair<std::string, std::future<CompileResult>>>	futurePool;		// Test window compilations, by BRDF name.
+		std::unordered_map<std::string, EditorCompile>	m_editorCompiles;				// Latest editor compilation of each BRDF panel.
 
 		/*saving images Utilities.*/
 		std::string										savedFramesDir = "res/";		// The frames Directory.
@@ -111,6 +168,8 @@ namespace brdfa {
 
 		bool updateAndRender();												// main loop. It handles engine updates and rendering.
 
+		int runHeadless();													// Renders the job of a headless engine into image files. Returns the exit code.
+
 		void close();														// closes the engine. By default the engine will call this funciton when the window is closed
 
 		bool interrupt();													// interrupt execution .. For later usage.
@@ -118,6 +177,8 @@ namespace brdfa {
 		bool loadObject(const std::string& object_path, const std::vector<std::string>& texture_path);												// loading a mesh object into the scene.
 		bool deleteObject(const int& idx);									// Deletes the object corresponding to that index.
 
+		bool instanceObject(const size_t& idx, const uint32_t& columns, const uint32_t& rows, const float& spacing, const std::array<int, 2>& parameters);	// Draws the object as a grid of instances sweeping two parameters.
+
 		bool reloadSkymap(const std::string& path);
 
 		bool loadEnvironmentMap(const std::array<std::string,6>& skyboxSides);										// Loading an environment map into the scene.
@@ -141,6 +202,8 @@ namespace brdfa {
 		void drawUI_objects();
 		void drawUI_camera();
 		void drawUI_editorBRDF();
+		void drawUI_compileStatus(BRDF_Panel& panel);
+		void drawUI_shaderCost(BRDF_Panel& panel);
 		void drawUI_logger();
 		void drawUI_comparer();
 		void drawUI_frameSaver(uint32_t imageIndex);
@@ -150,17 +213,47 @@ namespace brdfa {
 		void drawUI_skymapLoader();
 
 
-		void refreshObject(const size_t& idx);													// Records the objects back again.
+		void refreshObject(const size_t& idx);													// Marks the object to be recorded back again.
+		void refreshBRDFObjects(const std::string& brdfName);									// Marks the objects rendered with the BRDF to be recorded back again.
+		bool selectSampleVariant(const size_t& idx);											// Picks (and lazily creates) the specialized pipeline matching the object's light samples.
 		void addFragPipeline(const std::string&, const std::string&);							// This is used to add a pipeline to the scene. And refreshes the obejcts.
+		std::string assembleFragShader(const std::string& brdfSource, const std::string& brdfName) const;	// main.frag + BRDF source.
+		uint64_t fragShaderKey(const std::string& brdfSource, const std::string& brdfName, const ShaderCompileOptions& options) const;	// SPIR-V archive key of a BRDF (main.frag hash + BRDF).
+		ShaderCompileOptions cachedShaderOptions() const;										// Compile options of the archived builds (no debug info).
+		std::vector<char> loadEngineShader(const std::string& file, const bool& vertexShader, const std::string& defines = "");	// SPIR-V of an engine shader (vertex, skybox, minimal, culling), compiled once and archived.
+		void requestBRDFCompile(BRDF_Panel& panel);												// Submits the compilation of an editor panel (or takes it from the archive).
+		void applyBRDFCompile(BRDF_Panel& panel, CompileResult& result, const uint64_t& key, const bool& cacheable);	// Diagnostics, error markers, cost and hot-swap of a finished compilation.
+		void updateEditorCompiles();															// Debounced submits and finished compilations of the editor.
+		void editedBRDF(BRDF_Panel& panel);														// Marks an editor panel as changed.
 		void saveBRDF(const std::string& brdfName, const bool& cacheIt = true);					// Save the BRDF to the disk.
 		void recreatePipeline(const std::string&, const std::vector<char>& , const bool & refreshObjs = true);					// Quickly recreates a specific pipeline.
 		void addPipeline(const std::string&, const std::vector<char>&);							// Add a new pipeline to the graphics pipelines.
+		void logPipelineTime(const std::string& name, const std::chrono::high_resolution_clock::time_point& start);	// Records the creation time of a pipeline.
+		void buildBRDFPipeline(const std::string& brdfName, const std::vector<char>& fragSpirv);	// Builds the pipeline of a BRDF. Uses pipeline libraries if supported.
+		void publishReadyPipelines();															// Publishes the pipelines built by the workers.
+		void requestPipelineSwap(const BRDF_Panel& panel);										// Rebuilds the pipeline of a loaded BRDF on the compile service.
+		void swapBRDFPipeline(ReadyPipeline& ready);												// Swaps in a pipeline rebuilt by requestPipelineSwap().
+		void retirePipeline(const VkPipeline& pipeline);										// Destroys the pipeline once the frames in flight are done with it.
+		void destroyRetiredPipelines(const bool& all);											// Destroys the retired pipelines no frame uses anymore.
+		void archiveSpirv(const uint64_t& key, const std::vector<char>& spirv);				// Stores SPIR-V into the archive on the compile service.
+		void keepEditorSpirv(const uint64_t& key, const std::vector<char>& spirv);				// Keeps the SPIR-V of an editor compilation in memory.
+		void maintainGeometry();																// Compacts the geometry arena once the deleted meshes left too many holes.
+		bool finishCompaction();																// Swaps in the geometry of a compaction whose copies are done.
+		std::vector<Mesh*> geometryMeshes();													// The meshes holding ranges of the geometry arena.
+		void joinPipelineWorkers();																// Waits for the pipeline workers and publishes what they built.
 		void loadPipelines();																	// Load all pipelines needed by the program to run.
 		void startWindow();																		// Starts the GLFW window
 		void startVulkan();																		// Fully initialize the Vulkan engine.
 		bool startImgui();																		// Starts the Imgui for vulkan and glfw
+		void startImguiVulkan();																// Initializes the Vulkan backend of Imgui for the UI render pass.
+		void applyAntiAliasing(const AntiAliasing& mode);										// Switches the anti-aliasing mode or the governed targets, rebuilding the sample dependent resources only.
+		void applyShadingMode(const bool& deferred);											// Switches between forward and deferred shading, rebuilding the G-buffer and the scene pipelines.
+		float sceneAttachmentsMB() const;														// Memory of the scene attachments allocated by the mode.
+		void stepGovernor(CameraUniforms& camera, const float& frameMs);						// Steps the frame-time governor and writes its sample cap into the camera block.
+		void createScenePipelines();															// Creates the pipelines drawn in the scene render pass, BRDFs included.
 		void update(uint32_t currentImage);														// Update function. Time dependent function.
 		void render(uint32_t imageIndex);														// Render the engine's scene.
+		uint32_t renderOffscreen();																// Renders a headless frame into its offscreen image. Returns the image.
 		void record(uint32_t imageIndex);														// Save the frame into a file.
 		void drawUI(uint32_t imageIndex);														// Draw the UI (ImGui)
 		void cleanup();																			// Clean up the swapchain and the Vulkan objects. Mostly used during window resizing
@@ -5,6 +5,16 @@
 #include <optional>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
 // GLM Dependencies
 #define GLM_FORCE_RADIANS
@@ -24,6 +34,38 @@
 
 #include <iostream>
 
+/*Compatibility with the vendored Vulkan headers (1.2.189), which predate VK_EXT_graphics_pipeline_library.*/
+#ifndef VK_EXT_graphics_pipeline_library
+#define VK_EXT_graphics_pipeline_library 1
+#define VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME "VK_EXT_graphics_pipeline_library"
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT ((VkStructureType)1000320000)
+#define VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT ((VkStructureType)1000320002)
+#define VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT ((VkPipelineCreateFlagBits)0x00800000)
+#define VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT ((VkPipelineCreateFlagBits)0x00000400)
+
+typedef enum VkGraphicsPipelineLibraryFlagBitsEXT {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT = 0x00000001,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT = 0x00000002,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT = 0x00000004,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT = 0x00000008,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FLAG_BITS_MAX_ENUM_EXT = 0x7FFFFFFF
+} VkGraphicsPipelineLibraryFlagBitsEXT;
+typedef VkFlags VkGraphicsPipelineLibraryFlagsEXT;
+
+typedef struct VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT {
+    VkStructureType                         sType;
+    void*                                   pNext;
+    VkBool32                                graphicsPipelineLibrary;
+} VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT;
+
+typedef struct VkGraphicsPipelineLibraryCreateInfoEXT {
+    VkStructureType                         sType;
+    void*                                   pNext;
+    VkGraphicsPipelineLibraryFlagsEXT       flags;
+} VkGraphicsPipelineLibraryCreateInfoEXT;
+#endif
+
+
 namespace brdfa {
 
     /// <summary>
@@ -81,12 +123,27 @@ namespace brdfa {
     /// Holds the device stuff and its specific vulkan objects.
     /// </summary>
     struct Device {
-        VkSampleCountFlagBits			msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkSampleCountFlagBits			msaaSamples = VK_SAMPLE_COUNT_1_BIT;   // Samples of the scene attachments, set by the anti-aliasing mode.
+        VkSampleCountFlagBits           maxMsaaSamples = VK_SAMPLE_COUNT_1_BIT;// Highest sample count of the color and depth attachments.
         VkPhysicalDevice                physicalDevice;                 // GPU Vulkan object (Id to gpu device)
         VkDevice                        device;                         // Logical device vulkan object.
-        VkSurfaceKHR					surface;                     // Presentation surface
+        VkSurfaceKHR					surface = VK_NULL_HANDLE;    // Presentation surface. None when headless.
         VkQueue                         graphicsQueue;
         VkQueue                         presentQueue;
+        bool                            pipelineLibrary = false;        // VK_EXT_graphics_pipeline_library is enabled. BRDF pipelines are linked from libraries.
+        bool                            descriptorIndexing = false;     // VK_EXT_descriptor_indexing is enabled. The textures are bound through the bindless table.
+        uint32_t                        bindlessTextures = 0;           // Size of the bindless texture array.
+        PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;  // VK_KHR_draw_indirect_count, if enabled.
+        bool                            multiDrawIndirect = false;      // multiDrawIndirect and drawIndirectFirstInstance are enabled: a batch of meshes is one indirect draw.
+        bool                            pipelineStatistics = false;     // Pipeline statistics queries (and their inheritance by the secondaries) are enabled.
+        bool                            fragmentStores = false;         // fragmentStoresAndAtomics is enabled: main.frag keeps the adaptive sampling statistics.
+        float                           timestampPeriod = 0.0f;         // Nanoseconds per timestamp tick of the graphics queue. 0: no timestamps.
+    };
+
+
+    struct Buffer {
+        VkBuffer                        obj;                            // Vulkan Object ID. Vulkan don't allocate memory for the buffer.
+        VkDeviceMemory                  memory;                         // The allocated Memory ID. It is somekind of a pointer that Vulkan understands.
     };
 
 
@@ -95,12 +152,28 @@ namespace brdfa {
     /// </summary>
     struct Image {
         bool                            cubemap = false;                // If the image represents a cube map or not.
-        VkImage                         obj;                            // Image object handled by Vulkan.
-        VkDeviceMemory                  memory;                         // Memory ID of the allocated Image on the device. Vulkan handles these kind of IDs
-        VkImageView                     view;                           // The Image view attached to the Image object.
+        VkImage                         obj = VK_NULL_HANDLE;           // Image object handled by Vulkan.
+        VkDeviceMemory                  memory = VK_NULL_HANDLE;        // Memory ID of the allocated Image on the device. Vulkan handles these kind of IDs
+        VkImageView                     view = VK_NULL_HANDLE;          // The Image view attached to the Image object.
         VkSampler                       sampler = VK_NULL_HANDLE;       // Incase the image needs to be sampled and sent to the GPU.
         uint32_t                        mipLevels;                      // Miplevels count of the image.
         uint32_t                        width, height;
+        VkFormat                        format = VK_FORMAT_UNDEFINED;   // Format the image was created with.
+        VkDeviceSize                    size = 0;                       // Bytes of device memory allocated for the image.
+    };
+
+
+    /*Thin G-buffer of the deferred mode, laid down by the pre-pass and read by the full screen shading passes of the BRDFs.
+      Single sampled, sized after the swapchain.*/
+    struct GBuffer {
+        Image                           surface;                        // RGBA16F: octahedral world normal, texture coordinates.
+        Image                           color;                          // RGBA8: vertex color.
+        Image                           instance;                       // R32UI: visible instance entry, 0xFFFFFFFF for none.
+        Image                           depth;                          // Depth of the G-buffer pass, sampled to rebuild the positions.
+        Buffer                          tileCommands;                   // One VkDrawIndirectCommand per batch (DEFERRED_MAX_BATCHES), 6 vertices per tile.
+        Buffer                          tileLists;                      // Tiles of each batch, a list per batch the size of the tile grid.
+        VkFramebuffer                   framebuffer = VK_NULL_HANDLE;
+        VkSampler                       sampler = VK_NULL_HANDLE;       // Nearest sampler. The shading passes only use texelFetch.
     };
 
 
@@ -108,21 +181,176 @@ namespace brdfa {
     /// 
     /// </summary>
     struct SwapChain {
-        VkSwapchainKHR                  swapChain;                      // Swapchain vulkan object (ID to a swapchain)
+        VkSwapchainKHR                  swapChain = VK_NULL_HANDLE;     // Swapchain vulkan object (ID to a swapchain). None when headless.
         std::vector<VkImage>            images;                         // Swapchain Image objects.
+        std::vector<Image>              offscreenImages;                // Headless only: the images standing in for the swapchain ones.
+        VkImageLayout                   presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;   // Layout the frames end in. Transfer source when headless (read back).
         VkFormat                        format;                         // Swapchain image format type
         VkExtent2D                      extent;                         // Swapchain window size
+        VkPresentModeKHR                presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;   // Headless, nothing waits for a display.
         std::vector<VkImageView>        imageViews;                     // Image views to render into
         std::vector<VkFramebuffer>      framebuffers;                   // framebuffers to hold different attachments through the render pass.
         Image							colorImage;					    // A color resolve attachment for miltisampling
         Image							depthImage;		    			// A depth attachment used for depth testing.
+        Image                           sceneImage;                     // Resolve target of the scaled MSAA scene, read by the upscale pass. Governed mode only.
+        GBuffer                         gbuffer;                        // Deferred mode only.
+
+    };
+
+
+    /*Sets of one layout. Allocated out of a list of pools, a new (twice bigger) pool is added when the last one is full.
+      Released sets go to a free list and are handed out again before allocating, so the pools are never reset.*/
+    struct DescriptorAllocator {
+        VkDescriptorSetLayout           layout = VK_NULL_HANDLE;        // Layout of the sets.
+        VkDescriptorUpdateTemplate      updateTemplate = VK_NULL_HANDLE;// Writes all the bindings of a set in one call.
+        std::vector<VkDescriptorPoolSize> setSizes;                     // Descriptors of one set, by type.
+        uint32_t                        setsPerPool = 1;                // Sets of the next pool.
+        VkDescriptorPoolCreateFlags     poolFlags = 0;                  // Update after bind layouts need update after bind pools.
+        std::vector<VkDescriptorPool>   pools;                          // Pools allocated so far. The last one is allocated from.
+        std::vector<VkDescriptorSet>    freeSets;                       // Released sets, reused first.
+    };
+
 
+    /*A range of elements (vertices or indices) of a geometry heap.*/
+    struct GeometryRange {
+        uint32_t                        offset = 0;                     // First element.
+        uint32_t                        count = 0;                      // Number of elements.
     };
 
+
+    /*Device local buffer shared by the geometry of all the meshes, handed out in ranges of elements.*/
+    struct GeometryHeap {
+        Buffer                          buffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+        VkBufferUsageFlags              usage = 0;
+        VkDeviceSize                    stride = 0;                     // Size of an element.
+        uint32_t                        capacity = 0;                   // Elements of the buffer.
+        uint32_t                        top = 0;                        // End of the highest range handed out.
+        std::vector<GeometryRange>      freeRanges;                     // Released ranges below top. Sorted by offset, neighbours merged.
+    };
+
+
+    /*A compaction of the geometry arena (see beginGeometryCompaction()). The packed copies of the heaps are filled by a fenced
+      transfer while the frames keep drawing from the current buffers; once the fence signaled, they replace those of the heaps
+      and the replaced buffers are kept here until the frames in flight are done with them.*/
+    struct GeometryCompaction {
+        VkFence                         fence = VK_NULL_HANDLE;         // Signals the end of the copies. Null unless they are running.
+        VkCommandBuffer                 commandBuffer = VK_NULL_HANDLE; // Copies of the compaction, out of Commander::uploadPool.
+        std::array<Buffer, 3>           buffers{};                      // Packed vertices, indices and instances, then the replaced buffers.
+        std::array<uint32_t, 3>         tops{};                         // Top of each heap once packed.
+        std::vector<std::array<uint32_t, 3>> offsets;                   // New vertex, index and instance offsets of the meshes, in the order given.
+        bool                            retiring = false;               // buffers hold the replaced buffers.
+        uint64_t                        retiredAt = 0;                  // Frame the buffers were replaced at.
+    };
+
+
+    /*The static geometry of the scene: the vertices, indices and instances of every mesh in shared buffers, the per draw data of
+      every mesh in a record table, and the indirect draw commands. A mesh is a vertex range, an index range, an instance range
+      and a draw slot (its record). The commands are laid out in batch order every frame (see recordDrawData()).*/
+    struct GeometryArena {
+        GeometryHeap                    vertices;
+        GeometryHeap                    indices;
+        GeometryHeap                    instances;                      // InstanceData of every mesh. A mesh that isn't instanced holds one.
+        Buffer                          visible;                        // Instances left by the culling pass, one entry per element of the instance heap.
+        Buffer                          drawRecords;                    // One DrawRecord per draw slot.
+        Buffer                          drawCommands;                   // One VkDrawIndexedIndirectCommand per mesh, in batch order.
+        Buffer                          drawCounts;                     // Culling flags of each draw slot, then the draw count of each batch (VK_KHR_draw_indirect_count).
+        std::vector<VkDrawIndexedIndirectCommand> commands;             // Commands of the frame before the culling pass. Reused.
+        uint32_t                        drawCapacity = 0;               // Draw slots of the buffers.
+        uint32_t                        usedDraws = 0;                  // Slots handed out so far.
+        std::vector<uint32_t>           freeDraws;                      // Released slots, reused first.
+        size_t                          compactions = 0;                // Compactions done since the start.
+        GeometryCompaction              compaction;                     // Compaction in flight, if any.
+    };
+
+
+    /*The descriptors split by update frequency:
+        set 0 (frame):    camera block of the frame region and the skymap. One set per swapchain image.
+        set 1 (material): the textures of a mesh. One set per mesh.
+        set 2 (draw):     the instance table, the visible instances and the draw records of the geometry arena. A single set.
+        set 3 (gbuffer):  the G-buffer of the deferred mode.
+        set 4 (adaptive): the statistics and sample budget of the adaptive sampling, when the device supports it.
+      The per object data (transformation, parameters, samples) is in the draw record of the mesh (see DrawRecord).*/
     struct Descriptor {
-        VkDescriptorSetLayout           layout = VK_NULL_HANDLE;                         // The layout of the descriptor sets
-        VkDescriptorPool                pool = VK_NULL_HANDLE;                           // Vulkan Object which handles memory allocation functionalities
-        std::vector<VkDescriptorSet>    sets;                           // The sets we have initialized and created.
+        DescriptorAllocator             frame;                          // Set 0
+        DescriptorAllocator             material;                       // Set 1
+        DescriptorAllocator             draw;                           // Set 2
+        VkDescriptorSet                 drawSet = VK_NULL_HANDLE;       // Written by writeDrawDescriptors() whenever a buffer of the arena is recreated.
+        VkDescriptorSet                 retiredDrawSet = VK_NULL_HANDLE;// Replaced by renewDrawDescriptors(), released once the frames in flight are done with it.
+        DescriptorAllocator             gbuffer;                        // Set 3: the G-buffer attachments (deferred mode).
+        VkDescriptorSet                 gbufferSet = VK_NULL_HANDLE;    // Written with the G-buffer, by writeGBufferDescriptors().
+        DescriptorAllocator             adaptive;                       // Set 4: the adaptive sampling images, also set 0 of adaptive.comp.
+        VkDescriptorSet                 adaptiveSet = VK_NULL_HANDLE;   // Null unless Device::fragmentStores. Written by writeAdaptiveDescriptors().
+        std::vector<VkDescriptorSet>    frameSets;                      // One per frame region of the uniform arena.
+        size_t                          setWrites = 0;                  // Sets written since the start. Shown in the Logs window.
+
+        /*Bindless mode (VK_EXT_descriptor_indexing). Set 1 is then a single set shared by all the meshes: a partially bound
+          texture array and the material table (per mesh: the texture count followed by the indices into the array).*/
+        bool                            bindless = false;
+        VkDescriptorSet                 textureSet = VK_NULL_HANDLE;    // Texture array and material table.
+        uint32_t                        textureCapacity = 0;            // Slots of the texture array.
+        uint32_t                        usedTextures = 0;               // Slots handed out so far.
+        std::vector<uint32_t>           freeTextures;                   // Released slots, reused first.
+        Buffer                          materialTable;                  // Host visible and mapped. MATERIAL_RECORD_SIZE uints per record.
+        uint32_t*                       materialRecords = nullptr;      // Mapped material table.
+        uint32_t                        materialCapacity = 0;           // Records of the material table.
+        uint32_t                        usedMaterials = 0;              // Records handed out so far.
+        std::vector<uint32_t>           freeMaterials;                  // Released records, reused first.
+    };
+
+
+    /*Anti-aliasing of the scene. The MSAA modes are clamped to the sample counts of the device. FXAA renders single sampled
+      and filters the image in a full screen pass (see antialiasing_abs.cpp).*/
+    enum AntiAliasing {
+        AA_OFF = 0,
+        AA_MSAA_2X = 1,
+        AA_MSAA_4X = 2,
+        AA_MSAA_8X = 3,
+        AA_FXAA = 4,
+        AA_MODE_COUNT = 5
+    };
+
+
+    /*Full screen pass between the scene and the UI: reads the single sampled scene color and writes the swapchain image, before the
+      UI is drawn over it. FXAA in the AA_FXAA mode; the upscale of the governed mode (upscale.frag), which also blends the frame
+      into a history image when the samples are spread over several frames. The render pass, framebuffers and pipeline follow
+      the swapchain.*/
+    struct PostProcess {
+        VkDescriptorSetLayout           setLayout = VK_NULL_HANDLE;     // Scene color, history of the previous frame.
+        VkDescriptorPool                pool = VK_NULL_HANDLE;
+        std::array<VkDescriptorSet, 2>  sets = {};                      // One per history image read. FXAA only uses the first.
+        VkPipelineLayout                layout = VK_NULL_HANDLE;
+        VkSampler                       sampler = VK_NULL_HANDLE;       // Linear, clamped. FXAA and the upscale sample between the texels.
+        VkShaderModule                  vertModule = VK_NULL_HANDLE;    // fullscreen.vert
+        VkShaderModule                  fragModule = VK_NULL_HANDLE;    // fxaa.frag
+        VkShaderModule                  upscaleModule = VK_NULL_HANDLE; // upscale.frag
+        bool                            upscaled = false;               // The targets are the ones of the upscale.
+        VkRenderPass                    renderPass = VK_NULL_HANDLE;    // Null unless the mode is AA_FXAA or governed.
+        VkPipeline                      pipeline = VK_NULL_HANDLE;
+        std::vector<VkFramebuffer>      framebuffers;                   // One per swapchain image, times 2 (history written) when upscaled.
+        std::array<Image, 2>            history;                        // RGBA16F accumulation of the upscaled frames, written and read in turns.
+    };
+
+
+    /*Frame-time governor. Holds a target frame time by scaling the render extent of the scene (50 to 100% of the swapchain
+      extent, upscaled by the post pass), then by capping the light samples a frame evaluates, the rest being accumulated over
+      the next frames. See governor_abs.cpp.*/
+    struct Governor {
+        bool                            enabled = false;
+        float                           targetMs = 16.6f;               // Frame time to hold.
+        float                           frameMs = 0.0f;                 // Smoothed frame time: GPU time of the scene buffer, or the frame interval without timestamps.
+        float                           refreshMs = 1000.0f / 60.0f;    // Refresh period of the display.
+        float                           minTargetMs = 0.0f;             // Lowest target: the refresh period when the frame interval under FIFO is governed.
+        float                           scale = 1.0f;                   // Render extent over the swapchain extent, per axis.
+        int                             sampleCap = 0;                  // Light samples per frame and pixel. 0: uncapped.
+        int                             maxSamples = 1;                 // Highest sample count of the scene, reached through accumulation.
+        bool                            sharpen = true;                 // CAS-like sharpening of the upscale, bilinear otherwise.
+        uint32_t                        accumulated = 0;                // Frames blended into the history since it was reset.
+        float                           weight = 1.0f;                  // 1 drops the history, 0 blends each pixel by the samples its frame took.
+        uint32_t                        sampleOffset = 0;               // Frame of the accumulation, picks the block of each sample sequence.
+        uint32_t                        historyIndex = 0;               // History image written by the frame.
+        uint32_t                        settleFrames = 0;               // Frames left before the next decision.
+        std::vector<std::string>        decisions;                      // Ring of the latest changes, GOVERNOR_LOG_SIZE once filled. The strings are reused.
+        size_t                          decisionCount = 0;              // Changes logged since the reset. The latest is at (decisionCount - 1) % GOVERNOR_LOG_SIZE.
     };
 
 
@@ -131,34 +359,126 @@ namespace brdfa {
         VkRenderPass                    sceneRenderPass;                // Render pass to be used in Graphics pipeline.
         VkPipelineLayout                layout;                         // Pipeline layout used in the current Graphics pipeline.
         std::unordered_map<std::string, VkPipeline>                      pipelines;                       // Graphics pipeline that we can submit commands into.
+        VkPipelineCache                 cache = VK_NULL_HANDLE;         // Pipeline cache shared by all the pipelines. Persisted on the disk between runs.
+        VkShaderModule                  vertModule = VK_NULL_HANDLE;    // Vertex module shared by all the BRDF pipelines.
+        VkPipeline                      vertexInputLibrary = VK_NULL_HANDLE;        // Shared graphics pipeline libraries (VK_EXT_graphics_pipeline_library).
+        VkPipeline                      preRasterLibrary = VK_NULL_HANDLE;          // Built once per render pass/layout. Only the fragment library
+        VkPipeline                      fragmentOutputLibrary = VK_NULL_HANDLE;     // changes between BRDFs.
+        std::unordered_map<std::string, VkPipeline>                      fragmentLibraries;               // Fragment shader library of each BRDF pipeline.
+        std::unordered_map<std::string, VkPipeline>                      variants;                        // Specialized BRDF pipelines (fixed sample count). Created lazily, keyed by variantKey().
+        VkPipeline                      depthPipeline = VK_NULL_HANDLE; // Depth only pipeline of the pre-pass: main.vert without a fragment shader.
+        AntiAliasing                    antiAliasing = AA_MSAA_4X;      // Mode the render passes and pipelines were created for.
+        bool                            scaled = false;                 // The scene is drawn offscreen at the render extent and upscaled (governed mode).
+
+        /*Deferred mode. The pre-pass fills the G-buffer, classify.comp lists the tiles of each batch, and the BRDF pipelines shade
+          the tiles of their batch (tiles.vert).*/
+        bool                            deferred = false;
+        VkRenderPass                    gbufferRenderPass = VK_NULL_HANDLE;
+        VkPipeline                      gbufferPipeline = VK_NULL_HANDLE;   // main.vert and gbuffer.frag.
+        VkPipelineLayout                classifyLayout = VK_NULL_HANDLE;    // The draw and G-buffer sets, ClassifyPushConstants.
+        VkPipeline                      classifyPipeline = VK_NULL_HANDLE;  // classify.comp
+
+        /*Key of the variant of the given BRDF specialized for the given sample count*/
+        static std::string variantKey(const std::string& brdfName, const int& samples) {
+            return brdfName + "#" + std::to_string(samples);
+        }
     };
 
 
-    struct Commander {
-        VkCommandPool                   pool;                           // Handles the memory allocation of the command buffers
-        std::vector<VkCommandBuffer>    sceneBuffers;                   // Command buffers allocated from this pool.
-        std::vector<VkCommandBuffer>    uiBuffers;
+    /// <summary>
+    /// Specialization constants data of the main fragment shader. Matches the constant_id layout of main.frag.
+    /// </summary>
+    struct SampleSpecialization {
+        int32_t                         samples;                        // constant_id = 0: Number of light samples (0 selects the dynamic count).
+        int32_t                         stride;                         // constant_id = 1: Stride of the pseudo random sequence between samples.
+
+        static std::array<VkSpecializationMapEntry, 2> getMapEntries() {
+            std::array<VkSpecializationMapEntry, 2> entries{};
+            entries[0].constantID = 0;
+            entries[0].offset = offsetof(SampleSpecialization, samples);
+            entries[0].size = sizeof(int32_t);
+
+            entries[1].constantID = 1;
+            entries[1].offset = offsetof(SampleSpecialization, stride);
+            entries[1].size = sizeof(int32_t);
+            return entries;
+        }
     };
 
 
+    struct FrameContext {
+        VkCommandPool                   pool;                           // Transient pool of the frame. Reset as a whole once the frame fence signals.
+        VkCommandBuffer                 sceneBuffer;                    // Thin primary executing the secondaries of the scene.
+        VkCommandBuffer                 uiBuffer;                       // ImGui draw commands.
+        bool                            statisticsPending = false;      // The scene buffer of the frame wrote its pipeline statistics query.
+        bool                            timestampsPending = false;      // The scene buffer of the frame wrote its timestamps.
+    };
 
 
-    struct Buffer {
-        VkBuffer                        obj;                            // Vulkan Object ID. Vulkan don't allocate memory for the buffer.
-        VkDeviceMemory                  memory;                         // The allocated Memory ID. It is somekind of a pointer that Vulkan understands.
+    struct Mesh;
+
+
+    /*Secondary command buffers drawing a batch: the meshes sharing a pipeline, every mesh in the pre-pass, or the skybox.
+      A buffer is re-recorded when the key of the batch differs from the one it was recorded with (see recordSceneCommands()).*/
+    struct DrawBatch {
+        VkPipeline                      pipeline = VK_NULL_HANDLE;
+        uint32_t                        first = 0;                      // First draw command (in Commander::drawOrder) of the batch.
+        uint32_t                        count = 0;                      // Meshes of the batch.
+        uint64_t                        key = 0;                        // Pipeline, commands, members and scene version of the batch.
+        std::vector<VkCommandBuffer>    buffers;                        // One per swapchain image. Allocated on first use.
+        std::vector<uint64_t>           recordedKeys;                   // Key each of the buffers was recorded with.
+        uint32_t                        binds = 0;                      // Binds recorded in each of the buffers.
+        uint32_t                        draws = 0;                      // Draw calls recorded in each of the buffers.
     };
 
 
-    struct MVPMatrices {
-        alignas(16) glm::mat4           model;                          // Model matrix: Maps model to world space.
+    struct Commander {
+        VkCommandPool                   pool;                           // Handles the memory allocation of the long lived command buffers (the secondaries of the batches)
+        VkCommandPool                   uploadPool;                     // Pool of the one-time (upload) command buffers.
+        std::vector<VkCommandBuffer>    uploadBuffers;                  // One-time command buffers being recorded. Used as a stack.
+        std::vector<FrameContext>       frames;                         // One context per frame in flight.
+        std::vector<VkCommandBuffer>    executeList;                    // Reused list of the secondaries executed by a scene buffer.
+        size_t                          recordedSecondaries = 0;        // Number of secondary buffers recorded so far.
+        size_t                          frameBinds = 0;                 // Pipeline, buffer and descriptor set binds executed by the last scene buffer.
+        size_t                          frameDraws = 0;                 // Draw calls executed by the last scene buffer.
+        size_t                          allocations = 0;                // Number of command pools and buffers allocated so far.
+        bool                            depthPrepass = true;            // Lay the depth of the meshes down first, so each pixel is shaded once. Always on in deferred mode.
+        VkExtent2D                      renderExtent = { 0, 0 };        // Viewport of the scene secondaries. The swapchain extent when 0.
+        std::vector<Mesh*>              drawOrder;                      // Meshes sorted by pipeline: draw command i draws drawOrder[i]. Reused.
+        std::vector<DrawBatch>          batches;                        // One per pipeline drawing meshes. Kept past batchCount for later frames.
+        uint32_t                        batchCount = 0;                 // Batches of the last frame.
+        DrawBatch                       prepass;                        // Every mesh, depth only (or into the G-buffer).
+        DrawBatch                       skybox;
+        uint64_t                        sceneVersion = 1;               // Bumped by invalidateSceneCommands(): every batch is re-recorded.
+        VkQueryPool                     statistics = VK_NULL_HANDLE;    // Pipeline statistics of the scene pass, one query per frame in flight.
+        uint64_t                        fragmentInvocations = 0;        // Fragment shader invocations of the last finished scene pass.
+        VkQueryPool                     timestamps = VK_NULL_HANDLE;    // Start and end of the scene buffer, two queries per frame in flight.
+        float                           gpuFrameMs = 0.0f;              // GPU time of the last finished scene buffer: culling, scene and post passes. 0 if not measured.
+    };
+
+
+    struct FrameAllocations {
+        size_t                          heap = 0;                       // operator new calls of the main thread.
+        size_t                          imgui = 0;                      // ImGui allocator calls of the main thread (malloc, not operator new).
+        size_t                          vulkan = 0;                     // Command pools and buffers allocated.
+    };
+
+
+
+
+    struct CameraUniforms {
         alignas(16) glm::mat4           view;                           // View matrix: Maps object to camera space
         alignas(16) glm::mat4           proj;                           // Projection matrix 
         alignas(16) glm::vec3           pos_c;                          // Camera position in the world
-        alignas(16) glm::vec3           render_opt;                     // This holds the rendering option, roughness, specularity and other data that are sent to the gpu.
+        int32_t                         sampleCap;                      // Light samples per frame (Governor::sampleCap). 0: all of them.
+        int32_t                         sampleOffset;                   // Frame of the accumulation (Governor::sampleOffset).
+        int32_t                         adaptive;                       // Adaptive sampling: 0 off, 1 on, 2 budget heatmap.
+        int32_t                         adaptiveMax;                    // Samples per pixel and frame at most (AdaptiveSampling::maxSamples).
+        alignas(16) glm::mat4           inverseViewProj;                // Deferred mode: maps the G-buffer depth back to the world.
+        alignas(16) glm::vec4           viewport;                       // Extent the scene is drawn at, and its reciprocal.
     };
 
 
-    
     struct Parameters {
         alignas(16) glm::vec3           extra012 = glm::vec3(0.0, 0.0, 0.0);       // Extra parameters from 0 to 2
         alignas(16) glm::vec3           extra345 = glm::vec3(0.0, 0.0, 0.0);       // Extra parameters from 3 to 5
@@ -167,6 +487,172 @@ namespace brdfa {
 
 
 
+    /*Per draw data of a mesh, at its draw slot in GeometryArena::drawRecords. Matches the DrawRecord struct (std430) of main.vert,
+      main.frag, minimal.frag, cull.comp and classify.comp, which find it through the instance drawn (InstanceData::record).*/
+    struct DrawRecord {
+        glm::mat4                       model;                          // Model matrix: Maps model to world space. The normal matrix is derived from it in main.vert.
+        glm::vec4                       params0;                        // iParameter0..3
+        glm::vec4                       params1;                        // iParameter4..7
+        float                           param8;                         // iParameter8
+        int32_t                         samples;                        // Light samples of the dynamic pipeline.
+        uint32_t                        batch;                          // Mesh::batchIndex, for the tile classification of the deferred mode.
+        uint32_t                        material;                       // Record of the object in the bindless material table (in uints).
+    };
+    static_assert(sizeof(DrawRecord) == 112, "DrawRecord must match the std430 layout of the DrawRecord struct");
+
+
+    /*Pushed once per batch, or per draw when the device can't draw a batch in one call. Matches the push_constant block of main.vert
+      and main.frag.*/
+    struct DrawPushConstants {
+        uint32_t                        instanceBase;                   // Added to gl_InstanceIndex when firstInstance can't carry the instance range.
+                                                                        // Deferred shading: batch of the tiles drawn.
+        uint32_t                        record;                         // Deferred shading: record of the mesh shaded, or DEFERRED_ANY_RECORD.
+    };
+
+
+    /*Per pass data of classify.comp. Matches its push_constant block.*/
+    struct ClassifyPushConstants {
+        uint32_t                        extent[2];                      // Render extent of the scene.
+    };
+
+
+    /*An instance of a mesh, in the instance heap of the geometry arena. Matches the Instance struct (std430) of main.vert and main.frag.*/
+    struct InstanceData {
+        glm::mat4                       transformation = glm::mat4(1.f);// Placement of the instance, applied before the transformation of the mesh.
+        float                           params[9] = {};                 // iParameter0..8 of the instance.
+        uint32_t                        overrides = 0;                  // Bit i set: iParameter i comes from params, otherwise from the mesh.
+        uint32_t                        record = 0;                     // Draw slot of the mesh: its DrawRecord.
+        uint32_t                        padding = 0;
+    };
+    static_assert(sizeof(InstanceData) == 112, "InstanceData must match the std430 layout of the Instance struct");
+
+
+    /*Per frame data of the culling pass, one per frame in flight. Matches the CullFrame struct (std430) of cull.comp.
+      The CPU writes the matrices and clears the counters before the frame, the pass adds to the counters.*/
+    struct CullFrame {
+        glm::mat4                       viewProj;                       // Camera of the frame: frustum test.
+        glm::mat4                       previousViewProj;               // Camera the Hi-Z pyramid was built with: occlusion test.
+        glm::vec4                       viewport;                       // Size of the pyramid's first level, its level count, occlusion test on (1) or off (0).
+        uint32_t                        testedInstances;
+        uint32_t                        frustumCulled;                  // Instances out of the frustum.
+        uint32_t                        occlusionCulled;                // Instances behind the previous frame's depth.
+        uint32_t                        culledObjects;                  // Objects with every instance culled (draw count 0).
+        uint32_t                        culledTriangles;
+        uint32_t                        savedFragments;                 // Screen area of the occluded bounds: fragments not shaded.
+        float                           scale;                          // Render scale the pyramid was built at: its covered part.
+        uint32_t                        padding;
+    };
+    static_assert(sizeof(CullFrame) == 176, "CullFrame must match the std430 layout of cull.comp");
+
+
+    /*Per object data of the culling pass. Matches the push_constant block of cull.comp.*/
+    struct CullPushConstants {
+        glm::vec4                       boundsMin;                      // Mesh::boundsMin (xyz)
+        glm::vec4                       boundsMax;                      // Mesh::boundsMax (xyz)
+        uint32_t                        drawSlot;                       // Draw record (model matrix) and culling flags of the mesh.
+        uint32_t                        batchSlot;                      // Draw command of the mesh.
+        uint32_t                        countSlot;                      // Draw count of the batch of the mesh.
+        uint32_t                        batchOffset;                    // Draw of the mesh within its batch.
+        uint32_t                        instanceBase;                   // Instance range of the mesh in the instance heap.
+        uint32_t                        instanceCount;
+        uint32_t                        triangles;                      // Triangles of one instance.
+        uint32_t                        flags;                          // CULL_FLAG_*
+        uint32_t                        frame;                          // CullFrame of the frame.
+    };
+    static_assert(sizeof(CullPushConstants) <= 128, "CullPushConstants must fit the guaranteed push constant range");
+
+
+    /*GPU culling: a compute pass before the scene pass tests the bounds of every instance against the frustum and a
+      hierarchical depth (Hi-Z) pyramid built out of the previous frame's depth, and writes the instances left (and their
+      count) into the indirect draw commands of the geometry arena.*/
+    /*Per frame counters of the adaptive sampling passes, one per frame in flight. Matches the AdaptiveFrame struct (std430) of
+      adaptive.comp. Cleared on the GPU before the passes, read back once the frame is done.*/
+    struct AdaptiveFrame {
+        uint32_t                        errorSum;                       // Relative errors of the active pixels, in 1/ADAPTIVE_ERROR_SCALE.
+        uint32_t                        activePixels;                   // Pixels above the error target.
+        uint32_t                        convergedPixels;                // Pixels below the error target, or at the sample count of their object.
+        uint32_t                        budget;                         // Light samples handed out for the next scene pass.
+        uint32_t                        claimed;                        // Light samples the pixels asked for, budget or not.
+    };
+
+
+    /*Per pass data of adaptive.comp. Matches its push_constant block.*/
+    struct AdaptivePushConstants {
+        int32_t                         extent[2];                      // Render extent of the scene.
+        float                           targetError;                    // AdaptiveSampling::targetError
+        float                           budget;                         // Light samples of the frame, all the pixels together.
+        uint32_t                        pilot;                          // Samples of every pixel after a reset. 0 once the statistics exist.
+        uint32_t                        maxSamples;                     // AdaptiveSampling::maxSamples
+        uint32_t                        frame;                          // Counters written (frame in flight).
+    };
+
+
+    /*Adaptive sampling. main.frag keeps a running mean and variance of every pixel in storage images and takes as many light
+      samples as the budget map says. Before each scene pass, adaptive.comp rebuilds the map: the pixels above the error target
+      share the sample budget of the frame in proportion to their relative error, the others get none. See adaptive_abs.cpp.*/
+    struct AdaptiveSampling {
+        VkPipelineLayout                layout = VK_NULL_HANDLE;        // The adaptive set (Descriptor::adaptive) and AdaptivePushConstants.
+        VkPipeline                      errorPipeline = VK_NULL_HANDLE; // Relative error of every pixel.
+        VkPipeline                      budgetPipeline = VK_NULL_HANDLE;// Budget map from the errors.
+        Image                           mean;                           // RGBA32F: mean color, samples taken.
+        Image                           moments;                        // RGBA32F: mean luminance, sum of squared deviations, sample count of the object.
+        Image                           budgetMap;                      // R32UI: samples of the next scene pass.
+        Image                           error;                          // R32F: relative error, 0 once converged.
+        Buffer                          frames;                         // Host visible and mapped. One AdaptiveFrame per frame in flight.
+        AdaptiveFrame*                  mappedFrames = nullptr;
+        bool                            reset = true;                   // The statistics are cleared by the next pass: the picture changed.
+
+        bool                            supported = false;              // Device::fragmentStores
+        bool                            enabled = false;
+        bool                            heatmap = false;                // Debug view: the budget map instead of the picture.
+        float                           budget = 8.0f;                  // Light samples per pixel of the render extent and frame, spread by the error.
+        float                           targetError = 0.01f;            // Relative error of the mean under which a pixel stops sampling.
+        int                             maxSamples = 64;                // Samples per pixel and frame at most.
+        AdaptiveFrame                   stats{};                        // Counters of the last completed frame.
+    };
+
+
+    struct Culling {
+        VkDescriptorSetLayout           setLayout = VK_NULL_HANDLE;     // Set 0 of the culling pass: frames, pyramid, draw commands and counts.
+        VkPipelineLayout                layout = VK_NULL_HANDLE;        // Set 0, then the instance set layout of the meshes (set 1).
+        VkPipeline                      pipeline = VK_NULL_HANDLE;
+        VkDescriptorSetLayout           hizSetLayout = VK_NULL_HANDLE;  // Source level (or depth) and target level of a reduction.
+        VkPipelineLayout                hizLayout = VK_NULL_HANDLE;
+        VkPipeline                      hizSeedPipeline = VK_NULL_HANDLE;   // Depth attachment to the first level.
+        VkPipeline                      hizReducePipeline = VK_NULL_HANDLE; // Level to the next one.
+        VkDescriptorPool                pool = VK_NULL_HANDLE;
+        VkDescriptorSet                 set = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet>    hizSets;                        // One per level (HIZ_MAX_LEVELS).
+        Buffer                          frames;                         // Host visible and mapped. One CullFrame per frame in flight.
+        CullFrame*                      mappedFrames = nullptr;
+        VkSampler                       sampler = VK_NULL_HANDLE;       // Nearest, clamped.
+        Image                           hiz;                            // R32 max depth pyramid. Sized after the swapchain.
+        std::vector<VkImageView>        hizViews;                       // One per level.
+        uint32_t                        hizLevels = 0;
+        VkExtent2D                      hizExtent = { 0, 0 };
+        bool                            hizValid = false;               // The pyramid holds the depth of a previous frame.
+        glm::mat4                       hizViewProj = glm::mat4(1.f);   // Camera of the frame the pyramid was built from.
+        float                           renderScale = 1.0f;             // Render scale of the scene pass (Governor::scale).
+        float                           hizScale = 1.0f;                // Render scale the pyramid was built at.
+
+        bool                            enabled = true;                 // Frustum test (off: every instance is drawn).
+        bool                            occlusion = true;               // Hi-Z test.
+        bool                            showCulled = false;             // Debug view: the culled instances are drawn tinted instead of dropped.
+        CullFrame                       stats{};                        // Counters of the last completed frame.
+    };
+
+
+    /*One persistently mapped buffer holding the camera block of every frame. Each swapchain image has its own region
+      (aligned for dynamic offsets), so a region is only written once the previous frame of that image is done.*/
+    struct UniformArena {
+        Buffer                          buffer;                         // Host visible, coherent and mapped as long as it lives.
+        uint8_t*                        mapped = nullptr;               // Start of the mapped buffer.
+        VkDeviceSize                    frameSize = 0;                  // Aligned size of the camera block, i.e. of a frame region.
+        uint32_t                        frameCount = 0;                 // Number of frame regions.
+    };
+
+
+
     struct SyncCollection {
         VkSemaphore                     s_imageAvailable;
         VkSemaphore                     s_renderFinished;
@@ -247,7 +733,7 @@ namespace brdfa {
 
 
     struct Mesh {
-        uint32_t					uid;
+        uint32_t					uid = 0;                            // Id of the object in the scene, unique for the run. Pushed with the draws.
         std::vector<Image>			textureImages;				        // Holds the texture Image data.
 
         std::vector<Vertex>			vertices;					        // Vertices of the Mesh. Vertices can hold more than a position.
@@ -263,13 +749,32 @@ namespace brdfa {
         glm::vec3                   scale = glm::vec3(1, 1, 1);         // Holds the object scale on x,y,z
 
         Parameters                  params = {};                        // Parameters regarding this object
-        std::vector<Buffer>         paramsBuffer;                       // Holds the parameter buffers
+        VkDescriptorSet             materialSet = VK_NULL_HANDLE;       // Textures of the mesh (set 1). None for the skybox.
+        std::vector<uint32_t>       textureSlots;                       // Bindless mode: slots of the textures in the texture array.
+        uint32_t                    materialSlot = 0;                   // Bindless mode: record of the mesh in the material table.
+        std::vector<InstanceData>   instances;                          // Instances drawn by the mesh. Empty: the mesh is drawn once.
+        int                         instanceGrid[2] = { 10, 10 };       // Columns and rows of the instance grid generator (Object Viewer).
+        int                         gridParameters[2] = { 0, 1 };       // Parameters swept along the columns and the rows of the grid.
+        float                       gridSpacing = 2.5f;                 // Distance between the instances of the grid.
         int                         shownParameters = 0;                // The number of the shown extra parameters
 
         std::string                 renderOption = "None";
+        int                         specializedSamples = 0;             // Sample count of the specialized pipeline in use. 0 means the dynamic pipeline.
 
-        Buffer						vertexBuffer;				        // Vulkan buffer of the vertices
-        Buffer						indexBuffer;				        // Vulkan buffer of the Indices
+        glm::vec3                   boundsMin = glm::vec3(0.f);         // Model space bounding box of the vertices. Tested by the culling pass.
+        glm::vec3                   boundsMax = glm::vec3(0.f);
+        GeometryRange               vertexRange;                        // Vertices of the mesh in the geometry arena.
+        GeometryRange               indexRange;                         // Indices of the mesh in the geometry arena.
+        GeometryRange               instanceRange;                      // Instances of the mesh in the geometry arena.
+        uint32_t                    drawSlot = 0;                       // Draw record of the mesh in the geometry arena.
+        uint32_t                    batchSlot = 0;                      // Draw command of the mesh this frame (see Commander::drawOrder).
+        uint32_t                    batchFirst = 0;                     // First draw command of its batch this frame.
+        uint32_t                    batchIndex = 0;                     // Its batch this frame. Written into its draw record.
+
+        uint64_t                    drawVersion = 1;                    // Bumped when the pipeline or the draw record of the mesh change.
+        uint64_t                    recordVersion = 0;                  // drawVersion the draw record was written at.
+        uint64_t                    pipelineVersion = 0;                // drawVersion the pipeline was resolved at.
+        VkPipeline                  pipeline = VK_NULL_HANDLE;          // Pipeline drawing the mesh (see meshPipeline()).
 
 
         glm::mat4 getFinalTransformation() {
@@ -501,6 +1006,24 @@ namespace brdfa {
     };
 
 
+    /*Instruction counts of a SPIR-V function or block range, by class.*/
+    struct InstructionCounts {
+        uint32_t                alu = 0;                        // Arithmetic, conversions, comparisons, non transcendental GLSL.std.450.
+        uint32_t                transcendental = 0;             // sin, cos, pow, exp, log, sqrt ...
+        uint32_t                texture = 0;                    // Image samples, fetches and gathers.
+        uint32_t                branch = 0;                     // Conditional branches, switches and discards.
+        uint32_t                total = 0;                      // All the instructions.
+    };
+
+
+    /*Static cost report of a compiled BRDF fragment shader.*/
+    struct ShaderCost {
+        InstructionCounts       shader;                         // The whole module: all the functions and the declarations.
+        InstructionCounts       render;                         // render() of the BRDF with its callees. Empty if not found.
+        InstructionCounts       loop;                           // Body of the outermost loop of main() (the light sampling loop) with its callees.
+        bool                    renderFound = false;            // render() is a function of its own (not inlined and its name kept).
+        bool                    valid = false;
+    };
 
 
     /// <summary>
@@ -510,10 +1033,153 @@ namespace brdfa {
         std::string             brdfName;
         TextEditor              glslPanel;	/*IMGUI Text editor Addon: https://github.com/ELTE-IK-CG/Dragonfly/tree/master/include/ImGui-addons/imgui_text_editor*/
         std::vector<char>       latest_spir_v;
+        uint64_t                spirvKey = 0;           // Archive key of latest_spir_v. 0 if it is not cached (debug info builds).
         std::string             log_e = "";            // Holds the log of the last compilation
         bool                    tested = false;
         bool                    requireTest = false;
         bool                    saveFrame = false;      // Used for saving the frame of the current brdf
+
+        /*Background compilation of the editor (compile-as-you-type)*/
+        std::shared_ptr<std::atomic<uint64_t>> generation = std::make_shared<std::atomic<uint64_t>>(0);  // Bumped on every edit. Older compile jobs are cancelled/dropped.
+        std::chrono::high_resolution_clock::time_point lastEdit;
+        bool                    compilePending = false; // Edited and not submitted yet (debounce).
+        bool                    compiling = false;      // A compile job of the current generation is running.
+        bool                    liveUpdate = false;     // Hot-swap the pipeline after each successful compile.
+        float                   compileTime = 0.0f;     // Latest compile time (ms).
+        float                   editLatency = 0.0f;     // Latest edit to diagnostics time (ms).
+        ShaderCost              cost;                   // Cost report of latest_spir_v.
+        ShaderCost              previousCost;           // Cost report of the compilation before, to show what an edit changed.
+    };
+
+
+    /// <summary>
+    /// Shared GLSL snippets (shaders/include) served to the shaderc include callback. Loaded once, before any compilation.
+    /// </summary>
+    struct ShaderIncludes {
+        std::string             directory;
+        std::unordered_map<std::string, std::string> sources;  // Relative path ("microfacet.glsl") to source.
+        uint64_t                hash = 0;                       // Hash of all the snippets. Part of the SPIR-V archive keys.
+    };
+
+
+    /// <summary>
+    /// Memory mapped, content addressed SPIR-V cache archive. See helpers/cache_abs.cpp for the file layout.
+    /// </summary>
+    struct SpirvArchive {
+        std::string             path;
+        const char*             data = nullptr;                 // Mapped archive file (read only).
+        size_t                  size = 0;                       // Mapped size in bytes.
+        size_t                  validSize = 0;                  // Size of the archive up to its last valid record.
+        std::unordered_map<uint64_t, std::pair<size_t, uint32_t>> index;   // Key -> SPIR-V offset and size in the mapping.
+        std::unordered_set<uint64_t> used;                      // Keys read or written in this session. Others are dropped on compaction.
+        void*                   fileHandle = nullptr;           // Win32 file and mapping handles.
+        void*                   mappingHandle = nullptr;
+        int                     fd = -1;                        // POSIX file descriptor.
+        std::mutex              mutex;                          // Held by every archive call: the stores run on the compile service.
+    };
+
+
+    /// <summary>
+    /// A BRDF pipeline built by a worker thread, waiting to be published by the main thread.
+    /// </summary>
+    struct ReadyPipeline {
+        BRDF_Panel              panel;
+        VkPipeline              pipeline = VK_NULL_HANDLE;      // VK_NULL_HANDLE if the build failed.
+        VkPipelineCache         cache = VK_NULL_HANDLE;         // Cache of the worker. Merged into the engine cache when published.
+        float                   creationTime = 0.0f;            // Pipeline creation time in ms.
+        uint64_t                spirvKey = 0;                   // Archive key of the fragment shader source.
+        bool                    compiled = false;               // The SPIR-V was compiled (not found in the archive) and should be archived.
+        uint64_t                swapGeneration = 0;             // Hot-swap request the pipeline was built for. 0 for the loading builds.
+    };
+
+
+    /// <summary>
+    /// A BRDF pipeline re-linked with link time optimizations in the background. Replaces the fast-linked one.
+    /// </summary>
+    struct LinkedPipeline {
+        std::string             brdfName;
+        VkPipeline              pipeline = VK_NULL_HANDLE;      // VK_NULL_HANDLE if the link failed.
+        uint64_t                generation = 0;                 // Generation of the BRDF the link was started for. Older generations are dropped.
+        VkPipelineCache         cache = VK_NULL_HANDLE;         // Cache of the worker. Merged into the engine cache when swapped in or dropped.
+        float                   linkTime = 0.0f;                // Optimized link time in ms.
+    };
+
+
+    struct PipelineQueue {
+        std::mutex              mutex;
+        std::queue<ReadyPipeline> ready;                        // Pipelines built by the workers and not yet published.
+        std::queue<LinkedPipeline> linked;                      // Optimized pipelines not yet swapped in.
+        size_t                  pending = 0;                    // Number of the launched builds that are not published yet. (main thread only)
+        size_t                  linking = 0;                    // Number of the launched optimized links that are not swapped in yet. (main thread only)
+    };
+
+
+    /*shaderc optimization levels (spirv-opt recipes run by shaderc).*/
+    enum ShaderOptimization {
+        SHADER_OPT_NONE = 0,
+        SHADER_OPT_SIZE = 1,
+        SHADER_OPT_PERFORMANCE = 2
+    };
+
+
+    struct ShaderCompileOptions {
+        ShaderOptimization      optimization = SHADER_OPT_PERFORMANCE;
+        bool                    debugInfo = false;              // Builds with debug info are never cached.
+        bool                    bindless = false;               // Defines BRDFA_BINDLESS: the textures are read through the bindless table.
+        bool                    deferred = false;               // Defines BRDFA_DEFERRED: the fragment shaders read their inputs from the G-buffer.
+        bool                    adaptive = false;               // Defines BRDFA_ADAPTIVE: main.frag reads the budget map and keeps the pixel statistics.
+    };
+
+
+    /*Priority of the compile service jobs. Higher runs first.*/
+    enum CompilePriority {
+        BACKGROUND_PRIORITY = 0,                                // Loading/warm-up work.
+        INTERACTIVE_PRIORITY = 1                                // Work the user is waiting on (editor, test window).
+    };
+
+
+    struct CompileResult {
+        std::vector<char>       spirv;                          // Empty if the compilation failed.
+        std::string             log;                            // Compilation errors.
+        bool                    success = false;
+        bool                    cancelled = false;              // Dropped before compiling (a newer job replaced it).
+        float                   waitTime = 0.0f;                // Time spent in the queue (ms).
+        float                   compileTime = 0.0f;             // Compilation time (ms).
+    };
+
+
+    struct CompileJob {
+        int                     priority;
+        uint64_t                order;                          // Submission order. Jobs of the same priority run first come first served.
+        std::function<void()>   run;
+
+        bool operator<(const CompileJob& other) const {
+            if (priority != other.priority) return priority < other.priority;
+            return order > other.order;
+        }
+    };
+
+
+    /*Fixed pool of workers running the shader compilations (and the pipeline builds that depend on them).*/
+    struct CompileService {
+        std::vector<std::thread> workers;
+        std::mutex              mutex;
+        std::condition_variable condition;
+        std::priority_queue<CompileJob> jobs;
+        bool                    stopping = false;
+        uint64_t                submitted = 0;
+        size_t                  running = 0;                    // Jobs being executed right now.
+        size_t                  compiled = 0;                   // Finished compilations (stats).
+        double                  totalCompileTime = 0.0;         // Sum of the compilation times in ms (stats).
+    };
+
+
+    /*Compile job of a BRDF Editor panel.*/
+    struct EditorCompile {
+        std::future<CompileResult> result;
+        uint64_t                generation = 0;                 // Panel generation the job compiles.
+        uint64_t                key = 0;                        // Archive key of the compiled source.
+        bool                    cacheable = true;               // False for the debug info builds.
     };
 
     
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+// --------------------------------- Adaptive Sampling ---------------------------------
+//  Instead of the same light samples everywhere, every pixel keeps the running mean of its samples and the variance of
+//  their luminance (main.frag, BRDFA_ADAPTIVE). Before each scene pass, adaptive.comp takes the relative error of each
+//  mean and hands the budget of the frame out to the pixels above the error target, in proportion to their error; the
+//  converged ones stop sampling and show their mean. The statistics are cleared whenever the picture changes, and the
+//  first frame after that samples every pixel evenly to get the variances started.
+
+namespace brdfa {
+
+    /*Storage images of the statistics, sized after the swapchain.*/
+    static void createAdaptiveImage(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain, VkFormat format) {
+        createImage(commander, device, swapchain.extent.width, swapchain.extent.height, 1, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image);
+        image.view = createImageView(image.obj, device.device, format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    }
+
+
+    static void destroyAdaptiveImage(Image& image, const Device& device) {
+        if (image.obj == VK_NULL_HANDLE) return;
+        vkDestroyImageView(device.device, image.view, nullptr);
+        vkDestroyImage(device.device, image.obj, nullptr);
+        vkFreeMemory(device.device, image.memory, nullptr);
+        image = Image();
+    }
+
+
+    static VkPipeline createAdaptivePipeline(const Device& device, VkPipelineLayout layout, const std::vector<char>& spirv, VkPipelineCache cache) {
+        VkShaderModule module = createShaderModule(device, spirv);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateComputePipelines(device.device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device.device, module, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create an adaptive sampling pipeline!");
+        }
+        return pipeline;
+    }
+
+
+    /// <summary>
+    /// Creates the pipelines and the per frame counters of the adaptive sampling passes. The images are created by
+    /// createAdaptiveTargets() once the swapchain exists. Only done when the device has the adaptive set (Device::fragmentStores).
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj">The adaptive set layout is set 0 of the passes</param>
+    /// <param name="errorSpirv">adaptive.comp</param>
+    /// <param name="budgetSpirv">adaptive.comp with ADAPTIVE_BUDGET</param>
+    /// <param name="cache"></param>
+    /// <param name="frameCount">Frames in flight</param>
+    void createAdaptiveSampling(AdaptiveSampling& adaptive, Commander& commander, const Device& device, const Descriptor& descriptorObj,
+        const std::vector<char>& errorSpirv, const std::vector<char>& budgetSpirv, VkPipelineCache cache, uint32_t frameCount)
+    {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(AdaptivePushConstants);
+
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &descriptorObj.adaptive.layout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(device.device, &layoutInfo, nullptr, &adaptive.layout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the adaptive sampling pipeline layout!");
+        }
+        adaptive.errorPipeline = createAdaptivePipeline(device, adaptive.layout, errorSpirv, cache);
+        adaptive.budgetPipeline = createAdaptivePipeline(device, adaptive.layout, budgetSpirv, cache);
+
+        /*Counters, mapped as long as they live.*/
+        createBuffer(commander, device, sizeof(AdaptiveFrame) * frameCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, adaptive.frames);
+        void* data;
+        if (vkMapMemory(device.device, adaptive.frames.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to map the adaptive sampling counters!");
+        }
+        memset(data, 0, sizeof(AdaptiveFrame) * frameCount);
+        adaptive.mappedFrames = static_cast<AdaptiveFrame*>(data);
+        adaptive.supported = true;
+    }
+
+
+    /// <summary>
+    /// Creates the statistics, the budget map and the errors after the swapchain extent, in the general layout they stay in.
+    /// The statistics start cleared. Recreated along with the swapchain.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void createAdaptiveTargets(AdaptiveSampling& adaptive, Commander& commander, const Device& device, const SwapChain& swapchain) {
+        createAdaptiveImage(adaptive.mean, commander, device, swapchain, VK_FORMAT_R32G32B32A32_SFLOAT);
+        createAdaptiveImage(adaptive.moments, commander, device, swapchain, VK_FORMAT_R32G32B32A32_SFLOAT);
+        createAdaptiveImage(adaptive.budgetMap, commander, device, swapchain, VK_FORMAT_R32_UINT);
+        createAdaptiveImage(adaptive.error, commander, device, swapchain, VK_FORMAT_R32_SFLOAT);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+        std::array<VkImageMemoryBarrier, 4> barriers{};
+        std::array<VkImage, 4> images = { adaptive.mean.obj, adaptive.moments.obj, adaptive.budgetMap.obj, adaptive.error.obj };
+        for (size_t i = 0; i < images.size(); i++) {
+            barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].image = images[i];
+            barriers[i].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        /*No budget until the first pass writes one.*/
+        VkClearColorValue zero{};
+        VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdClearColorImage(commandBuffer, adaptive.budgetMap.obj, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+        endSingleTimeCommands(commander, device);
+        adaptive.reset = true;
+    }
+
+
+    /// <summary>
+    /// Destroys the images of the adaptive sampling. Done along with the swapchain.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="device"></param>
+    void destroyAdaptiveTargets(AdaptiveSampling& adaptive, const Device& device) {
+        destroyAdaptiveImage(adaptive.mean, device);
+        destroyAdaptiveImage(adaptive.moments, device);
+        destroyAdaptiveImage(adaptive.budgetMap, device);
+        destroyAdaptiveImage(adaptive.error, device);
+    }
+
+
+    /// <summary>
+    /// Destroys the pipelines, counters and images of the adaptive sampling.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="device"></param>
+    void destroyAdaptiveSampling(AdaptiveSampling& adaptive, const Device& device) {
+        destroyAdaptiveTargets(adaptive, device);
+        if (adaptive.mappedFrames != nullptr) vkUnmapMemory(device.device, adaptive.frames.memory);
+        vkDestroyBuffer(device.device, adaptive.frames.obj, nullptr);
+        vkFreeMemory(device.device, adaptive.frames.memory, nullptr);
+        vkDestroyPipeline(device.device, adaptive.errorPipeline, nullptr);
+        vkDestroyPipeline(device.device, adaptive.budgetPipeline, nullptr);
+        vkDestroyPipelineLayout(device.device, adaptive.layout, nullptr);
+        adaptive = AdaptiveSampling();
+    }
+
+
+    /// <summary>
+    /// Takes the counters of the last run of the frame (done, since its fence signaled) into AdaptiveSampling::stats.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="frame">Frame in flight</param>
+    void beginAdaptiveFrame(AdaptiveSampling& adaptive, const uint32_t& frame) {
+        if (adaptive.mappedFrames == nullptr) return;
+        adaptive.stats = adaptive.mappedFrames[frame];
+    }
+
+
+    /// <summary>
+    /// Records the adaptive sampling passes before the scene pass: clears the statistics if the picture changed, then builds the
+    /// budget map the scene pass reads out of the errors of the statistics the previous scene passes left.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="extent">Render extent of the scene</param>
+    /// <param name="frame">Frame in flight</param>
+    void recordAdaptiveSampling(AdaptiveSampling& adaptive, VkCommandBuffer commandBuffer, const Descriptor& descriptorObj,
+        const VkExtent2D& extent, const uint32_t& frame)
+    {
+        /*The scene pass of the previous frame is done with the statistics and the budget map.*/
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        /*After a reset, every pixel takes the average budget, rounded down so the frame holds it. main.frag takes
+          ADAPTIVE_MIN_SAMPLES at least in the pixels without samples, for a first variance: the only samples out of the budget.*/
+        AdaptivePushConstants constants{};
+        if (adaptive.reset) {
+            VkClearColorValue zero{};
+            VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            vkCmdClearColorImage(commandBuffer, adaptive.mean.obj, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+            vkCmdClearColorImage(commandBuffer, adaptive.moments.obj, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+            constants.pilot = static_cast<uint32_t>(std::clamp(static_cast<int>(std::floor(adaptive.budget)), 1, std::max(adaptive.maxSamples, 1)));
+            adaptive.reset = false;
+        }
+        vkCmdFillBuffer(commandBuffer, adaptive.frames.obj, sizeof(AdaptiveFrame) * frame, sizeof(AdaptiveFrame), 0);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        constants.extent[0] = static_cast<int32_t>(extent.width);
+        constants.extent[1] = static_cast<int32_t>(extent.height);
+        constants.targetError = adaptive.targetError;
+        constants.budget = adaptive.budget * static_cast<float>(extent.width) * static_cast<float>(extent.height);
+        constants.maxSamples = static_cast<uint32_t>(std::max(adaptive.maxSamples, 1));
+        constants.frame = frame;
+        uint32_t groupsX = (extent.width + ADAPTIVE_GROUP_SIZE - 1) / ADAPTIVE_GROUP_SIZE;
+        uint32_t groupsY = (extent.height + ADAPTIVE_GROUP_SIZE - 1) / ADAPTIVE_GROUP_SIZE;
+
+        /*Errors, then the budget map from their sum.*/
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, adaptive.layout, 0, 1, &descriptorObj.adaptiveSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, adaptive.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AdaptivePushConstants), &constants);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, adaptive.errorPipeline);
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, adaptive.budgetPipeline);
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+        /*The scene pass reads the budget map and updates the statistics. The counters are read back once the frame is done.*/
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <new>
+#include <cstdlib>
+
+
+// --------------------------------- Heap Allocation Counter ---------------------------------
+//  Replaces the global operator new to count the allocations of each thread, and counts the ones of ImGui (which allocates
+//  through malloc, see ImGui::SetAllocatorFunctions) apart. The frame loop reads the counts of the main thread at the start and
+//  at the end of a whole frame (see BRDFA_Engine::updateAndRender()), which must stay at zero in the steady state.
+
+namespace brdfa {
+
+    static thread_local size_t threadHeapAllocations = 0;
+    static thread_local size_t threadImguiAllocations = 0;
+
+
+    /// <summary>
+    /// Number of operator new calls made by the calling thread so far.
+    /// </summary>
+    /// <returns></returns>
+    size_t heapAllocations() {
+        return threadHeapAllocations;
+    }
+
+
+    /// <summary>
+    /// Allocator of ImGui (ImGui::SetAllocatorFunctions). Counts the allocations of the calling thread apart from the heap ones.
+    /// </summary>
+    /// <param name="size"></param>
+    /// <param name="userData"></param>
+    /// <returns></returns>
+    void* imguiAllocate(size_t size, void* userData) {
+        threadImguiAllocations++;
+        return std::malloc(size);
+    }
+
+
+    /// <summary>
+    /// Frees the memory of imguiAllocate().
+    /// </summary>
+    /// <param name="data"></param>
+    /// <param name="userData"></param>
+    void imguiFree(void* data, void* userData) {
+        std::free(data);
+    }
+
+
+    /// <summary>
+    /// Allocation counts so far: heap and ImGui ones of the calling thread, and the Vulkan ones of the commander. The difference of
+    /// two of them is what was allocated in between.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <returns></returns>
+    FrameAllocations allocationCounts(const Commander& commander) {
+        FrameAllocations counts;
+        counts.heap = threadHeapAllocations;
+        counts.imgui = threadImguiAllocations;
+        counts.vulkan = commander.allocations;
+        return counts;
+    }
+
+
+    /// <summary>
+    /// Allocations made since the given counts were taken (see allocationCounts()).
+    /// </summary>
+    /// <param name="start"></param>
+    /// <param name="commander"></param>
+    /// <returns></returns>
+    FrameAllocations allocationsSince(const FrameAllocations& start, const Commander& commander) {
+        FrameAllocations end = allocationCounts(commander);
+        end.heap -= start.heap;
+        end.imgui -= start.imgui;
+        end.vulkan -= start.vulkan;
+        return end;
+    }
+
+}
+
+
+void* operator new(std::size_t size) {
+    brdfa::threadHeapAllocations++;
+    if (size == 0) size = 1;
+    while (true) {
+        if (void* data = std::malloc(size)) return data;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+
+void operator delete(void* data) noexcept {
+    std::free(data);
+}
+
+
+void operator delete[](void* data) noexcept {
+    std::free(data);
+}
+
+
+void operator delete(void* data, std::size_t) noexcept {
+    std::free(data);
+}
+
+
+void operator delete[](void* data, std::size_t) noexcept {
+    std::free(data);
+}
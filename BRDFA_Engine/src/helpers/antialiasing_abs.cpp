@@ -0,0 +1,462 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <array>
+
+
+// --------------------------------- Anti-aliasing ---------------------------------
+//  The mode picks the sample count of the scene attachments (device.msaaSamples) and the targets of the scene and UI passes
+//  (see createRenderPass). Without MSAA the scene is drawn single sampled: straight into the swapchain image when off, or into
+//  the color attachment which the FXAA pass (fxaa.frag over a full screen triangle) filters into the swapchain image.
+//  The governed mode (see governor_abs.cpp) uses the same pass to upscale the scene (upscale.frag) in place of FXAA.
+
+namespace brdfa {
+
+    static const std::array<const char*, AA_MODE_COUNT> ANTI_ALIASING_NAMES = { "off", "msaa2", "msaa4", "msaa8", "fxaa" };
+
+
+    /*Push constants of upscale.frag. fxaa.frag only reads inverseSize.*/
+    struct PostPushConstants {
+        float       inverseSize[2];     // 1 / swapchain extent.
+        float       scale[2];           // Render extent over the swapchain extent: the corner of the scene color holding the frame.
+        float       sharpness;          // CAS-like sharpening of the upscale, 0 for bilinear.
+        float       weight;             // 1 drops the history, 0 blends each pixel by the samples its frame took.
+    };
+
+
+    /*Format of the accumulation history of the upscale.*/
+    static const VkFormat HISTORY_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+
+    /// <summary>
+    /// Samples of the scene attachments in the given mode, clamped to the highest count of the device. 1 without MSAA.
+    /// </summary>
+    /// <param name="mode"></param>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    VkSampleCountFlagBits antiAliasingSamples(AntiAliasing mode, const Device& device) {
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        switch (mode) {
+        case AA_MSAA_2X: samples = VK_SAMPLE_COUNT_2_BIT; break;
+        case AA_MSAA_4X: samples = VK_SAMPLE_COUNT_4_BIT; break;
+        case AA_MSAA_8X: samples = VK_SAMPLE_COUNT_8_BIT; break;
+        default: break;
+        }
+        return std::min(samples, device.maxMsaaSamples);
+    }
+
+
+    /// <summary>
+    /// Name of the mode, as taken by --anti-aliasing and shown in the UI.
+    /// </summary>
+    /// <param name="mode"></param>
+    /// <returns></returns>
+    const char* antiAliasingName(AntiAliasing mode) {
+        return (mode >= 0 && mode < AA_MODE_COUNT) ? ANTI_ALIASING_NAMES[mode] : "unknown";
+    }
+
+
+    /// <summary>
+    /// Mode of the given name (see antiAliasingName()). False if there is none.
+    /// </summary>
+    /// <param name="name"></param>
+    /// <param name="mode"></param>
+    /// <returns></returns>
+    bool parseAntiAliasing(const std::string& name, AntiAliasing& mode) {
+        for (int i = 0; i < AA_MODE_COUNT; i++) {
+            if (name == ANTI_ALIASING_NAMES[i]) {
+                mode = static_cast<AntiAliasing>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    /// <summary>
+    /// Creates the parts of the post pass that don't depend on the swapchain: descriptor sets, layouts, sampler and shader modules.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    /// <param name="vertShaderSpirv">fullscreen.vert</param>
+    /// <param name="fragShaderSpirv">fxaa.frag</param>
+    /// <param name="upscaleShaderSpirv">upscale.frag</param>
+    void createPostProcess(PostProcess& post, const Device& device, const std::vector<char>& vertShaderSpirv, const std::vector<char>& fragShaderSpirv,
+        const std::vector<char>& upscaleShaderSpirv)
+    {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        setLayoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device.device, &setLayoutInfo, nullptr, &post.setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass descriptor set layout!");
+        }
+
+        uint32_t setCount = static_cast<uint32_t>(post.sets.size());
+        VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount * static_cast<uint32_t>(bindings.size()) };
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = setCount;
+        if (vkCreateDescriptorPool(device.device, &poolInfo, nullptr, &post.pool) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass descriptor pool!");
+        }
+
+        std::array<VkDescriptorSetLayout, 2> setLayouts = { post.setLayout, post.setLayout };
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = post.pool;
+        allocInfo.descriptorSetCount = setCount;
+        allocInfo.pSetLayouts = setLayouts.data();
+        if (vkAllocateDescriptorSets(device.device, &allocInfo, post.sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to allocate the post pass descriptor sets!");
+        }
+
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(PostPushConstants);
+
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &post.setLayout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(device.device, &layoutInfo, nullptr, &post.layout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass pipeline layout!");
+        }
+
+        /*FXAA blends the texels around the edges through bilinear taps, the upscale between the texels of the smaller frame.*/
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(device.device, &samplerInfo, nullptr, &post.sampler) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass sampler!");
+        }
+
+        post.vertModule = createShaderModule(device, vertShaderSpirv);
+        post.fragModule = createShaderModule(device, fragShaderSpirv);
+        post.upscaleModule = createShaderModule(device, upscaleShaderSpirv);
+    }
+
+
+    /*Render pass of the post pass: the swapchain image, fully written by the full screen triangle, and the history image written by
+      the upscale. The scene pass is done writing the scene color before it is sampled, and the previous frame is done with the
+      history images: it wrote the one read now and read the one written now.*/
+    static void createPostRenderPass(PostProcess& post, const Device& device, const SwapChain& swapchain) {
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapchain.format;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = swapchain.presentLayout;
+
+        VkAttachmentDescription historyAttachment = colorAttachment;
+        historyAttachment.format = HISTORY_FORMAT;
+        historyAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, historyAttachment };
+        std::array<VkAttachmentReference, 2> colorRefs = { {
+            { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+            { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } } };
+        uint32_t attachmentCount = post.upscaled ? 2 : 1;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = attachmentCount;
+        subpass.pColorAttachments = colorRefs.data();
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = attachmentCount;
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+
+        if (vkCreateRenderPass(device.device, &renderPassInfo, nullptr, &post.renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass render pass!");
+        }
+    }
+
+
+    /*Full screen pipeline of fxaa.frag, or of upscale.frag writing the history too: no vertex input, depth or blending.*/
+    static void createPostPipeline(PostProcess& post, const Device& device, const SwapChain& swapchain, VkPipelineCache pipelineCache) {
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = post.vertModule;
+        shaderStages[0].pName = "main";
+        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = post.upscaled ? post.upscaleModule : post.fragModule;
+        shaderStages[1].pName = "main";
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapchain.extent.width;
+        viewport.height = (float)swapchain.extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapchain.extent;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachments{};
+        for (auto& colorBlendAttachment : colorBlendAttachments) {
+            colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            colorBlendAttachment.blendEnable = VK_FALSE;
+        }
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = post.upscaled ? 2 : 1;
+        colorBlending.pAttachments = colorBlendAttachments.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = post.layout;
+        pipelineInfo.renderPass = post.renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        if (vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &post.pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the post pass pipeline!");
+        }
+    }
+
+
+    /*Creates the history images of the upscale, left in the layout they are read in. Their content is dropped by the first frame,
+      which blends with a weight of 1.*/
+    static void createHistory(PostProcess& post, Commander& commander, const Device& device, const SwapChain& swapchain) {
+        for (Image& history : post.history) {
+            createImage(commander, device, swapchain.extent.width, swapchain.extent.height, 1, VK_SAMPLE_COUNT_1_BIT, HISTORY_FORMAT,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, history);
+            history.view = createImageView(history.obj, device.device, HISTORY_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+        std::array<VkImageMemoryBarrier, 2> barriers{};
+        for (size_t i = 0; i < barriers.size(); i++) {
+            barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].image = post.history[i].obj;
+            barriers[i].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+        endSingleTimeCommands(commander, device);
+    }
+
+
+    /// <summary>
+    /// Creates the render pass, framebuffers and pipeline of the post pass after the swapchain, and points its sets to the scene color.
+    /// Done in the AA_FXAA mode and when governed (upscaled), once the scene attachments exist.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="upscaled">Governed: upscale and accumulate instead of FXAA</param>
+    /// <param name="pipelineCache"></param>
+    void createPostTargets(PostProcess& post, Commander& commander, const Device& device, const SwapChain& swapchain, const bool& upscaled,
+        const VkPipelineCache& pipelineCache)
+    {
+        post.upscaled = upscaled;
+        createPostRenderPass(post, device, swapchain);
+        createPostPipeline(post, device, swapchain, pipelineCache);
+        if (upscaled)
+            createHistory(post, commander, device, swapchain);
+
+        /*Upscaled, each swapchain image has a framebuffer per history image written: imageIndex * 2 + Governor::historyIndex.*/
+        size_t perImage = upscaled ? post.history.size() : 1;
+        post.framebuffers.resize(swapchain.imageViews.size() * perImage);
+        for (size_t i = 0; i < post.framebuffers.size(); i++) {
+            std::array<VkImageView, 2> attachments = { swapchain.imageViews[i / perImage], upscaled ? post.history[i % perImage].view : VK_NULL_HANDLE };
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = post.renderPass;
+            framebufferInfo.attachmentCount = upscaled ? 2 : 1;
+            framebufferInfo.pAttachments = attachments.data();
+            framebufferInfo.width = swapchain.extent.width;
+            framebufferInfo.height = swapchain.extent.height;
+            framebufferInfo.layers = 1;
+            if (vkCreateFramebuffer(device.device, &framebufferInfo, nullptr, &post.framebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("ERROR: failed to create the post pass framebuffer!");
+            }
+        }
+
+        /*The scene color is the resolve target with MSAA. Set i reads history i, written by the previous frame.*/
+        VkImageView sceneView = (device.msaaSamples != VK_SAMPLE_COUNT_1_BIT) ? swapchain.sceneImage.view : swapchain.colorImage.view;
+        for (size_t i = 0; i < post.sets.size(); i++) {
+            std::array<VkDescriptorImageInfo, 2> imageInfos = { {
+                { post.sampler, sceneView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+                { post.sampler, upscaled ? post.history[i].view : VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } } };
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = post.sets[i];
+            write.dstBinding = 0;
+            write.descriptorCount = upscaled ? 2 : 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.pImageInfo = imageInfos.data();
+            vkUpdateDescriptorSets(device.device, 1, &write, 0, nullptr);
+        }
+    }
+
+
+    /// <summary>
+    /// Destroys what createPostTargets() created, if anything.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    void destroyPostTargets(PostProcess& post, const Device& device) {
+        if (post.renderPass == VK_NULL_HANDLE) return;
+        for (VkFramebuffer framebuffer : post.framebuffers)
+            vkDestroyFramebuffer(device.device, framebuffer, nullptr);
+        post.framebuffers.clear();
+        for (Image& history : post.history) {
+            if (history.obj == VK_NULL_HANDLE) continue;
+            vkDestroyImageView(device.device, history.view, nullptr);
+            vkDestroyImage(device.device, history.obj, nullptr);
+            vkFreeMemory(device.device, history.memory, nullptr);
+            history = Image();
+        }
+        vkDestroyPipeline(device.device, post.pipeline, nullptr);
+        vkDestroyRenderPass(device.device, post.renderPass, nullptr);
+        post.pipeline = VK_NULL_HANDLE;
+        post.renderPass = VK_NULL_HANDLE;
+        post.upscaled = false;
+    }
+
+
+    /// <summary>
+    /// Destroys the post pass along with its targets.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    void destroyPostProcess(PostProcess& post, const Device& device) {
+        destroyPostTargets(post, device);
+        vkDestroyShaderModule(device.device, post.upscaleModule, nullptr);
+        vkDestroyShaderModule(device.device, post.fragModule, nullptr);
+        vkDestroyShaderModule(device.device, post.vertModule, nullptr);
+        vkDestroySampler(device.device, post.sampler, nullptr);
+        vkDestroyPipelineLayout(device.device, post.layout, nullptr);
+        vkDestroyDescriptorPool(device.device, post.pool, nullptr);
+        vkDestroyDescriptorSetLayout(device.device, post.setLayout, nullptr);
+        post = PostProcess();
+    }
+
+
+    /// <summary>
+    /// Records the post pass into the swapchain image. The scene pass must be recorded before it. Upscaled, the frame is blended
+    /// into the history image of Governor::historyIndex, reading the other one.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="governor"></param>
+    /// <param name="renderExtent">Extent the scene was drawn at</param>
+    /// <param name="imageIndex"></param>
+    void recordPostProcess(const PostProcess& post, VkCommandBuffer commandBuffer, const SwapChain& swapchain, const Governor& governor,
+        const VkExtent2D& renderExtent, uint32_t imageIndex)
+    {
+        uint32_t history = governor.historyIndex % 2;
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = post.renderPass;
+        renderPassInfo.framebuffer = post.upscaled ? post.framebuffers[imageIndex * 2 + history] : post.framebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapchain.extent;
+
+        PostPushConstants constants{};
+        constants.inverseSize[0] = 1.0f / static_cast<float>(swapchain.extent.width);
+        constants.inverseSize[1] = 1.0f / static_cast<float>(swapchain.extent.height);
+        constants.scale[0] = static_cast<float>(renderExtent.width) / static_cast<float>(swapchain.extent.width);
+        constants.scale[1] = static_cast<float>(renderExtent.height) / static_cast<float>(swapchain.extent.height);
+        constants.sharpness = governor.sharpen ? 1.0f : 0.0f;
+        constants.weight = governor.weight;
+
+        VkDescriptorSet set = post.upscaled ? post.sets[1 - history] : post.sets[0];
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, post.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, post.layout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, post.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PostPushConstants), &constants);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <map>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+
+// --------------------------------- Shader Assembler ---------------------------------
+//  The fragment shader of a BRDF is main.frag followed by the BRDF source. #line directives name each part, so the
+//  compilation errors point at the exact line of main.frag, of the BRDF or of an included snippet.
+//  #include "..." is resolved by shaderc through the callbacks below, out of the snippets loaded from shaders/include.
+
+namespace brdfa {
+
+    /*Read only once loaded, so the compile workers share it without locking.*/
+    static ShaderIncludes shaderIncludes;
+
+
+    /*Keeps the strings of an include result alive until shaderc releases it.*/
+    struct IncludeResult {
+        shaderc_include_result  result;
+        std::string             name;
+        std::string             error;
+    };
+
+
+    static shaderc_include_result* resolveInclude(void* userData, const char* requestedSource, int /*type*/,
+        const char* /*requestingSource*/, size_t /*includeDepth*/)
+    {
+        const ShaderIncludes* includes = static_cast<const ShaderIncludes*>(userData);
+        IncludeResult* include = new IncludeResult();
+        include->result.user_data = include;
+
+        auto it = includes->sources.find(requestedSource);
+        if (it == includes->sources.end()) {
+            /*An empty source name tells shaderc that the content is the error.*/
+            include->error = std::string("Can't find \"") + requestedSource + "\" in " + includes->directory;
+            include->result.content = include->error.c_str();
+            include->result.content_length = include->error.size();
+            return &include->result;
+        }
+
+        include->name = it->first;
+        include->result.source_name = include->name.c_str();
+        include->result.source_name_length = include->name.size();
+        include->result.content = it->second.c_str();
+        include->result.content_length = it->second.size();
+        return &include->result;
+    }
+
+
+    static void releaseInclude(void* /*userData*/, shaderc_include_result* result) {
+        delete static_cast<IncludeResult*>(result->user_data);
+    }
+
+
+    static uint64_t hashSnippet(const std::string& data, uint64_t hash) {
+        for (const char& c : data) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+
+    /*Appends the source without the terminations left by the text mode reads, and ends it with a new line.*/
+    static void appendSource(std::string& out, const std::string& source, size_t start = 0) {
+        while (start < source.size()) {
+            size_t end = source.find('\0', start);
+            if (end == std::string::npos) end = source.size();
+            out.append(source, start, end - start);
+            start = end + 1;
+        }
+        if (!out.empty() && out.back() != '\n') out.push_back('\n');
+    }
+
+
+    /// <summary>
+    /// Loads all the snippets of the directory (recursively) into the include cache. Must be called before the first compilation.
+    /// </summary>
+    /// <param name="directory"></param>
+    void loadShaderIncludes(const std::string& directory) {
+        shaderIncludes.directory = directory;
+        shaderIncludes.sources.clear();
+        shaderIncludes.hash = 14695981039346656037ull;
+
+        std::error_code ec;
+        if (!std::filesystem::is_directory(directory, ec)) {
+            printf("[WARNING]: Shader include directory \"%s\" not found\n", directory.c_str());
+            return;
+        }
+
+        /*Sorted, so the hash doesn't depend on the directory order.*/
+        std::map<std::string, std::string> sorted;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec)) {
+            if (!entry.is_regular_file()) continue;
+            std::ifstream file(entry.path(), std::ios::binary);
+            std::stringstream ss;
+            ss << file.rdbuf();
+            sorted[std::filesystem::relative(entry.path(), directory).generic_string()] = ss.str();
+        }
+        for (auto& it : sorted) {
+            shaderIncludes.hash = hashSnippet(it.first, shaderIncludes.hash);
+            shaderIncludes.hash = hashSnippet(it.second, shaderIncludes.hash);
+            shaderIncludes.sources.insert({ it.first, std::move(it.second) });
+        }
+        printf("[INFO]: Loaded %zu shader include(s) from %s\n", shaderIncludes.sources.size(), directory.c_str());
+    }
+
+
+    /// <summary>
+    /// Makes the compile options resolve #include out of the loaded snippets.
+    /// </summary>
+    /// <param name="options"></param>
+    void bindShaderIncludes(shaderc_compile_options_t options) {
+        shaderc_compile_options_set_include_callbacks(options, resolveInclude, releaseInclude, &shaderIncludes);
+    }
+
+
+    /// <summary>
+    /// Describes everything besides the source that changes the compiled SPIR-V. Used in the SPIR-V archive keys.
+    /// </summary>
+    /// <param name="options"></param>
+    /// <returns></returns>
+    std::string shaderOptionsKey(const ShaderCompileOptions& options) {
+        return "opt:" + std::to_string(options.optimization) + (options.debugInfo ? "|debug" : "") + (options.bindless ? "|bindless" : "")
+            + (options.deferred ? "|deferred" : "") + (options.adaptive ? "|adaptive" : "") + "|includes:" + std::to_string(shaderIncludes.hash);
+    }
+
+
+    /// <summary>
+    /// Forms a shader out of a main source and a body, in one pass over both. The #version line of the main source stays first,
+    /// followed by the include extension and the #line directives naming the parts.
+    /// </summary>
+    /// <param name="mainSource"></param>
+    /// <param name="mainName">Name of the main source in the errors</param>
+    /// <param name="body"></param>
+    /// <param name="bodyName">Name of the body in the errors</param>
+    /// <returns></returns>
+    std::string assembleShader(const std::string& mainSource, const std::string& mainName, const std::string& body, const std::string& bodyName) {
+        static const std::string extension = "#extension GL_GOOGLE_include_directive : require\n";
+
+        std::string shader;
+        shader.reserve(mainSource.size() + body.size() + extension.size() + mainName.size() + bodyName.size() + 64);
+
+        /*#version must be the first statement.*/
+        size_t mainStart = 0;
+        int mainLine = 1;
+        if (mainSource.compare(0, 8, "#version") == 0) {
+            mainStart = mainSource.find('\n');
+            mainStart = (mainStart == std::string::npos) ? mainSource.size() : mainStart + 1;
+            shader.append(mainSource, 0, mainStart);
+            if (shader.back() != '\n') shader.push_back('\n');
+            mainLine = 2;
+        }
+        shader += extension;
+        shader += "#line " + std::to_string(mainLine) + " \"" + mainName + "\"\n";
+        appendSource(shader, mainSource, mainStart);
+
+        shader += "#line 1 \"" + bodyName + "\"\n";
+        appendSource(shader, body);
+        return shader;
+    }
+
+
+    /// <summary>
+    /// Extracts the errors of one source out of a compilation log, by line. The errors look like "name:line: error: message".
+    /// </summary>
+    /// <param name="log">compileShader() errors</param>
+    /// <param name="sourceName">Name the source was given in the #line directive</param>
+    /// <returns>Line (1 based) to messages</returns>
+    std::map<int, std::string> errorLines(const std::string& log, const std::string& sourceName) {
+        std::map<int, std::string> lines;
+        std::string prefix = sourceName + ":";
+        size_t pos = 0;
+        while ((pos = log.find(prefix, pos)) != std::string::npos) {
+            size_t number = pos + prefix.size();
+            size_t end = number;
+            while (end < log.size() && isdigit(static_cast<unsigned char>(log[end]))) end++;
+            pos = end;
+            if (end == number || end >= log.size() || log[end] != ':') continue;
+
+            int line = std::stoi(log.substr(number, end - number));
+            size_t messageEnd = log.find('\n', end);
+            std::string message = log.substr(end + 1, (messageEnd == std::string::npos ? log.size() : messageEnd) - end - 1);
+            message.erase(0, message.find_first_not_of(" \t"));
+            std::string& text = lines[line];
+            text += (text.empty() ? "" : "\n") + message;
+        }
+        return lines;
+    }
+
+}
@@ -0,0 +1,354 @@
+#pragma once
+#include "brdfa_structs.hpp"
+#include "brdfa_cons.hpp"
+
+#include <shaderc/shaderc.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------- SPIR-V Cache Archive ---------------------------------
+//  Layout:     [ArchiveHeader] [RecordHeader | SPIR-V | padding] [RecordHeader | SPIR-V | padding] ...
+//  Records are only appended. A torn record at the end (crash while writing) fails its size/checksum check
+//  and is cut off on the next write. Compaction rewrites the live records into a temporary file and renames it.
+
+namespace brdfa {
+
+    static const uint32_t ARCHIVE_MAGIC = 0x41535242;      // "BRSA"
+    static const uint32_t ARCHIVE_VERSION = 1;
+    static const uint32_t RECORD_MAGIC = 0x52565053;       // "SPVR"
+
+    struct ArchiveHeader {
+        uint32_t    magic;
+        uint32_t    version;
+    };
+
+    struct RecordHeader {
+        uint32_t    magic;
+        uint32_t    size;                   // SPIR-V size in bytes
+        uint64_t    key;                    // spirvKey() of the source
+        uint32_t    checksum;               // FNV-1a of the SPIR-V
+        uint32_t    reserved;
+    };
+
+
+    /// <summary>
+    /// FNV-1a hash. Continues from the given hash.
+    /// </summary>
+    static uint64_t fnv1a64(const char* data, const size_t& size, uint64_t hash = 14695981039346656037ull) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+
+    static uint32_t fnv1a32(const char* data, const size_t& size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+
+    /*Compiler (SPIR-V version/revision of shaderc), compile options and stage.*/
+    static std::string compilerMeta(const std::string& options, const bool& vertexShader) {
+        unsigned int version = 0, revision = 0;
+        shaderc_get_spv_version(&version, &revision);
+        return std::to_string(version) + "." + std::to_string(revision) + "|" + options + "|" + (vertexShader ? "vert" : "frag");
+    }
+
+
+    /*Records are 8 bytes aligned, so the SPIR-V views are aligned for uint32_t reads.*/
+    static size_t paddedSize(const size_t& size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+
+    /// <summary>
+    /// Maps the archive file into memory. Returns false if the file doesn't exist or is empty.
+    /// </summary>
+    static bool mapArchive(SpirvArchive& archive) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(archive.path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            CloseHandle(file);
+            return false;
+        }
+        archive.data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        archive.size = static_cast<size_t>(fileSize.QuadPart);
+        archive.fileHandle = file;
+        archive.mappingHandle = mapping;
+#else
+        int fd = open(archive.path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        archive.data = static_cast<const char*>(data);
+        archive.size = static_cast<size_t>(st.st_size);
+        archive.fd = fd;
+#endif
+        return archive.data != nullptr;
+    }
+
+
+    static void unmapArchive(SpirvArchive& archive) {
+#ifdef _WIN32
+        if (archive.data) UnmapViewOfFile(archive.data);
+        if (archive.mappingHandle) CloseHandle(archive.mappingHandle);
+        if (archive.fileHandle) CloseHandle(archive.fileHandle);
+        archive.fileHandle = nullptr;
+        archive.mappingHandle = nullptr;
+#else
+        if (archive.data) munmap(const_cast<char*>(archive.data), archive.size);
+        if (archive.fd >= 0) close(archive.fd);
+        archive.fd = -1;
+#endif
+        archive.data = nullptr;
+        archive.size = 0;
+    }
+
+
+    /// <summary>
+    /// Maps the archive and rebuilds its index from the record headers.
+    /// </summary>
+    static void indexArchive(SpirvArchive& archive) {
+        archive.index.clear();
+        archive.validSize = 0;
+        if (!mapArchive(archive)) return;
+
+        ArchiveHeader header;
+        if (archive.size < sizeof(ArchiveHeader)) return;
+        memcpy(&header, archive.data, sizeof(header));
+        if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+            printf("[WARNING]: SPIR-V archive \"%s\" has an unknown format. It will be rewritten.\n", archive.path.c_str());
+            return;
+        }
+
+        size_t offset = sizeof(ArchiveHeader);
+        while (offset + sizeof(RecordHeader) <= archive.size) {
+            RecordHeader record;
+            memcpy(&record, archive.data + offset, sizeof(record));
+            size_t payload = offset + sizeof(RecordHeader);
+            if (record.magic != RECORD_MAGIC || payload + record.size > archive.size
+                || fnv1a32(archive.data + payload, record.size) != record.checksum) {
+                printf("[WARNING]: SPIR-V archive has a torn record. It is dropped.\n");
+                break;
+            }
+
+            archive.index[record.key] = { payload, record.size };
+            offset = payload + paddedSize(record.size);
+        }
+        archive.validSize = std::min(offset, archive.size);
+    }
+
+
+    /// <summary>
+    /// Opens (one file open and one mapping) the SPIR-V archive and indexes its records.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="path"></param>
+    void openSpirvArchive(SpirvArchive& archive, const std::string& path) {
+        std::lock_guard<std::mutex> lock(archive.mutex);
+        archive.path = path;
+        indexArchive(archive);
+        printf("[INFO]: SPIR-V archive opened: %zu entries (%zu bytes)\n", archive.index.size(), archive.size);
+    }
+
+
+    void closeSpirvArchive(SpirvArchive& archive) {
+        std::lock_guard<std::mutex> lock(archive.mutex);
+        unmapArchive(archive);
+        archive.index.clear();
+        archive.used.clear();
+    }
+
+
+    /// <summary>
+    /// Content key of a shader: hash of the assembled source, the compiler (SPIR-V version/revision of shaderc), the compile options and the stage.
+    /// </summary>
+    /// <param name="source">Full GLSL source (main shader + BRDF)</param>
+    /// <param name="options">Description of the compile options</param>
+    /// <param name="vertexShader">Stage</param>
+    /// <returns></returns>
+    uint64_t spirvKey(const std::string& source, const std::string& options, const bool& vertexShader) {
+        std::string meta = compilerMeta(options, vertexShader);
+        uint64_t hash = fnv1a64(source.data(), source.size());
+        return fnv1a64(meta.data(), meta.size(), hash);
+    }
+
+
+    /// <summary>
+    /// Hash of a source, without the terminations left by the text mode reads.
+    /// </summary>
+    /// <param name="source"></param>
+    /// <returns></returns>
+    uint64_t sourceHash(const std::string& source) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const char& c : source) {
+            if (c != '\0') hash = fnv1a64(&c, 1, hash);
+        }
+        return hash;
+    }
+
+
+    /// <summary>
+    /// Key of a BRDF fragment shader out of the pair (main shader hash, BRDF source hash). Unlike spirvKey(), it doesn't need the
+    /// shader to be assembled. The BRDF name is included as it names the BRDF part of the assembled shader.
+    /// </summary>
+    /// <param name="mainHash">sourceHash() of the main shader</param>
+    /// <param name="brdfSource"></param>
+    /// <param name="brdfName"></param>
+    /// <param name="options">Description of the compile options</param>
+    /// <returns></returns>
+    uint64_t brdfSpirvKey(const uint64_t& mainHash, const std::string& brdfSource, const std::string& brdfName, const std::string& options) {
+        uint64_t pair[2] = { mainHash, sourceHash(brdfSource) };
+        std::string meta = brdfName + "|" + compilerMeta(options, false);
+        uint64_t hash = fnv1a64(reinterpret_cast<const char*>(pair), sizeof(pair));
+        return fnv1a64(meta.data(), meta.size(), hash);
+    }
+
+
+    /// <summary>
+    /// Looks the key up and copies its SPIR-V out of the mapping. A pointer into the mapping would not outlive a store
+    /// made meanwhile by the compile service, which maps the archive again.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="key"></param>
+    /// <param name="spirv"></param>
+    /// <returns>True if found</returns>
+    bool findSpirv(SpirvArchive& archive, const uint64_t& key, std::vector<char>& spirv) {
+        std::lock_guard<std::mutex> lock(archive.mutex);
+        auto it = archive.index.find(key);
+        if (it == archive.index.end()) return false;
+        spirv.assign(archive.data + it->second.first, archive.data + it->second.first + it->second.second);
+        archive.used.insert(key);
+        return true;
+    }
+
+
+    /// <summary>
+    /// Appends a record to the archive. A torn tail left by an interrupted write is cut off first. Only the new record is
+    /// indexed: the archive is mapped again, the records before it are not read.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="key"></param>
+    /// <param name="spirv"></param>
+    void storeSpirv(SpirvArchive& archive, const uint64_t& key, const std::vector<char>& spirv) {
+        std::lock_guard<std::mutex> lock(archive.mutex);
+        archive.used.insert(key);
+        if (spirv.empty() || archive.index.find(key) != archive.index.end()) return;
+
+        size_t validSize = archive.validSize;
+        unmapArchive(archive);
+
+        std::error_code ec;
+        if (validSize == 0) {
+            std::ofstream file(archive.path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+            ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION };
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        else if (std::filesystem::file_size(archive.path, ec) != validSize) {
+            std::filesystem::resize_file(archive.path, validSize, ec);
+        }
+
+        std::ofstream file(archive.path, std::ofstream::out | std::ofstream::binary | std::ofstream::app);
+        if (!file) {
+            std::cout << "ERROR: CAN'T WRITE THE SPIR-V ARCHIVE" << std::endl;
+            indexArchive(archive);
+            return;
+        }
+        RecordHeader record = { RECORD_MAGIC, static_cast<uint32_t>(spirv.size()), key, fnv1a32(spirv.data(), spirv.size()), 0 };
+        const char padding[8] = {};
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        file.write(spirv.data(), spirv.size());
+        file.write(padding, paddedSize(spirv.size()) - spirv.size());
+        file.close();
+
+        size_t payload = std::max(validSize, sizeof(ArchiveHeader)) + sizeof(RecordHeader);
+        size_t end = payload + paddedSize(spirv.size());
+        if (!file || !mapArchive(archive) || archive.size < end) {
+            unmapArchive(archive);
+            indexArchive(archive);
+            return;
+        }
+        archive.index[key] = { payload, static_cast<uint32_t>(spirv.size()) };
+        archive.validSize = end;
+    }
+
+
+    /// <summary>
+    /// Rewrites the archive with only the entries used in this session, if the unused ones take most of the file.
+    /// The new archive is written into a temporary file which then replaces the old one.
+    /// </summary>
+    /// <param name="archive"></param>
+    void compactSpirvArchive(SpirvArchive& archive) {
+        std::lock_guard<std::mutex> lock(archive.mutex);
+        size_t liveBytes = 0;
+        for (const auto& it : archive.index) {
+            if (archive.used.count(it.first)) liveBytes += sizeof(RecordHeader) + paddedSize(it.second.second);
+        }
+        size_t totalBytes = archive.validSize > sizeof(ArchiveHeader) ? archive.validSize - sizeof(ArchiveHeader) : 0;
+        if (totalBytes == 0 || liveBytes * 2 > totalBytes) return;
+
+        std::string tempPath = archive.path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+            if (!file) return;
+            ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION };
+            const char padding[8] = {};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& it : archive.index) {
+                if (!archive.used.count(it.first)) continue;
+                const char* spirv = archive.data + it.second.first;
+                RecordHeader record = { RECORD_MAGIC, it.second.second, it.first, fnv1a32(spirv, it.second.second), 0 };
+                file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+                file.write(spirv, it.second.second);
+                file.write(padding, paddedSize(it.second.second) - it.second.second);
+            }
+        }
+
+        unmapArchive(archive);
+        std::error_code ec;
+        std::filesystem::rename(tempPath, archive.path, ec);
+        if (ec) printf("[WARNING]: SPIR-V archive compaction failed: %s\n", ec.message().c_str());
+        else printf("[INFO]: SPIR-V archive compacted (%zu -> %zu bytes)\n", totalBytes, liveBytes);
+        indexArchive(archive);
+    }
+
+}
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <vulkan/vulkan.h>
 #include <iostream>
+#include <cstring>
+#include <functional>
 
 #include <helpers/functions.hpp>
 
@@ -21,7 +23,7 @@ namespace brdfa {
     /// <param name="commander"></param>
     /// <param name="device"></param>
     void endSingleTimeCommands(Commander& commander, const Device& device) {
-        VkCommandBuffer commandBuffer = commander.sceneBuffers.back();
+        VkCommandBuffer commandBuffer = commander.uploadBuffers.back();
         vkEndCommandBuffer(commandBuffer);
 
         VkSubmitInfo submitInfo{};
@@ -32,8 +34,8 @@ namespace brdfa {
         vkQueueSubmit(device.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
         vkQueueWaitIdle(device.graphicsQueue);
 
-        vkFreeCommandBuffers(device.device, commander.pool, 1, &commandBuffer);
-        commander.sceneBuffers.pop_back();
+        vkFreeCommandBuffers(device.device, commander.uploadPool, 1, &commandBuffer);
+        commander.uploadBuffers.pop_back();
     }
 
 
@@ -49,18 +51,19 @@ namespace brdfa {
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commander.pool;
+        allocInfo.commandPool = commander.uploadPool;
         allocInfo.commandBufferCount = 1;
 
         VkCommandBuffer commandBuffer;
         vkAllocateCommandBuffers(device.device, &allocInfo, &commandBuffer);
+        commander.allocations++;
 
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
         vkBeginCommandBuffer(commandBuffer, &beginInfo);
-        commander.sceneBuffers.push_back(commandBuffer);
+        commander.uploadBuffers.push_back(commandBuffer);
         return commandBuffer;
     }
 
@@ -120,6 +123,8 @@ namespace brdfa {
         image.height = height;
         image.mipLevels = mipLevels;
         image.cubemap = cubemap;
+        image.format = format;
+        image.size = memRequirements.size;
         vkBindImageMemory(device.device, image.obj, image.memory, 0);
 
     }
@@ -184,6 +189,54 @@ namespace brdfa {
 
 
 
+    /// <summary>
+    /// Creates a device local buffer holding the given data, uploaded through a staging buffer. Waits for the upload.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="data"></param>
+    /// <param name="size"></param>
+    /// <param name="usage">Usage of the buffer besides the transfer destination</param>
+    /// <param name="buffer"></param>
+    void createDeviceBuffer(Commander& commander, const Device& device, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, Buffer& buffer) {
+        createBuffer(commander, device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer);
+        uploadBuffer(commander, device, data, size, buffer, 0);
+    }
+
+
+
+    /// <summary>
+    /// Writes the given data into a (device local) buffer at the given offset, through a staging buffer. Waits for the upload.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="data"></param>
+    /// <param name="size"></param>
+    /// <param name="buffer">Created with VK_BUFFER_USAGE_TRANSFER_DST_BIT</param>
+    /// <param name="offset"></param>
+    void uploadBuffer(Commander& commander, const Device& device, const void* data, VkDeviceSize size, Buffer& buffer, VkDeviceSize offset) {
+        Buffer staging;
+        createBuffer(commander, device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging);
+
+        void* mapped;
+        vkMapMemory(device.device, staging.memory, 0, size, 0, &mapped);
+        memcpy(mapped, data, (size_t)size);
+        vkUnmapMemory(device.device, staging.memory);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+        VkBufferCopy copyRegion{};
+        copyRegion.dstOffset = offset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, staging.obj, buffer.obj, 1, &copyRegion);
+        endSingleTimeCommands(commander, device);
+
+        vkDestroyBuffer(device.device, staging.obj, nullptr);
+        vkFreeMemory(device.device, staging.memory, nullptr);
+    }
+
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -222,12 +275,14 @@ namespace brdfa {
     /// </summary>
     /// <param name="commandPool"></param>
     /// <param name="device"></param>
-    void createCommandPool(VkCommandPool& commandPool, const Device& device) {
+    /// <param name="flags"></param>
+    void createCommandPool(VkCommandPool& commandPool, const Device& device, VkCommandPoolCreateFlags flags) {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(device);
 
         VkCommandPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        poolInfo.flags = flags;
 
         if (vkCreateCommandPool(device.device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics command pool!");
@@ -240,36 +295,20 @@ namespace brdfa {
     /// 
     /// </summary>
     /// <param name="commander"></param>
-    /// <param name="device"></param>
     /// <param name="gpipeline"></param>
     /// <param name="swapchain"></param>
+    /// <param name="post">With FXAA, the UI is drawn in the framebuffers of the FXAA pass</param>
     /// <param name="index"></param>
-    void updateUICommandBuffers(Commander& commander, const Device& device, const GPipeline& gpipeline, const SwapChain& swapchain, const uint32_t index) {
-
-        if (commander.uiBuffers.size() != swapchain.images.size()) {
-            throw std::runtime_error("ERROR: You must intialize the commander Scene buffer first by calling createCommandBuffers() function.");
-        }
-
-        /*deleting the existing buffer from the pool*/
-        vkFreeCommandBuffers(device.device, commander.pool, 1, &commander.uiBuffers[index]);
-
-        /*Allocate the commandbuffer to the pool*/
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commander.pool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
-        if (vkAllocateCommandBuffers(device.device, &allocInfo, &commander.uiBuffers[index]) != VK_SUCCESS) {
-            throw std::runtime_error("ERROR: failed to allocate command buffers!");
-        }
-
+    /// <param name="frame">Frame context recorded into</param>
+    void updateUICommandBuffers(Commander& commander, const GPipeline& gpipeline, const SwapChain& swapchain, const PostProcess& post, const uint32_t index, const uint32_t frame) {
+        VkCommandBuffer commandBuffer = commander.frames[frame].uiBuffer;
 
         /*Begin the command buffer recording.*/
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-        if (vkBeginCommandBuffer(commander.uiBuffers[index], &beginInfo) != VK_SUCCESS) {
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("ERROR: failed to begin recording command buffer!");
         }
 
@@ -281,117 +320,569 @@ namespace brdfa {
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = gpipeline.uiRenderpass;
-        renderPassInfo.framebuffer = swapchain.framebuffers[index];
+        renderPassInfo.framebuffer = post.renderPass != VK_NULL_HANDLE ? post.framebuffers[index] : swapchain.framebuffers[index];
         renderPassInfo.renderArea.offset = { 0, 0 };
         renderPassInfo.renderArea.extent = swapchain.extent;
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size()); 
         renderPassInfo.pClearValues = clearValues.data();
-        vkCmdBeginRenderPass(commander.uiBuffers[index], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-        // for (auto& it : gpipeline.pipelines) {
-        // printf("[INFO]: updateUICommandBuffers: Updating pipeline: %s\n", it.first.c_str());
-        vkCmdBindPipeline(commander.uiBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.pipelines.begin()->second);
-        /*Drawing data to the framebuffer*/
+        /*Drawing data to the framebuffer. ImGui binds a pipeline of its own.*/
         ImDrawData* drawData = ImGui::GetDrawData();
         if (drawData)
         {
             drawData->DisplayPos = { 0, 0 };
-            ImGui_ImplVulkan_RenderDrawData(drawData, commander.uiBuffers[index]);
+            ImGui_ImplVulkan_RenderDrawData(drawData, commandBuffer);
         }
-        // }
-        
 
-        vkCmdEndRenderPass(commander.uiBuffers[index]);
-        if (vkEndCommandBuffer(commander.uiBuffers[index]) != VK_SUCCESS) {
+        vkCmdEndRenderPass(commandBuffer);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer!");
         }
     }
 
 
-    /// <summary>
-    /// 
-    /// </summary>
-    /// <param name="commander"></param>
-    /// <param name="device"></param>
-    /// <param name="gpipeline"></param>
-    /// <param name="descriptorObj"></param>
-    /// <param name="swapchain"></param>
-    /// <param name="meshes"></param>
-    void recordCommandBuffers(Commander& commander, const Device& device, const GPipeline& gpipeline, const Descriptor& descriptorObj ,const SwapChain& swapchain, std::vector<Mesh>& meshes, Mesh& skymap, VkPipeline& skymap_pipeline) {
-        commander.sceneBuffers.resize(swapchain.framebuffers.size());
-        commander.uiBuffers.resize(swapchain.framebuffers.size());
+    static void allocateCommandBuffers(Commander& commander, const Device& device, VkCommandBufferLevel level, std::vector<VkCommandBuffer>& buffers, size_t count) {
+        buffers.resize(count);
+        if (count == 0) return;
 
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.commandPool = commander.pool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t)commander.sceneBuffers.size();
+        allocInfo.level = level;
+        allocInfo.commandBufferCount = (uint32_t)count;
 
-        if (vkAllocateCommandBuffers(device.device, &allocInfo, commander.sceneBuffers.data()) != VK_SUCCESS) {
+        if (vkAllocateCommandBuffers(device.device, &allocInfo, buffers.data()) != VK_SUCCESS) {
             throw std::runtime_error("ERROR: failed to allocate command buffers!");
         }
+        commander.allocations += count;
+    }
+
+
+    /*Pipeline drawing the mesh: its specialized variant, its BRDF, or the first pipeline (also when the BRDF has none, e.g. it
+      does not compile for the shading mode).*/
+    static VkPipeline meshPipeline(const GPipeline& gpipeline, const Mesh& mesh) {
+        auto variant = gpipeline.variants.find(GPipeline::variantKey(mesh.renderOption, mesh.specializedSamples));
+        if (mesh.specializedSamples > 0 && variant != gpipeline.variants.end())
+            return variant->second;
+        auto pipeline = gpipeline.pipelines.find(mesh.renderOption);
+        if (mesh.renderOption != "" && pipeline != gpipeline.pipelines.end())
+            return pipeline->second;
+        return gpipeline.pipelines.begin()->second;
+    }
+
+
+    /*Extent the scene is drawn at: the render extent of the governor, or the whole swapchain image.*/
+    static VkExtent2D sceneExtent(const Commander& commander, const SwapChain& swapchain) {
+        return (commander.renderExtent.width > 0 && commander.renderExtent.height > 0) ? commander.renderExtent : swapchain.extent;
+    }
+
+
+    /*FNV-1a step folding a value into the key of a batch.*/
+    static uint64_t foldKey(uint64_t key, uint64_t value) {
+        return (key ^ value) * 1099511628211ull;
+    }
 
-        for (size_t i = 0; i < commander.sceneBuffers.size(); i++) {
-            VkCommandBufferBeginInfo beginInfo{};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-           
 
-            if (vkBeginCommandBuffer(commander.sceneBuffers[i], &beginInfo) != VK_SUCCESS) {
-                throw std::runtime_error("ERROR: failed to begin recording command buffer!");
+    /*Sorts the meshes by pipeline into Commander::drawOrder and splits them into one batch per pipeline. The pipeline of a mesh
+      is only looked up again once its draw version changed. A batch is re-recorded when its key changes: the scene version, its
+      pipeline, its index (its tile list in deferred mode), its commands or what its members bind and push.*/
+    static void buildBatches(Commander& commander, const GPipeline& gpipeline, std::vector<Mesh>& meshes) {
+        commander.drawOrder.clear();
+        for (auto& mesh : meshes) {
+            if (mesh.pipelineVersion != mesh.drawVersion) {
+                mesh.pipeline = meshPipeline(gpipeline, mesh);
+                mesh.pipelineVersion = mesh.drawVersion;
+            }
+            commander.drawOrder.push_back(&mesh);
+        }
+        std::sort(commander.drawOrder.begin(), commander.drawOrder.end(), [](const Mesh* a, const Mesh* b) {
+            if (a->pipeline != b->pipeline) return std::less<VkPipeline>()(a->pipeline, b->pipeline);
+            return a->drawSlot < b->drawSlot;
+        });
+
+        commander.batchCount = 0;
+        uint64_t orderKey = foldKey(14695981039346656037ull, commander.sceneVersion);
+        for (uint32_t i = 0; i < static_cast<uint32_t>(commander.drawOrder.size()); i++) {
+            Mesh& mesh = *commander.drawOrder[i];
+            if (commander.batchCount == 0 || commander.batches[commander.batchCount - 1].pipeline != mesh.pipeline) {
+                if (commander.batches.size() == commander.batchCount)
+                    commander.batches.emplace_back();
+                DrawBatch& batch = commander.batches[commander.batchCount++];
+                batch.pipeline = mesh.pipeline;
+                batch.first = i;
+                batch.count = 0;
+                batch.key = foldKey(foldKey(14695981039346656037ull, commander.sceneVersion), std::hash<VkPipeline>()(mesh.pipeline));
+                batch.key = foldKey(foldKey(batch.key, i), commander.batchCount - 1);
+            }
+            DrawBatch& batch = commander.batches[commander.batchCount - 1];
+            batch.count++;
+            mesh.batchSlot = i;
+            mesh.batchFirst = batch.first;
+            if (mesh.batchIndex != commander.batchCount - 1) {
+                mesh.batchIndex = commander.batchCount - 1;         // Read by the tile classification out of the draw record.
+                mesh.drawVersion++;
             }
-            /*IMGUI: */
-            //ImGui_ImplVulkan_CreateFontsTexture(commander.buffers[i]);
-
-
-            VkRenderPassBeginInfo renderPassInfo{};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = gpipeline.sceneRenderPass;
-            renderPassInfo.framebuffer = swapchain.framebuffers[i];
-            renderPassInfo.renderArea.offset = { 0, 0 };
-            renderPassInfo.renderArea.extent = swapchain.extent;
-
-            std::array<VkClearValue, 2> clearValues{};
-            clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-            clearValues[1].depthStencil = { 1.0f, 0 };
-
-            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-            renderPassInfo.pClearValues = clearValues.data();
-
-            vkCmdBeginRenderPass(commander.sceneBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            // Skybox Rendering
-            VkDeviceSize offsets[] = { 0 };
-            VkBuffer skymap_vertexBuffer[] = { skymap.vertexBuffer.obj };
-            vkCmdBindDescriptorSets(commander.sceneBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 0, 1, &descriptorObj.sets[i], 0, NULL);
-            vkCmdBindPipeline(commander.sceneBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, skymap_pipeline);
-            vkCmdBindVertexBuffers(commander.sceneBuffers[i], 0, 1, skymap_vertexBuffer, offsets);
-            vkCmdBindIndexBuffer(commander.sceneBuffers[i], skymap.indexBuffer.obj, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(commander.sceneBuffers[i], skymap.indices.size(), 1, 0, 0, 0);
-            
-            for (size_t j = 0; j < meshes.size(); j++) {
-                // printf("[INFO]: Recoording pipeline: %s\n", it.first.c_str());
-                if (meshes[j].renderOption != "") {
-                    vkCmdBindPipeline(commander.sceneBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.pipelines.at(meshes[j].renderOption));
+
+            uint64_t member = foldKey(foldKey(foldKey(mesh.uid, mesh.drawSlot), mesh.instanceRange.offset), std::hash<VkDescriptorSet>()(mesh.materialSet));
+            batch.key = foldKey(batch.key, member);
+            orderKey = foldKey(orderKey, member);
+        }
+        commander.prepass.key = orderKey;
+        commander.skybox.key = foldKey(14695981039346656037ull, commander.sceneVersion);
+    }
+
+
+    /*If the buffer of the batch for the swapchain image was recorded with another key. Allocates the buffers on first use.*/
+    static bool batchStale(Commander& commander, const Device& device, const SwapChain& swapchain, DrawBatch& batch, uint32_t imageIndex) {
+        if (batch.buffers.size() != swapchain.framebuffers.size()) {
+            if (!batch.buffers.empty())
+                vkFreeCommandBuffers(device.device, commander.pool, static_cast<uint32_t>(batch.buffers.size()), batch.buffers.data());
+            allocateCommandBuffers(commander, device, VK_COMMAND_BUFFER_LEVEL_SECONDARY, batch.buffers, swapchain.framebuffers.size());
+            batch.recordedKeys.assign(swapchain.framebuffers.size(), 0);
+        }
+        return batch.recordedKeys[imageIndex] != batch.key;
+    }
+
+
+    /*Begins the buffer of the batch for the swapchain image and binds what every scene draw uses: the pipeline, the dynamic
+      viewport, the shared geometry buffers and the frame set.*/
+    static VkCommandBuffer beginBatch(Commander& commander, const GPipeline& gpipeline, const Descriptor& descriptorObj,
+        const GeometryArena& geometry, const SwapChain& swapchain, DrawBatch& batch, uint32_t imageIndex, bool gbufferPass)
+    {
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = gbufferPass ? gpipeline.gbufferRenderPass : gpipeline.sceneRenderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = gbufferPass ? swapchain.gbuffer.framebuffer : swapchain.framebuffers[imageIndex];
+        inheritanceInfo.pipelineStatistics = commander.statistics != VK_NULL_HANDLE ? VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT : 0;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        VkCommandBuffer commandBuffer = batch.buffers[imageIndex];
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to begin recording command buffer!");
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batch.pipeline);
+
+        /*Dynamic in every scene pipeline: the governed scene only covers the corner of the attachments the upscale reads.*/
+        VkExtent2D extent = sceneExtent(commander, swapchain);
+        VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+        VkRect2D scissor{ { 0, 0 }, extent };
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        /*The shared geometry buffers. The ranges of the meshes are in their draw commands.*/
+        VkDeviceSize offsets[] = { 0 };
+        VkBuffer vertexBuffers[] = { geometry.vertices.buffer.obj };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, geometry.indices.buffer.obj, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 0, 1, &descriptorObj.frameSets[imageIndex], 0, nullptr);
+        batch.binds = 4;
+        batch.draws = 0;
+        return commandBuffer;
+    }
+
+
+    static void endBatch(Commander& commander, DrawBatch& batch, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+        batch.recordedKeys[imageIndex] = batch.key;
+        commander.recordedSecondaries++;
+    }
+
+
+    /*Draws the command of a mesh alone: the fallback when the device can't draw several commands at once (or sets a material
+      set per mesh). Without drawIndirectFirstInstance the first instance of the command is 0, so the instance base is pushed.*/
+    static void drawMesh(const Device& device, const GPipeline& gpipeline, const GeometryArena& geometry, VkCommandBuffer commandBuffer, const Mesh& mesh) {
+        DrawPushConstants constants{ device.multiDrawIndirect ? 0u : mesh.instanceRange.offset, mesh.drawSlot };
+        vkCmdPushConstants(commandBuffer, gpipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0, sizeof(DrawPushConstants), &constants);
+        vkCmdDrawIndexedIndirect(commandBuffer, geometry.drawCommands.obj, sizeof(VkDrawIndexedIndirectCommand) * mesh.batchSlot,
+            1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+
+    /*Records the pre-pass: the depth of every mesh (or the G-buffer in deferred mode), one indirect draw over all the commands.
+      It only binds what main.vert and gbuffer.frag read.*/
+    static void recordPrepassBatch(Commander& commander, const Device& device, const GPipeline& gpipeline, const Descriptor& descriptorObj,
+        const GeometryArena& geometry, const SwapChain& swapchain, uint32_t imageIndex)
+    {
+        DrawBatch& batch = commander.prepass;
+        VkCommandBuffer commandBuffer = beginBatch(commander, gpipeline, descriptorObj, geometry, swapchain, batch, imageIndex, gpipeline.deferred);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 2, 1, &descriptorObj.drawSet, 0, nullptr);
+        batch.binds++;
+        if (device.multiDrawIndirect) {
+            DrawPushConstants constants{ 0, 0 };
+            vkCmdPushConstants(commandBuffer, gpipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                0, sizeof(DrawPushConstants), &constants);
+            vkCmdDrawIndexedIndirect(commandBuffer, geometry.drawCommands.obj, 0, static_cast<uint32_t>(commander.drawOrder.size()), sizeof(VkDrawIndexedIndirectCommand));
+            batch.draws = 1;
+        }
+        else {
+            for (const Mesh* mesh : commander.drawOrder) drawMesh(device, gpipeline, geometry, commandBuffer, *mesh);
+            batch.draws = static_cast<uint32_t>(commander.drawOrder.size());
+        }
+        endBatch(commander, batch, commandBuffer, imageIndex);
+    }
+
+
+    /*Records the batch of a pipeline: the pipeline and the sets are bound once, the per draw data is read from the draw records
+      (see DrawRecord), and with the bindless textures the whole batch is one indirect draw whose count comes from the culling
+      pass when the draw count extension is there. In deferred mode the batch draws the tiles classify.comp listed for it, once with
+      the bindless textures (every pixel of the batch is shaded), otherwise once per mesh (the pixels of the mesh are shaded).*/
+    static void recordShadingBatch(Commander& commander, const Device& device, const GPipeline& gpipeline, const Descriptor& descriptorObj,
+        const GeometryArena& geometry, const SwapChain& swapchain, DrawBatch& batch, uint32_t batchIndex, uint32_t imageIndex)
+    {
+        VkCommandBuffer commandBuffer = beginBatch(commander, gpipeline, descriptorObj, geometry, swapchain, batch, imageIndex, false);
+        const VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (descriptorObj.bindless) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 1, 1, &descriptorObj.textureSet, 0, nullptr);
+            batch.binds++;
+        }
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 2, 1, &descriptorObj.drawSet, 0, nullptr);
+        batch.binds++;
+        if (gpipeline.deferred) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 3, 1, &descriptorObj.gbufferSet, 0, nullptr);
+            batch.binds++;
+        }
+        /*main.frag is built with the adaptive sampling whenever the device allows it, on or off.*/
+        if (descriptorObj.adaptiveSet != VK_NULL_HANDLE) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 4, 1, &descriptorObj.adaptiveSet, 0, nullptr);
+            batch.binds++;
+        }
+
+        if (gpipeline.deferred) {
+            uint32_t meshCount = descriptorObj.bindless ? 1 : batch.count;
+            for (uint32_t i = batch.first; i < batch.first + meshCount; i++) {
+                const Mesh& mesh = *commander.drawOrder[i];
+                if (!descriptorObj.bindless) {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 1, 1, &mesh.materialSet, 0, nullptr);
+                    batch.binds++;
                 }
-                else {
-                    vkCmdBindPipeline(commander.sceneBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.pipelines.begin()->second);
+                DrawPushConstants constants{ batchIndex, descriptorObj.bindless ? DEFERRED_ANY_RECORD : mesh.drawSlot };
+                vkCmdPushConstants(commandBuffer, gpipeline.layout, stages, 0, sizeof(DrawPushConstants), &constants);
+                if (batchIndex < DEFERRED_MAX_BATCHES)
+                    vkCmdDrawIndirect(commandBuffer, swapchain.gbuffer.tileCommands.obj, sizeof(VkDrawIndirectCommand) * batchIndex, 1, sizeof(VkDrawIndirectCommand));
+                else
+                    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                batch.draws++;
+            }
+        }
+        else if (descriptorObj.bindless && device.multiDrawIndirect) {
+            DrawPushConstants constants{ 0, 0 };
+            vkCmdPushConstants(commandBuffer, gpipeline.layout, stages, 0, sizeof(DrawPushConstants), &constants);
+            VkDeviceSize commandOffset = sizeof(VkDrawIndexedIndirectCommand) * batch.first;
+            if (device.cmdDrawIndexedIndirectCount != nullptr) {
+                /*The culling pass trims the count to the last command of the batch with a visible instance.*/
+                device.cmdDrawIndexedIndirectCount(commandBuffer, geometry.drawCommands.obj, commandOffset,
+                    geometry.drawCounts.obj, sizeof(uint32_t) * (geometry.drawCapacity + batch.first), batch.count, sizeof(VkDrawIndexedIndirectCommand));
+            }
+            else {
+                vkCmdDrawIndexedIndirect(commandBuffer, geometry.drawCommands.obj, commandOffset, batch.count, sizeof(VkDrawIndexedIndirectCommand));
+            }
+            batch.draws = 1;
+        }
+        else {
+            for (uint32_t i = batch.first; i < batch.first + batch.count; i++) {
+                const Mesh& mesh = *commander.drawOrder[i];
+                if (!descriptorObj.bindless) {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 1, 1, &mesh.materialSet, 0, nullptr);
+                    batch.binds++;
                 }
+                drawMesh(device, gpipeline, geometry, commandBuffer, mesh);
+                batch.draws++;
+            }
+        }
+        endBatch(commander, batch, commandBuffer, imageIndex);
+    }
+
+
+    /*Records the skybox: a direct draw of the skymap, which only uses the frame set and is never culled.*/
+    static void recordSkyboxBatch(Commander& commander, const GPipeline& gpipeline, const Descriptor& descriptorObj,
+        const GeometryArena& geometry, const SwapChain& swapchain, const Mesh& skymap, VkPipeline pipeline, uint32_t imageIndex)
+    {
+        DrawBatch& batch = commander.skybox;
+        batch.pipeline = pipeline;
+        VkCommandBuffer commandBuffer = beginBatch(commander, gpipeline, descriptorObj, geometry, swapchain, batch, imageIndex, false);
+        vkCmdDrawIndexed(commandBuffer, skymap.indexRange.count, 1, skymap.indexRange.offset, static_cast<int32_t>(skymap.vertexRange.offset), 0);
+        batch.draws = 1;
+        endBatch(commander, batch, commandBuffer, imageIndex);
+    }
+
+
+    /// <summary>
+    /// Creates one context per frame in flight: a transient pool along with the scene and UI buffers allocated out of it once.
+    /// The buffers are re-recorded every frame after resetFrameContext(), so the frame loop itself allocates nothing.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="frameCount"></param>
+    void createFrameContexts(Commander& commander, const Device& device, size_t frameCount) {
+        commander.frames.resize(frameCount);
+        for (auto& frame : commander.frames) {
+            createCommandPool(frame.pool, device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+            VkCommandBuffer buffers[2];
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = frame.pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 2;
+            if (vkAllocateCommandBuffers(device.device, &allocInfo, buffers) != VK_SUCCESS) {
+                throw std::runtime_error("ERROR: failed to allocate command buffers!");
+            }
+            frame.sceneBuffer = buffers[0];
+            frame.uiBuffer = buffers[1];
+            commander.allocations += 3;
+        }
 
-                /*Get buffer address from the device:*/
-                int descriptorSetIndex = j * swapchain.images.size() + i;
-                VkBuffer vertexBuffers[] = { meshes[j].vertexBuffer.obj };
-                vkCmdBindVertexBuffers(commander.sceneBuffers[i], 0, 1, vertexBuffers, offsets);
-                vkCmdBindIndexBuffer(commander.sceneBuffers[i], meshes[j].indexBuffer.obj, 0, VK_INDEX_TYPE_UINT32);
-                vkCmdBindDescriptorSets(commander.sceneBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, gpipeline.layout, 0, 1, &descriptorObj.sets[descriptorSetIndex], 0, nullptr);
-                vkCmdDrawIndexed(commander.sceneBuffers[i], meshes[j].indices.size(), 1, 0, 0, 0);
+        /*Fragment shader invocations of the scene pass, one query per frame.*/
+        if (device.pipelineStatistics) {
+            VkQueryPoolCreateInfo queryInfo{};
+            queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            queryInfo.queryCount = static_cast<uint32_t>(frameCount);
+            queryInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+            if (vkCreateQueryPool(device.device, &queryInfo, nullptr, &commander.statistics) != VK_SUCCESS) {
+                throw std::runtime_error("ERROR: failed to create the pipeline statistics query pool!");
             }
+        }
 
-            vkCmdEndRenderPass(commander.sceneBuffers[i]);
-            if (vkEndCommandBuffer(commander.sceneBuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to record command buffer!");
+        /*GPU time of the scene buffer, two timestamps per frame.*/
+        if (device.timestampPeriod > 0.0f) {
+            VkQueryPoolCreateInfo queryInfo{};
+            queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryInfo.queryCount = 2 * static_cast<uint32_t>(frameCount);
+            if (vkCreateQueryPool(device.device, &queryInfo, nullptr, &commander.timestamps) != VK_SUCCESS) {
+                throw std::runtime_error("ERROR: failed to create the timestamp query pool!");
             }
         }
     }
 
 
-}
\ No newline at end of file
+    /// <summary>
+    /// Destroys the frame contexts (and their buffers).
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void destroyFrameContexts(Commander& commander, const Device& device) {
+        for (auto& frame : commander.frames) {
+            vkDestroyCommandPool(device.device, frame.pool, nullptr);
+        }
+        commander.frames.clear();
+        if (commander.statistics != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device.device, commander.statistics, nullptr);
+        commander.statistics = VK_NULL_HANDLE;
+        if (commander.timestamps != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device.device, commander.timestamps, nullptr);
+        commander.timestamps = VK_NULL_HANDLE;
+    }
+
+
+    /// <summary>
+    /// Resets the buffers of a frame context and takes the pipeline statistics and the GPU time of its last scene buffer. Must be
+    /// called once the fence of the frame signaled.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="frame"></param>
+    void resetFrameContext(Commander& commander, const Device& device, const uint32_t frame) {
+        vkResetCommandPool(device.device, commander.frames[frame].pool, 0);
+        if (commander.frames[frame].statisticsPending) {
+            uint64_t invocations = 0;
+            if (vkGetQueryPoolResults(device.device, commander.statistics, frame, 1, sizeof(uint64_t), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+                commander.fragmentInvocations = invocations;
+            commander.frames[frame].statisticsPending = false;
+        }
+        if (commander.frames[frame].timestampsPending) {
+            uint64_t ticks[2] = { 0, 0 };
+            if (vkGetQueryPoolResults(device.device, commander.timestamps, 2 * frame, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+                commander.gpuFrameMs = static_cast<float>(static_cast<double>(ticks[1] - ticks[0]) * device.timestampPeriod * 1e-6);
+            commander.frames[frame].timestampsPending = false;
+        }
+    }
+
+
+    static void freeBatchCommandBuffers(Commander& commander, const Device& device, DrawBatch& batch) {
+        if (!batch.buffers.empty())
+            vkFreeCommandBuffers(device.device, commander.pool, static_cast<uint32_t>(batch.buffers.size()), batch.buffers.data());
+        batch.buffers.clear();
+        batch.recordedKeys.clear();
+    }
+
+
+    /// <summary>
+    /// Frees the secondaries of the batches, the pre-pass and the skybox.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void freeSceneCommandBuffers(Commander& commander, const Device& device) {
+        for (auto& batch : commander.batches) freeBatchCommandBuffers(commander, device, batch);
+        freeBatchCommandBuffers(commander, device, commander.prepass);
+        freeBatchCommandBuffers(commander, device, commander.skybox);
+    }
+
+
+    /// <summary>
+    /// Marks every batch for re-recording, and every mesh for a new pipeline lookup and draw record. Used when the descriptors, the
+    /// pipelines, the render pass or the framebuffers change.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="meshes"></param>
+    void invalidateSceneCommands(Commander& commander, std::vector<Mesh>& meshes) {
+        commander.sceneVersion++;
+        for (auto& mesh : meshes) mesh.drawVersion++;
+    }
+
+
+    /// <summary>
+    /// Records the scene buffer of a frame for a swapchain image. The meshes are drawn in one batch per pipeline (see buildBatches());
+    /// only the secondaries of the batches changed since their last recording are re-recorded, the primary itself writes the draw
+    /// data and executes them. Must be called once the previous submission of the image is done. With Commander::depthPrepass, the
+    /// pre-pass runs first and the skybox last. In deferred mode the pre-pass fills the G-buffer in a render pass of its own, before
+    /// the scene pass shades it.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="gpipeline"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="geometry">Shared geometry, draw records and draw commands of the meshes</param>
+    /// <param name="swapchain"></param>
+    /// <param name="post">Post pass recorded after the scene pass when its render pass exists</param>
+    /// <param name="governor">Accumulation state of the upscale</param>
+    /// <param name="adaptive">Budget map built before the scene pass when the adaptive sampling is on</param>
+    /// <param name="meshes"></param>
+    /// <param name="skymap"></param>
+    /// <param name="skymap_pipeline"></param>
+    /// <param name="imageIndex"></param>
+    /// <param name="frame">Frame context recorded into</param>
+    void recordSceneCommands(Commander& commander, const Device& device, const GPipeline& gpipeline, const Descriptor& descriptorObj,
+        GeometryArena& geometry, Culling& culling, const SwapChain& swapchain, const PostProcess& post, const Governor& governor, AdaptiveSampling& adaptive, std::vector<Mesh>& meshes,
+        Mesh& skymap, VkPipeline& skymap_pipeline,
+        uint32_t imageIndex, uint32_t frame)
+    {
+        /*Secondaries. With the pre-pass, the depth of every mesh is laid down before any of them is shaded, so the BRDF loop only runs
+          for the fragments left visible. The skybox only uses the frame set and comes last, where no mesh wrote depth. In deferred
+          mode, the pre-pass is executed in the G-buffer pass: the first prepassCount entries of the list.*/
+        buildBatches(commander, gpipeline, meshes);
+        commander.executeList.clear();
+        commander.frameBinds = 0;
+        commander.frameDraws = 0;
+        if ((commander.depthPrepass || gpipeline.deferred) && !commander.drawOrder.empty()) {
+            commander.prepass.pipeline = gpipeline.deferred ? gpipeline.gbufferPipeline : gpipeline.depthPipeline;
+            commander.prepass.key = foldKey(commander.prepass.key, std::hash<VkPipeline>()(commander.prepass.pipeline));
+            if (batchStale(commander, device, swapchain, commander.prepass, imageIndex))
+                recordPrepassBatch(commander, device, gpipeline, descriptorObj, geometry, swapchain, imageIndex);
+            commander.executeList.push_back(commander.prepass.buffers[imageIndex]);
+            commander.frameBinds += commander.prepass.binds;
+            commander.frameDraws += commander.prepass.draws;
+        }
+        uint32_t prepassCount = gpipeline.deferred ? static_cast<uint32_t>(commander.executeList.size()) : 0;
+        for (uint32_t j = 0; j < commander.batchCount; j++) {
+            DrawBatch& batch = commander.batches[j];
+            if (batchStale(commander, device, swapchain, batch, imageIndex))
+                recordShadingBatch(commander, device, gpipeline, descriptorObj, geometry, swapchain, batch, j, imageIndex);
+            commander.executeList.push_back(batch.buffers[imageIndex]);
+            commander.frameBinds += batch.binds;
+            commander.frameDraws += batch.draws;
+        }
+        commander.skybox.key = foldKey(commander.skybox.key, std::hash<VkPipeline>()(skymap_pipeline));
+        if (batchStale(commander, device, swapchain, commander.skybox, imageIndex))
+            recordSkyboxBatch(commander, gpipeline, descriptorObj, geometry, swapchain, skymap, skymap_pipeline, imageIndex);
+        commander.executeList.push_back(commander.skybox.buffers[imageIndex]);
+        commander.frameBinds += commander.skybox.binds;
+        commander.frameDraws += commander.skybox.draws;
+
+        /*Thin primary*/
+        VkCommandBuffer commandBuffer = commander.frames[frame].sceneBuffer;
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to begin recording command buffer!");
+        }
+
+        /*GPU time of the whole scene buffer, read back by resetFrameContext(). It leaves out the UI and the wait for the display,
+          so the frame-time governor sees the work its scale and samples change.*/
+        if (commander.timestamps != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, commander.timestamps, 2 * frame, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, commander.timestamps, 2 * frame);
+        }
+
+        /*The draw records and commands of the frame, then their instance counts, written by the culling pass.*/
+        recordDrawData(geometry, commandBuffer, device, commander.drawOrder);
+        recordCulling(culling, commandBuffer, geometry, descriptorObj, meshes, frame);
+        if (adaptive.enabled)
+            recordAdaptiveSampling(adaptive, commandBuffer, descriptorObj, sceneExtent(commander, swapchain), frame);
+
+        /*Fragment shader invocations of the whole scene pass, read back by resetFrameContext().*/
+        if (commander.statistics != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, commander.statistics, frame, 1);
+            vkCmdBeginQuery(commandBuffer, commander.statistics, frame, 0);
+        }
+
+        /*G-buffer pass. The cleared instance (0xFFFFFFFF) marks the pixels no object covers.*/
+        if (gpipeline.deferred) {
+            std::array<VkClearValue, 4> gbufferClears{};
+            gbufferClears[2].color.uint32[0] = 0xFFFFFFFFu;        // No instance.
+            gbufferClears[3].depthStencil = { 1.0f, 0 };
+
+            VkRenderPassBeginInfo gbufferPassInfo{};
+            gbufferPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            gbufferPassInfo.renderPass = gpipeline.gbufferRenderPass;
+            gbufferPassInfo.framebuffer = swapchain.gbuffer.framebuffer;
+            gbufferPassInfo.renderArea.offset = { 0, 0 };
+            gbufferPassInfo.renderArea.extent = swapchain.extent;
+            gbufferPassInfo.clearValueCount = static_cast<uint32_t>(gbufferClears.size());
+            gbufferPassInfo.pClearValues = gbufferClears.data();
+
+            vkCmdBeginRenderPass(commandBuffer, &gbufferPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            if (prepassCount > 0)
+                vkCmdExecuteCommands(commandBuffer, prepassCount, commander.executeList.data());
+            vkCmdEndRenderPass(commandBuffer);
+            recordTileClassification(gpipeline, commandBuffer, descriptorObj, swapchain, sceneExtent(commander, swapchain));
+        }
+
+        /*The swapchain image is cleared itself when anti-aliasing is off.*/
+        std::array<VkClearValue, 3> clearValues{};
+        clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        clearValues[2].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = gpipeline.sceneRenderPass;
+        renderPassInfo.framebuffer = swapchain.framebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapchain.extent;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(commander.executeList.size()) - prepassCount, commander.executeList.data() + prepassCount);
+        vkCmdEndRenderPass(commandBuffer);
+        if (commander.statistics != VK_NULL_HANDLE) {
+            vkCmdEndQuery(commandBuffer, commander.statistics, frame);
+            commander.frames[frame].statisticsPending = true;
+        }
+
+        if (post.renderPass != VK_NULL_HANDLE)
+            recordPostProcess(post, commandBuffer, swapchain, governor, sceneExtent(commander, swapchain), imageIndex);
+        recordHiZ(culling, commandBuffer, device, swapchain, frame);
+        if (commander.timestamps != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, commander.timestamps, 2 * frame + 1);
+            commander.frames[frame].timestampsPending = true;
+        }
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+
+// --------------------------------- Compile Service ---------------------------------
+//  A fixed number of workers pull jobs out of a priority queue. Interactive jobs (editor, test window) run before the
+//  background ones (loading), and jobs of the same priority run in submission order. Each worker compiles with its own
+//  thread local shaderc compiler (see compileShader()).
+
+namespace brdfa {
+
+    static float elapsedMs(const std::chrono::high_resolution_clock::time_point& start) {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+
+    static void compileWorker(CompileService* service) {
+        while (true) {
+            CompileJob job;
+            {
+                std::unique_lock<std::mutex> lock(service->mutex);
+                service->condition.wait(lock, [service] { return service->stopping || !service->jobs.empty(); });
+                if (service->jobs.empty()) return;          // Stopping and nothing left to run.
+                job = service->jobs.top();
+                service->jobs.pop();
+                service->running++;
+            }
+
+            job.run();
+
+            std::lock_guard<std::mutex> lock(service->mutex);
+            service->running--;
+        }
+    }
+
+
+    /// <summary>
+    /// Starts the workers of the compile service.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="workerCount">0: one worker per hardware thread</param>
+    void startCompileService(CompileService& service, size_t workerCount) {
+        if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+        service.stopping = false;
+        for (size_t i = 0; i < workerCount; i++) {
+            service.workers.push_back(std::thread(compileWorker, &service));
+        }
+        printf("[INFO]: Compile service started with %zu workers\n", workerCount);
+    }
+
+
+    /// <summary>
+    /// Runs the queued jobs to completion and joins the workers.
+    /// </summary>
+    /// <param name="service"></param>
+    void stopCompileService(CompileService& service) {
+        {
+            std::lock_guard<std::mutex> lock(service.mutex);
+            service.stopping = true;
+        }
+        service.condition.notify_all();
+        for (auto& worker : service.workers) {
+            if (worker.joinable()) worker.join();
+        }
+        service.workers.clear();
+    }
+
+
+    /// <summary>
+    /// Queues a task on the compile service workers.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="priority"></param>
+    /// <param name="task"></param>
+    /// <returns>Ready once the task has run</returns>
+    std::future<void> submitTask(CompileService& service, const CompilePriority& priority, const std::function<void()>& task) {
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> future = promise->get_future();
+        {
+            std::lock_guard<std::mutex> lock(service.mutex);
+            service.jobs.push({ static_cast<int>(priority), service.submitted++, [task, promise]() {
+                try {
+                    task();
+                    promise->set_value();
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            } });
+        }
+        service.condition.notify_one();
+        return future;
+    }
+
+
+    /// <summary>
+    /// Compiles the GLSL on the calling thread and records its time in the service statistics.
+    /// Used by the jobs that need the SPIR-V right away (a job waiting for another job could starve the pool).
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="source"></param>
+    /// <param name="vertexShader"></param>
+    /// <param name="name"></param>
+    /// <returns></returns>
+    CompileResult runCompile(CompileService& service, const std::string& source, const bool& vertexShader, const std::string& name,
+        const ShaderCompileOptions& options)
+    {
+        CompileResult result;
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            result.spirv = compileShader(source, vertexShader, name, options);
+            result.success = true;
+        }
+        catch (const std::exception& exp) {
+            result.log = exp.what();
+        }
+        result.compileTime = elapsedMs(start);
+
+        std::lock_guard<std::mutex> lock(service.mutex);
+        service.compiled++;
+        service.totalCompileTime += result.compileTime;
+        return result;
+    }
+
+
+    /// <summary>
+    /// Queues a compilation on the compile service.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="source">GLSL source</param>
+    /// <param name="vertexShader"></param>
+    /// <param name="name">Name used in the compilation errors</param>
+    /// <param name="options"></param>
+    /// <param name="priority"></param>
+    /// <param name="cancelled">Checked when a worker picks the job. If it returns true the job is dropped without compiling.</param>
+    /// <returns>The SPIR-V (or the errors) along with the queue and compile times.</returns>
+    std::future<CompileResult> submitCompile(CompileService& service, const std::string& source, const bool& vertexShader,
+        const std::string& name, const ShaderCompileOptions& options, const CompilePriority& priority, const std::function<bool()>& cancelled)
+    {
+        auto promise = std::make_shared<std::promise<CompileResult>>();
+        std::future<CompileResult> future = promise->get_future();
+        auto submitTime = std::chrono::high_resolution_clock::now();
+        CompileService* pService = &service;
+        submitTask(service, priority, [pService, source, vertexShader, name, options, promise, submitTime, cancelled]() {
+            float waitTime = elapsedMs(submitTime);
+            CompileResult result;
+            if (cancelled && cancelled()) result.cancelled = true;
+            else result = runCompile(*pService, source, vertexShader, name, options);
+            result.waitTime = waitTime;
+            promise->set_value(std::move(result));
+        });
+        return future;
+    }
+
+
+    /// <summary>
+    /// Number of jobs waiting for a worker.
+    /// </summary>
+    size_t compileQueueDepth(CompileService& service) {
+        std::lock_guard<std::mutex> lock(service.mutex);
+        return service.jobs.size();
+    }
+
+
+    /// <summary>
+    /// Mean compilation time (ms) of the service since it started.
+    /// </summary>
+    float meanCompileTime(CompileService& service) {
+        std::lock_guard<std::mutex> lock(service.mutex);
+        return service.compiled == 0 ? 0.0f : static_cast<float>(service.totalCompileTime / service.compiled);
+    }
+
+
+    /// <summary>
+    /// Compiles every BRDF of the brdfs directory against main.frag and prints where the time goes. main.frag is also compiled
+    /// with a stub render(), which gives the part of each compilation spent on main.frag (the part a separately compiled main
+    /// shader would save). Runs on the calling thread; no window or device is needed.
+    /// </summary>
+    /// <param name="shadersPath"></param>
+    /// <returns>Process exit code</returns>
+    int benchmarkBRDFCompilation(const std::string& shadersPath) {
+        const std::string stub = "vec3 render(vec3 L, vec3 N, vec3 V, vec2 textureCord, mat3 worldToLocal){ return vec3(0.); }\n";
+        const int repeats = 3;
+
+        loadShaderIncludes(shadersPath + "/include");
+        std::vector<char> mainCode = readFile(shadersPath + "/main.frag", false);
+        std::string mainSource(mainCode.begin(), mainCode.end());
+        uint64_t mainHash = sourceHash(mainSource);
+
+        /*Median of the repeats. The first compilation of the thread also initializes the compiler, so it is done once before.*/
+        auto timeCompile = [&](const std::string& source, const std::string& name, bool& success) {
+            std::vector<float> times;
+            for (int i = 0; i < repeats; i++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                try {
+                    compileShader(source, false, name);
+                    success = true;
+                }
+                catch (const std::exception&) {
+                    success = false;
+                }
+                times.push_back(elapsedMs(start));
+            }
+            std::sort(times.begin(), times.end());
+            return times[repeats / 2];
+        };
+
+        bool success = false;
+        std::string stubShader = assembleShader(mainSource, "main.frag", stub, "stub.brdf");
+        timeCompile(stubShader, "stub", success);
+        float mainTime = timeCompile(stubShader, "stub", success);
+        if (!success) {
+            printf("[ERROR]: main.frag doesn't compile with a stub BRDF\n");
+            return 1;
+        }
+
+        printf("%-28s %12s %10s %12s %12s\n", "BRDF", "assemble us", "key us", "compile ms", "BRDF ms");
+        float totalCompile = 0.0f;
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(shadersPath + "/brdfs")) {
+            if (entry.path().extension() != ".brdf") continue;
+            std::string brdfName = entry.path().stem().string();
+            std::vector<char> brdfCode = readFile(entry.path().string(), false);
+            std::string brdfSource(brdfCode.begin(), brdfCode.end());
+
+            auto start = std::chrono::high_resolution_clock::now();
+            std::string shader = assembleShader(mainSource, "main.frag", brdfSource, brdfName + ".brdf");
+            float assembleTime = elapsedMs(start) * 1000.0f;
+
+            start = std::chrono::high_resolution_clock::now();
+            brdfSpirvKey(mainHash, brdfSource, brdfName, shaderOptionsKey(ShaderCompileOptions()));
+            float keyTime = elapsedMs(start) * 1000.0f;
+
+            float compileTime = timeCompile(shader, brdfName, success);
+            if (!success) {
+                printf("%-28s %12.1f %10.1f %12s\n", brdfName.c_str(), assembleTime, keyTime, "FAILED");
+                continue;
+            }
+            printf("%-28s %12.1f %10.1f %12.2f %12.2f\n", brdfName.c_str(), assembleTime, keyTime, compileTime, std::max(0.0f, compileTime - mainTime));
+            totalCompile += compileTime;
+            count++;
+        }
+
+        if (count > 0) {
+            printf("\nmain.frag with a stub BRDF: %.2f ms\n", mainTime);
+            printf("Mean compile: %.2f ms, of which main.frag: %.2f ms (%.0f%%)\n", totalCompile / count, mainTime, 100.0f * mainTime * count / totalCompile);
+        }
+        return 0;
+    }
+
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <cstring>
+#include <algorithm>
+
+
+// --------------------------------- GPU Culling ---------------------------------
+//  Before the scene pass, cull.comp runs one invocation per instance of every object. The instances passing the frustum
+//  test and the occlusion test (against the Hi-Z pyramid of the previous frame) are appended to the visible list of the
+//  object and counted in its indirect draw command, so the recorded draws only ever cover what is left. After the scene
+//  pass, hiz.comp reduces the depth attachment into the pyramid used by the next frame.
+
+namespace brdfa {
+
+    /*Constants of hiz.comp.*/
+    struct HizPushConstants {
+        int32_t     sourceSize[2];
+        int32_t     targetSize[2];
+        int32_t     samples;
+    };
+
+
+    static VkDescriptorSetLayoutBinding cullBinding(uint32_t binding, VkDescriptorType type) {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        layoutBinding.descriptorType = type;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        return layoutBinding;
+    }
+
+
+    static VkDescriptorSetLayout createSetLayout(const Device& device, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(device.device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the culling descriptor set layout!");
+        }
+        return layout;
+    }
+
+
+    static VkPipelineLayout createComputeLayout(const Device& device, const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushSize) {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = pushSize;
+
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        layoutInfo.pSetLayouts = setLayouts.data();
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushRange;
+        VkPipelineLayout layout;
+        if (vkCreatePipelineLayout(device.device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the culling pipeline layout!");
+        }
+        return layout;
+    }
+
+
+    static VkPipeline createComputePipeline(const Device& device, VkPipelineLayout layout, const std::vector<char>& spirv, VkPipelineCache cache) {
+        VkShaderModule module = createShaderModule(device, spirv);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateComputePipelines(device.device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device.device, module, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the culling compute pipeline!");
+        }
+        return pipeline;
+    }
+
+
+    static void writeImageDescriptor(const Device& device, VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+        VkSampler sampler, VkImageView view, VkImageLayout layout)
+    {
+        VkDescriptorImageInfo imageInfo{ sampler, view, layout };
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = binding;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device.device, 1, &write, 0, nullptr);
+    }
+
+
+    static void writeBufferDescriptor(const Device& device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer) {
+        VkDescriptorBufferInfo bufferInfo{ buffer, 0, VK_WHOLE_SIZE };
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = binding;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device.device, 1, &write, 0, nullptr);
+    }
+
+
+    static VkImageAspectFlags depthAspects(VkFormat format) {
+        bool stencil = format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
+        return VK_IMAGE_ASPECT_DEPTH_BIT | (stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+    }
+
+
+    /// <summary>
+    /// Creates the pipelines, the descriptors and the per frame buffer of the culling passes. The Hi-Z pyramid is created
+    /// by createHiZ() once the swapchain exists.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj">The draw set layout is set 1 of the culling pass</param>
+    /// <param name="cullSpirv">cull.comp</param>
+    /// <param name="hizSeedSpirv">hiz.comp reading the depth attachment</param>
+    /// <param name="hizReduceSpirv">hiz.comp reading a level of the pyramid</param>
+    /// <param name="cache"></param>
+    /// <param name="frameCount">Frames in flight</param>
+    void createCulling(Culling& culling, Commander& commander, const Device& device, const Descriptor& descriptorObj,
+        const std::vector<char>& cullSpirv, const std::vector<char>& hizSeedSpirv, const std::vector<char>& hizReduceSpirv,
+        VkPipelineCache cache, uint32_t frameCount)
+    {
+        /*Layouts and pipelines*/
+        culling.setLayout = createSetLayout(device, {
+            cullBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+            cullBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+            cullBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+            cullBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) });
+        culling.hizSetLayout = createSetLayout(device, {
+            cullBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+            cullBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) });
+        culling.layout = createComputeLayout(device, { culling.setLayout, descriptorObj.draw.layout }, sizeof(CullPushConstants));
+        culling.hizLayout = createComputeLayout(device, { culling.hizSetLayout }, sizeof(HizPushConstants));
+        culling.pipeline = createComputePipeline(device, culling.layout, cullSpirv, cache);
+        culling.hizSeedPipeline = createComputePipeline(device, culling.hizLayout, hizSeedSpirv, cache);
+        culling.hizReducePipeline = createComputePipeline(device, culling.hizLayout, hizReduceSpirv, cache);
+
+        /*One set for the culling pass and one per level of the pyramid.*/
+        std::array<VkDescriptorPoolSize, 3> poolSizes = { {
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + HIZ_MAX_LEVELS },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, HIZ_MAX_LEVELS } } };
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1 + HIZ_MAX_LEVELS;
+        if (vkCreateDescriptorPool(device.device, &poolInfo, nullptr, &culling.pool) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the culling descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(1 + HIZ_MAX_LEVELS, culling.hizSetLayout);
+        layouts[0] = culling.setLayout;
+        std::vector<VkDescriptorSet> sets(layouts.size());
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = culling.pool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(device.device, &allocInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to allocate the culling descriptor sets!");
+        }
+        culling.set = sets[0];
+        culling.hizSets.assign(sets.begin() + 1, sets.end());
+
+        /*Per frame data, mapped as long as it lives.*/
+        createBuffer(commander, device, sizeof(CullFrame) * frameCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, culling.frames);
+        void* data;
+        if (vkMapMemory(device.device, culling.frames.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to map the culling frames!");
+        }
+        memset(data, 0, sizeof(CullFrame) * frameCount);
+        culling.mappedFrames = static_cast<CullFrame*>(data);
+        writeBufferDescriptor(device, culling.set, 0, culling.frames.obj);
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = static_cast<float>(HIZ_MAX_LEVELS);
+        if (vkCreateSampler(device.device, &samplerInfo, nullptr, &culling.sampler) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the Hi-Z sampler!");
+        }
+    }
+
+
+    /// <summary>
+    /// Points the culling pass at the indirect draw buffers of the arena. Called again whenever they are recreated.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void writeCullingDescriptors(Culling& culling, const Device& device, const GeometryArena& geometry) {
+        writeBufferDescriptor(device, culling.set, 2, geometry.drawCommands.obj);
+        writeBufferDescriptor(device, culling.set, 3, geometry.drawCounts.obj);
+    }
+
+
+    /// <summary>
+    /// Creates the Hi-Z pyramid after the depth attachment of the swapchain, and writes the descriptors reading it.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void createHiZ(Culling& culling, Commander& commander, const Device& device, const SwapChain& swapchain) {
+        culling.hizExtent = swapchain.extent;
+        uint32_t largest = std::max(swapchain.extent.width, swapchain.extent.height);
+        culling.hizLevels = 1;
+        while ((largest >> culling.hizLevels) > 0 && culling.hizLevels < HIZ_MAX_LEVELS) culling.hizLevels++;
+
+        createImage(commander, device, swapchain.extent.width, swapchain.extent.height, culling.hizLevels, VK_SAMPLE_COUNT_1_BIT,
+            VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, culling.hiz);
+        culling.hiz.view = createImageView(culling.hiz.obj, device.device, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, culling.hizLevels);
+
+        culling.hizViews.resize(culling.hizLevels);
+        for (uint32_t level = 0; level < culling.hizLevels; level++) {
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = culling.hiz.obj;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = VK_FORMAT_R32_SFLOAT;
+            viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+            if (vkCreateImageView(device.device, &viewInfo, nullptr, &culling.hizViews[level]) != VK_SUCCESS) {
+                throw std::runtime_error("ERROR: failed to create a Hi-Z level view!");
+            }
+        }
+
+        /*The pyramid stays in the general layout: written as storage, sampled by the culling pass.*/
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = culling.hiz.obj;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, culling.hizLevels, 0, 1 };
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        endSingleTimeCommands(commander, device);
+
+        writeImageDescriptor(device, culling.set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, culling.sampler, culling.hiz.view, VK_IMAGE_LAYOUT_GENERAL);
+        for (uint32_t level = 0; level < culling.hizLevels; level++) {
+            if (level == 0)
+                writeImageDescriptor(device, culling.hizSets[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, culling.sampler,
+                    swapchain.depthImage.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+            else
+                writeImageDescriptor(device, culling.hizSets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, culling.sampler,
+                    culling.hizViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+            writeImageDescriptor(device, culling.hizSets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_NULL_HANDLE,
+                culling.hizViews[level], VK_IMAGE_LAYOUT_GENERAL);
+        }
+        culling.hizValid = false;
+    }
+
+
+    /// <summary>
+    /// Destroys the Hi-Z pyramid. Done along with the swapchain.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    void destroyHiZ(Culling& culling, const Device& device) {
+        for (VkImageView view : culling.hizViews) vkDestroyImageView(device.device, view, nullptr);
+        culling.hizViews.clear();
+        if (culling.hiz.obj != VK_NULL_HANDLE) {
+            vkDestroyImageView(device.device, culling.hiz.view, nullptr);
+            vkDestroyImage(device.device, culling.hiz.obj, nullptr);
+            vkFreeMemory(device.device, culling.hiz.memory, nullptr);
+            culling.hiz.obj = VK_NULL_HANDLE;
+        }
+        culling.hizValid = false;
+    }
+
+
+    /// <summary>
+    /// Destroys the pipelines, descriptors and buffers of the culling passes.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    void destroyCulling(Culling& culling, const Device& device) {
+        destroyHiZ(culling, device);
+        vkDestroySampler(device.device, culling.sampler, nullptr);
+        if (culling.mappedFrames != nullptr) vkUnmapMemory(device.device, culling.frames.memory);
+        vkDestroyBuffer(device.device, culling.frames.obj, nullptr);
+        vkFreeMemory(device.device, culling.frames.memory, nullptr);
+        vkDestroyDescriptorPool(device.device, culling.pool, nullptr);
+        vkDestroyPipeline(device.device, culling.pipeline, nullptr);
+        vkDestroyPipeline(device.device, culling.hizSeedPipeline, nullptr);
+        vkDestroyPipeline(device.device, culling.hizReducePipeline, nullptr);
+        vkDestroyPipelineLayout(device.device, culling.layout, nullptr);
+        vkDestroyPipelineLayout(device.device, culling.hizLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device.device, culling.setLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device.device, culling.hizSetLayout, nullptr);
+        culling = Culling();
+    }
+
+
+    /// <summary>
+    /// Takes the counters of the last run of the frame (done, since its fence signaled) into Culling::stats and writes the
+    /// cameras of the new run.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="frame">Frame in flight</param>
+    /// <param name="viewProj">Camera of the frame</param>
+    void beginCullFrame(Culling& culling, const uint32_t& frame, const glm::mat4& viewProj) {
+        CullFrame& data = culling.mappedFrames[frame];
+        culling.stats = data;
+
+        memset(&data, 0, sizeof(CullFrame));
+        data.viewProj = viewProj;
+        data.previousViewProj = culling.hizViewProj;
+        data.viewport = glm::vec4(culling.hizExtent.width, culling.hizExtent.height, culling.hizLevels, (culling.hizValid && culling.occlusion) ? 1.0f : 0.0f);
+        data.scale = culling.hizScale;
+    }
+
+
+    /// <summary>
+    /// Records the culling pass of the meshes, outside of the scene pass. The draw commands of the frame were written with no
+    /// instance and the draw counts cleared by recordDrawData(); cull.comp adds the instances left, and raises the draw count of
+    /// a batch up to its last mesh with an instance left.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="geometry"></param>
+    /// <param name="descriptorObj">Draw set of the arena (set 1)</param>
+    /// <param name="meshes"></param>
+    /// <param name="frame">Frame in flight</param>
+    void recordCulling(Culling& culling, VkCommandBuffer commandBuffer, const GeometryArena& geometry, const Descriptor& descriptorObj,
+        std::vector<Mesh>& meshes, const uint32_t& frame)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        uint32_t flags = culling.showCulled ? CULL_FLAG_SHOW_CULLED : 0;
+        if (culling.enabled) flags |= CULL_FLAG_FRUSTUM | (culling.occlusion ? CULL_FLAG_OCCLUSION : 0);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipeline);
+        std::array<VkDescriptorSet, 2> sets = { culling.set, descriptorObj.drawSet };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.layout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+        for (Mesh& mesh : meshes) {
+            CullPushConstants constants{};
+            constants.boundsMin = glm::vec4(mesh.boundsMin, 1.0f);
+            constants.boundsMax = glm::vec4(mesh.boundsMax, 1.0f);
+            constants.drawSlot = mesh.drawSlot;
+            constants.batchSlot = mesh.batchSlot;
+            constants.countSlot = geometry.drawCapacity + mesh.batchFirst;
+            constants.batchOffset = mesh.batchSlot - mesh.batchFirst;
+            constants.instanceBase = mesh.instanceRange.offset;
+            constants.instanceCount = mesh.instanceRange.count;
+            constants.triangles = mesh.indexRange.count / 3;
+            constants.flags = flags;
+            constants.frame = frame;
+
+            vkCmdPushConstants(commandBuffer, culling.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &constants);
+            vkCmdDispatch(commandBuffer, (constants.instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        }
+
+        /*The scene pass draws what is left. The counters are read back once the frame is done.*/
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+
+    /// <summary>
+    /// Records the reduction of the depth attachment into the Hi-Z pyramid, after the scene pass. The pyramid is tested
+    /// against by the culling pass of the next frame.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="frame">Frame in flight</param>
+    void recordHiZ(Culling& culling, VkCommandBuffer commandBuffer, const Device& device, const SwapChain& swapchain, const uint32_t& frame) {
+        VkImageMemoryBarrier depthBarrier{};
+        depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = swapchain.depthImage.obj;
+        depthBarrier.subresourceRange = { depthAspects(swapchain.depthImage.format), 0, 1, 0, 1 };
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        /*The culling pass of this frame is done reading the pyramid.*/
+        VkMemoryBarrier levelBarrier{};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 1, &depthBarrier);
+
+        HizPushConstants constants{};
+        constants.samples = static_cast<int32_t>(device.msaaSamples);
+        uint32_t width = culling.hizExtent.width, height = culling.hizExtent.height;
+        uint32_t sourceWidth = width, sourceHeight = height;
+
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        for (uint32_t level = 0; level < culling.hizLevels; level++) {
+            /*A single sampled depth attachment seeds like any other level.*/
+            if (level == 0)
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    device.msaaSamples != VK_SAMPLE_COUNT_1_BIT ? culling.hizSeedPipeline : culling.hizReducePipeline);
+            else {
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+                if (level == 1 && device.msaaSamples != VK_SAMPLE_COUNT_1_BIT) vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.hizReducePipeline);
+                sourceWidth = width;
+                sourceHeight = height;
+                width = std::max(1u, width / 2);
+                height = std::max(1u, height / 2);
+            }
+            constants.sourceSize[0] = static_cast<int32_t>(sourceWidth);
+            constants.sourceSize[1] = static_cast<int32_t>(sourceHeight);
+            constants.targetSize[0] = static_cast<int32_t>(width);
+            constants.targetSize[1] = static_cast<int32_t>(height);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.hizLayout, 0, 1, &culling.hizSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, culling.hizLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HizPushConstants), &constants);
+            vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+        }
+
+        /*The pyramid is read by the next culling pass, the depth attachment is written by the UI pass.*/
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.srcAccessMask = 0;
+        depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0, 1, &levelBarrier, 0, nullptr, 1, &depthBarrier);
+
+        culling.hizViewProj = culling.mappedFrames[frame].viewProj;
+        culling.hizScale = culling.renderScale;
+        culling.hizValid = true;
+    }
+
+}
@@ -0,0 +1,424 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <array>
+
+
+// --------------------------------- Deferred Shading ---------------------------------
+//  In deferred mode (--deferred) the pre-pass rasterizes the meshes into a thin G-buffer (gbuffer.frag): the octahedral normal
+//  and texture coordinates (RGBA16F), the vertex color (RGBA8) and the visible instance (R32UI) of the nearest surface, 20 bytes
+//  per pixel with the depth. The position is rebuilt from the depth (CameraUniforms::inverseViewProj).
+//  classify.comp then sorts the 8x8 tiles of the G-buffer by batch: every tile is appended to the list of each batch (pipeline)
+//  it has pixels of, and counted in the indirect draw of that batch. The BRDF pipelines draw the tiles of their batch (tiles.vert),
+//  and main.frag shades only the pixels of the batch, so the BRDF loop runs once per pixel whatever the overdraw, and a BRDF
+//  only rasterizes the tiles where it is seen. The batches past DEFERRED_MAX_BATCHES draw a full screen triangle instead. The
+//  skybox stays a forward draw behind the shaded pixels.
+
+namespace brdfa {
+
+    static const std::array<VkFormat, 3> GBUFFER_FORMATS = {
+        VK_FORMAT_R16G16B16A16_SFLOAT,          // Surface
+        VK_FORMAT_R8G8B8A8_UNORM,               // Color
+        VK_FORMAT_R32_UINT                      // Instance
+    };
+
+
+    /*First depth format the device can render into and sample: the shading passes rebuild the positions from it.*/
+    static VkFormat gbufferDepthFormat(const Device& device) {
+        std::array<VkFormat, 3> candidates = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(device.physicalDevice, format, &props);
+            const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+            if ((props.optimalTilingFeatures & features) == features)
+                return format;
+        }
+        throw std::runtime_error("ERROR: no depth format for the G-buffer!");
+    }
+
+
+    /*One single sampled attachment of the G-buffer, with its view.*/
+    static void createGBufferImage(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain,
+        VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    {
+        createImage(commander, device, swapchain.extent.width, swapchain.extent.height, 1, VK_SAMPLE_COUNT_1_BIT,
+            format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image);
+        image.view = createImageView(image.obj, device.device, format, aspect, 1);
+    }
+
+
+    static void destroyGBufferImage(Image& image, const Device& device) {
+        vkDestroyImageView(device.device, image.view, nullptr);
+        vkDestroyImage(device.device, image.obj, nullptr);
+        vkFreeMemory(device.device, image.memory, nullptr);
+    }
+
+
+    /// <summary>
+    /// Creates the render pass of the G-buffer pre-pass. The attachments, depth included, are left readable by the shading passes.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void createGBufferRenderPass(GPipeline& gpipeline, const Device& device) {
+        std::array<VkAttachmentDescription, 4> attachments{};
+        std::array<VkAttachmentReference, 3> colorRefs{};
+        for (size_t i = 0; i < GBUFFER_FORMATS.size(); i++) {
+            attachments[i].format = GBUFFER_FORMATS[i];
+            attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            colorRefs[i] = { static_cast<uint32_t>(i), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        }
+
+        VkAttachmentDescription& depthAttachment = attachments[3];
+        depthAttachment.format = gbufferDepthFormat(device);
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        VkAttachmentReference depthRef = { 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+        subpass.pColorAttachments = colorRefs.data();
+        subpass.pDepthStencilAttachment = &depthRef;
+
+        /*The shading passes and the classification of the previous frame are done reading before the attachments are cleared, and
+          the writes of this frame are visible to the classification and the shading passes after it.*/
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+            | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device.device, &renderPassInfo, nullptr, &gpipeline.gbufferRenderPass) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the G-buffer render pass!");
+        }
+    }
+
+
+    /// <summary>
+    /// Creates the G-buffer attachments, framebuffer and sampler, and the tile lists, after the swapchain extent. Recreated along
+    /// with the swapchain.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="gpipeline"></param>
+    void createGBuffer(SwapChain& swapchain, Commander& commander, const Device& device, const GPipeline& gpipeline) {
+        GBuffer& gbuffer = swapchain.gbuffer;
+        const VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        createGBufferImage(gbuffer.surface, commander, device, swapchain, GBUFFER_FORMATS[0], colorUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+        createGBufferImage(gbuffer.color, commander, device, swapchain, GBUFFER_FORMATS[1], colorUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+        createGBufferImage(gbuffer.instance, commander, device, swapchain, GBUFFER_FORMATS[2], colorUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+        createGBufferImage(gbuffer.depth, commander, device, swapchain, gbufferDepthFormat(device),
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        std::array<VkImageView, 4> attachments = { gbuffer.surface.view, gbuffer.color.view, gbuffer.instance.view, gbuffer.depth.view };
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = gpipeline.gbufferRenderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = swapchain.extent.width;
+        framebufferInfo.height = swapchain.extent.height;
+        framebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(device.device, &framebufferInfo, nullptr, &gbuffer.framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the G-buffer framebuffer!");
+        }
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(device.device, &samplerInfo, nullptr, &gbuffer.sampler) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the G-buffer sampler!");
+        }
+
+        /*Every batch may cover every tile of the grid.*/
+        VkDeviceSize tiles = ((swapchain.extent.width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE) * ((swapchain.extent.height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE);
+        createBuffer(commander, device, sizeof(VkDrawIndirectCommand) * DEFERRED_MAX_BATCHES,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gbuffer.tileCommands);
+        createBuffer(commander, device, sizeof(uint32_t) * tiles * DEFERRED_MAX_BATCHES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gbuffer.tileLists);
+    }
+
+
+    /// <summary>
+    /// Destroys the G-buffer of the swapchain, if any.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="device"></param>
+    void destroyGBuffer(SwapChain& swapchain, const Device& device) {
+        GBuffer& gbuffer = swapchain.gbuffer;
+        if (gbuffer.framebuffer == VK_NULL_HANDLE) return;
+        vkDestroyFramebuffer(device.device, gbuffer.framebuffer, nullptr);
+        vkDestroySampler(device.device, gbuffer.sampler, nullptr);
+        destroyGBufferImage(gbuffer.surface, device);
+        destroyGBufferImage(gbuffer.color, device);
+        destroyGBufferImage(gbuffer.instance, device);
+        destroyGBufferImage(gbuffer.depth, device);
+        vkDestroyBuffer(device.device, gbuffer.tileCommands.obj, nullptr);
+        vkFreeMemory(device.device, gbuffer.tileCommands.memory, nullptr);
+        vkDestroyBuffer(device.device, gbuffer.tileLists.obj, nullptr);
+        vkFreeMemory(device.device, gbuffer.tileLists.memory, nullptr);
+        gbuffer = GBuffer();
+    }
+
+
+    /// <summary>
+    /// Creates the pipeline of the G-buffer pre-pass (GPipeline::gbufferPipeline): main.vert and gbuffer.frag, single sampled.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="vertShaderSpirv"></param>
+    /// <param name="fragShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    void createGBufferPipeline(GPipeline& gpipeline, const Device& device, const SwapChain& swapchain,
+        const std::vector<char>& vertShaderSpirv, const std::vector<char>& fragShaderSpirv, const VkPipelineCache& pipelineCache)
+    {
+        VkShaderModule vertShaderModule = createShaderModule(device, vertShaderSpirv);
+        VkShaderModule fragShaderModule = createShaderModule(device, fragShaderSpirv);
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertShaderModule;
+        shaderStages[0].pName = "main";
+        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = fragShaderModule;
+        shaderStages[1].pName = "main";
+
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapchain.extent.width;
+        viewport.height = (float)swapchain.extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapchain.extent;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        /*One surface per pixel: the shading passes run once per pixel too.*/
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        std::array<VkPipelineColorBlendAttachmentState, 3> colorBlendAttachments{};
+        for (auto& attachment : colorBlendAttachments) {
+            attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            attachment.blendEnable = VK_FALSE;
+        }
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+        colorBlending.pAttachments = colorBlendAttachments.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = sceneDynamicState();
+        pipelineInfo.layout = gpipeline.layout;
+        pipelineInfo.renderPass = gpipeline.gbufferRenderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkResult result = vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.gbufferPipeline);
+        vkDestroyShaderModule(device.device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device.device, vertShaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the G-buffer pipeline!");
+        }
+    }
+
+
+
+    /// <summary>
+    /// Creates the tile classification pass (classify.comp): the draw set (set 0), the G-buffer set (set 1) and ClassifyPushConstants.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="spirv">classify.comp</param>
+    /// <param name="pipelineCache"></param>
+    void createTileClassification(GPipeline& gpipeline, const Device& device, const Descriptor& descriptorObj,
+        const std::vector<char>& spirv, const VkPipelineCache& pipelineCache)
+    {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(ClassifyPushConstants);
+
+        std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorObj.draw.layout, descriptorObj.gbuffer.layout };
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        layoutInfo.pSetLayouts = setLayouts.data();
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(device.device, &layoutInfo, nullptr, &gpipeline.classifyLayout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the tile classification pipeline layout!");
+        }
+
+        VkShaderModule module = createShaderModule(device, spirv);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = gpipeline.classifyLayout;
+
+        VkResult result = vkCreateComputePipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.classifyPipeline);
+        vkDestroyShaderModule(device.device, module, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the tile classification pipeline!");
+        }
+    }
+
+
+    /// <summary>
+    /// Destroys the tile classification pass, if any.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void destroyTileClassification(GPipeline& gpipeline, const Device& device) {
+        vkDestroyPipeline(device.device, gpipeline.classifyPipeline, nullptr);
+        vkDestroyPipelineLayout(device.device, gpipeline.classifyLayout, nullptr);
+        gpipeline.classifyPipeline = VK_NULL_HANDLE;
+        gpipeline.classifyLayout = VK_NULL_HANDLE;
+    }
+
+
+    /// <summary>
+    /// Records the tile classification between the G-buffer pass and the scene pass: the draws of the batches are reset to no
+    /// tiles, then classify.comp appends each tile of the render extent to the lists of the batches it has pixels of.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="extent">Render extent of the scene</param>
+    void recordTileClassification(const GPipeline& gpipeline, VkCommandBuffer commandBuffer, const Descriptor& descriptorObj,
+        const SwapChain& swapchain, const VkExtent2D& extent)
+    {
+        /*The scene pass of the previous frame is done drawing the tiles.*/
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        std::array<VkDrawIndirectCommand, DEFERRED_MAX_BATCHES> commands;
+        for (auto& command : commands) command = { 0, 1, 0, 0 };
+        vkCmdUpdateBuffer(commandBuffer, swapchain.gbuffer.tileCommands.obj, 0, sizeof(commands), commands.data());
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        ClassifyPushConstants constants{ { extent.width, extent.height } };
+        std::array<VkDescriptorSet, 2> sets = { descriptorObj.drawSet, descriptorObj.gbufferSet };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpipeline.classifyPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpipeline.classifyLayout, 0,
+            static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+        vkCmdPushConstants(commandBuffer, gpipeline.classifyLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClassifyPushConstants), &constants);
+        vkCmdDispatch(commandBuffer, (extent.width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE, (extent.height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+
+}
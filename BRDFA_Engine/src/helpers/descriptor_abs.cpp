@@ -2,11 +2,14 @@
 
 #include <brdfa_structs.hpp>
 #include <brdfa_cons.hpp>
+#include <helpers/functions.hpp>
 
 
 #include <algorithm>
 #include <vulkan/vulkan.h>
 #include <iostream>
+#include <cstddef>
+#include <cstring>
 
 
 
@@ -17,207 +20,562 @@
 namespace brdfa {
 
 
+    /*Data read by the update templates. The template entries point at the members.*/
+    struct FrameDescriptorData {
+        VkDescriptorBufferInfo  camera;
+        VkDescriptorImageInfo   skymap;
+    };
+
+    struct MaterialDescriptorData {
+        VkDescriptorImageInfo   textures[TEXTURE_COUNT];
+    };
+
+    struct DrawDescriptorData {
+        VkDescriptorBufferInfo  instances;
+        VkDescriptorBufferInfo  visible;
+        VkDescriptorBufferInfo  records;
+    };
+
+    struct GBufferDescriptorData {
+        VkDescriptorImageInfo   surface;
+        VkDescriptorImageInfo   color;
+        VkDescriptorImageInfo   instance;
+        VkDescriptorImageInfo   depth;
+        VkDescriptorBufferInfo  tileCommands;
+        VkDescriptorBufferInfo  tileLists;
+    };
+
+    struct AdaptiveDescriptorData {
+        VkDescriptorImageInfo   mean;
+        VkDescriptorImageInfo   moments;
+        VkDescriptorImageInfo   budget;
+        VkDescriptorImageInfo   error;
+        VkDescriptorBufferInfo  frames;
+    };
+
+
+
+    static VkDescriptorSetLayoutBinding layoutBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages) {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        layoutBinding.descriptorType = type;
+        layoutBinding.pImmutableSamplers = nullptr;
+        layoutBinding.stageFlags = stages;
+        return layoutBinding;
+    }
+
 
     /// <summary>
-    /// 
+    /// Creates the layout, the update template and the first pool of an allocator.
     /// </summary>
-    /// <param name="descriptorObj"></param>
+    /// <param name="allocator"></param>
     /// <param name="device"></param>
-    /// <param name="swapchain"></param>
-    void createDescriptorSetLayout(Descriptor& descriptorObj, const Device& device, const SwapChain& swapchain) {
-
-        /*Uniform variables.*/
-        VkDescriptorSetLayoutBinding uboLayoutBinding{};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.pImmutableSamplers = nullptr;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        /*Sky map binding*/
-        VkDescriptorSetLayoutBinding skymapLayoutBinding{};
-        skymapLayoutBinding.binding = 1;
-        skymapLayoutBinding.descriptorCount = 1;
-        skymapLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        skymapLayoutBinding.pImmutableSamplers = nullptr;
-        skymapLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding iTextureLayoutBinding1{};
-        iTextureLayoutBinding1.binding = 2;
-        iTextureLayoutBinding1.descriptorCount = 1;
-        iTextureLayoutBinding1.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        iTextureLayoutBinding1.pImmutableSamplers = nullptr;
-        iTextureLayoutBinding1.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding iTextureLayoutBinding2{};
-        iTextureLayoutBinding2.binding = 3;
-        iTextureLayoutBinding2.descriptorCount = 1;
-        iTextureLayoutBinding2.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        iTextureLayoutBinding2.pImmutableSamplers = nullptr;
-        iTextureLayoutBinding2.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding iTextureLayoutBinding3{};
-        iTextureLayoutBinding3.binding = 4;
-        iTextureLayoutBinding3.descriptorCount = 1;
-        iTextureLayoutBinding3.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        iTextureLayoutBinding3.pImmutableSamplers = nullptr;
-        iTextureLayoutBinding3.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding iTextureLayoutBinding4{};
-        iTextureLayoutBinding4.binding = 5;
-        iTextureLayoutBinding4.descriptorCount = 1;
-        iTextureLayoutBinding4.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        iTextureLayoutBinding4.pImmutableSamplers = nullptr;
-        iTextureLayoutBinding4.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        /*Object Parameters variables.*/
-        VkDescriptorSetLayoutBinding extraParamsLayoutBinding{};
-        extraParamsLayoutBinding.binding = 6;
-        extraParamsLayoutBinding.descriptorCount = 1;
-        extraParamsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        extraParamsLayoutBinding.pImmutableSamplers = nullptr;
-        extraParamsLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-
-        std::array<VkDescriptorSetLayoutBinding, 7> bindings = { 
-            uboLayoutBinding, 
-            skymapLayoutBinding, 
-            iTextureLayoutBinding1, iTextureLayoutBinding2, iTextureLayoutBinding3, iTextureLayoutBinding4,
-            extraParamsLayoutBinding };
-
+    /// <param name="bindings"></param>
+    /// <param name="dataOffsets">Offset of each binding's info in the data given to the template. Empty: no template (the sets are written by hand).</param>
+    /// <param name="dataStride"></param>
+    /// <param name="setsPerPool">Sets of the first pool</param>
+    /// <param name="bindingFlags">Empty, or the descriptor indexing flags of each binding</param>
+    static void createAllocator(DescriptorAllocator& allocator, const Device& device, const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const std::vector<size_t>& dataOffsets, size_t dataStride, uint32_t setsPerPool, const std::vector<VkDescriptorBindingFlags>& bindingFlags = {})
+    {
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
         layoutInfo.pBindings = bindings.data();
 
-        if (vkCreateDescriptorSetLayout(device.device, &layoutInfo, nullptr, &descriptorObj.layout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor set layout!");
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        allocator.poolFlags = 0;
+        if (!bindingFlags.empty()) {
+            flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+            flagsInfo.pBindingFlags = bindingFlags.data();
+            layoutInfo.pNext = &flagsInfo;
+            for (const auto& flags : bindingFlags) {
+                if (flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+                    layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+                    allocator.poolFlags |= VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+                }
+            }
+        }
+        if (vkCreateDescriptorSetLayout(device.device, &layoutInfo, nullptr, &allocator.layout) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create descriptor set layout!");
         }
-    }
 
+        std::vector<VkDescriptorUpdateTemplateEntry> entries(bindings.size());
+        allocator.setSizes.clear();
+        for (size_t i = 0; i < bindings.size(); i++) {
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = bindings[i].descriptorCount;
+            entries[i].descriptorType = bindings[i].descriptorType;
+            entries[i].offset = dataOffsets.empty() ? 0 : dataOffsets[i];
+            entries[i].stride = dataStride;
+
+            auto size = std::find_if(allocator.setSizes.begin(), allocator.setSizes.end(),
+                [&](const VkDescriptorPoolSize& s) { return s.type == bindings[i].descriptorType; });
+            if (size == allocator.setSizes.end()) allocator.setSizes.push_back({ bindings[i].descriptorType, bindings[i].descriptorCount });
+            else size->descriptorCount += bindings[i].descriptorCount;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        templateInfo.descriptorSetLayout = allocator.layout;
+        if (!dataOffsets.empty() && vkCreateDescriptorUpdateTemplate(device.device, &templateInfo, nullptr, &allocator.updateTemplate) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create descriptor update template!");
+        }
 
+        allocator.setsPerPool = setsPerPool;
+        allocator.pools.clear();
+        allocator.freeSets.clear();
+    }
 
-   /// <summary>
-   /// creates a BRDFA Descriptor Object. 
-   /// Descriptor Object holds the sets being created, the pool which they correspond to, and
-   /// their layout in memory. Number of sets is determined by: swapchain images size * meshes count in the scene.
-   /// </summary>
-   /// <param name="descriptorObj">The desired Descriptor Object to be filled</param>
-   /// <param name="device">BRDFA Device object</param>
-   /// <param name="swapchain">BRDFA SwapChain object</param>
-   /// <param name="meshCount">Number of meshes needed to be rendered</param>
-    void initDescriptors(Descriptor& descriptorObj, const Device& device, const SwapChain& swapchain, const std::vector<Buffer>& uniformBuffers, std::vector<Mesh>& meshes, Image& skymap) {
 
-        /*Descriptor Pool creation*/
-        size_t descriptorCount = swapchain.images.size() * meshes.size(); // How many descriptors of this kind can be allocated through the whole sets
-        std::array<VkDescriptorPoolSize, 4> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;          // ubov
-        poolSizes[0].descriptorCount = descriptorCount;
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;  // texture
-        poolSizes[1].descriptorCount = descriptorCount * TEXTURE_COUNT;
-        poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;  // environment map
-        poolSizes[2].descriptorCount = descriptorCount;
-        poolSizes[3].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;          // extra object parameters
-        poolSizes[3].descriptorCount = descriptorCount;
+    static void addPool(DescriptorAllocator& allocator, const Device& device) {
+        std::vector<VkDescriptorPoolSize> poolSizes = allocator.setSizes;
+        for (auto& size : poolSizes) size.descriptorCount *= allocator.setsPerPool;
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = allocator.poolFlags;
         poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = descriptorCount; // we want to allocate a set for each object.
+        poolInfo.maxSets = allocator.setsPerPool;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device.device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create descriptor pool!");
+        }
+        allocator.pools.push_back(pool);
+        allocator.setsPerPool *= 2;
+    }
+
 
-        if (vkCreateDescriptorPool(device.device, &poolInfo, nullptr, &descriptorObj.pool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor pool!");
+    static void destroyAllocator(DescriptorAllocator& allocator, const Device& device) {
+        for (auto& pool : allocator.pools) vkDestroyDescriptorPool(device.device, pool, nullptr);
+        if (allocator.updateTemplate != VK_NULL_HANDLE)
+            vkDestroyDescriptorUpdateTemplate(device.device, allocator.updateTemplate, nullptr);
+        vkDestroyDescriptorSetLayout(device.device, allocator.layout, nullptr);
+        allocator = DescriptorAllocator();
+    }
+
+
+    /*Points the texture set at the material table.*/
+    static void writeMaterialTableDescriptor(Descriptor& descriptorObj, const Device& device) {
+        VkDescriptorBufferInfo tableInfo{ descriptorObj.materialTable.obj, 0, VK_WHOLE_SIZE };
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorObj.textureSet;
+        write.dstBinding = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &tableInfo;
+        vkUpdateDescriptorSets(device.device, 1, &write, 0, nullptr);
+        descriptorObj.setWrites++;
+    }
+
+
+    /// <summary>
+    /// (Re)creates the material table with room for the given records. The records written so far are kept.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="capacity"></param>
+    static void growMaterialTable(Descriptor& descriptorObj, Commander& commander, const Device& device, uint32_t capacity) {
+        Buffer table;
+        VkDeviceSize size = VkDeviceSize(capacity) * MATERIAL_RECORD_SIZE * sizeof(uint32_t);
+        createBuffer(commander, device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, table);
+
+        void* data;
+        if (vkMapMemory(device.device, table.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to map the material table!");
         }
+        memset(data, 0, size);
+        if (descriptorObj.materialRecords != nullptr) {
+            memcpy(data, descriptorObj.materialRecords, size_t(descriptorObj.materialCapacity) * MATERIAL_RECORD_SIZE * sizeof(uint32_t));
+            vkUnmapMemory(device.device, descriptorObj.materialTable.memory);
+            vkDestroyBuffer(device.device, descriptorObj.materialTable.obj, nullptr);
+            vkFreeMemory(device.device, descriptorObj.materialTable.memory, nullptr);
+        }
+        descriptorObj.materialTable = table;
+        descriptorObj.materialRecords = static_cast<uint32_t*>(data);
+        descriptorObj.materialCapacity = capacity;
+        writeMaterialTableDescriptor(descriptorObj, device);
+    }
 
 
-        /*Allocating descriptor sets*/
-        size_t setcount = descriptorCount;          // swapchain.images.size() * meshCount;
-        std::vector<VkDescriptorSetLayout> layouts(setcount, descriptorObj.layout);
+    /// <summary>
+    /// Creates the set layouts of the three update frequencies (frame, material, draw), their update templates and pools,
+    /// along with the G-buffer set of the deferred mode and the set of the adaptive sampling.
+    /// Done once; the swapchain recreation keeps them.
+    /// With descriptor indexing, set 1 is the bindless texture array and the material table instead of a set per mesh.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void createDescriptors(Descriptor& descriptorObj, Commander& commander, const Device& device) {
+        const VkShaderStageFlags allStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        /*Set 0: camera block of the frame (static offset, one set per frame region) and the skymap.*/
+        createAllocator(descriptorObj.frame, device, {
+                layoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, allStages),
+                layoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) },
+            { offsetof(FrameDescriptorData, camera), offsetof(FrameDescriptorData, skymap) }, sizeof(FrameDescriptorData), 4);
+
+        descriptorObj.bindless = device.descriptorIndexing;
+        if (descriptorObj.bindless) {
+            /*Set 1 (bindless): every texture in one partially bound array, written slot by slot (update after bind, so the
+              recorded command buffers stay valid), and the material table.*/
+            VkDescriptorSetLayoutBinding textureArray = layoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+            textureArray.descriptorCount = device.bindlessTextures;
+            createAllocator(descriptorObj.material, device, {
+                    textureArray,
+                    layoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT) },
+                {}, 0, 1,
+                { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, 0 });
+            descriptorObj.textureSet = allocateDescriptorSet(descriptorObj.material, device);
+            descriptorObj.textureCapacity = device.bindlessTextures;
+            growMaterialTable(descriptorObj, commander, device, MATERIAL_TABLE_CAPACITY);
+        }
+        else {
+            /*Set 1: textures of a mesh.*/
+            std::vector<VkDescriptorSetLayoutBinding> textureBindings;
+            std::vector<size_t> textureOffsets;
+            for (uint32_t i = 0; i < TEXTURE_COUNT; i++) {
+                textureBindings.push_back(layoutBinding(i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT));
+                textureOffsets.push_back(offsetof(MaterialDescriptorData, textures) + i * sizeof(VkDescriptorImageInfo));
+            }
+            createAllocator(descriptorObj.material, device, textureBindings, textureOffsets, sizeof(MaterialDescriptorData), 16);
+        }
+
+        /*Set 2: instance table, instances left by the culling pass and draw records of every mesh. The culling pass binds it too
+          (as its set 1).*/
+        createAllocator(descriptorObj.draw, device, {
+                layoutBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, allStages | VK_SHADER_STAGE_COMPUTE_BIT),
+                layoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT),
+                layoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, allStages | VK_SHADER_STAGE_COMPUTE_BIT) },
+            { offsetof(DrawDescriptorData, instances), offsetof(DrawDescriptorData, visible), offsetof(DrawDescriptorData, records) },
+            sizeof(DrawDescriptorData), 2);
+        descriptorObj.drawSet = allocateDescriptorSet(descriptorObj.draw, device);
+
+        /*Set 3: the G-buffer read by the deferred shading passes, and the tiles classify.comp (set 1 there) lists for them. Part of
+          the pipeline layout in both modes; only bound in deferred mode.*/
+        createAllocator(descriptorObj.gbuffer, device, {
+                layoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
+                layoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
+                layoutBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT),
+                layoutBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
+                layoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                layoutBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT) },
+            { offsetof(GBufferDescriptorData, surface), offsetof(GBufferDescriptorData, color), offsetof(GBufferDescriptorData, instance),
+              offsetof(GBufferDescriptorData, depth), offsetof(GBufferDescriptorData, tileCommands), offsetof(GBufferDescriptorData, tileLists) },
+            sizeof(GBufferDescriptorData), 1);
+        descriptorObj.gbufferSet = allocateDescriptorSet(descriptorObj.gbuffer, device);
+
+        /*Set 4: the statistics and budget map of the adaptive sampling, shared with adaptive.comp. Part of the pipeline layout in
+          every case; the set only exists (and is bound) when main.frag can write the statistics.*/
+        const VkShaderStageFlags adaptiveStages = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+        createAllocator(descriptorObj.adaptive, device, {
+                layoutBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, adaptiveStages),
+                layoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, adaptiveStages),
+                layoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, adaptiveStages),
+                layoutBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT),
+                layoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT) },
+            { offsetof(AdaptiveDescriptorData, mean), offsetof(AdaptiveDescriptorData, moments), offsetof(AdaptiveDescriptorData, budget),
+                offsetof(AdaptiveDescriptorData, error), offsetof(AdaptiveDescriptorData, frames) },
+            sizeof(AdaptiveDescriptorData), 1);
+        if (device.fragmentStores)
+            descriptorObj.adaptiveSet = allocateDescriptorSet(descriptorObj.adaptive, device);
+    }
+
+
+    /// <summary>
+    /// Destroys the pools, templates and layouts of the descriptors.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    void destroyDescriptors(Descriptor& descriptorObj, const Device& device) {
+        if (descriptorObj.materialRecords != nullptr) {
+            vkUnmapMemory(device.device, descriptorObj.materialTable.memory);
+            vkDestroyBuffer(device.device, descriptorObj.materialTable.obj, nullptr);
+            vkFreeMemory(device.device, descriptorObj.materialTable.memory, nullptr);
+            descriptorObj.materialRecords = nullptr;
+        }
+        destroyAllocator(descriptorObj.frame, device);
+        destroyAllocator(descriptorObj.material, device);
+        destroyAllocator(descriptorObj.draw, device);
+        destroyAllocator(descriptorObj.gbuffer, device);
+        destroyAllocator(descriptorObj.adaptive, device);
+        descriptorObj.frameSets.clear();
+        descriptorObj.drawSet = VK_NULL_HANDLE;
+        descriptorObj.retiredDrawSet = VK_NULL_HANDLE;
+        descriptorObj.gbufferSet = VK_NULL_HANDLE;
+        descriptorObj.adaptiveSet = VK_NULL_HANDLE;
+    }
+
+
+    /// <summary>
+    /// Hands out a set of the allocator: a released one if any, otherwise a new one (adding a pool when the last one is full).
+    /// The content of a reused set is stale until it is written.
+    /// </summary>
+    /// <param name="allocator"></param>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    VkDescriptorSet allocateDescriptorSet(DescriptorAllocator& allocator, const Device& device) {
+        if (!allocator.freeSets.empty()) {
+            VkDescriptorSet set = allocator.freeSets.back();
+            allocator.freeSets.pop_back();
+            return set;
+        }
+
         VkDescriptorSetAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorObj.pool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(setcount);
-        allocInfo.pSetLayouts = layouts.data();
-
-        // Every 2 consecutive sets are for an individual object in that frame.
-        descriptorObj.sets.resize(setcount);
-        if (vkAllocateDescriptorSets(device.device, &allocInfo, descriptorObj.sets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("ERROR: failed to allocate descriptor sets!");
-        }
-
-
-        for (size_t i = 0; i < descriptorObj.sets.size(); i++) {
-            std::vector<VkWriteDescriptorSet> descriptorWrites;
-            /*Mesh UBO uniform*/
-            descriptorWrites.push_back({});
-
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i].obj;
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(MVPMatrices);
-
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = descriptorObj.sets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-            
-            /*Mesh Skymap uniform*/
-            descriptorWrites.push_back({});
-            VkDescriptorImageInfo skymapInfo{};
-            skymapInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            skymapInfo.imageView = skymap.view;
-            skymapInfo.sampler = skymap.sampler;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorObj.sets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &skymapInfo;
-
-            /*Mesh Texture uniform*/
-            std::vector<Image> textures = meshes[i / swapchain.images.size()].textureImages;
-            std::vector<VkDescriptorImageInfo> imageInfos;
-            imageInfos.resize(textures.size());
-
-            for (int j = 0; j < textures.size(); j++) {
-                descriptorWrites.push_back({});
-                imageInfos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                imageInfos[j].imageView = textures[j].view;
-                imageInfos[j].sampler = textures[j].sampler;
-
-                descriptorWrites[descriptorWrites.size() - 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrites[descriptorWrites.size() - 1].dstSet = descriptorObj.sets[i];
-                descriptorWrites[descriptorWrites.size() - 1].dstBinding = 2 + j;
-                descriptorWrites[descriptorWrites.size() - 1].dstArrayElement = 0;
-                descriptorWrites[descriptorWrites.size() - 1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                descriptorWrites[descriptorWrites.size() - 1].descriptorCount = 1;
-                descriptorWrites[descriptorWrites.size() - 1].pImageInfo = &imageInfos[j];
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &allocator.layout;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+        if (!allocator.pools.empty()) {
+            allocInfo.descriptorPool = allocator.pools.back();
+            result = vkAllocateDescriptorSets(device.device, &allocInfo, &set);
+        }
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            addPool(allocator, device);
+            allocInfo.descriptorPool = allocator.pools.back();
+            result = vkAllocateDescriptorSets(device.device, &allocInfo, &set);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to allocate descriptor set!");
+        }
+        return set;
+    }
+
+
+    /// <summary>
+    /// Gives a set back to its allocator. The set must not be in use by the device anymore.
+    /// </summary>
+    /// <param name="allocator"></param>
+    /// <param name="set"></param>
+    void releaseDescriptorSet(DescriptorAllocator& allocator, VkDescriptorSet set) {
+        if (set != VK_NULL_HANDLE) allocator.freeSets.push_back(set);
+    }
+
+
+    /// <summary>
+    /// Writes the frame sets (camera block and skymap), one per frame region of the uniform arena. Sets are taken or released
+    /// to match the region count. Called when the skymap or the arena buffer changes.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="uniforms"></param>
+    /// <param name="skymap"></param>
+    void writeFrameDescriptors(Descriptor& descriptorObj, const Device& device, const UniformArena& uniforms, const Image& skymap) {
+        while (descriptorObj.frameSets.size() > uniforms.frameCount) {
+            releaseDescriptorSet(descriptorObj.frame, descriptorObj.frameSets.back());
+            descriptorObj.frameSets.pop_back();
+        }
+        while (descriptorObj.frameSets.size() < uniforms.frameCount) {
+            descriptorObj.frameSets.push_back(allocateDescriptorSet(descriptorObj.frame, device));
+        }
+
+        for (uint32_t i = 0; i < uniforms.frameCount; i++) {
+            FrameDescriptorData data{};
+            data.camera = { uniforms.buffer.obj, cameraUniformOffset(uniforms, i), sizeof(CameraUniforms) };
+            data.skymap = { skymap.sampler, skymap.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+            vkUpdateDescriptorSetWithTemplate(device.device, descriptorObj.frameSets[i], descriptorObj.frame.updateTemplate, &data);
+            descriptorObj.setWrites++;
+        }
+    }
+
+
+    /// <summary>
+    /// Takes (if needed) and writes the material set of a mesh. The texture slots the mesh doesn't fill repeat its last texture.
+    /// In bindless mode, the new textures of the mesh take a slot of the texture array and the mesh takes (if needed) a record
+    /// of the material table, which is written; nothing else is touched unless the material table has to grow.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if a set used by the other meshes was rewritten (their command buffers must be re-recorded)</returns>
+    bool writeMaterialDescriptors(Descriptor& descriptorObj, Commander& commander, const Device& device, Mesh& mesh) {
+        if (mesh.textureImages.empty())
+            throw std::runtime_error("ERROR: a mesh needs at least one texture to be rendered");
+
+        if (descriptorObj.bindless) {
+            if (mesh.textureImages.size() >= MATERIAL_RECORD_SIZE)
+                throw std::runtime_error("ERROR: too many textures for a material record");
+
+            /*Slots of the new textures*/
+            std::vector<VkDescriptorImageInfo> imageInfos(mesh.textureImages.size() - std::min(mesh.textureSlots.size(), mesh.textureImages.size()));
+            std::vector<VkWriteDescriptorSet> writes(imageInfos.size());
+            for (size_t i = 0; i < imageInfos.size(); i++) {
+                uint32_t slot;
+                if (!descriptorObj.freeTextures.empty()) {
+                    slot = descriptorObj.freeTextures.back();
+                    descriptorObj.freeTextures.pop_back();
+                }
+                else if (descriptorObj.usedTextures < descriptorObj.textureCapacity) {
+                    slot = descriptorObj.usedTextures++;
+                }
+                else {
+                    throw std::runtime_error("ERROR: the bindless texture array is full");
+                }
+                const Image& texture = mesh.textureImages[mesh.textureSlots.size()];
+                mesh.textureSlots.push_back(slot);
+
+                imageInfos[i] = { texture.sampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+                writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[i].dstSet = descriptorObj.textureSet;
+                writes[i].dstBinding = 0;
+                writes[i].dstArrayElement = slot;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writes[i].descriptorCount = 1;
+                writes[i].pImageInfo = &imageInfos[i];
+            }
+            if (!writes.empty()) {
+                vkUpdateDescriptorSets(device.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+                descriptorObj.setWrites++;
             }
 
-            /*Mesh UBO uniform*/
-            descriptorWrites.push_back({});
+            /*Material record*/
+            bool grown = false;
+            if (mesh.materialSet == VK_NULL_HANDLE) {
+                if (!descriptorObj.freeMaterials.empty()) {
+                    mesh.materialSlot = descriptorObj.freeMaterials.back();
+                    descriptorObj.freeMaterials.pop_back();
+                }
+                else {
+                    mesh.materialSlot = descriptorObj.usedMaterials++;
+                }
+            }
+            if (mesh.materialSlot >= descriptorObj.materialCapacity) {
+                growMaterialTable(descriptorObj, commander, device, std::max(mesh.materialSlot + 1, descriptorObj.materialCapacity * 2));
+                grown = true;
+            }
+            uint32_t* record = descriptorObj.materialRecords + size_t(mesh.materialSlot) * MATERIAL_RECORD_SIZE;
+            record[0] = static_cast<uint32_t>(mesh.textureSlots.size());
+            std::copy(mesh.textureSlots.begin(), mesh.textureSlots.end(), record + 1);
+            mesh.materialSet = descriptorObj.textureSet;
+            return grown;
+        }
+
+        if (mesh.materialSet == VK_NULL_HANDLE)
+            mesh.materialSet = allocateDescriptorSet(descriptorObj.material, device);
 
-            VkDescriptorBufferInfo paramsInfo{};
-            paramsInfo.buffer = meshes[i / swapchain.images.size()].paramsBuffer[i % swapchain.images.size()].obj;
-            paramsInfo.offset = 0;
-            paramsInfo.range = sizeof(Parameters);
-            descriptorWrites[descriptorWrites.size() - 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[descriptorWrites.size() - 1].dstSet = descriptorObj.sets[i];
-            descriptorWrites[descriptorWrites.size() - 1].dstBinding = 6;
-            descriptorWrites[descriptorWrites.size() - 1].dstArrayElement = 0;
-            descriptorWrites[descriptorWrites.size() - 1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[descriptorWrites.size() - 1].descriptorCount = 1;
-            descriptorWrites[descriptorWrites.size() - 1].pBufferInfo = &paramsInfo;
+        MaterialDescriptorData data{};
+        for (size_t i = 0; i < TEXTURE_COUNT; i++) {
+            const Image& texture = mesh.textureImages[std::min(i, mesh.textureImages.size() - 1)];
+            data.textures[i] = { texture.sampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        }
+        vkUpdateDescriptorSetWithTemplate(device.device, mesh.materialSet, descriptorObj.material.updateTemplate, &data);
+        descriptorObj.setWrites++;
+        return false;
+    }
 
 
-            vkUpdateDescriptorSets(device.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, VK_NULL_HANDLE);
+    /// <summary>
+    /// Gives the material set (or in bindless mode, the texture slots and the material record) of a mesh back. Done when the mesh is deleted.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="mesh"></param>
+    void releaseMaterialDescriptors(Descriptor& descriptorObj, Mesh& mesh) {
+        if (descriptorObj.bindless) {
+            descriptorObj.freeTextures.insert(descriptorObj.freeTextures.end(), mesh.textureSlots.begin(), mesh.textureSlots.end());
+            mesh.textureSlots.clear();
+            if (mesh.materialSet != VK_NULL_HANDLE) descriptorObj.freeMaterials.push_back(mesh.materialSlot);
+        }
+        else {
+            releaseDescriptorSet(descriptorObj.material, mesh.materialSet);
         }
+        mesh.materialSet = VK_NULL_HANDLE;
     }
 
+
+
+    /// <summary>
+    /// Points the draw set at the instance table, the visible list and the draw records of the geometry arena. Done whenever one
+    /// of them is recreated, while the device is idle.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void writeDrawDescriptors(Descriptor& descriptorObj, const Device& device, const GeometryArena& geometry) {
+        DrawDescriptorData data{ { geometry.instances.buffer.obj, 0, VK_WHOLE_SIZE }, { geometry.visible.obj, 0, VK_WHOLE_SIZE },
+            { geometry.drawRecords.obj, 0, VK_WHOLE_SIZE } };
+        vkUpdateDescriptorSetWithTemplate(device.device, descriptorObj.drawSet, descriptorObj.draw.updateTemplate, &data);
+        descriptorObj.setWrites++;
+    }
+
+
+    /// <summary>
+    /// Points a new draw set at the buffers of the geometry arena, for the buffers replaced while frames are in flight (a compaction).
+    /// The current set is still bound by their command buffers: it is retired, and released by releaseRetiredDrawSet().
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void renewDrawDescriptors(Descriptor& descriptorObj, const Device& device, const GeometryArena& geometry) {
+        releaseRetiredDrawSet(descriptorObj);
+        descriptorObj.retiredDrawSet = descriptorObj.drawSet;
+        descriptorObj.drawSet = allocateDescriptorSet(descriptorObj.draw, device);
+        writeDrawDescriptors(descriptorObj, device, geometry);
+    }
+
+
+    /// <summary>
+    /// Gives the draw set retired by renewDrawDescriptors() back to the allocator. Called once no frame in flight uses it.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    void releaseRetiredDrawSet(Descriptor& descriptorObj) {
+        if (descriptorObj.retiredDrawSet == VK_NULL_HANDLE) return;
+        releaseDescriptorSet(descriptorObj.draw, descriptorObj.retiredDrawSet);
+        descriptorObj.retiredDrawSet = VK_NULL_HANDLE;
+    }
+
+
+    /// <summary>
+    /// Points the G-buffer set at the attachments of the swapchain's G-buffer. Done whenever the G-buffer is (re)created.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void writeGBufferDescriptors(Descriptor& descriptorObj, const Device& device, const SwapChain& swapchain) {
+        const GBuffer& gbuffer = swapchain.gbuffer;
+        GBufferDescriptorData data{
+            { gbuffer.sampler, gbuffer.surface.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+            { gbuffer.sampler, gbuffer.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+            { gbuffer.sampler, gbuffer.instance.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+            { gbuffer.sampler, gbuffer.depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL },
+            { gbuffer.tileCommands.obj, 0, VK_WHOLE_SIZE },
+            { gbuffer.tileLists.obj, 0, VK_WHOLE_SIZE } };
+        vkUpdateDescriptorSetWithTemplate(device.device, descriptorObj.gbufferSet, descriptorObj.gbuffer.updateTemplate, &data);
+        descriptorObj.setWrites++;
+    }
+
+
+    /// <summary>
+    /// Points the adaptive set at the images and counters of the adaptive sampling. Done whenever the images are (re)created.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="adaptive"></param>
+    void writeAdaptiveDescriptors(Descriptor& descriptorObj, const Device& device, const AdaptiveSampling& adaptive) {
+        if (descriptorObj.adaptiveSet == VK_NULL_HANDLE) return;
+        AdaptiveDescriptorData data{
+            { VK_NULL_HANDLE, adaptive.mean.view, VK_IMAGE_LAYOUT_GENERAL },
+            { VK_NULL_HANDLE, adaptive.moments.view, VK_IMAGE_LAYOUT_GENERAL },
+            { VK_NULL_HANDLE, adaptive.budgetMap.view, VK_IMAGE_LAYOUT_GENERAL },
+            { VK_NULL_HANDLE, adaptive.error.view, VK_IMAGE_LAYOUT_GENERAL },
+            { adaptive.frames.obj, 0, VK_WHOLE_SIZE } };
+        vkUpdateDescriptorSetWithTemplate(device.device, descriptorObj.adaptiveSet, descriptorObj.adaptive.updateTemplate, &data);
+        descriptorObj.setWrites++;
+    }
+
+
 }
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <algorithm>
 // --------------------------------- Device Creation Abstraction ---------------------------------
 
 
@@ -77,8 +78,12 @@ namespace brdfa {
                 indices.graphicsFamily = i;
             }
 
+            /*Headless (no surface), nothing is presented: the graphics queue stands in for the present one.*/
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device.physicalDevice, i, device.surface, &presentSupport);
+            if (device.surface != VK_NULL_HANDLE)
+                vkGetPhysicalDeviceSurfaceSupportKHR(device.physicalDevice, i, device.surface, &presentSupport);
+            else
+                presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == static_cast<uint32_t>(i);
 
             if (presentSupport) {
                 indices.presentFamily = i;
@@ -158,10 +163,11 @@ namespace brdfa {
     /// <returns></returns>
      bool isDeviceSuitable(const Device& device) {
         QueueFamilyIndices indices = findQueueFamilies(device);
-        bool extensionsSupported = checkDeviceExtensionSupport(device.physicalDevice);
+        bool headless = device.surface == VK_NULL_HANDLE;        // No swapchain needed. Software ICDs (lavapipe) qualify too.
+        bool extensionsSupported = headless || checkDeviceExtensionSupport(device.physicalDevice);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = headless;
+        if (!headless && extensionsSupported) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
@@ -196,7 +202,8 @@ namespace brdfa {
             device.physicalDevice = physicalDevice;
             if (isDeviceSuitable(device)) {
                 found = true;
-                device.msaaSamples = getMaxUsableSampleCount(physicalDevice);
+                device.maxMsaaSamples = getMaxUsableSampleCount(physicalDevice);
+                device.msaaSamples = device.maxMsaaSamples;
                 break;
             }
         }
@@ -208,12 +215,112 @@ namespace brdfa {
 
 
 
+    /// <summary>
+    /// Checks if the physical device can link graphics pipelines from libraries (VK_EXT_graphics_pipeline_library).
+    /// </summary>
+    /// <param name="physicalDevice"></param>
+    /// <returns></returns>
+     bool checkPipelineLibrarySupport(const VkPhysicalDevice& physicalDevice) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_1) return false;
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions(pipelineLibraryExtensions.begin(), pipelineLibraryExtensions.end());
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+        if (!requiredExtensions.empty()) return false;
+
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+        libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &libraryFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+        return libraryFeatures.graphicsPipelineLibrary == VK_TRUE;
+    }
+
+
+    /// <summary>
+    /// Checks if the physical device can index a partially bound, update after bind texture array (VK_EXT_descriptor_indexing).
+    /// The array is sized within the update after bind limits of the device, both as sampled images and as samplers, leaving room
+    /// for the other samplers of the fragment stage. A device whose limits leave less than BINDLESS_MIN_TEXTURES slots keeps the
+    /// fixed bindings.
+    /// </summary>
+    /// <param name="physicalDevice"></param>
+    /// <param name="textureCapacity">Size the bindless texture array can have on the device</param>
+    /// <returns></returns>
+    static bool checkDescriptorIndexingSupport(const VkPhysicalDevice& physicalDevice, uint32_t& textureCapacity) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions(descriptorIndexingExtensions.begin(), descriptorIndexingExtensions.end());
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+        if (!requiredExtensions.empty()) return false;
+
+        VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+        if (features.features.shaderSampledImageArrayDynamicIndexing != VK_TRUE || indexingFeatures.runtimeDescriptorArray != VK_TRUE
+            || indexingFeatures.descriptorBindingPartiallyBound != VK_TRUE || indexingFeatures.descriptorBindingSampledImageUpdateAfterBind != VK_TRUE
+            || indexingFeatures.shaderSampledImageArrayNonUniformIndexing != VK_TRUE)
+            return false;
+
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+        uint32_t limit = std::min({
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+        textureCapacity = std::min(BINDLESS_TEXTURE_CAPACITY, limit > BINDLESS_RESERVED_SAMPLERS ? limit - BINDLESS_RESERVED_SAMPLERS : 0);
+        if (textureCapacity < BINDLESS_MIN_TEXTURES) {
+            printf("[INFO]: The update after bind limits of the device hold %u textures only. Bindless textures are not used.\n", limit);
+            textureCapacity = 0;
+            return false;
+        }
+        return true;
+    }
+
+
+    /*If the device supports VK_KHR_draw_indirect_count.*/
+    static bool checkDrawIndirectCountSupport(const VkPhysicalDevice& physicalDevice) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions(drawIndirectCountExtensions.begin(), drawIndirectCountExtensions.end());
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+        return requiredExtensions.empty();
+    }
+
+
     /// <summary>
     /// 
     /// </summary>
     /// <param name="device"></param>
     /// <param name="enableValidationLayers"></param>
-     void createLogicalDevice(Device& device, const bool& enableValidationLayers) {
+    /// <param name="allowDescriptorIndexing">False to keep the fixed texture bindings even if the device supports the bindless table</param>
+     void createLogicalDevice(Device& device, const bool& enableValidationLayers, const bool& allowDescriptorIndexing) {
         QueueFamilyIndices indices = findQueueFamilies(device);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -229,16 +336,80 @@ namespace brdfa {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        device.descriptorIndexing = allowDescriptorIndexing && checkDescriptorIndexingSupport(device.physicalDevice, device.bindlessTextures);
+
+        /*Fragment shader invocations are counted while the scene pass executes the secondaries: both features are needed.*/
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(device.physicalDevice, &supportedFeatures);
+        device.pipelineStatistics = supportedFeatures.pipelineStatisticsQuery == VK_TRUE && supportedFeatures.inheritedQueries == VK_TRUE;
+        /*The adaptive sampling statistics are written by main.frag.*/
+        device.fragmentStores = supportedFeatures.fragmentStoresAndAtomics == VK_TRUE;
+        /*A batch of meshes is one indirect draw, each draw finding its instances through its first instance.*/
+        device.multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE && supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+        /*The GPU time of the frames (frame-time governor) is taken with timestamps on the graphics queue.*/
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice, &familyCount, families.data());
+        bool timestamps = families[indices.graphicsFamily.value()].timestampValidBits > 0;
+        device.timestampPeriod = timestamps ? properties.limits.timestampPeriod : 0.0f;
+
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing = device.descriptorIndexing ? VK_TRUE : VK_FALSE;
+        deviceFeatures.pipelineStatisticsQuery = device.pipelineStatistics ? VK_TRUE : VK_FALSE;
+        deviceFeatures.inheritedQueries = device.pipelineStatistics ? VK_TRUE : VK_FALSE;
+        deviceFeatures.fragmentStoresAndAtomics = device.fragmentStores ? VK_TRUE : VK_FALSE;
+        deviceFeatures.multiDrawIndirect = device.multiDrawIndirect ? VK_TRUE : VK_FALSE;
+        deviceFeatures.drawIndirectFirstInstance = device.multiDrawIndirect ? VK_TRUE : VK_FALSE;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        /*Optional extensions. The swapchain one is not needed headless.*/
+        std::vector<const char*> extensions;
+        if (device.surface != VK_NULL_HANDLE)
+            extensions.assign(deviceExtensions.begin(), deviceExtensions.end());
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+        libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        device.pipelineLibrary = checkPipelineLibrarySupport(device.physicalDevice);
+        if (device.pipelineLibrary) {
+            extensions.insert(extensions.end(), pipelineLibraryExtensions.begin(), pipelineLibraryExtensions.end());
+            libraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+            createInfo.pNext = &libraryFeatures;
+        }
+        printf("[INFO]: Graphics pipeline libraries: %s\n", device.pipelineLibrary ? "enabled" : "not supported (full pipeline creation)");
+
+        VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        if (device.descriptorIndexing) {
+            extensions.insert(extensions.end(), descriptorIndexingExtensions.begin(), descriptorIndexingExtensions.end());
+            indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+            indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+            indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            indexingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &indexingFeatures;
+        }
+        printf("[INFO]: Bindless textures: %s\n", device.descriptorIndexing ? ("enabled (" + std::to_string(device.bindlessTextures) + " slots)").c_str() : "disabled (fixed texture bindings)");
+
+        printf("[INFO]: Pipeline statistics: %s\n", device.pipelineStatistics ? "enabled" : "not supported");
+        printf("[INFO]: GPU timestamps: %s\n", device.timestampPeriod > 0.0f ? "enabled" : "not supported (frame interval)");
+        printf("[INFO]: Adaptive sampling: %s\n", device.fragmentStores ? "available" : "not supported (no fragment shader stores)");
+        printf("[INFO]: Multi draw indirect: %s\n", device.multiDrawIndirect ? "enabled (one draw per pipeline)" : "not supported (one draw per mesh)");
+
+        bool drawIndirectCount = checkDrawIndirectCountSupport(device.physicalDevice);
+        if (drawIndirectCount)
+            extensions.insert(extensions.end(), drawIndirectCountExtensions.begin(), drawIndirectCountExtensions.end());
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 
         if (enableValidationLayers) {
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -254,6 +425,10 @@ namespace brdfa {
 
         vkGetDeviceQueue(device.device, indices.graphicsFamily.value(), 0, &device.graphicsQueue);
         vkGetDeviceQueue(device.device, indices.presentFamily.value(), 0, &device.presentQueue);
+
+        if (drawIndirectCount)
+            device.cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device.device, "vkCmdDrawIndexedIndirectCountKHR");
+        printf("[INFO]: Indirect draw count: %s\n", device.cmdDrawIndexedIndirectCount ? "enabled" : "not supported (fixed draw counts)");
     }
 
 }
@@ -1,6 +1,8 @@
 
 #include <helpers/functions.hpp>
 
+#include <chrono>
+
 
 namespace brdfa {
 
@@ -97,62 +99,82 @@ namespace brdfa {
     }
 
 
-    /// <summary>
-    /// Creates Empty buffers in the RAM for holding Uniform variables. 
-    ///     
-    /// Note:
-    ///     Each scene object will have its own related uniform buffer.
-    ///     Each independent frame will have its own related uniform buffer.
-    ///     Therefore, Uniform buffers size is: swapchain images * mesh count.
-    /// </summary>
-    /// <param name="uniformBuffers"></param>
-    /// <param name="commander"></param>
-    /// <param name="device"></param>
-    /// <param name="swapchain"></param>
-    /// <param name="meshCount"></param>
-    void createUniformBuffers(std::vector<Buffer>& uniformBuffers, Commander& commander, const Device& device, const SwapChain& swapchain, uint32_t meshCount) {
-        VkDeviceSize bufferSize = sizeof(MVPMatrices);
-        uniformBuffers.resize(swapchain.images.size() * meshCount);       // Mesh Count can be of a maximum size to reduce the allocations
-        for (size_t i = 0; i < uniformBuffers.size(); i++) {
-            createBuffer(
-                commander, device,
-                bufferSize,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                uniformBuffers[i]);
+    /*A cache of a worker, started from the engine cache data. Merged into the engine cache by the main thread, as vkMergePipelineCaches
+      needs its destination externally synchronized.*/
+    static VkPipelineCache createWorkerCache(const Device& device, const std::vector<char>& cacheSeed) {
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = cacheSeed.size();
+        cacheInfo.pInitialData = cacheSeed.empty() ? nullptr : cacheSeed.data();
+        VkPipelineCache cache = VK_NULL_HANDLE;
+        if (vkCreatePipelineCache(device.device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            cache = VK_NULL_HANDLE;
         }
+        return cache;
     }
 
 
-
-    void threadAddSpirv(const std::string& cacheFileName, BRDF_Panel lp, std::unordered_map<std::string, BRDF_Panel>* loadedBRDFs)
+    void threadBuildPipeline(const std::string& source, const uint64_t& key, const ShaderCompileOptions& options, BRDF_Panel lp,
+        const GPipeline* gpipeline, const Device* device, const SwapChain* swapchain, const Descriptor* descriptor,
+        const std::vector<char>* cacheSeed, CompileService* compiler, PipelineQueue* queue, const uint64_t& swapGeneration)
     {
-        std::vector<char> frag_spirv = readFile(cacheFileName);
-        lp.latest_spir_v = frag_spirv;
-        loadedBRDFs->insert({ lp.brdfName, lp });
-        printf("[INFO]: ReadFile thread completed: BRDF (%s) \n", lp.brdfName.c_str());
+        ReadyPipeline ready{};
+        ready.spirvKey = key;
+        ready.swapGeneration = swapGeneration;
+        try {
+            if (lp.latest_spir_v.empty()) {
+                CompileResult result = runCompile(*compiler, source, false, lp.brdfName, options);
+                if (!result.success) throw std::runtime_error(result.log);
+                lp.latest_spir_v = std::move(result.spirv);
+                ready.compiled = true;
+            }
+            lp.tested = true;
+            lp.log_e = "";
+
+            /*Each worker owns its cache so the creations don't contend on the engine cache.*/
+            ready.cache = createWorkerCache(*device, *cacheSeed);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            VkPipeline unusedSkymap = VK_NULL_HANDLE;
+            createGraphicsPipeline(
+                gpipeline->layout, gpipeline->sceneRenderPass,
+                ready.pipeline, unusedSkymap,
+                *device, *swapchain, *descriptor, {}, lp.latest_spir_v, false,
+                nullptr, ready.cache, gpipeline->vertModule);
+            ready.creationTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("[INFO]: Pipeline thread completed: BRDF (%s) \n", lp.brdfName.c_str());
+        }
+        catch (const std::exception& exp) {
+            std::cout << exp.what() << std::endl;
+            lp.log_e = exp.what();
+            ready.pipeline = VK_NULL_HANDLE;
+        }
+
+        ready.panel = lp;
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->ready.push(ready);
     }
 
 
-    void threadCompileGLSL(const std::string& concat, BRDF_Panel& lp, std::unordered_map<std::string, BRDF_Panel>* loadedBRDFs, bool testing)
+    void threadLinkPipeline(const std::string& brdfName, const uint64_t& generation, const VkPipeline& fragmentLibrary,
+        const GPipeline* gpipeline, const Device* device, const std::vector<char>* cacheSeed, PipelineQueue* queue)
     {
+        LinkedPipeline linked{};
+        linked.brdfName = brdfName;
+        linked.generation = generation;
         try {
-            std::vector<char> frag_spir = compileShader(concat, false, lp.brdfName);
-            lp.latest_spir_v = frag_spir;
-            lp.tested = true;
-            lp.log_e = "";
-            if (!testing) loadedBRDFs->insert({ lp.brdfName, lp });
-            printf("[INFO]: compileShader thread completed: BRDF (%s) \n", lp.brdfName.c_str());
+            linked.cache = createWorkerCache(*device, *cacheSeed);
+            auto start = std::chrono::high_resolution_clock::now();
+            linked.pipeline = linkPipelineLibraries(*gpipeline, *device, fragmentLibrary, true, linked.cache);
+            linked.linkTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
         }
         catch (const std::exception& exp) {
             std::cout << exp.what() << std::endl;
-            lp.log_e = exp.what();
+            linked.pipeline = VK_NULL_HANDLE;
         }
 
-        //lp.latest_spir_v = compileShader(concat, false, "FragmentSHader");;
-        //loadedBRDFs->insert({ lp.brdfName, lp });
-        //printf("[INFO]: compileShader thread completed: BRDF (%s) \n", lp.brdfName.c_str());
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->linked.push(linked);
     }
 
 }
\ No newline at end of file
@@ -6,7 +6,9 @@
 
 
 #include <algorithm>
+#include <map>
 #include <vulkan/vulkan.h>
+#include <shaderc/shaderc.h>
 #include <iostream>
 
 
@@ -54,8 +56,9 @@ namespace brdfa {
     /// 
     /// </summary>
     /// <param name="enableValidationLayers"></param>
+    /// <param name="headless">No window: the surface extensions of GLFW are left out</param>
     /// <returns></returns>
-    std::vector<const char*> getRequiredExtensions(const bool& enableValidationLayers);
+    std::vector<const char*> getRequiredExtensions(const bool& enableValidationLayers, const bool& headless = false);
 
 
 
@@ -65,7 +68,8 @@ namespace brdfa {
     /// <param name="applicationName"></param>
     /// <param name="enableValidationLayers"></param>
     /// <param name="instance"></param>
-    void createInstance(const char* applicationName, const bool& enableValidationLayers, Instance& instance);
+    /// <param name="headless">Created without the surface extensions (no GLFW window)</param>
+    void createInstance(const char* applicationName, const bool& enableValidationLayers, Instance& instance, const bool& headless = false);
 
 
 
@@ -140,7 +144,8 @@ namespace brdfa {
     /// </summary>
     /// <param name="device"></param>
     /// <param name="enableValidationLayers"></param>
-    void createLogicalDevice(Device& device, const bool& enableValidationLayers);
+    /// <param name="allowDescriptorIndexing">False to keep the fixed texture bindings even if the device supports the bindless table</param>
+    void createLogicalDevice(Device& device, const bool& enableValidationLayers, const bool& allowDescriptorIndexing = true);
 
 
 
@@ -228,7 +233,8 @@ namespace brdfa {
     /// <param name="commander"></param>
     /// <param name="device"></param>
     /// <param name="swapchain"></param>
-    void createColorResources(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain);
+    /// <param name="sampled">Read by the FXAA or upscale pass instead of living in tile memory only</param>
+    void createColorResources(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain, bool sampled = false);
 
 
     /// <summary>
@@ -291,7 +297,7 @@ namespace brdfa {
 
 
     /// <summary>
-    /// Given a glsl code, it compiles it at runtime and returns a spir-v code.
+    /// Given a glsl code, it compiles it at runtime and returns a spir-v code. A shader name ending with ".comp" compiles a compute shader.
     /// </summary>
     /// <param name="device"></param>
     /// <param name="glslCode"></param>
@@ -299,7 +305,8 @@ namespace brdfa {
     std::vector<char> compileShader(
         const std::string& glslCode, 
         const bool& vertexShader = true, 
-        const std::string& shadername = "realtimeShader");
+        const std::string& shadername = "realtimeShader",
+        const ShaderCompileOptions& compileOptions = ShaderCompileOptions());
 
 
 
@@ -315,6 +322,18 @@ namespace brdfa {
         const SwapChain& swapchain);
 
 
+    /// <summary>
+    /// If the scene is drawn into a color attachment of its own (MSAA, FXAA or governed) rather than straight into the swapchain image.
+    /// Without it, the scene framebuffers hold the swapchain image and the depth attachment only.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    bool sceneColorAttachment(
+        const GPipeline& gpipeline, 
+        const Device& device);
+
+
     /// <summary>
     /// This will allow the creation of a pipeline layout
     /// </summary>
@@ -327,6 +346,13 @@ namespace brdfa {
         const Descriptor& descriptor);
 
 
+    /// <summary>
+    /// Dynamic state of the scene pipelines: viewport and scissor, set by the secondaries to Commander::renderExtent.
+    /// </summary>
+    /// <returns></returns>
+    const VkPipelineDynamicStateCreateInfo* sceneDynamicState();
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -334,6 +360,9 @@ namespace brdfa {
     /// <param name="device"></param>
     /// <param name="swapchain"></param>
     /// <param name="descriptor"></param>
+    /// <param name="fragSpecialization">Optional specialization constants of the fragment stage (nullptr keeps the shader defaults)</param>
+    /// <param name="pipelineCache">Pipeline cache used to speed up the creation</param>
+    /// <param name="sharedVertModule">Vertex module to use instead of creating one from vertShaderSpirv. It is not destroyed.</param>
     void createGraphicsPipeline(
         const VkPipelineLayout& layout, 
         const VkRenderPass& sceneRenderPass,
@@ -344,7 +373,95 @@ namespace brdfa {
         const Descriptor& descriptor, 
         const std::vector<char>& vertShaderSpirv,
         const std::vector<char>& fragShaderSpirv, 
-        const bool& isSkymap);
+        const bool& isSkymap,
+        const VkSpecializationInfo* fragSpecialization = nullptr,
+        const VkPipelineCache& pipelineCache = VK_NULL_HANDLE,
+        const VkShaderModule& sharedVertModule = VK_NULL_HANDLE);
+
+
+    /// <summary>
+    /// Creates the depth only pipeline of the pre-pass (GPipeline::depthPipeline): main.vert, no fragment shader, no color writes.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="vertShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    void createDepthPipeline(
+        GPipeline& gpipeline,
+        const Device& device,
+        const SwapChain& swapchain,
+        const std::vector<char>& vertShaderSpirv,
+        const VkPipelineCache& pipelineCache = VK_NULL_HANDLE);
+
+
+    /// <summary>
+    /// Builds the vertex input, pre-rasterization and fragment output libraries shared by all the BRDF pipelines.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="pipelineCache"></param>
+    void createPipelineLibraries(GPipeline& gpipeline, const Device& device, const SwapChain& swapchain, const VkPipelineCache& pipelineCache);
+
+
+    /// <summary>
+    /// Builds the fragment shader library of a BRDF.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="fragShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    /// <returns></returns>
+    VkPipeline createFragmentLibrary(const GPipeline& gpipeline, const Device& device, const std::vector<char>& fragShaderSpirv, const VkPipelineCache& pipelineCache);
+
+
+    /// <summary>
+    /// Links the shared libraries and the given fragment library into an executable pipeline.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="fragmentLibrary"></param>
+    /// <param name="optimized">Link time optimizations</param>
+    /// <param name="pipelineCache"></param>
+    /// <returns></returns>
+    VkPipeline linkPipelineLibraries(const GPipeline& gpipeline, const Device& device, const VkPipeline& fragmentLibrary, const bool& optimized, const VkPipelineCache& pipelineCache);
+
+
+    /// <summary>
+    /// Destroys the shared and the fragment pipeline libraries.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void destroyPipelineLibraries(GPipeline& gpipeline, const Device& device);
+
+
+    /// <summary>
+    /// Creates a pipeline cache from the data saved at the given path. The saved data is validated against the current device.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="path"></param>
+    /// <param name="warm">True if the saved data was used</param>
+    /// <returns></returns>
+    VkPipelineCache createPipelineCache(const Device& device, const std::string& path, bool& warm);
+
+
+    /// <summary>
+    /// Merges the source caches into the destination cache. The source caches are destroyed.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="dstCache"></param>
+    /// <param name="srcCaches"></param>
+    void mergePipelineCaches(const Device& device, const VkPipelineCache& dstCache, std::vector<VkPipelineCache>& srcCaches);
+
+
+    /// <summary>
+    /// Saves the pipeline cache data into the disk.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="cache"></param>
+    /// <param name="path"></param>
+    void savePipelineCache(const Device& device, const VkPipelineCache& cache, const std::string& path);
 
 
 
@@ -444,6 +561,43 @@ namespace brdfa {
 
 
 
+    /// <summary>
+    /// Creates a device local buffer holding the given data, uploaded through a staging buffer. Waits for the upload.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="data"></param>
+    /// <param name="size"></param>
+    /// <param name="usage">Usage of the buffer besides the transfer destination</param>
+    /// <param name="buffer"></param>
+    void createDeviceBuffer(
+        Commander& commander,
+        const Device& device,
+        const void* data,
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        Buffer& buffer);
+
+
+    /// <summary>
+    /// Writes the given data into a (device local) buffer at the given offset, through a staging buffer. Waits for the upload.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="data"></param>
+    /// <param name="size"></param>
+    /// <param name="buffer">Created with VK_BUFFER_USAGE_TRANSFER_DST_BIT</param>
+    /// <param name="offset"></param>
+    void uploadBuffer(
+        Commander& commander,
+        const Device& device,
+        const void* data,
+        VkDeviceSize size,
+        Buffer& buffer,
+        VkDeviceSize offset);
+
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -468,9 +622,11 @@ namespace brdfa {
     /// </summary>
     /// <param name="commandPool"></param>
     /// <param name="device"></param>
+    /// <param name="flags"></param>
     void createCommandPool(
         VkCommandPool& commandPool,
-        const Device& device);
+        const Device& device,
+        VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
 
 
@@ -478,36 +634,115 @@ namespace brdfa {
     /// 
     /// </summary>
     /// <param name="commander"></param>
-    /// <param name="device"></param>
     /// <param name="gpipeline"></param>
     /// <param name="swapchain"></param>
+    /// <param name="post">With FXAA, the UI is drawn in the framebuffers of the FXAA pass</param>
     /// <param name="index"></param>
+    /// <param name="frame">Frame context recorded into</param>
     void updateUICommandBuffers(
         Commander& commander, 
-        const Device& device, 
         const GPipeline& gpipeline,
         const SwapChain& swapchain, 
-        const uint32_t index);
+        const PostProcess& post,
+        const uint32_t index,
+        const uint32_t frame);
 
 
     /// <summary>
-    /// 
+    /// Creates one context per frame in flight: a transient pool along with the scene and UI buffers allocated out of it once.
+    /// The buffers are re-recorded every frame after resetFrameContext(), so the frame loop itself allocates nothing.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="frameCount"></param>
+    void createFrameContexts(
+        Commander& commander,
+        const Device& device,
+        size_t frameCount);
+
+
+    /// <summary>
+    /// Destroys the frame contexts (and their buffers).
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void destroyFrameContexts(
+        Commander& commander,
+        const Device& device);
+
+
+    /// <summary>
+    /// Resets the buffers of a frame context. Must be called once the fence of the frame signaled.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="frame"></param>
+    void resetFrameContext(
+        Commander& commander,
+        const Device& device,
+        const uint32_t frame);
+
+
+    /// <summary>
+    /// Frees the secondaries of the batches (pre-pass, meshes and skybox).
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void freeSceneCommandBuffers(
+        Commander& commander,
+        const Device& device);
+
+
+    /// <summary>
+    /// Marks every batch for re-recording and every draw record for rewriting. Used when the descriptors, the render pass, the
+    /// framebuffers or the buffers of the geometry arena change.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="meshes"></param>
+    void invalidateSceneCommands(
+        Commander& commander,
+        std::vector<Mesh>& meshes);
+
+
+    /// <summary>
+    /// Records the scene buffer of a frame for a swapchain image. The meshes are sorted by pipeline into batches, each drawn by one
+    /// indirect call; only the secondaries of the batches changed since their last recording are re-recorded, and the primary itself
+    /// only writes the draw data and executes them. Must be called once the previous submission of the image is done.
+    /// With Commander::depthPrepass, the depth only batch of the meshes runs first and the skybox last. In deferred mode the
+    /// pre-pass fills the G-buffer in a render pass of its own, before the scene pass shades it. With FXAA or governed, the post pass
+    /// follows the scene pass.
     /// </summary>
     /// <param name="commander"></param>
     /// <param name="device"></param>
     /// <param name="gpipeline"></param>
     /// <param name="descriptorObj"></param>
+    /// <param name="geometry">Shared geometry and draw commands of the meshes</param>
+    /// <param name="culling">Culling pass recorded before the scene pass, Hi-Z pyramid built after it</param>
     /// <param name="swapchain"></param>
+    /// <param name="post">Post pass recorded after the scene pass when its render pass exists</param>
+    /// <param name="governor">Accumulation state of the upscale</param>
+    /// <param name="adaptive">Budget map built before the scene pass when the adaptive sampling is on</param>
     /// <param name="meshes"></param>
-    void recordCommandBuffers(
-        Commander& commander, 
-        const Device& device, 
-        const GPipeline& gpipeline, 
-        const Descriptor& descriptorObj, 
-        const SwapChain& swapchain, 
-        std::vector<Mesh>& meshes, 
-        Mesh& skymap, 
-        VkPipeline& skymap_pipeline);
+    /// <param name="skymap"></param>
+    /// <param name="skymap_pipeline"></param>
+    /// <param name="imageIndex"></param>
+    /// <param name="frame">Frame context recorded into</param>
+    void recordSceneCommands(
+        Commander& commander,
+        const Device& device,
+        const GPipeline& gpipeline,
+        const Descriptor& descriptorObj,
+        GeometryArena& geometry,
+        Culling& culling,
+        const SwapChain& swapchain,
+        const PostProcess& post,
+        const Governor& governor,
+        AdaptiveSampling& adaptive,
+        std::vector<Mesh>& meshes,
+        Mesh& skymap,
+        VkPipeline& skymap_pipeline,
+        uint32_t imageIndex,
+        uint32_t frame);
 
 
     ////////////////////////////////////////////////////////////////// Descriptors Abstractions
@@ -515,33 +750,147 @@ namespace brdfa {
 
 
     /// <summary>
-    /// 
+    /// Creates the set layouts of the three update frequencies (frame, material, object), their update templates and pools,
+    /// along with the shared object set. Done once; the swapchain recreation keeps them.
+    /// With descriptor indexing, set 1 is the bindless texture array and the material table instead of a set per mesh.
     /// </summary>
     /// <param name="descriptorObj"></param>
+    /// <param name="commander"></param>
     /// <param name="device"></param>
-    /// <param name="swapchain"></param>
-    void createDescriptorSetLayout(
+    void createDescriptors(
+        Descriptor& descriptorObj, 
+        Commander& commander,
+        const Device& device);
+
+
+    /// <summary>
+    /// Destroys the pools, templates and layouts of the descriptors.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    void destroyDescriptors(
+        Descriptor& descriptorObj, 
+        const Device& device);
+
+
+    /// <summary>
+    /// Hands out a set of the allocator: a released one if any, otherwise a new one (adding a pool when the last one is full).
+    /// The content of a reused set is stale until it is written.
+    /// </summary>
+    /// <param name="allocator"></param>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    VkDescriptorSet allocateDescriptorSet(
+        DescriptorAllocator& allocator, 
+        const Device& device);
+
+
+    /// <summary>
+    /// Gives a set back to its allocator. The set must not be in use by the device anymore.
+    /// </summary>
+    /// <param name="allocator"></param>
+    /// <param name="set"></param>
+    void releaseDescriptorSet(
+        DescriptorAllocator& allocator, 
+        VkDescriptorSet set);
+
+
+    /// <summary>
+    /// Writes the frame sets (camera block and skymap), one per frame region of the uniform arena. Sets are taken or released
+    /// to match the region count. Called when the skymap or the arena buffer changes.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="uniforms"></param>
+    /// <param name="skymap"></param>
+    void writeFrameDescriptors(
         Descriptor& descriptorObj, 
         const Device& device, 
-        const SwapChain& swapchain);
+        const UniformArena& uniforms, 
+        const Image& skymap);
 
 
     /// <summary>
-    /// creates a BRDFA Descriptor Object. 
-    /// Descriptor Object holds the sets being created, the pool which they correspond to, and
-    /// their layout in memory. Number of sets is determined by: swapchain images size * meshes count in the scene.
+    /// Takes (if needed) and writes the material set of a mesh. The texture slots the mesh doesn't fill repeat its last texture.
+    /// In bindless mode, the new textures of the mesh take a slot of the texture array and the mesh takes (if needed) a record
+    /// of the material table, which is written; nothing else is touched unless the material table has to grow.
     /// </summary>
-    /// <param name="descriptorObj">The desired Descriptor Object to be filled</param>
-    /// <param name="device">BRDFA Device object</param>
-    /// <param name="swapchain">BRDFA SwapChain object</param>
-    /// <param name="meshCount">Number of meshes needed to be rendered</param>
-    void initDescriptors(
+    /// <param name="descriptorObj"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if a set used by the other meshes was rewritten (their command buffers must be re-recorded)</returns>
+    bool writeMaterialDescriptors(
         Descriptor& descriptorObj, 
+        Commander& commander,
         const Device& device, 
-        const SwapChain& swapchain, 
-        const std::vector<Buffer>& uniformBuffers, 
-        std::vector<Mesh>& meshes, 
-        Image& skymap);
+        Mesh& mesh);
+
+
+    /// <summary>
+    /// Points the draw set at the instance table, the visible list and the draw records of the geometry arena. The device must be idle.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void writeDrawDescriptors(
+        Descriptor& descriptorObj,
+        const Device& device,
+        const GeometryArena& geometry);
+
+
+    /// <summary>
+    /// Points a new draw set at the buffers of the geometry arena while the frames in flight keep the current one, which is retired
+    /// to Descriptor::retiredDrawSet.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void renewDrawDescriptors(
+        Descriptor& descriptorObj,
+        const Device& device,
+        const GeometryArena& geometry);
+
+
+    /// <summary>
+    /// Releases the draw set retired by renewDrawDescriptors(), once no frame in flight uses it.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    void releaseRetiredDrawSet(Descriptor& descriptorObj);
+
+
+    /// <summary>
+    /// Points the G-buffer set at the attachments of the swapchain's G-buffer. Done whenever the G-buffer is (re)created.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void writeGBufferDescriptors(
+        Descriptor& descriptorObj,
+        const Device& device,
+        const SwapChain& swapchain);
+
+
+    /// <summary>
+    /// Points the adaptive set at the images and counters of the adaptive sampling. Done whenever the images are (re)created.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="device"></param>
+    /// <param name="adaptive"></param>
+    void writeAdaptiveDescriptors(
+        Descriptor& descriptorObj,
+        const Device& device,
+        const AdaptiveSampling& adaptive);
+
+
+    /// <summary>
+    /// Gives the material set (or in bindless mode, the texture slots and the material record) of a mesh back. Done when the mesh is deleted.
+    /// </summary>
+    /// <param name="descriptorObj"></param>
+    /// <param name="mesh"></param>
+    void releaseMaterialDescriptors(
+        Descriptor& descriptorObj, 
+        Mesh& mesh);
 
 
     /////////////////////////////////////////////////// Mesh abstractions
@@ -549,16 +898,12 @@ namespace brdfa {
 
 
     /// <summary>
-    /// 
+    /// Reads the vertices and indices of the model into the mesh. The device copy is made by uploadGeometry().
     /// </summary>
     /// <param name="mesh"></param>
-    /// <param name="commander"></param>
-    /// <param name="device"></param>
     /// <param name="modelPath"></param>
     void loadVertices(
         Mesh& mesh, 
-        Commander& commander, 
-        const Device& device, 
         const std::string& modelPath);
 
 
@@ -604,8 +949,7 @@ namespace brdfa {
         Commander& commander, 
         const Device& device, 
         const std::string& modelPath, 
-        const std::string& texturePath, 
-        const size_t& bufferCounts);
+        const std::string& texturePath);
 
     /// <summary>
     /// 
@@ -619,8 +963,24 @@ namespace brdfa {
         Commander& commander, 
         const Device& device, 
         const std::string& modelPath, 
-        const std::vector<std::string>& texturePaths, 
-        const size_t& bufferCounts);
+        const std::vector<std::string>& texturePaths);
+
+
+    /// <summary>
+    /// Lays out columns x rows instances of the mesh on a grid centered on it, sweeping two parameters from 0 to 1
+    /// (the first along the columns, the second along the rows). The other parameters are those of the mesh.
+    /// </summary>
+    /// <param name="mesh"></param>
+    /// <param name="columns"></param>
+    /// <param name="rows"></param>
+    /// <param name="spacing">Distance between two neighbour instances</param>
+    /// <param name="parameters">Indices (0 to 8) of the swept parameters</param>
+    void generateInstanceGrid(
+        Mesh& mesh,
+        const uint32_t& columns,
+        const uint32_t& rows,
+        const float& spacing,
+        const std::array<int, 2>& parameters);
 
 
     /// <summary>
@@ -666,39 +1026,886 @@ namespace brdfa {
         uint8_t maxFramesInFlight);
 
 
+    // ----------------------------------------- Uniform arena -----------------------------------------
+
     /// <summary>
-    /// Creates Empty buffers in the RAM for holding Uniform variables. 
-    ///     
-    /// Note:
-    ///     Each scene object will have its own related uniform buffer.
-    ///     Each independent frame will have its own related uniform buffer.
-    ///     Therefore, Uniform buffers size is: swapchain images * mesh count.
+    /// Creates the buffer of the uniform arena (camera blocks) and maps it. The content must be written again afterwards.
     /// </summary>
-    /// <param name="uniformBuffers"></param>
+    /// <param name="arena"></param>
     /// <param name="commander"></param>
     /// <param name="device"></param>
-    /// <param name="swapchain"></param>
-    /// <param name="meshCount"></param>
-    void createUniformBuffers(
-        std::vector<Buffer>& uniformBuffers, 
-        Commander& commander, 
-        const Device& device, 
-        const SwapChain& swapchain,
-        uint32_t meshCount);
+    /// <param name="frameCount">Number of frame regions (swapchain images)</param>
+    void createUniformArena(
+        UniformArena& arena,
+        Commander& commander,
+        const Device& device,
+        const uint32_t& frameCount);
+
+
+    /// <summary>
+    /// Unmaps and destroys the buffer of the uniform arena.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyUniformArena(UniformArena& arena, const Device& device);
+
+
+    /// <summary>
+    /// Offset of the camera block of a frame region.
+    /// </summary>
+    uint32_t cameraUniformOffset(const UniformArena& arena, const uint32_t& frame);
+
+
+    /// <summary>
+    /// Writes the camera block of a frame region.
+    /// </summary>
+    void writeCameraUniforms(UniformArena& arena, const uint32_t& frame, const CameraUniforms& camera);
 
 
+    /// <summary>
+    /// Packs the per draw data (transformation, parameters, samples, id, material record) of a mesh.
+    /// </summary>
+    /// <param name="mesh"></param>
+    /// <returns></returns>
+    DrawRecord drawRecord(Mesh& mesh);
+
+
+    /// <summary>
+    /// Prints the CPU time and memory per frame of the per object data for 1, 100 and 10000 objects: uniform blocks in a
+    /// mapped arena against the draw record table.
+    /// </summary>
+    /// <returns>Process exit code</returns>
+    int benchmarkObjectData();
 
-    void threadAddSpirv(
-        const std::string& cacheFileName,
-        BRDF_Panel lp, 
-        std::unordered_map<std::string, BRDF_Panel>* loadedBRDFs);
 
 
-    void threadCompileGLSL(
-        const std::string& concat, 
-        BRDF_Panel& lp, 
-        std::unordered_map<std::string, BRDF_Panel>* loadedBRDFs, 
-        bool testing = false);
+    // ----------------------------------------- Geometry arena -----------------------------------------
+
+    /// <summary>
+    /// Creates the shared vertex, index and instance buffers and the draw buffers of the arena.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void createGeometryArena(GeometryArena& arena, Commander& commander, const Device& device);
+
+
+    /// <summary>
+    /// Destroys the buffers of the arena.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyGeometryArena(GeometryArena& arena, const Device& device);
+
+
+    /// <summary>
+    /// Takes the ranges and the draw slot of a mesh and uploads its vertices and indices. The device must be idle.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if a buffer of the arena was recreated: the command buffers of all the meshes must be re-recorded.</returns>
+    bool uploadGeometry(GeometryArena& arena, Commander& commander, const Device& device, Mesh& mesh);
+
+
+    /// <summary>
+    /// Moves the instances of a mesh (one identity instance if it isn't instanced) into a new range of the instance heap. The device
+    /// must be idle.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if the instance heap was recreated: the draw set must be written again and all the meshes re-recorded.</returns>
+    bool uploadInstances(GeometryArena& arena, Commander& commander, const Device& device, Mesh& mesh);
+
+
+    /// <summary>
+    /// Gives the ranges and the draw slot of a mesh back.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="mesh"></param>
+    void releaseGeometry(GeometryArena& arena, Mesh& mesh);
+
+
+    /// <summary>
+    /// Part of the used geometry left free by released meshes (0 to 1).
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <returns></returns>
+    float geometryFragmentation(const GeometryArena& arena);
+
+
+    /// <summary>
+    /// Starts packing the ranges of the given meshes at the start of new buffers, in a fenced submission. The frames keep drawing
+    /// from the current buffers until finishGeometryCompaction().
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="meshes">Every mesh holding ranges of the arena</param>
+    void beginGeometryCompaction(GeometryArena& arena, Commander& commander, const Device& device, const std::vector<Mesh*>& meshes);
+
+
+    /// <summary>
+    /// Swaps the packed buffers in and moves the meshes to their new ranges once the fence of the compaction signaled. The draw set
+    /// must then be renewed and all the command buffers re-recorded.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="meshes">The meshes given to beginGeometryCompaction(), in the same order</param>
+    /// <param name="frame">Frame the buffers are replaced at</param>
+    /// <returns>False if no compaction runs or its copies aren't done yet.</returns>
+    bool finishGeometryCompaction(GeometryArena& arena, Commander& commander, const Device& device, const std::vector<Mesh*>& meshes, uint64_t frame);
+
+
+    /// <summary>
+    /// Destroys the buffers replaced by the last compaction, once no frame in flight reads them.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyRetiredGeometry(GeometryArena& arena, const Device& device);
+
+
+    /// <summary>
+    /// Records the draw records changed since they were last written and the draw commands of the frame in batch order, and clears
+    /// the draw counts. Must be outside of a render pass, before the culling pass.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="device"></param>
+    /// <param name="drawOrder">The meshes in batch order (Commander::drawOrder)</param>
+    void recordDrawData(GeometryArena& arena, VkCommandBuffer commandBuffer, const Device& device, const std::vector<Mesh*>& drawOrder);
+
+
+
+    // ----------------------------------------- GPU Culling -----------------------------------------
+
+    /// <summary>
+    /// Creates the pipelines, the descriptors and the per frame buffer of the culling passes (cull.comp, hiz.comp).
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj">The draw set layout is set 1 of the culling pass</param>
+    /// <param name="cullSpirv">cull.comp</param>
+    /// <param name="hizSeedSpirv">hiz.comp reading the depth attachment</param>
+    /// <param name="hizReduceSpirv">hiz.comp reading a level of the pyramid</param>
+    /// <param name="cache"></param>
+    /// <param name="frameCount">Frames in flight</param>
+    void createCulling(Culling& culling, Commander& commander, const Device& device, const Descriptor& descriptorObj,
+        const std::vector<char>& cullSpirv, const std::vector<char>& hizSeedSpirv, const std::vector<char>& hizReduceSpirv,
+        VkPipelineCache cache, uint32_t frameCount);
+
+
+    /// <summary>
+    /// Points the culling pass at the indirect draw buffers of the arena. Called again whenever they are recreated.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    /// <param name="geometry"></param>
+    void writeCullingDescriptors(Culling& culling, const Device& device, const GeometryArena& geometry);
+
+
+    /// <summary>
+    /// Creates the Hi-Z pyramid after the depth attachment of the swapchain. Recreated along with the swapchain.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void createHiZ(Culling& culling, Commander& commander, const Device& device, const SwapChain& swapchain);
+
+
+    /// <summary>
+    /// Destroys the Hi-Z pyramid.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    void destroyHiZ(Culling& culling, const Device& device);
+
+
+    /// <summary>
+    /// Destroys the culling passes, the Hi-Z pyramid included.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="device"></param>
+    void destroyCulling(Culling& culling, const Device& device);
+
+
+    /// <summary>
+    /// Takes the counters of the last run of the frame into Culling::stats and writes the cameras of the new run. Called
+    /// once the fence of the frame signaled.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="frame">Frame in flight</param>
+    /// <param name="viewProj">Camera of the frame</param>
+    void beginCullFrame(Culling& culling, const uint32_t& frame, const glm::mat4& viewProj);
+
+
+    /// <summary>
+    /// Records the culling pass of the meshes, after recordDrawData(). Must be outside of a render pass.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="geometry"></param>
+    /// <param name="descriptorObj">Draw set of the arena (set 1)</param>
+    /// <param name="meshes"></param>
+    /// <param name="frame">Frame in flight</param>
+    void recordCulling(Culling& culling, VkCommandBuffer commandBuffer, const GeometryArena& geometry, const Descriptor& descriptorObj,
+        std::vector<Mesh>& meshes, const uint32_t& frame);
+
+
+    /// <summary>
+    /// Records the reduction of the depth attachment into the Hi-Z pyramid, after the scene pass.
+    /// </summary>
+    /// <param name="culling"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="frame">Frame in flight</param>
+    void recordHiZ(Culling& culling, VkCommandBuffer commandBuffer, const Device& device, const SwapChain& swapchain, const uint32_t& frame);
+
+
+
+    // ----------------------------------------- Deferred Shading -----------------------------------------
+
+    /// <summary>
+    /// Creates the render pass of the G-buffer pre-pass. The attachments, depth included, are left readable by the shading passes.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void createGBufferRenderPass(GPipeline& gpipeline, const Device& device);
+
+
+    /// <summary>
+    /// Creates the G-buffer attachments, framebuffer and sampler, and the tile lists, after the swapchain extent. Recreated along
+    /// with the swapchain.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="gpipeline"></param>
+    void createGBuffer(SwapChain& swapchain, Commander& commander, const Device& device, const GPipeline& gpipeline);
+
+
+    /// <summary>
+    /// Destroys the G-buffer of the swapchain, if any.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="device"></param>
+    void destroyGBuffer(SwapChain& swapchain, const Device& device);
+
+
+    /// <summary>
+    /// Creates the pipeline of the G-buffer pre-pass (GPipeline::gbufferPipeline): main.vert and gbuffer.frag, single sampled.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="vertShaderSpirv"></param>
+    /// <param name="fragShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    void createGBufferPipeline(
+        GPipeline& gpipeline,
+        const Device& device,
+        const SwapChain& swapchain,
+        const std::vector<char>& vertShaderSpirv,
+        const std::vector<char>& fragShaderSpirv,
+        const VkPipelineCache& pipelineCache = VK_NULL_HANDLE);
+
+
+    /// <summary>
+    /// Creates the tile classification pass (classify.comp): the draw set (set 0), the G-buffer set (set 1) and ClassifyPushConstants.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="spirv">classify.comp</param>
+    /// <param name="pipelineCache"></param>
+    void createTileClassification(
+        GPipeline& gpipeline,
+        const Device& device,
+        const Descriptor& descriptorObj,
+        const std::vector<char>& spirv,
+        const VkPipelineCache& pipelineCache = VK_NULL_HANDLE);
+
+
+    /// <summary>
+    /// Destroys the tile classification pass, if any.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void destroyTileClassification(GPipeline& gpipeline, const Device& device);
+
+
+    /// <summary>
+    /// Records the tile classification between the G-buffer pass and the scene pass: the draws of the batches are reset to no
+    /// tiles, then classify.comp appends each tile of the render extent to the lists of the batches it has pixels of.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="extent">Render extent of the scene</param>
+    void recordTileClassification(
+        const GPipeline& gpipeline,
+        VkCommandBuffer commandBuffer,
+        const Descriptor& descriptorObj,
+        const SwapChain& swapchain,
+        const VkExtent2D& extent);
+
+
+
+    // ----------------------------------------- Anti-aliasing -----------------------------------------
+
+    /// <summary>
+    /// Samples of the scene attachments in the given mode, clamped to the highest count of the device. 1 without MSAA.
+    /// </summary>
+    /// <param name="mode"></param>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    VkSampleCountFlagBits antiAliasingSamples(AntiAliasing mode, const Device& device);
+
+
+    /// <summary>
+    /// Name of the mode, as taken by --anti-aliasing and shown in the UI.
+    /// </summary>
+    /// <param name="mode"></param>
+    /// <returns></returns>
+    const char* antiAliasingName(AntiAliasing mode);
+
+
+    /// <summary>
+    /// Mode of the given name (see antiAliasingName()). False if there is none.
+    /// </summary>
+    /// <param name="name"></param>
+    /// <param name="mode"></param>
+    /// <returns></returns>
+    bool parseAntiAliasing(const std::string& name, AntiAliasing& mode);
+
+
+    /// <summary>
+    /// Creates the parts of the post pass that don't depend on the swapchain: descriptor sets, layouts, sampler and shader modules.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    /// <param name="vertShaderSpirv">fullscreen.vert</param>
+    /// <param name="fragShaderSpirv">fxaa.frag</param>
+    /// <param name="upscaleShaderSpirv">upscale.frag</param>
+    void createPostProcess(
+        PostProcess& post,
+        const Device& device,
+        const std::vector<char>& vertShaderSpirv,
+        const std::vector<char>& fragShaderSpirv,
+        const std::vector<char>& upscaleShaderSpirv);
+
+
+    /// <summary>
+    /// Creates the render pass, framebuffers and pipeline of the post pass after the swapchain, and points its sets to the scene color.
+    /// Done in the AA_FXAA mode and when governed (upscaled), once the scene attachments exist.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="upscaled">Governed: upscale and accumulate instead of FXAA</param>
+    /// <param name="pipelineCache"></param>
+    void createPostTargets(
+        PostProcess& post,
+        Commander& commander,
+        const Device& device,
+        const SwapChain& swapchain,
+        const bool& upscaled,
+        const VkPipelineCache& pipelineCache = VK_NULL_HANDLE);
+
+
+    /// <summary>
+    /// Destroys what createPostTargets() created, if anything.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    void destroyPostTargets(PostProcess& post, const Device& device);
+
+
+    /// <summary>
+    /// Destroys the post pass along with its targets.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="device"></param>
+    void destroyPostProcess(PostProcess& post, const Device& device);
+
+
+    /// <summary>
+    /// Records the post pass into the swapchain image. The scene pass must be recorded before it. Upscaled, the frame is blended
+    /// into the history image of Governor::historyIndex, reading the other one.
+    /// </summary>
+    /// <param name="post"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="governor"></param>
+    /// <param name="renderExtent">Extent the scene was drawn at</param>
+    /// <param name="imageIndex"></param>
+    void recordPostProcess(
+        const PostProcess& post,
+        VkCommandBuffer commandBuffer,
+        const SwapChain& swapchain,
+        const Governor& governor,
+        const VkExtent2D& renderExtent,
+        uint32_t imageIndex);
+
+
+
+    // ----------------------------------------- Frame-time governor -----------------------------------------
+
+    /// <summary>
+    /// Render extent of the scene at the scale of the governor.
+    /// </summary>
+    /// <param name="governor"></param>
+    /// <param name="extent">Swapchain extent</param>
+    /// <returns></returns>
+    VkExtent2D governedExtent(const Governor& governor, const VkExtent2D& extent);
+
+
+    /// <summary>
+    /// Drops the frames accumulated so far: the next one starts the history again. Done when the picture changes.
+    /// </summary>
+    /// <param name="governor"></param>
+    void resetAccumulation(Governor& governor);
+
+
+    /// <summary>
+    /// Back to the full scale and samples, with the decision log cleared.
+    /// </summary>
+    /// <param name="governor"></param>
+    void resetGovernor(Governor& governor);
+
+
+    /// <summary>
+    /// Steps the governor once per frame: scale or sample cap changes when the smoothed frame time is off the target, then the
+    /// sample block of the frame and its weight in the history.
+    /// </summary>
+    /// <param name="governor"></param>
+    /// <param name="frameMs">GPU time of the last finished frame, or the interval between the last two frames without timestamps</param>
+    /// <returns>True if the render scale changed</returns>
+    bool updateGovernor(Governor& governor, const float& frameMs);
+
+
+
+    // ----------------------------------------- Adaptive Sampling -----------------------------------------
+
+    /// <summary>
+    /// Creates the pipelines (adaptive.comp) and the per frame counters of the adaptive sampling passes.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="descriptorObj">The adaptive set layout is set 0 of the passes</param>
+    /// <param name="errorSpirv">adaptive.comp</param>
+    /// <param name="budgetSpirv">adaptive.comp with ADAPTIVE_BUDGET</param>
+    /// <param name="cache"></param>
+    /// <param name="frameCount">Frames in flight</param>
+    void createAdaptiveSampling(AdaptiveSampling& adaptive, Commander& commander, const Device& device, const Descriptor& descriptorObj,
+        const std::vector<char>& errorSpirv, const std::vector<char>& budgetSpirv, VkPipelineCache cache, uint32_t frameCount);
+
+
+    /// <summary>
+    /// Creates the statistics, budget map and errors after the swapchain extent. Recreated along with the swapchain.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    void createAdaptiveTargets(AdaptiveSampling& adaptive, Commander& commander, const Device& device, const SwapChain& swapchain);
+
+
+    /// <summary>
+    /// Destroys the images of the adaptive sampling.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="device"></param>
+    void destroyAdaptiveTargets(AdaptiveSampling& adaptive, const Device& device);
+
+
+    /// <summary>
+    /// Destroys the adaptive sampling passes, the images included.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="device"></param>
+    void destroyAdaptiveSampling(AdaptiveSampling& adaptive, const Device& device);
+
+
+    /// <summary>
+    /// Takes the counters of the last run of the frame into AdaptiveSampling::stats. Called once the fence of the frame signaled.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="frame">Frame in flight</param>
+    void beginAdaptiveFrame(AdaptiveSampling& adaptive, const uint32_t& frame);
+
+
+    /// <summary>
+    /// Records the passes building the budget map of the scene pass. Must be outside of a render pass.
+    /// </summary>
+    /// <param name="adaptive"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="descriptorObj"></param>
+    /// <param name="extent">Render extent of the scene</param>
+    /// <param name="frame">Frame in flight</param>
+    void recordAdaptiveSampling(AdaptiveSampling& adaptive, VkCommandBuffer commandBuffer, const Descriptor& descriptorObj,
+        const VkExtent2D& extent, const uint32_t& frame);
+
+
+
+    // ----------------------------------------- Headless Rendering -----------------------------------------
+
+    /// <summary>
+    /// Creates the images standing in for the swapchain ones when there is no window: SwapChain::images, views, format and extent
+    /// are filled like createSwapChain() does. The frames end in SwapChain::presentLayout, the transfer source of the readback.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="width"></param>
+    /// <param name="height"></param>
+    /// <param name="imageCount">One per frame in flight</param>
+    void createOffscreenSwapChain(SwapChain& swapchain, Commander& commander, const Device& device, const uint32_t& width, const uint32_t& height,
+        const uint32_t& imageCount);
+
+
+    /// <summary>
+    /// Destroys the offscreen images and their views.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="device"></param>
+    void destroyOffscreenSwapChain(SwapChain& swapchain, const Device& device);
+
+
+    /// <summary>
+    /// Copies a rendered offscreen image back to the host. Waits for the copy.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="index">Image of the frame</param>
+    /// <param name="pixels">RGBA, 8 bits per channel (sRGB), rows top to bottom</param>
+    void readbackImage(Commander& commander, const Device& device, const SwapChain& swapchain, const uint32_t& index, std::vector<uint8_t>& pixels);
+
+
+
+    // ----------------------------------------- SPIR-V archive -----------------------------------------
+
+    /// <summary>
+    /// Opens the SPIR-V archive (one file open, memory mapped) and indexes its records.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="path"></param>
+    void openSpirvArchive(SpirvArchive& archive, const std::string& path);
+
+
+    /// <summary>
+    /// Unmaps the SPIR-V archive.
+    /// </summary>
+    /// <param name="archive"></param>
+    void closeSpirvArchive(SpirvArchive& archive);
+
+
+    /// <summary>
+    /// Content key of a shader: the source, the compiler version, the compile options and the stage.
+    /// </summary>
+    /// <param name="source"></param>
+    /// <param name="options"></param>
+    /// <param name="vertexShader"></param>
+    /// <returns></returns>
+    uint64_t spirvKey(const std::string& source, const std::string& options, const bool& vertexShader);
+
+
+    /// <summary>
+    /// Hash of a source, without the terminations left by the text mode reads.
+    /// </summary>
+    /// <param name="source"></param>
+    /// <returns></returns>
+    uint64_t sourceHash(const std::string& source);
+
+
+    /// <summary>
+    /// Archive key of a BRDF fragment shader made of the pair (main shader hash, BRDF source hash), so the lookup
+    /// doesn't need the shader to be assembled.
+    /// </summary>
+    /// <param name="mainHash">sourceHash() of the main shader</param>
+    /// <param name="brdfSource"></param>
+    /// <param name="brdfName"></param>
+    /// <param name="options">Description of the compile options</param>
+    /// <returns></returns>
+    uint64_t brdfSpirvKey(const uint64_t& mainHash, const std::string& brdfSource, const std::string& brdfName, const std::string& options);
+
+
+    /// <summary>
+    /// Finds the SPIR-V of the key and copies it into spirv.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="key"></param>
+    /// <param name="spirv"></param>
+    /// <returns></returns>
+    bool findSpirv(SpirvArchive& archive, const uint64_t& key, std::vector<char>& spirv);
+
+
+    /// <summary>
+    /// Appends the SPIR-V of the key to the archive. Thread safe: the engine runs it on the compile service.
+    /// </summary>
+    /// <param name="archive"></param>
+    /// <param name="key"></param>
+    /// <param name="spirv"></param>
+    void storeSpirv(SpirvArchive& archive, const uint64_t& key, const std::vector<char>& spirv);
+
+
+    /// <summary>
+    /// Drops the entries that were not used in this session, if they take most of the archive.
+    /// </summary>
+    /// <param name="archive"></param>
+    void compactSpirvArchive(SpirvArchive& archive);
+
+
+    /// <summary>
+    /// Worker of the parallel pipeline loading. Compiles the BRDF (unless its SPIR-V was found in the archive) and builds its graphics pipeline using
+    /// the shared vertex module and a pipeline cache of its own. The result is pushed into the queue to be published by the main thread.
+    /// </summary>
+    /// <param name="source">The full GLSL fragment shader. Only compiled if lp holds no SPIR-V.</param>
+    /// <param name="key">Archive key of the source</param>
+    /// <param name="options">Compile options of the source</param>
+    /// <param name="lp">BRDF panel of the pipeline</param>
+    /// <param name="gpipeline">Holds the layout, render pass and the shared vertex module</param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="descriptor"></param>
+    /// <param name="cacheSeed">Data used to initialize the thread pipeline cache</param>
+    /// <param name="compiler">Compile service running the job. Records the compile time.</param>
+    /// <param name="queue">Queue to publish the pipeline into</param>
+    /// <param name="swapGeneration">Hot-swap request of an edited BRDF the pipeline is built for. 0 when loading.</param>
+    void threadBuildPipeline(
+        const std::string& source,
+        const uint64_t& key,
+        const ShaderCompileOptions& options,
+        BRDF_Panel lp,
+        const GPipeline* gpipeline,
+        const Device* device,
+        const SwapChain* swapchain,
+        const Descriptor* descriptor,
+        const std::vector<char>* cacheSeed,
+        CompileService* compiler,
+        PipelineQueue* queue,
+        const uint64_t& swapGeneration = 0);
+
+
+    /// <summary>
+    /// Worker of the graphics pipeline libraries path. Re-links the BRDF pipeline with link time optimizations and
+    /// pushes it into the queue, so the main thread can swap it with the fast-linked one.
+    /// </summary>
+    /// <param name="brdfName"></param>
+    /// <param name="generation">Generation of the BRDF when the link was started</param>
+    /// <param name="fragmentLibrary">Must be kept alive until the link is done</param>
+    /// <param name="gpipeline">Holds the shared libraries</param>
+    /// <param name="device"></param>
+    /// <param name="cacheSeed">Engine cache data the cache of the worker starts from. The engine cache itself is only touched by the main thread.</param>
+    /// <param name="queue"></param>
+    void threadLinkPipeline(
+        const std::string& brdfName,
+        const uint64_t& generation,
+        const VkPipeline& fragmentLibrary,
+        const GPipeline* gpipeline,
+        const Device* device,
+        const std::vector<char>* cacheSeed,
+        PipelineQueue* queue);
+
+
+    /// <summary>
+    /// Loads the shared GLSL snippets of the directory into the include cache. Must be called before the first compilation.
+    /// </summary>
+    /// <param name="directory"></param>
+    void loadShaderIncludes(const std::string& directory);
+
+
+    /// <summary>
+    /// Makes the compile options resolve #include "..." out of the loaded snippets.
+    /// </summary>
+    /// <param name="options"></param>
+    void bindShaderIncludes(shaderc_compile_options_t options);
+
+
+    /// <summary>
+    /// Describes the compile options and the loaded snippets. Used in the SPIR-V archive keys.
+    /// </summary>
+    /// <param name="options"></param>
+    /// <returns></returns>
+    std::string shaderOptionsKey(const ShaderCompileOptions& options);
+
+
+    /// <summary>
+    /// Extracts the errors of one source out of a compilation log, by line (1 based), e.g. for the editor error markers.
+    /// </summary>
+    /// <param name="log">compileShader() errors</param>
+    /// <param name="sourceName">Name the source was given in the #line directive</param>
+    /// <returns></returns>
+    std::map<int, std::string> errorLines(const std::string& log, const std::string& sourceName);
+
+
+    /// <summary>
+    /// Forms a shader out of a main source and a body in linear time. #line directives name the parts, so the
+    /// compilation errors point at the exact line of each.
+    /// </summary>
+    /// <param name="mainSource">Starts with the #version line</param>
+    /// <param name="mainName">Name of the main source in the errors</param>
+    /// <param name="body"></param>
+    /// <param name="bodyName">Name of the body in the errors</param>
+    /// <returns></returns>
+    std::string assembleShader(
+        const std::string& mainSource,
+        const std::string& mainName,
+        const std::string& body,
+        const std::string& bodyName);
+
+
+    /// <summary>
+    /// Starts the workers of the compile service.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="workerCount">0: one worker per hardware thread</param>
+    void startCompileService(CompileService& service, size_t workerCount = 0);
+
+
+    /// <summary>
+    /// Runs the queued jobs to completion and joins the workers.
+    /// </summary>
+    /// <param name="service"></param>
+    void stopCompileService(CompileService& service);
+
+
+    /// <summary>
+    /// Queues a task on the compile service workers. The future is ready once the task has run.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="priority">Interactive tasks run before the background ones</param>
+    /// <param name="task"></param>
+    /// <returns></returns>
+    std::future<void> submitTask(
+        CompileService& service, 
+        const CompilePriority& priority, 
+        const std::function<void()>& task);
+
+
+    /// <summary>
+    /// Compiles the GLSL on the calling thread (thread local compiler) and records the time in the service statistics.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="source"></param>
+    /// <param name="vertexShader"></param>
+    /// <param name="name"></param>
+    /// <returns>The SPIR-V, or the compilation errors.</returns>
+    CompileResult runCompile(
+        CompileService& service,
+        const std::string& source,
+        const bool& vertexShader,
+        const std::string& name,
+        const ShaderCompileOptions& options);
+
+
+    /// <summary>
+    /// Queues a compilation on the compile service.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <param name="source"></param>
+    /// <param name="vertexShader"></param>
+    /// <param name="name">Name used in the compilation errors</param>
+    /// <param name="options">Optimization level and debug info</param>
+    /// <param name="priority">Interactive compilations run before the background ones</param>
+    /// <param name="cancelled">Checked when a worker picks the job. If it returns true the job is dropped without compiling.</param>
+    /// <returns>The SPIR-V (or the errors) along with the queue and compile times.</returns>
+    std::future<CompileResult> submitCompile(
+        CompileService& service,
+        const std::string& source,
+        const bool& vertexShader,
+        const std::string& name,
+        const ShaderCompileOptions& options,
+        const CompilePriority& priority = INTERACTIVE_PRIORITY,
+        const std::function<bool()>& cancelled = nullptr);
+
+
+    /// <summary>
+    /// Number of jobs waiting for a compile service worker.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <returns></returns>
+    size_t compileQueueDepth(CompileService& service);
+
+
+    /// <summary>
+    /// Mean compilation time (ms) of the compile service.
+    /// </summary>
+    /// <param name="service"></param>
+    /// <returns></returns>
+    float meanCompileTime(CompileService& service);
+
+
+    /// <summary>
+    /// Compiles all the BRDFs against main.frag and prints the assembly, key and compile times, along with the part of
+    /// the compile time spent on main.frag.
+    /// </summary>
+    /// <param name="shadersPath">Holds main.frag, brdfs/ and include/</param>
+    /// <returns>Process exit code</returns>
+    int benchmarkBRDFCompilation(const std::string& shadersPath = SHADERS_PATH);
+
+
+    /// <summary>
+    /// Static cost report of a compiled BRDF fragment shader: instruction counts by class (ALU, transcendental, texture, branch)
+    /// of the whole shader, of render() and of the light sampling loop body.
+    /// </summary>
+    /// <param name="spirv"></param>
+    /// <returns></returns>
+    ShaderCost analyzeShaderCost(const std::vector<char>& spirv);
+
+
+    /// <summary>
+    /// Number of heap allocations (operator new calls) made by the calling thread so far.
+    /// </summary>
+    /// <returns></returns>
+    size_t heapAllocations();
+
+
+    /// <summary>
+    /// Allocator of ImGui (ImGui::SetAllocatorFunctions). Counts the allocations of the calling thread apart from the heap ones.
+    /// </summary>
+    /// <param name="size"></param>
+    /// <param name="userData"></param>
+    /// <returns></returns>
+    void* imguiAllocate(size_t size, void* userData);
+
+
+    /// <summary>
+    /// Frees the memory of imguiAllocate().
+    /// </summary>
+    /// <param name="data"></param>
+    /// <param name="userData"></param>
+    void imguiFree(void* data, void* userData);
+
+
+    /// <summary>
+    /// Allocation counts so far: heap and ImGui ones of the calling thread, and the Vulkan ones of the commander.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <returns></returns>
+    FrameAllocations allocationCounts(const Commander& commander);
+
+
+    /// <summary>
+    /// Allocations made since the given counts were taken (see allocationCounts()).
+    /// </summary>
+    /// <param name="start"></param>
+    /// <param name="commander"></param>
+    /// <returns></returns>
+    FrameAllocations allocationsSince(
+        const FrameAllocations& start,
+        const Commander& commander);
 
 
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <brdfa_structs.hpp>
 #include <brdfa_cons.hpp>
+#include <helpers/functions.hpp>
 
 #include <vulkan/vulkan.h>
 #include <shaderc/shaderc.h> // For real time compilation.
@@ -14,6 +15,7 @@
 #include <sstream>
 #include <cstdlib>
 #include <regex>
+#include <cstring>
 
 namespace brdfa {
 
@@ -23,7 +25,7 @@ namespace brdfa {
     /// </summary>
     /// <param name="filename"></param>
     /// <returns></returns>
-    std::vector<char> readFile(const std::string& filename, const bool& binary = true) {
+    std::vector<char> readFile(const std::string& filename, const bool& binary) {
 
         if (binary) {
             std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -81,23 +83,69 @@ namespace brdfa {
 
 
 
+    /*shaderc compiler and options owned by a thread. Created on the first compilation of the thread and released when it exits,
+      so the compile service workers (and the main thread) don't re-initialize the compiler for every shader.*/
+    struct ThreadCompiler {
+        shaderc_compiler_t          compiler;
+        shaderc_compile_options_t   options;
+        shaderc_compile_options_t   debugOptions;           // Same, with debug info (shaderc can't turn it off once set).
+
+        ThreadCompiler() : compiler(shaderc_compiler_initialize()), options(shaderc_compile_options_initialize()), debugOptions(shaderc_compile_options_initialize()) {
+            bindShaderIncludes(options);
+            bindShaderIncludes(debugOptions);
+            shaderc_compile_options_set_generate_debug_info(debugOptions);
+        }
+        ~ThreadCompiler() {
+            shaderc_compile_options_release(debugOptions);
+            shaderc_compile_options_release(options);
+            shaderc_compiler_release(compiler);
+        }
+    };
+
+    static ThreadCompiler& threadCompiler() {
+        static thread_local ThreadCompiler compiler;
+        return compiler;
+    }
+
+
     /// <summary>
     /// Given a glsl code, it compiles it at runtime and returns a spir-v code.
     /// </summary>
     /// <param name="device"></param>
     /// <param name="glslCode"></param>
     /// <returns></returns>
-    std::vector<char> compileShader(const std::string& glslCode, const bool& vertexShader = true, const std::string& shadername = "realtimeShader") {
+    std::vector<char> compileShader(const std::string& glslCode, const bool& vertexShader, const std::string& shadername, const ShaderCompileOptions& compileOptions) {
 
         std::string glslC(glslCode.begin(), glslCode.end());
         //std::cout << glslCode.c_str() << std::endl;
 
-        shaderc_shader_kind kind = (vertexShader) ? shaderc_glsl_vertex_shader : shaderc_fragment_shader;
+        /*The compute shaders of the engine are told apart by their extension.*/
+        bool computeShader = shadername.size() > 5 && shadername.compare(shadername.size() - 5, 5, ".comp") == 0;
+        shaderc_shader_kind kind = computeShader ? shaderc_glsl_compute_shader : (vertexShader) ? shaderc_glsl_vertex_shader : shaderc_fragment_shader;
+
+        /*Without debug info, the optimization levels also strip the names and the source of the SPIR-V.*/
+        ThreadCompiler& compiler = threadCompiler();
+        shaderc_compile_options_t options = compileOptions.debugInfo ? compiler.debugOptions : compiler.options;
+        switch (compileOptions.optimization) {
+            case SHADER_OPT_SIZE:           shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_size); break;
+            case SHADER_OPT_PERFORMANCE:    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance); break;
+            default:                        shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_zero); break;
+        }
 
-        shaderc_compiler_t compiler = shaderc_compiler_initialize();
+        /*The macros go on a copy. The thread options are shared by all the compilations of the thread.*/
+        shaderc_compile_options_t compileOpts = options;
+        if (compileOptions.bindless || compileOptions.deferred || compileOptions.adaptive)
+            compileOpts = shaderc_compile_options_clone(options);
+        if (compileOptions.bindless)
+            shaderc_compile_options_add_macro_definition(compileOpts, "BRDFA_BINDLESS", strlen("BRDFA_BINDLESS"), "1", 1);
+        if (compileOptions.deferred)
+            shaderc_compile_options_add_macro_definition(compileOpts, "BRDFA_DEFERRED", strlen("BRDFA_DEFERRED"), "1", 1);
+        if (compileOptions.adaptive)
+            shaderc_compile_options_add_macro_definition(compileOpts, "BRDFA_ADAPTIVE", strlen("BRDFA_ADAPTIVE"), "1", 1);
         shaderc_compilation_result_t result = shaderc_compile_into_spv(
-            compiler, glslC.c_str(), strlen(glslC.c_str()),
-            kind, shadername.c_str(), "main", nullptr);
+            compiler.compiler, glslC.c_str(), strlen(glslC.c_str()),
+            kind, shadername.c_str(), "main", compileOpts);
+        if (compileOpts != options) shaderc_compile_options_release(compileOpts);
 
         shaderc_compilation_status compilationStatus = shaderc_result_get_compilation_status(result);
 
@@ -125,27 +173,13 @@ namespace brdfa {
                     start_pos += told.length(); // Handles case where 'to' is a substring of 'from'
                 }
 
-                /*Changing the lines numbers*/
-                std::string finalOutput = compilationError;
-                std::regex reg(":[0-9]+:");   // matches words beginning by "sub"
-                std::regex_iterator<std::string::iterator> rit(compilationError.begin(), compilationError.end(), reg);
-                std::regex_iterator<std::string::iterator> rend;
-                while (rit != rend) {
-                    std::string lin = rit->str();
-                    std::regex line_e(lin.c_str());
-                    std::string newline = std::string(lin.begin() + 1, lin.end() - 1);
-                    newline = std::to_string(std::stoi(newline) - 118);
-                    newline = std::string(":") + newline + std::string(":");
-                    finalOutput = std::regex_replace(finalOutput, line_e, newline);
-                    ++rit;
-                }
-                ss << finalOutput;
+                /*The #line directives of the assembler already name the file and line of each error.*/
+                ss << compilationError;
 
                 // Releasing the compiled data.
                 shaderc_result_release(result);
-                shaderc_compiler_release(compiler);
 
-                throw std::exception(ss.str().c_str());
+                throw std::runtime_error(ss.str());
                 break;
         }
 
@@ -155,13 +189,17 @@ namespace brdfa {
 
         // Releasing the compiled data.
         shaderc_result_release(result);
-        shaderc_compiler_release(compiler);
 
         return spirvRet;
     }
 
 
 
+    bool sceneColorAttachment(const GPipeline& gpipeline, const Device& device) {
+        return device.msaaSamples != VK_SAMPLE_COUNT_1_BIT || gpipeline.antiAliasing == AA_FXAA || gpipeline.scaled;
+    }
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -181,40 +219,54 @@ namespace brdfa {
             }
         }
 
+        /*Where the scene is drawn depends on the anti-aliasing mode: into the multisampled color attachment resolved into the swapchain
+          image (MSAA), into the single sampled color attachment read by the FXAA pass (FXAA), or straight into the swapchain image (off).
+          Governed (GPipeline::scaled), the scene never reaches the swapchain image: the upscale reads the color attachment, or the
+          resolve target (SwapChain::sceneImage) with MSAA. When off, the framebuffers only hold the swapchain image and the depth
+          attachment: no color attachment is allocated (see sceneColorAttachment()).*/
+        bool multisampled = device.msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        bool postProcessed = gpipeline.scaled || (!multisampled && gpipeline.antiAliasing == AA_FXAA);
+        bool sampledColor = postProcessed && !multisampled;
+        bool colorUsed = sceneColorAttachment(gpipeline, device);
+
         /*Scene Render pass*/
         {
             VkAttachmentDescription colorAttachment{};
             colorAttachment.format = swapchain.format;
             colorAttachment.samples = device.msaaSamples;
-            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.loadOp = colorUsed ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            colorAttachment.storeOp = colorUsed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
             colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorAttachment.finalLayout = sampledColor ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
             VkAttachmentDescription depthAttachment{};
             depthAttachment.format = choosenFormat;
             depthAttachment.samples = device.msaaSamples;
             depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;                 // Read by the Hi-Z pyramid after the pass.
             depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+            /*Resolve target with MSAA, the color attachment itself when off. Written by the FXAA pass otherwise. Governed with MSAA,
+              the scene image read by the upscale.*/
             VkAttachmentDescription colorAttachmentResolve{};
             colorAttachmentResolve.format = swapchain.format;
             colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-            colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachmentResolve.loadOp = colorUsed ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+            colorAttachmentResolve.storeOp = sampledColor ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
             colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            colorAttachmentResolve.finalLayout = !postProcessed ? swapchain.presentLayout
+                : (multisampled ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
-            /*Attachment references.*/
-            std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+            /*Attachment references. When off, the swapchain image takes the place of the color attachment.*/
+            std::vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+            if (!colorUsed) attachments = { colorAttachmentResolve, depthAttachment };
             VkAttachmentReference colorAttachmentRef{};
             colorAttachmentRef.attachment = 0;
             colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -232,12 +284,14 @@ namespace brdfa {
             subpass.colorAttachmentCount = 1;
             subpass.pColorAttachments = &colorAttachmentRef;
             subpass.pDepthStencilAttachment = &depthAttachmentRef;
-            subpass.pResolveAttachments = &colorAttachmentResolveRef;
+            subpass.pResolveAttachments = multisampled ? &colorAttachmentResolveRef : nullptr;
 
+            /*With FXAA or the upscale, the previous frame's pass must be done reading the scene color before it is written again.*/
             VkSubpassDependency dependency{};
             dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
             dependency.dstSubpass = 0;
-            dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+            dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+                | (postProcessed ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : 0);
             dependency.srcAccessMask = 0;
             dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
             dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
@@ -257,8 +311,50 @@ namespace brdfa {
             }
         }
 
-        /*UI Render pass*/
-        {
+        /*UI Render pass. Drawn over the swapchain image: through the resolve with MSAA, straight into it when off, and in the FXAA
+          pass framebuffers (the swapchain image only) with FXAA or governed, at the native extent.*/
+        if (postProcessed) {
+            VkAttachmentDescription colorAttachment{};
+            colorAttachment.format = swapchain.format;
+            colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            colorAttachment.initialLayout = swapchain.presentLayout;
+            colorAttachment.finalLayout = swapchain.presentLayout;
+
+            VkAttachmentReference colorAttachmentRef{};
+            colorAttachmentRef.attachment = 0;
+            colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            VkSubpassDescription subpass{};
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.colorAttachmentCount = 1;
+            subpass.pColorAttachments = &colorAttachmentRef;
+
+            VkSubpassDependency dependency{};
+            dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+            dependency.dstSubpass = 0;
+            dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+
+            VkRenderPassCreateInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            renderPassInfo.attachmentCount = 1;
+            renderPassInfo.pAttachments = &colorAttachment;
+            renderPassInfo.subpassCount = 1;
+            renderPassInfo.pSubpasses = &subpass;
+            renderPassInfo.dependencyCount = 1;
+            renderPassInfo.pDependencies = &dependency;
+
+            if (vkCreateRenderPass(device.device, &renderPassInfo, nullptr, &gpipeline.uiRenderpass) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render pass!");
+            }
+        }
+        else {
             VkAttachmentDescription colorAttachment{};
             colorAttachment.format = swapchain.format;
             colorAttachment.samples = device.msaaSamples;
@@ -286,11 +382,12 @@ namespace brdfa {
             colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
             colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-            colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            colorAttachmentResolve.initialLayout = swapchain.presentLayout;
+            colorAttachmentResolve.finalLayout = swapchain.presentLayout;
 
-            /*Attachment references.*/
-            std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+            /*Attachment references. Compatible with the scene framebuffers: the swapchain image first when off.*/
+            std::vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+            if (!multisampled) attachments = { colorAttachmentResolve, depthAttachment };
 
             VkAttachmentReference colorAttachmentRef{};
             colorAttachmentRef.attachment = 0;
@@ -309,7 +406,7 @@ namespace brdfa {
             subpass.colorAttachmentCount = 1;
             subpass.pColorAttachments = &colorAttachmentRef;
             subpass.pDepthStencilAttachment = &depthAttachmentRef;
-            subpass.pResolveAttachments = &colorAttachmentResolveRef;
+            subpass.pResolveAttachments = multisampled ? &colorAttachmentResolveRef : nullptr;
 
             VkSubpassDependency dependency{};
             dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -345,8 +442,18 @@ namespace brdfa {
     void createPipelineLayout(GPipeline& gpipeline,  const Device& device, const Descriptor& descriptor) {
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptor.layout;
+        std::array<VkDescriptorSetLayout, 5> setLayouts = { descriptor.frame.layout, descriptor.material.layout, descriptor.draw.layout,
+            descriptor.gbuffer.layout, descriptor.adaptive.layout };
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+
+        /*Instance base and draw record of the draws (see DrawPushConstants). The rest is in the draw records.*/
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(DrawPushConstants);
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
 
         if (vkCreatePipelineLayout(device.device, &pipelineLayoutInfo, nullptr, &gpipeline.layout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create pipeline layout!");
@@ -354,6 +461,19 @@ namespace brdfa {
     }
 
 
+    /// <summary>
+    /// Dynamic state of the scene pipelines: the viewport and scissor, set by the secondaries to the render extent of the governor
+    /// (Commander::renderExtent), so scaling the scene doesn't rebuild any pipeline.
+    /// </summary>
+    /// <returns></returns>
+    const VkPipelineDynamicStateCreateInfo* sceneDynamicState() {
+        static const std::array<VkDynamicState, 2> states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        static VkPipelineDynamicStateCreateInfo info{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, nullptr, 0,
+            static_cast<uint32_t>(states.size()), states.data() };
+        return &info;
+    }
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -366,12 +486,15 @@ namespace brdfa {
             VkPipeline& gpipeline,      VkPipeline& sky_map_pipeline, 
             const Device& device,       const SwapChain& swapchain, 
             const Descriptor& descriptor,       const std::vector<char>& vertShaderSpirv, 
-            const std::vector<char>& fragShaderSpirv,       const bool& isSkymap) 
+            const std::vector<char>& fragShaderSpirv,       const bool& isSkymap,
+            const VkSpecializationInfo* fragSpecialization, const VkPipelineCache& pipelineCache,
+            const VkShaderModule& sharedVertModule) 
     {
 
         //auto vertShaderCode = readFile("shaders/vert.spv");
         //auto fragShaderCode = readFile("shaders/frag.spv");
-        VkShaderModule vertShaderModule = createShaderModule(device, vertShaderSpirv);
+        /*The shared vertex module is owned by the caller. Otherwise, a temporary one is created from the given SPIR-V.*/
+        VkShaderModule vertShaderModule = (sharedVertModule != VK_NULL_HANDLE) ? sharedVertModule : createShaderModule(device, vertShaderSpirv);
         VkShaderModule fragShaderModule = createShaderModule(device, fragShaderSpirv);
 
 
@@ -394,6 +517,7 @@ namespace brdfa {
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageInfo.module = fragShaderModule;
         fragShaderStageInfo.pName = "main";
+        fragShaderStageInfo.pSpecializationInfo = fragSpecialization;
 
         VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
@@ -453,7 +577,7 @@ namespace brdfa {
         depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
         depthStencil.depthTestEnable = VK_TRUE;
         depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;         // Also passes the depth laid down by the pre-pass.
         depthStencil.depthBoundsTestEnable = VK_FALSE;
         depthStencil.stencilTestEnable = VK_FALSE;
 
@@ -484,19 +608,20 @@ namespace brdfa {
         pipelineInfo.pMultisampleState = &multisampling;
         pipelineInfo.pDepthStencilState = &depthStencil;
         pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = sceneDynamicState();
         pipelineInfo.layout = layout;
         pipelineInfo.renderPass = sceneRenderPass;
         pipelineInfo.subpass = 0;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-        if (!isSkymap && vkCreateGraphicsPipelines(device.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &gpipeline) != VK_SUCCESS) {
+        if (!isSkymap && vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
 
-        /*Pipeline for Skymap*/
+        /*Pipeline for Skymap. Drawn last at the far plane, only where no mesh is.*/
         depthStencil.depthWriteEnable = VK_FALSE;
-        depthStencil.depthTestEnable = VK_FALSE;
+        depthStencil.depthTestEnable = VK_TRUE;
         rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
 
         vertShaderStageInfo.module = vertShaderModule;
@@ -504,20 +629,450 @@ namespace brdfa {
         shaderStages[0] = vertShaderStageInfo;
         shaderStages[1] = fragShaderStageInfo;
 
-        if (isSkymap && vkCreateGraphicsPipelines(device.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &sky_map_pipeline) != VK_SUCCESS) {
+        if (isSkymap && vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &sky_map_pipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
 
         vkDestroyShaderModule(device.device, fragShaderModule, nullptr);
+        if (sharedVertModule == VK_NULL_HANDLE)
+            vkDestroyShaderModule(device.device, vertShaderModule, nullptr);
+    }
+
+
+    /// <summary>
+    /// Creates the depth only pipeline of the pre-pass (GPipeline::depthPipeline): the vertex stage of the BRDF pipelines,
+    /// no fragment shader and no color writes. main.vert declares gl_Position invariant, so both passes get the same depth.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="vertShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    void createDepthPipeline(GPipeline& gpipeline, const Device& device, const SwapChain& swapchain, const std::vector<char>& vertShaderSpirv, const VkPipelineCache& pipelineCache) {
+        VkShaderModule vertShaderModule = createShaderModule(device, vertShaderSpirv);
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapchain.extent.width;
+        viewport.height = (float)swapchain.extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapchain.extent;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = device.msaaSamples;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        /*The color attachment is left untouched.*/
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = 0;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &vertShaderStageInfo;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = sceneDynamicState();
+        pipelineInfo.layout = gpipeline.layout;
+        pipelineInfo.renderPass = gpipeline.sceneRenderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkResult result = vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.depthPipeline);
         vkDestroyShaderModule(device.device, vertShaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the depth pre-pass pipeline!");
+        }
     }
 
 
+    /// <summary>
+    /// Creates a pipeline cache and fills it with the data saved on the disk (if any). The saved data is only used when its header
+    /// matches the vendor, device and pipeline cache UUID of the current physical device. Otherwise, an empty cache is created.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="path">Path of the saved pipeline cache data</param>
+    /// <param name="warm">Set to true if the saved data has been loaded into the cache</param>
+    /// <returns></returns>
+    VkPipelineCache createPipelineCache(const Device& device, const std::string& path, bool& warm) {
+        std::vector<char> data;
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize((size_t)file.tellg());
+            file.seekg(0);
+            file.read(data.data(), data.size());
+            file.close();
+        }
 
+        /*Validating the header against the current driver*/
+        warm = false;
+        if (data.size() >= sizeof(VkPipelineCacheHeaderVersionOne)) {
+            VkPipelineCacheHeaderVersionOne header;
+            memcpy(&header, data.data(), sizeof(header));
 
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
 
+            warm = header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne)
+                && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                && header.vendorID == properties.vendorID
+                && header.deviceID == properties.deviceID
+                && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        if (!warm && !data.empty())
+            printf("[WARNING]: Pipeline cache \"%s\" was created by another device or driver. Starting with an empty cache.\n", path.c_str());
 
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = warm ? data.size() : 0;
+        cacheInfo.pInitialData = warm ? data.data() : nullptr;
 
+        VkPipelineCache cache;
+        if (vkCreatePipelineCache(device.device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create pipeline cache!");
+        }
+        printf("[INFO]: Pipeline cache loaded (%s, %zu bytes)\n", warm ? "warm" : "cold", cacheInfo.initialDataSize);
+        return cache;
+    }
+
+
+    /// <summary>
+    /// Merges the given caches into the destination cache and destroys them. Used for the caches owned by the worker threads.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="dstCache"></param>
+    /// <param name="srcCaches"></param>
+    void mergePipelineCaches(const Device& device, const VkPipelineCache& dstCache, std::vector<VkPipelineCache>& srcCaches) {
+        if (srcCaches.empty()) return;
+        if (vkMergePipelineCaches(device.device, dstCache, static_cast<uint32_t>(srcCaches.size()), srcCaches.data()) != VK_SUCCESS) {
+            printf("[WARNING]: Failed to merge the pipeline caches\n");
+        }
+        for (auto& cache : srcCaches) {
+            vkDestroyPipelineCache(device.device, cache, nullptr);
+        }
+        srcCaches.clear();
+    }
+
+
+    /// <summary>
+    /// Writes the pipeline cache data into the disk so the next run starts with a warm cache.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <param name="cache"></param>
+    /// <param name="path"></param>
+    void savePipelineCache(const Device& device, const VkPipelineCache& cache, const std::string& path) {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device.device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+            return;
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device.device, cache, &dataSize, data.data()) != VK_SUCCESS)
+            return;
+
+        std::ofstream file(path, std::ofstream::out | std::ofstream::binary);
+        if (!file) {
+            std::cout << "ERROR: CAN'T SAVE PIPELINE CACHE" << std::endl;
+            return;
+        }
+        file.write(data.data(), dataSize);
+        file.close();
+        printf("[INFO]: Pipeline cache saved (%zu bytes)\n", dataSize);
+    }
+
+
+    /// <summary>
+    /// Builds the graphics pipeline libraries that are shared by all the BRDF pipelines: vertex input, pre-rasterization (main vertex shader)
+    /// and fragment output. The states match the ones of createGraphicsPipeline. Requires device.pipelineLibrary.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="pipelineCache"></param>
+    void createPipelineLibraries(GPipeline& gpipeline, const Device& device, const SwapChain& swapchain, const VkPipelineCache& pipelineCache) {
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        /*Vertex input interface*/
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        if (vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.vertexInputLibrary) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the vertex input library!");
+        }
+        pipelineInfo.pVertexInputState = nullptr;
+        pipelineInfo.pInputAssemblyState = nullptr;
+
+        /*Pre-rasterization shaders*/
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = gpipeline.vertModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapchain.extent.width;
+        viewport.height = (float)swapchain.extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapchain.extent;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &vertShaderStageInfo;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pDynamicState = sceneDynamicState();
+        pipelineInfo.layout = gpipeline.layout;
+        pipelineInfo.renderPass = gpipeline.sceneRenderPass;
+        pipelineInfo.subpass = 0;
+        if (vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.preRasterLibrary) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the pre-rasterization library!");
+        }
+        pipelineInfo.stageCount = 0;
+        pipelineInfo.pStages = nullptr;
+        pipelineInfo.pViewportState = nullptr;
+        pipelineInfo.pRasterizationState = nullptr;
+        pipelineInfo.pDynamicState = nullptr;
+
+        /*Fragment output interface*/
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = device.msaaSamples;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = VK_NULL_HANDLE;
+        if (vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &gpipeline.fragmentOutputLibrary) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the fragment output library!");
+        }
+    }
+
+
+    /// <summary>
+    /// Builds the fragment shader library of a BRDF. This is the only part that is compiled when a BRDF changes.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="fragShaderSpirv"></param>
+    /// <param name="pipelineCache"></param>
+    /// <returns></returns>
+    VkPipeline createFragmentLibrary(const GPipeline& gpipeline, const Device& device, const std::vector<char>& fragShaderSpirv, const VkPipelineCache& pipelineCache) {
+        VkShaderModule fragShaderModule = createShaderModule(device, fragShaderSpirv);
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = device.msaaSamples;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;         // Same depth state as createGraphicsPipeline.
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &fragShaderStageInfo;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.layout = gpipeline.layout;
+        pipelineInfo.renderPass = gpipeline.sceneRenderPass;
+        pipelineInfo.subpass = 0;
+
+        VkPipeline library;
+        VkResult result = vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &library);
+        vkDestroyShaderModule(device.device, fragShaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the fragment shader library!");
+        }
+        return library;
+    }
+
+
+    /// <summary>
+    /// Links the shared libraries with the fragment library of a BRDF into an executable pipeline.
+    /// The fast link skips the link time optimizations, so it is meant to be replaced by an optimized link later on.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    /// <param name="fragmentLibrary"></param>
+    /// <param name="optimized">Apply link time optimizations (slower link, faster pipeline)</param>
+    /// <param name="pipelineCache"></param>
+    /// <returns></returns>
+    VkPipeline linkPipelineLibraries(const GPipeline& gpipeline, const Device& device, const VkPipeline& fragmentLibrary, const bool& optimized, const VkPipelineCache& pipelineCache) {
+        std::array<VkPipeline, 4> libraries = { gpipeline.vertexInputLibrary, gpipeline.preRasterLibrary, fragmentLibrary, gpipeline.fragmentOutputLibrary };
+
+        VkPipelineLibraryCreateInfoKHR linkInfo{};
+        linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+        linkInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+        linkInfo.pLibraries = libraries.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &linkInfo;
+        pipelineInfo.flags = optimized ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+        pipelineInfo.layout = gpipeline.layout;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device.device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to link the pipeline libraries!");
+        }
+        return pipeline;
+    }
+
+
+    /// <summary>
+    /// Destroys the shared and the fragment pipeline libraries.
+    /// </summary>
+    /// <param name="gpipeline"></param>
+    /// <param name="device"></param>
+    void destroyPipelineLibraries(GPipeline& gpipeline, const Device& device) {
+        for (auto& it : gpipeline.fragmentLibraries) {
+            vkDestroyPipeline(device.device, it.second, nullptr);
+        }
+        gpipeline.fragmentLibraries.clear();
+        vkDestroyPipeline(device.device, gpipeline.vertexInputLibrary, nullptr);
+        vkDestroyPipeline(device.device, gpipeline.preRasterLibrary, nullptr);
+        vkDestroyPipeline(device.device, gpipeline.fragmentOutputLibrary, nullptr);
+        gpipeline.vertexInputLibrary = VK_NULL_HANDLE;
+        gpipeline.preRasterLibrary = VK_NULL_HANDLE;
+        gpipeline.fragmentOutputLibrary = VK_NULL_HANDLE;
+    }
 
 }
\ No newline at end of file
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <cstring>
+#include <algorithm>
+
+
+// --------------------------------- Geometry Arena ---------------------------------
+//  The vertices, indices and instances of every mesh live in shared device local buffers, handed out in ranges (first fit
+//  over the released ranges, then past the top). The per draw data of each mesh is a record of the draw record table, which
+//  the shaders find through the instance drawn. The indirect commands are written in batch order at the start of every frame
+//  (see recordDrawData()), so the meshes sharing a pipeline are consecutive commands drawn by a single call. Deleted meshes
+//  leave holes behind; once they take too much of the used part, the arena is compacted in the background (see
+//  beginGeometryCompaction()).
+
+namespace brdfa {
+
+    static void createHeap(GeometryHeap& heap, Commander& commander, const Device& device, VkBufferUsageFlags usage, VkDeviceSize stride, uint32_t capacity) {
+        heap.usage = usage;
+        heap.stride = stride;
+        heap.capacity = capacity;
+        createBuffer(commander, device, stride * capacity,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, heap.buffer);
+    }
+
+
+    static void destroyHeap(GeometryHeap& heap, const Device& device) {
+        if (heap.buffer.obj == VK_NULL_HANDLE) return;
+        vkDestroyBuffer(device.device, heap.buffer.obj, nullptr);
+        vkFreeMemory(device.device, heap.buffer.memory, nullptr);
+        heap.buffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    }
+
+
+    /*Copies ranges of a heap into a new buffer of the given capacity, which replaces the old one. The device must be idle.*/
+    static void moveHeap(GeometryHeap& heap, Commander& commander, const Device& device, uint32_t capacity, const std::vector<VkBufferCopy>& copies) {
+        Buffer old = heap.buffer;
+        createHeap(heap, commander, device, heap.usage, heap.stride, capacity);
+        if (!copies.empty()) {
+            VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+            vkCmdCopyBuffer(commandBuffer, old.obj, heap.buffer.obj, static_cast<uint32_t>(copies.size()), copies.data());
+            endSingleTimeCommands(commander, device);
+        }
+        vkDestroyBuffer(device.device, old.obj, nullptr);
+        vkFreeMemory(device.device, old.memory, nullptr);
+    }
+
+
+    /*Hands out a range of the heap. Doubles the heap if nothing fits, in which case true is returned.*/
+    static bool allocateRange(GeometryHeap& heap, Commander& commander, const Device& device, uint32_t count, GeometryRange& range) {
+        range.count = count;
+        for (auto it = heap.freeRanges.begin(); it != heap.freeRanges.end(); it++) {
+            if (it->count < count) continue;
+            range.offset = it->offset;
+            it->offset += count;
+            it->count -= count;
+            if (it->count == 0) heap.freeRanges.erase(it);
+            return false;
+        }
+
+        bool grown = false;
+        if (heap.top + count > heap.capacity) {
+            uint32_t capacity = std::max(heap.capacity * 2, heap.top + count);
+            moveHeap(heap, commander, device, capacity, { { 0, 0, heap.stride * heap.top } });
+            printf("[INFO]: Geometry heap grown to %u elements\n", heap.capacity);
+            grown = true;
+        }
+        range.offset = heap.top;
+        heap.top += count;
+        return grown;
+    }
+
+
+    /*Gives a range back, merged with its free neighbours. A range ending at the top lowers the top instead.*/
+    static void releaseRange(GeometryHeap& heap, const GeometryRange& range) {
+        if (range.count == 0) return;
+        auto next = std::lower_bound(heap.freeRanges.begin(), heap.freeRanges.end(), range,
+            [](const GeometryRange& a, const GeometryRange& b) { return a.offset < b.offset; });
+        auto it = heap.freeRanges.insert(next, range);
+        if (std::next(it) != heap.freeRanges.end() && it->offset + it->count == std::next(it)->offset) {
+            it->count += std::next(it)->count;
+            heap.freeRanges.erase(std::next(it));
+        }
+        if (it != heap.freeRanges.begin() && std::prev(it)->offset + std::prev(it)->count == it->offset) {
+            std::prev(it)->count += it->count;
+            it = heap.freeRanges.erase(it);
+            it--;
+        }
+        if (it->offset + it->count == heap.top) {
+            heap.top = it->offset;
+            heap.freeRanges.erase(it);
+        }
+    }
+
+
+    static uint32_t freeElements(const GeometryHeap& heap) {
+        uint32_t count = 0;
+        for (const auto& range : heap.freeRanges) count += range.count;
+        return count;
+    }
+
+
+    static void destroyBuffer(Buffer& buffer, const Device& device) {
+        if (buffer.obj == VK_NULL_HANDLE) return;
+        vkDestroyBuffer(device.device, buffer.obj, nullptr);
+        vkFreeMemory(device.device, buffer.memory, nullptr);
+        buffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    }
+
+
+    /*(Re)creates the draw record, draw command and draw count buffers with room for the given slots. Nothing is kept: the records
+      are written again (the meshes are invalidated by the caller), the commands and counts every frame. The count buffer holds the
+      culling flags of each slot, then the draw count of the batch starting at each command.*/
+    static void growDraws(GeometryArena& arena, Commander& commander, const Device& device, uint32_t capacity) {
+        const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        destroyBuffer(arena.drawRecords, device);
+        destroyBuffer(arena.drawCommands, device);
+        destroyBuffer(arena.drawCounts, device);
+        createBuffer(commander, device, sizeof(DrawRecord) * capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.drawRecords);
+        createBuffer(commander, device, sizeof(VkDrawIndexedIndirectCommand) * capacity, usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.drawCommands);
+        createBuffer(commander, device, sizeof(uint32_t) * 2 * capacity, usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.drawCounts);
+        arena.drawCapacity = capacity;
+    }
+
+
+    /*(Re)creates the visible list after the capacity of the instance heap. The culling pass writes it every frame.*/
+    static void createVisible(GeometryArena& arena, Commander& commander, const Device& device) {
+        destroyBuffer(arena.visible, device);
+        createBuffer(commander, device, sizeof(uint32_t) * arena.instances.capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.visible);
+    }
+
+
+    /// <summary>
+    /// Creates the shared vertex, index and instance buffers and the draw buffers of the arena.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    void createGeometryArena(GeometryArena& arena, Commander& commander, const Device& device) {
+        createHeap(arena.vertices, commander, device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(Vertex), GEOMETRY_VERTEX_CAPACITY);
+        createHeap(arena.indices, commander, device, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t), GEOMETRY_INDEX_CAPACITY);
+        createHeap(arena.instances, commander, device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(InstanceData), GEOMETRY_INSTANCE_CAPACITY);
+        createVisible(arena, commander, device);
+        growDraws(arena, commander, device, GEOMETRY_DRAW_CAPACITY);
+    }
+
+
+    /// <summary>
+    /// Destroys the buffers of the arena, along with those of a compaction. The command buffer of the compaction goes with the upload pool.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyGeometryArena(GeometryArena& arena, const Device& device) {
+        destroyHeap(arena.vertices, device);
+        destroyHeap(arena.indices, device);
+        destroyHeap(arena.instances, device);
+        destroyBuffer(arena.visible, device);
+        destroyBuffer(arena.drawRecords, device);
+        destroyBuffer(arena.drawCommands, device);
+        destroyBuffer(arena.drawCounts, device);
+        if (arena.compaction.fence != VK_NULL_HANDLE) {
+            vkWaitForFences(device.device, 1, &arena.compaction.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(device.device, arena.compaction.fence, nullptr);
+        }
+        for (auto& buffer : arena.compaction.buffers) destroyBuffer(buffer, device);
+        arena = GeometryArena();
+    }
+
+
+    /// <summary>
+    /// Takes the ranges and the draw slot of a mesh and uploads its vertices and indices. The device must be idle.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if a buffer of the arena was recreated: the command buffers of all the meshes must be re-recorded.</returns>
+    bool uploadGeometry(GeometryArena& arena, Commander& commander, const Device& device, Mesh& mesh) {
+        bool grown = allocateRange(arena.vertices, commander, device, static_cast<uint32_t>(mesh.vertices.size()), mesh.vertexRange);
+        grown |= allocateRange(arena.indices, commander, device, static_cast<uint32_t>(mesh.indices.size()), mesh.indexRange);
+
+        if (!arena.freeDraws.empty()) {
+            mesh.drawSlot = arena.freeDraws.back();
+            arena.freeDraws.pop_back();
+        }
+        else {
+            if (arena.usedDraws == arena.drawCapacity) {
+                growDraws(arena, commander, device, arena.drawCapacity * 2);
+                grown = true;
+            }
+            mesh.drawSlot = arena.usedDraws++;
+        }
+
+        uploadBuffer(commander, device, mesh.vertices.data(), arena.vertices.stride * mesh.vertexRange.count,
+            arena.vertices.buffer, arena.vertices.stride * mesh.vertexRange.offset);
+        uploadBuffer(commander, device, mesh.indices.data(), arena.indices.stride * mesh.indexRange.count,
+            arena.indices.buffer, arena.indices.stride * mesh.indexRange.offset);
+        return grown;
+    }
+
+
+    /// <summary>
+    /// Moves the instances of a mesh into a new range of the instance heap (one identity instance if it isn't instanced), each
+    /// pointing at the draw record of the mesh. Called once the mesh has its draw slot, and whenever its instances change.
+    /// The device must be idle.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="mesh"></param>
+    /// <returns>True if the instance heap was recreated: the draw set must be written again and all the meshes re-recorded.</returns>
+    bool uploadInstances(GeometryArena& arena, Commander& commander, const Device& device, Mesh& mesh) {
+        std::vector<InstanceData> instances = mesh.instances;
+        if (instances.empty()) instances.push_back(InstanceData());
+        for (auto& instance : instances) instance.record = mesh.drawSlot;
+
+        releaseRange(arena.instances, mesh.instanceRange);
+        bool grown = allocateRange(arena.instances, commander, device, static_cast<uint32_t>(instances.size()), mesh.instanceRange);
+        if (grown) createVisible(arena, commander, device);
+        uploadBuffer(commander, device, instances.data(), arena.instances.stride * mesh.instanceRange.count,
+            arena.instances.buffer, arena.instances.stride * mesh.instanceRange.offset);
+        return grown;
+    }
+
+
+    /// <summary>
+    /// Gives the ranges and the draw slot of a mesh back. Done when the mesh is deleted.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="mesh"></param>
+    void releaseGeometry(GeometryArena& arena, Mesh& mesh) {
+        releaseRange(arena.vertices, mesh.vertexRange);
+        releaseRange(arena.indices, mesh.indexRange);
+        releaseRange(arena.instances, mesh.instanceRange);
+        arena.freeDraws.push_back(mesh.drawSlot);
+        mesh.vertexRange = GeometryRange();
+        mesh.indexRange = GeometryRange();
+        mesh.instanceRange = GeometryRange();
+    }
+
+
+    /// <summary>
+    /// Part of the used geometry (below the top of the heaps) left free by released meshes. The largest of the vertices, indices
+    /// and instances.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <returns>0 to 1</returns>
+    float geometryFragmentation(const GeometryArena& arena) {
+        float fragmentation = 0.0f;
+        for (const GeometryHeap* heap : { &arena.vertices, &arena.indices, &arena.instances }) {
+            if (heap->top > 0) fragmentation = std::max(fragmentation, float(freeElements(*heap)) / heap->top);
+        }
+        return fragmentation;
+    }
+
+
+    /// <summary>
+    /// Starts a compaction: the ranges of the given meshes are packed at the start of new buffers (one copy per heap) by a fenced
+    /// submission, while the frames keep drawing from the current buffers. Nothing of the arena or the meshes changes until
+    /// finishGeometryCompaction(), and the ranges must not change meanwhile.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="meshes">Every mesh holding ranges of the arena</param>
+    void beginGeometryCompaction(GeometryArena& arena, Commander& commander, const Device& device, const std::vector<Mesh*>& meshes) {
+        GeometryCompaction& compaction = arena.compaction;
+        std::array<GeometryHeap*, 3> heaps = { &arena.vertices, &arena.indices, &arena.instances };
+        std::array<std::vector<VkBufferCopy>, 3> copies;
+        compaction.tops = { 0, 0, 0 };
+        compaction.offsets.clear();
+        for (Mesh* mesh : meshes) {
+            std::array<const GeometryRange*, 3> ranges = { &mesh->vertexRange, &mesh->indexRange, &mesh->instanceRange };
+            std::array<uint32_t, 3> offsets{};
+            for (size_t h = 0; h < heaps.size(); h++) {
+                if (ranges[h]->count > 0)
+                    copies[h].push_back({ heaps[h]->stride * ranges[h]->offset, heaps[h]->stride * compaction.tops[h], heaps[h]->stride * ranges[h]->count });
+                offsets[h] = compaction.tops[h];
+                compaction.tops[h] += ranges[h]->count;
+            }
+            compaction.offsets.push_back(offsets);
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commander.uploadPool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device.device, &allocInfo, &compaction.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to allocate the geometry compaction command buffer!");
+        }
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(compaction.commandBuffer, &beginInfo);
+        for (size_t h = 0; h < heaps.size(); h++) {
+            createBuffer(commander, device, heaps[h]->stride * heaps[h]->capacity,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | heaps[h]->usage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compaction.buffers[h]);
+            if (!copies[h].empty())
+                vkCmdCopyBuffer(compaction.commandBuffer, heaps[h]->buffer.obj, compaction.buffers[h].obj, static_cast<uint32_t>(copies[h].size()), copies[h].data());
+        }
+
+        /*The frames recorded after the swap read the copies.*/
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(compaction.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(compaction.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to record the geometry compaction!");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device.device, &fenceInfo, nullptr, &compaction.fence) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to create the geometry compaction fence!");
+        }
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &compaction.commandBuffer;
+        if (vkQueueSubmit(device.graphicsQueue, 1, &submitInfo, compaction.fence) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to submit the geometry compaction!");
+        }
+    }
+
+
+    /// <summary>
+    /// Ends the compaction started by beginGeometryCompaction() if its fence signaled: the heaps take the packed buffers and the
+    /// meshes their new offsets. The replaced buffers are kept until destroyRetiredGeometry(), since the frames in flight still
+    /// read them. The draw set must then point at the new instance heap and all the command buffers be re-recorded.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="meshes">The meshes given to beginGeometryCompaction(), in the same order</param>
+    /// <param name="frame">Frame the buffers are replaced at</param>
+    /// <returns>False if no compaction runs or its copies aren't done yet.</returns>
+    bool finishGeometryCompaction(GeometryArena& arena, Commander& commander, const Device& device, const std::vector<Mesh*>& meshes, uint64_t frame) {
+        GeometryCompaction& compaction = arena.compaction;
+        if (compaction.fence == VK_NULL_HANDLE || vkGetFenceStatus(device.device, compaction.fence) != VK_SUCCESS)
+            return false;
+        if (meshes.size() != compaction.offsets.size())
+            throw std::runtime_error("ERROR: the meshes changed while the geometry was compacted!");
+        vkDestroyFence(device.device, compaction.fence, nullptr);
+        vkFreeCommandBuffers(device.device, commander.uploadPool, 1, &compaction.commandBuffer);
+        compaction.fence = VK_NULL_HANDLE;
+        compaction.commandBuffer = VK_NULL_HANDLE;
+
+        std::array<GeometryHeap*, 3> heaps = { &arena.vertices, &arena.indices, &arena.instances };
+        for (size_t h = 0; h < heaps.size(); h++) {
+            std::swap(heaps[h]->buffer, compaction.buffers[h]);
+            heaps[h]->top = compaction.tops[h];
+            heaps[h]->freeRanges.clear();
+        }
+        for (size_t i = 0; i < meshes.size(); i++) {
+            meshes[i]->vertexRange.offset = compaction.offsets[i][0];
+            meshes[i]->indexRange.offset = compaction.offsets[i][1];
+            meshes[i]->instanceRange.offset = compaction.offsets[i][2];
+        }
+        compaction.retiring = true;
+        compaction.retiredAt = frame;
+
+        arena.compactions++;
+        printf("[INFO]: Geometry compacted to %u vertices, %u indices and %u instances\n", compaction.tops[0], compaction.tops[1], compaction.tops[2]);
+        return true;
+    }
+
+
+    /// <summary>
+    /// Destroys the buffers replaced by the last compaction. Called once no frame in flight reads them.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyRetiredGeometry(GeometryArena& arena, const Device& device) {
+        for (auto& buffer : arena.compaction.buffers) destroyBuffer(buffer, device);
+        arena.compaction.retiring = false;
+    }
+
+
+    /// <summary>
+    /// Records the draw data of a frame, before the culling pass: the records of the meshes changed since they were last written,
+    /// and the draw command of every mesh in batch order with no instance (the culling pass adds the visible ones). The draw counts
+    /// are cleared. Without multiDrawIndirect the commands can't carry the instance range (firstInstance 0): it is pushed instead.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commandBuffer"></param>
+    /// <param name="device"></param>
+    /// <param name="drawOrder">The meshes in batch order (Commander::drawOrder)</param>
+    void recordDrawData(GeometryArena& arena, VkCommandBuffer commandBuffer, const Device& device, const std::vector<Mesh*>& drawOrder) {
+        /*The draws and the culling pass of the previous frame are done with the buffers.*/
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+            | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        arena.commands.resize(drawOrder.size());
+        for (size_t i = 0; i < drawOrder.size(); i++) {
+            Mesh& mesh = *drawOrder[i];
+            if (mesh.recordVersion != mesh.drawVersion) {
+                DrawRecord record = drawRecord(mesh);
+                vkCmdUpdateBuffer(commandBuffer, arena.drawRecords.obj, sizeof(DrawRecord) * mesh.drawSlot, sizeof(DrawRecord), &record);
+                mesh.recordVersion = mesh.drawVersion;
+            }
+            VkDrawIndexedIndirectCommand& command = arena.commands[i];
+            command.indexCount = mesh.indexRange.count;
+            command.instanceCount = 0;
+            command.firstIndex = mesh.indexRange.offset;
+            command.vertexOffset = static_cast<int32_t>(mesh.vertexRange.offset);
+            command.firstInstance = device.multiDrawIndirect ? mesh.instanceRange.offset : 0;
+        }
+
+        /*vkCmdUpdateBuffer takes 65536 bytes at most.*/
+        const size_t chunk = 65536 / sizeof(VkDrawIndexedIndirectCommand);
+        for (size_t first = 0; first < arena.commands.size(); first += chunk) {
+            size_t count = std::min(chunk, arena.commands.size() - first);
+            vkCmdUpdateBuffer(commandBuffer, arena.drawCommands.obj, sizeof(VkDrawIndexedIndirectCommand) * first,
+                sizeof(VkDrawIndexedIndirectCommand) * count, arena.commands.data() + first);
+        }
+        vkCmdFillBuffer(commandBuffer, arena.drawCounts.obj, 0, VK_WHOLE_SIZE, 0);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+}
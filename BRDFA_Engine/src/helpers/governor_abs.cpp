@@ -0,0 +1,147 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+
+// --------------------------------- Frame-time governor ---------------------------------
+//  Holds Governor::targetMs with two knobs. The render scale comes first: the scene secondaries draw into the corner of
+//  the scene attachments (Commander::renderExtent) and the post pass upscales it, while the UI stays at the native extent.
+//  Once the scale is at GOVERNOR_MIN_SCALE, the light samples a frame evaluates are halved (CameraUniforms::sampleCap) and
+//  the post pass averages the sample blocks of consecutive frames into its history. Frees up in the reverse order. The frame
+//  time held is the GPU time of the scene buffer (timestamps), which the wait for the display does not inflate.
+
+namespace brdfa {
+
+    /*Keeps the decision for the Logs window. The ring and its strings are allocated by the first decisions only, so the governor
+      does not allocate in the frames after.*/
+    static void logDecision(Governor& governor, const char* decision) {
+        if (governor.decisions.size() < GOVERNOR_LOG_SIZE)
+            governor.decisions.resize(GOVERNOR_LOG_SIZE);
+        std::string& slot = governor.decisions[governor.decisionCount % GOVERNOR_LOG_SIZE];
+        slot.reserve(GOVERNOR_DECISION_LENGTH);
+        slot.assign(decision);
+        governor.decisionCount++;
+        governor.settleFrames = GOVERNOR_SETTLE_FRAMES;
+        resetAccumulation(governor);
+    }
+
+
+    /*Frames the capped samples are spread over. 1 when uncapped.*/
+    static uint32_t accumulationFrames(const Governor& governor) {
+        if (governor.sampleCap <= 0 || governor.sampleCap >= governor.maxSamples) return 1;
+        return static_cast<uint32_t>((governor.maxSamples + governor.sampleCap - 1) / governor.sampleCap);
+    }
+
+
+    /// <summary>
+    /// Render extent of the scene at the scale of the governor.
+    /// </summary>
+    /// <param name="governor"></param>
+    /// <param name="extent">Swapchain extent</param>
+    /// <returns></returns>
+    VkExtent2D governedExtent(const Governor& governor, const VkExtent2D& extent) {
+        VkExtent2D scaled{};
+        scaled.width = std::max(1u, static_cast<uint32_t>(std::lround(extent.width * governor.scale)));
+        scaled.height = std::max(1u, static_cast<uint32_t>(std::lround(extent.height * governor.scale)));
+        return scaled;
+    }
+
+
+    /// <summary>
+    /// Drops the frames accumulated so far: the next one starts the history again. Done when the picture changes.
+    /// </summary>
+    /// <param name="governor"></param>
+    void resetAccumulation(Governor& governor) {
+        governor.accumulated = 0;
+        governor.sampleOffset = 0;
+    }
+
+
+    /// <summary>
+    /// Back to the full scale and samples, with the decision log cleared.
+    /// </summary>
+    /// <param name="governor"></param>
+    void resetGovernor(Governor& governor) {
+        governor.scale = 1.0f;
+        governor.sampleCap = 0;
+        governor.frameMs = 0.0f;
+        governor.settleFrames = GOVERNOR_SETTLE_FRAMES;
+        governor.weight = 1.0f;
+        governor.decisionCount = 0;
+        resetAccumulation(governor);
+    }
+
+
+    /// <summary>
+    /// Takes the frame time of the last frame and steps the governor once per frame: changes the scale or the sample cap when the
+    /// smoothed frame time is off the target and the previous change settled, then picks the sample block of the frame and its
+    /// weight in the history. Governor::historyIndex flips every frame.
+    /// </summary>
+    /// <param name="governor"></param>
+    /// <param name="frameMs">GPU time of the last finished frame, or the interval between the last two frames without timestamps</param>
+    /// <returns>True if the render scale changed</returns>
+    bool updateGovernor(Governor& governor, const float& frameMs) {
+        governor.frameMs = (governor.frameMs > 0.0f) ? governor.frameMs + (frameMs - governor.frameMs) * 0.1f : frameMs;
+        float previousScale = governor.scale;
+
+        if (governor.enabled && governor.settleFrames > 0) {
+            governor.settleFrames--;
+        }
+        else if (governor.enabled) {
+            char decision[GOVERNOR_DECISION_LENGTH];
+            if (governor.frameMs > governor.targetMs * 1.05f) {
+                /*Too slow: the pixel count goes down with the square of the scale, so the scale follows the root of the ratio.*/
+                if (governor.scale > GOVERNOR_MIN_SCALE) {
+                    float scale = std::floor(governor.scale * std::sqrt(governor.targetMs / governor.frameMs) / GOVERNOR_SCALE_STEP) * GOVERNOR_SCALE_STEP;
+                    governor.scale = std::max(GOVERNOR_MIN_SCALE, std::min(scale, governor.scale - GOVERNOR_SCALE_STEP));
+                    snprintf(decision, sizeof(decision), "%.1f ms > %.1f ms: scale %d%% -> %d%%", governor.frameMs, governor.targetMs,
+                        static_cast<int>(std::lround(previousScale * 100.0f)), static_cast<int>(std::lround(governor.scale * 100.0f)));
+                    logDecision(governor, decision);
+                }
+                else if (governor.maxSamples > 1 && governor.sampleCap != 1) {
+                    int previousCap = (governor.sampleCap > 0) ? governor.sampleCap : governor.maxSamples;
+                    governor.sampleCap = std::max(1, previousCap / 2);
+                    snprintf(decision, sizeof(decision), "%.1f ms > %.1f ms at %d%%: samples per frame %d -> %d (%u frames to converge)",
+                        governor.frameMs, governor.targetMs, static_cast<int>(std::lround(governor.scale * 100.0f)), previousCap,
+                        governor.sampleCap, accumulationFrames(governor));
+                    logDecision(governor, decision);
+                }
+            }
+            else if (governor.frameMs < governor.targetMs * 0.8f) {
+                /*Headroom: the samples come back first, the picture converging faster, then the resolution.*/
+                if (governor.sampleCap > 0) {
+                    int previousCap = governor.sampleCap;
+                    governor.sampleCap = (previousCap * 2 >= governor.maxSamples) ? 0 : previousCap * 2;
+                    snprintf(decision, sizeof(decision), "%.1f ms < %.1f ms: samples per frame %d -> %d", governor.frameMs, governor.targetMs * 0.8f,
+                        previousCap, governor.sampleCap > 0 ? governor.sampleCap : governor.maxSamples);
+                    logDecision(governor, decision);
+                }
+                else if (governor.scale < 1.0f) {
+                    governor.scale = std::min(1.0f, governor.scale + GOVERNOR_SCALE_STEP);
+                    snprintf(decision, sizeof(decision), "%.1f ms < %.1f ms: scale %d%% -> %d%%", governor.frameMs, governor.targetMs * 0.8f,
+                        static_cast<int>(std::lround(previousScale * 100.0f)), static_cast<int>(std::lround(governor.scale * 100.0f)));
+                    logDecision(governor, decision);
+                }
+            }
+        }
+
+        /*Frame n of the history evaluates the block n % blocks of each sequence (main.frag), the last block being the shorter one,
+          and upscale.frag weighs it by the samples it took: the history is the mean of the samples. The first frame drops it.*/
+        governor.historyIndex ^= 1u;
+        uint32_t frames = accumulationFrames(governor);
+        if (frames == 1) {
+            governor.weight = 1.0f;
+            resetAccumulation(governor);
+        }
+        else {
+            governor.sampleOffset = governor.accumulated;
+            governor.weight = (governor.accumulated == 0) ? 1.0f : 0.0f;
+            governor.accumulated++;
+        }
+        return governor.scale != previousScale;
+    }
+
+}
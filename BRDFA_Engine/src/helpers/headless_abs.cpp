@@ -0,0 +1,113 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+
+// --------------------------------- Headless Rendering ---------------------------------
+//  Without a window there is no surface nor swapchain: the scene is drawn into plain images created here, one per frame in
+//  flight, that the rest of the engine uses as the swapchain images. The render passes leave them in the transfer source
+//  layout (SwapChain::presentLayout) instead of presenting them, and readbackImage() copies a finished frame to the host.
+
+namespace brdfa {
+
+    /*sRGB like the surface formats picked for a window, in the byte order of the image files.*/
+    static const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+
+    /// <summary>
+    /// Creates the images standing in for the swapchain ones when there is no window.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="width"></param>
+    /// <param name="height"></param>
+    /// <param name="imageCount">One per frame in flight</param>
+    void createOffscreenSwapChain(SwapChain& swapchain, Commander& commander, const Device& device, const uint32_t& width, const uint32_t& height,
+        const uint32_t& imageCount) {
+        swapchain.swapChain = VK_NULL_HANDLE;
+        swapchain.format = OFFSCREEN_FORMAT;
+        swapchain.extent = { std::max(1u, width), std::max(1u, height) };
+        swapchain.presentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        swapchain.offscreenImages.resize(imageCount);
+        swapchain.images.resize(imageCount);
+        swapchain.imageViews.resize(imageCount);
+        for (uint32_t i = 0; i < imageCount; i++) {
+            Image& image = swapchain.offscreenImages[i];
+            createImage(commander, device, swapchain.extent.width, swapchain.extent.height, 1, VK_SAMPLE_COUNT_1_BIT, swapchain.format,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image);
+            image.view = createImageView(image.obj, device.device, swapchain.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+            swapchain.images[i] = image.obj;
+            swapchain.imageViews[i] = image.view;
+        }
+    }
+
+
+    /// <summary>
+    /// Destroys the offscreen images and their views.
+    /// </summary>
+    /// <param name="swapchain"></param>
+    /// <param name="device"></param>
+    void destroyOffscreenSwapChain(SwapChain& swapchain, const Device& device) {
+        for (auto& image : swapchain.offscreenImages) {
+            vkDestroyImageView(device.device, image.view, nullptr);
+            vkDestroyImage(device.device, image.obj, nullptr);
+            vkFreeMemory(device.device, image.memory, nullptr);
+        }
+        swapchain.offscreenImages.clear();
+        swapchain.images.clear();
+        swapchain.imageViews.clear();
+    }
+
+
+    /// <summary>
+    /// Copies a rendered offscreen image back to the host. Waits for the copy.
+    /// </summary>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="swapchain"></param>
+    /// <param name="index">Image of the frame</param>
+    /// <param name="pixels">RGBA, 8 bits per channel (sRGB), rows top to bottom</param>
+    void readbackImage(Commander& commander, const Device& device, const SwapChain& swapchain, const uint32_t& index, std::vector<uint8_t>& pixels) {
+        VkDeviceSize size = static_cast<VkDeviceSize>(swapchain.extent.width) * swapchain.extent.height * 4;
+        Buffer staging;
+        createBuffer(commander, device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commander, device);
+
+        /*The scene pass (or the post pass) left the image in the transfer source layout: its writes are made visible to the copy.*/
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = swapchain.presentLayout;
+        barrier.newLayout = swapchain.presentLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapchain.images[index];
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageExtent = { swapchain.extent.width, swapchain.extent.height, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer, swapchain.images[index], swapchain.presentLayout, staging.obj, 1, &region);
+        endSingleTimeCommands(commander, device);
+
+        void* data;
+        vkMapMemory(device.device, staging.memory, 0, size, 0, &data);
+        pixels.resize(static_cast<size_t>(size));
+        memcpy(pixels.data(), data, static_cast<size_t>(size));
+        vkUnmapMemory(device.device, staging.memory);
+
+        vkDestroyBuffer(device.device, staging.obj, nullptr);
+        vkFreeMemory(device.device, staging.memory, nullptr);
+    }
+
+}
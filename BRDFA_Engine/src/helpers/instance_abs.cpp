@@ -73,13 +73,16 @@ namespace brdfa {
     /// 
     /// </summary>
     /// <param name="enableValidationLayers"></param>
+    /// <param name="headless">No window: the surface extensions of GLFW are left out</param>
     /// <returns></returns>
-    std::vector<const char*> getRequiredExtensions(const bool& enableValidationLayers) {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> getRequiredExtensions(const bool& enableValidationLayers, const bool& headless) {
+        std::vector<const char*> extensions;
+        if (!headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -96,7 +99,8 @@ namespace brdfa {
     /// <param name="applicationName"></param>
     /// <param name="enableValidationLayers"></param>
     /// <param name="instance"></param>
-    void createInstance(const char* applicationName, const bool& enableValidationLayers, Instance& instance) {
+    /// <param name="headless">Created without the surface extensions (no GLFW window)</param>
+    void createInstance(const char* applicationName, const bool& enableValidationLayers, Instance& instance, const bool& headless) {
 
         if (enableValidationLayers && !checkValidationLayerSupport()) {
             throw std::runtime_error("ERROR: validation layers requested, but not available!\n\t\tTry to disable the validation layer in the engine configuration before creating it.");
@@ -108,9 +112,9 @@ namespace brdfa {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_1;                // 1.1 for vkGetPhysicalDeviceFeatures2 (optional device features)
 
-        auto extensions = getRequiredExtensions(enableValidationLayers);
+        auto extensions = getRequiredExtensions(enableValidationLayers, headless);
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
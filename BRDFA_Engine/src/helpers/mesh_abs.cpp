@@ -32,13 +32,11 @@ namespace std {
 namespace brdfa {
 
     /// <summary>
-    /// 
+    /// Reads the vertices and indices of the model into the mesh. The device copy is made by uploadGeometry().
     /// </summary>
     /// <param name="mesh"></param>
-    /// <param name="commander"></param>
-    /// <param name="device"></param>
     /// <param name="modelPath"></param>
-    void loadVertices(Mesh& mesh, Commander& commander, const Device& device, const std::string& modelPath) {
+    void loadVertices(Mesh& mesh, const std::string& modelPath) {
         mesh.vertices.clear();
         mesh.indices.clear();
 
@@ -85,82 +83,13 @@ namespace brdfa {
             }
         }
 
-        /*Creation of Vertex Buffer*/
-        /*Creation of staging buffer in RAM*/
-        VkDeviceSize bufferSize = sizeof(mesh.vertices[0]) * mesh.vertices.size();
-        Buffer v_staging;
-        createBuffer(
-            commander, device,
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            v_staging);
-
-        /*Filling the RAM memeory with vertices data*/
-        void* data;
-        vkMapMemory(device.device, v_staging.memory, 0, bufferSize, 0, &data);
-        memcpy(data, mesh.vertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device.device, v_staging.memory);
-
-        /*Creation of vertex buffer in GPU RAM*/
-        createBuffer(
-            commander, device,
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT
-            | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            mesh.vertexBuffer);
-
-        /*Filling the GPU RAM buffer that we just  created.*/
-        copyBuffer(
-            commander, device,
-            v_staging.obj, mesh.vertexBuffer.obj,
-            bufferSize);
-
-        /*Clearing the staging Buffer data from RAM.*/
-        vkDestroyBuffer(device.device, v_staging.obj, nullptr);
-        vkFreeMemory(device.device, v_staging.memory, nullptr);
-
-
-        /*Creation of Indices Buffer*/
-        /*Creation of staging buffer in RAM*/
-        bufferSize = sizeof(mesh.indices[0]) * mesh.indices.size();
-        Buffer i_staging;
-        createBuffer(
-            commander, device,
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            i_staging);
-
-
-        /*Filling the staging index buffer*/
-        data = nullptr;
-
-        vkMapMemory(device.device, i_staging.memory, 0, bufferSize, 0, &data);
-        memcpy(data, mesh.indices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device.device, i_staging.memory);
-
-        /*Creation of the Index Buffer in the GPU RAM*/
-        createBuffer(
-            commander, device,
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT
-            | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            mesh.indexBuffer);
-
-        /*Copying the Index RAM buffer to index GPU RAM buffer*/
-        copyBuffer(
-            commander, device,
-            i_staging.obj, mesh.indexBuffer.obj,
-            bufferSize);
-
-        /*Clearing the index RAM Buffer*/
-        vkDestroyBuffer(device.device, i_staging.obj, nullptr);
-        vkFreeMemory(device.device, i_staging.memory, nullptr);
+        /*Bounds of the mesh, tested by the culling pass.*/
+        mesh.boundsMin = mesh.vertices.empty() ? glm::vec3(0.f) : mesh.vertices[0].pos;
+        mesh.boundsMax = mesh.boundsMin;
+        for (const Vertex& vertex : mesh.vertices) {
+            mesh.boundsMin = glm::min(mesh.boundsMin, vertex.pos);
+            mesh.boundsMax = glm::max(mesh.boundsMax, vertex.pos);
+        }
     }
 
 
@@ -293,7 +222,7 @@ namespace brdfa {
     /// <param name="texturePath"></param>
     void populate(Mesh& mesh, Commander& commander, const Device& device, const std::string& modelPath, const std::string& texturePath)
     {
-        loadVertices(mesh, commander, device, modelPath);
+        loadVertices(mesh, modelPath);
         loadTexture(mesh, commander, device, texturePath);
         vkDeviceWaitIdle(device.device);
     }
@@ -307,19 +236,9 @@ namespace brdfa {
 	/// <param name="modelPath"></param>
 	/// <param name="texturePath"></param>
 	/// <returns></returns>
-	Mesh loadMesh(Commander& commander, const Device& device, const std::string& modelPath, const std::string& texturePath, const size_t& bufferCounts) {
+	Mesh loadMesh(Commander& commander, const Device& device, const std::string& modelPath, const std::string& texturePath) {
         Mesh mesh{};
         populate(mesh, commander, device, modelPath, texturePath);
-        for (int i = 0; i < bufferCounts; i++) {
-            mesh.paramsBuffer.push_back({});
-            createBuffer(
-                commander, device, VkDeviceSize(sizeof(Parameters)),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                mesh.paramsBuffer[i]);
-        }
-
         return mesh;
 	}
 
@@ -332,28 +251,49 @@ namespace brdfa {
     /// <param name="modelPath"></param>
     /// <param name="texturePath"></param>
     /// <returns></returns>
-    Mesh loadMesh(Commander& commander, const Device& device, const std::string& modelPath, const std::vector<std::string>& texturePaths, const size_t& bufferCounts) {
+    Mesh loadMesh(Commander& commander, const Device& device, const std::string& modelPath, const std::vector<std::string>& texturePaths) {
         Mesh mesh{};
-        loadVertices(mesh, commander, device, modelPath);
+        loadVertices(mesh, modelPath);
         for (const std::string& path: texturePaths) {
             if (path == "") continue;
             loadTexture(mesh, commander, device, path);
             vkDeviceWaitIdle(device.device);
         }
-        for (int i = 0; i < bufferCounts; i++) {
-            mesh.paramsBuffer.push_back({});
-            createBuffer(
-                commander, device, VkDeviceSize(sizeof(Parameters)),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                mesh.paramsBuffer[i]);
-        }
-
         return mesh;
     }
 
 
+    /// <summary>
+    /// Lays out columns x rows instances of the mesh on a grid centered on it (in the XZ plane of the mesh). Each instance takes
+    /// the parameters of the mesh, with the first swept parameter going from 0 to 1 along the columns and the second along the rows.
+    /// </summary>
+    /// <param name="mesh"></param>
+    /// <param name="columns"></param>
+    /// <param name="rows"></param>
+    /// <param name="spacing">Distance between two neighbour instances</param>
+    /// <param name="parameters">Indices (0 to 8) of the parameters swept along the columns and the rows</param>
+    void generateInstanceGrid(Mesh& mesh, const uint32_t& columns, const uint32_t& rows, const float& spacing, const std::array<int, 2>& parameters) {
+        const float meshParams[9] = {
+            mesh.params.extra012.x, mesh.params.extra012.y, mesh.params.extra012.z,
+            mesh.params.extra345.x, mesh.params.extra345.y, mesh.params.extra345.z,
+            mesh.params.extra678.x, mesh.params.extra678.y, mesh.params.extra678.z
+        };
+
+        mesh.instances.resize(size_t(columns) * rows);
+        for (uint32_t r = 0; r < rows; r++) {
+            for (uint32_t c = 0; c < columns; c++) {
+                InstanceData& instance = mesh.instances[size_t(r) * columns + c];
+                glm::vec3 offset((float(c) - 0.5f * (columns - 1)) * spacing, 0.0f, (float(r) - 0.5f * (rows - 1)) * spacing);
+                instance.transformation = glm::translate(glm::mat4(1.f), offset);
+                std::copy(meshParams, meshParams + 9, instance.params);
+                instance.params[parameters[0]] = (columns > 1) ? float(c) / (columns - 1) : 0.0f;
+                instance.params[parameters[1]] = (rows > 1) ? float(r) / (rows - 1) : 0.0f;
+                instance.overrides = (1u << parameters[0]) | (1u << parameters[1]);
+            }
+        }
+    }
+
+
     /// <summary>
     /// 
     /// </summary>
@@ -367,19 +307,6 @@ namespace brdfa {
             vkDestroyImage(device.device, textureImage.obj, nullptr);
             vkFreeMemory(device.device, textureImage.memory, nullptr);
         }
-
-        /*Destroying Parameters buffer data.*/
-        for (int i = 0; i < mesh.paramsBuffer.size(); i++) {
-            vkDestroyBuffer(device.device, mesh.paramsBuffer[i].obj, nullptr);
-            vkFreeMemory(device.device, mesh.paramsBuffer[i].memory, nullptr);
-        }
-        mesh.paramsBuffer.clear();
-
-        /*Destroying Vertices data*/
-        vkDestroyBuffer(device.device, mesh.indexBuffer.obj, nullptr);
-        vkFreeMemory(device.device, mesh.indexBuffer.memory, nullptr);
-        vkDestroyBuffer(device.device, mesh.vertexBuffer.obj, nullptr);
-        vkFreeMemory(device.device, mesh.vertexBuffer.memory, nullptr);
     }
 
 
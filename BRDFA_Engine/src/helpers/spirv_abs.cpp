@@ -0,0 +1,188 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+// --------------------------------- SPIR-V Cost Report ---------------------------------
+//  Walks the SPIR-V words of a compiled BRDF and counts its instructions by class. Static counts only: the loop body is
+//  counted once, whatever the sample count is. A call counts the body of its callee (and of the callees of that one), as
+//  if it was inlined.
+
+namespace brdfa {
+
+    static const uint32_t SPIRV_MAGIC = 0x07230203;
+
+    /*Opcodes used by the report (SPIR-V 1.0 numbering)*/
+    enum SpirvOp : uint32_t {
+        OP_NAME = 5,
+        OP_EXT_INST_IMPORT = 11,
+        OP_EXT_INST = 12,
+        OP_ENTRY_POINT = 15,
+        OP_FUNCTION = 54,
+        OP_FUNCTION_END = 56,
+        OP_FUNCTION_CALL = 57,
+        OP_IMAGE_SAMPLE_FIRST = 87,     // OpImageSampleImplicitLod
+        OP_IMAGE_SAMPLE_LAST = 97,      // OpImageDrefGather
+        OP_ALU_FIRST = 109,             // OpConvertFToU
+        OP_ALU_LAST = 205,              // OpBitCount
+        OP_DERIVATIVE_FIRST = 207,      // OpDPdx
+        OP_DERIVATIVE_LAST = 215,       // OpFwidthCoarse
+        OP_LOOP_MERGE = 246,
+        OP_LABEL = 248,
+        OP_BRANCH_CONDITIONAL = 250,
+        OP_SWITCH = 251,
+        OP_KILL = 252
+    };
+
+    /*GLSL.std.450 instructions 13 (Sin) to 32 (InverseSqrt) are the trigonometric, exponential and root functions.*/
+    static const uint32_t GLSL_TRANSCENDENTAL_FIRST = 13;
+    static const uint32_t GLSL_TRANSCENDENTAL_LAST = 32;
+
+
+    static std::string spirvString(const uint32_t* words, const size_t& count) {
+        const char* text = reinterpret_cast<const char*>(words);
+        return std::string(text, strnlen(text, count * 4));
+    }
+
+
+    /*Instructions of a function body, without its callees, and the functions it calls (once per call site).*/
+    struct FunctionBody {
+        InstructionCounts       own;
+        std::vector<uint32_t>   calls;
+    };
+
+
+    static void addCounts(InstructionCounts& to, const InstructionCounts& from) {
+        to.alu += from.alu;
+        to.transcendental += from.transcendental;
+        to.texture += from.texture;
+        to.branch += from.branch;
+        to.total += from.total;
+    }
+
+
+    /*Counts of a function along with the bodies of its callees. SPIR-V has no recursion: the guard only stops malformed modules.*/
+    static const InstructionCounts& inclusiveCounts(const uint32_t& function, const std::unordered_map<uint32_t, FunctionBody>& bodies,
+        std::unordered_map<uint32_t, InstructionCounts>& done, std::unordered_set<uint32_t>& visiting) {
+        static const InstructionCounts none{};
+        auto it = done.find(function);
+        if (it != done.end()) return it->second;
+        auto body = bodies.find(function);
+        if (body == bodies.end() || !visiting.insert(function).second) return none;
+
+        InstructionCounts counts = body->second.own;
+        for (const uint32_t& callee : body->second.calls)
+            addCounts(counts, inclusiveCounts(callee, bodies, done, visiting));
+        visiting.erase(function);
+        return done[function] = counts;
+    }
+
+
+    static void countInstruction(InstructionCounts& counts, const uint32_t* words, const uint32_t& glslSet) {
+        uint32_t op = words[0] & 0xFFFF;
+        counts.total++;
+        if (op >= OP_ALU_FIRST && op <= OP_ALU_LAST) counts.alu++;
+        else if (op >= OP_DERIVATIVE_FIRST && op <= OP_DERIVATIVE_LAST) counts.alu++;
+        else if (op >= OP_IMAGE_SAMPLE_FIRST && op <= OP_IMAGE_SAMPLE_LAST) counts.texture++;
+        else if (op == OP_BRANCH_CONDITIONAL || op == OP_SWITCH || op == OP_KILL) counts.branch++;
+        else if (op == OP_EXT_INST && words[3] == glslSet) {
+            if (words[4] >= GLSL_TRANSCENDENTAL_FIRST && words[4] <= GLSL_TRANSCENDENTAL_LAST) counts.transcendental++;
+            else counts.alu++;
+        }
+    }
+
+
+    /// <summary>
+    /// Counts the instructions of a compiled BRDF fragment shader by class: the whole shader, the render() function
+    /// (unless it was inlined or its name stripped by the optimizer) and the body of the outermost loop of main(). The last two
+    /// take in the functions they call.
+    /// </summary>
+    /// <param name="spirv"></param>
+    /// <returns></returns>
+    ShaderCost analyzeShaderCost(const std::vector<char>& spirv) {
+        ShaderCost cost;
+        if (spirv.size() < 20 || spirv.size() % 4 != 0) return cost;
+        std::vector<uint32_t> words(spirv.size() / 4);
+        memcpy(words.data(), spirv.data(), spirv.size());
+        if (words[0] != SPIRV_MAGIC) return cost;
+
+        /*First pass: names, entry point and the GLSL.std.450 import. The names are gone if the optimizer stripped the debug info.*/
+        std::unordered_map<uint32_t, std::string> names;
+        uint32_t glslSet = UINT32_MAX;
+        uint32_t entryPoint = UINT32_MAX;
+        for (size_t i = 5; i < words.size();) {
+            uint32_t count = words[i] >> 16;
+            uint32_t op = words[i] & 0xFFFF;
+            if (count == 0 || i + count > words.size()) return cost;
+            if (op == OP_NAME && count > 2) names[words[i + 1]] = spirvString(&words[i + 2], count - 2);
+            if (op == OP_EXT_INST_IMPORT && count > 2 && spirvString(&words[i + 2], count - 2) == "GLSL.std.450") glslSet = words[i + 1];
+            if (op == OP_ENTRY_POINT && count > 2 && entryPoint == UINT32_MAX) entryPoint = words[i + 2];
+            i += count;
+        }
+
+        /*Second pass: counting, per function. Function names are mangled by glslang, e.g. "render(vf3;vf3;...".*/
+        std::unordered_map<uint32_t, FunctionBody> bodies;
+        FunctionBody* body = nullptr;
+        FunctionBody loop;
+        uint32_t renderFunction = UINT32_MAX;
+        bool inMain = false, inLoop = false, loopDone = false;
+        uint32_t loopMerge = 0;
+        for (size_t i = 5; i < words.size(); i += words[i] >> 16) {
+            uint32_t op = words[i] & 0xFFFF;
+            if (op == OP_FUNCTION) {
+                uint32_t function = words[i + 2];
+                if (renderFunction == UINT32_MAX && names[function].compare(0, 7, "render(") == 0) renderFunction = function;
+                inMain = function == entryPoint;
+                body = &bodies[function];
+                continue;
+            }
+            if (op == OP_FUNCTION_END) {
+                inMain = false;
+                body = nullptr;
+                continue;
+            }
+
+            /*Outside of the functions: types, constants and globals.*/
+            countInstruction(cost.shader, &words[i], glslSet);
+            if (body == nullptr) continue;
+
+            /*Outermost loop of main: from its header block to its merge block.*/
+            if (inMain && !loopDone) {
+                if (op == OP_LOOP_MERGE && !inLoop) {
+                    inLoop = true;
+                    loopMerge = words[i + 1];
+                }
+                else if (op == OP_LABEL && inLoop && words[i + 1] == loopMerge) {
+                    inLoop = false;
+                    loopDone = true;
+                }
+            }
+
+            countInstruction(body->own, &words[i], glslSet);
+            if (inLoop) countInstruction(loop.own, &words[i], glslSet);
+            if (op == OP_FUNCTION_CALL) {
+                body->calls.push_back(words[i + 3]);
+                if (inLoop) loop.calls.push_back(words[i + 3]);
+            }
+        }
+
+        /*The callees, through the call graph.*/
+        std::unordered_map<uint32_t, InstructionCounts> done;
+        std::unordered_set<uint32_t> visiting;
+        if (renderFunction != UINT32_MAX) cost.render = inclusiveCounts(renderFunction, bodies, done, visiting);
+        cost.loop = loop.own;
+        for (const uint32_t& callee : loop.calls)
+            addCounts(cost.loop, inclusiveCounts(callee, bodies, done, visiting));
+
+        cost.renderFound = renderFunction != UINT32_MAX;
+        cost.valid = true;
+        return cost;
+    }
+
+}
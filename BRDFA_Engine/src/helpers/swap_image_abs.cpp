@@ -292,7 +292,8 @@ namespace brdfa {
     /// <param name="commander"></param>
     /// <param name="device"></param>
     /// <param name="swapchain"></param>
-     void createColorResources(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain) {
+    /// <param name="sampled">Read by the FXAA or upscale pass instead of living in tile memory only</param>
+     void createColorResources(Image& image, Commander& commander, const Device& device, const SwapChain& swapchain, bool sampled) {
         VkFormat colorFormat = swapchain.format;
 
         createImage(
@@ -302,7 +303,7 @@ namespace brdfa {
             device.msaaSamples, 
             colorFormat, 
             VK_IMAGE_TILING_OPTIMAL, 
-            VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT 
+            (sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
                 | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
             image);
@@ -343,7 +344,7 @@ namespace brdfa {
             device.msaaSamples, 
             choosenFormat, 
             VK_IMAGE_TILING_OPTIMAL, 
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,     // Sampled by the Hi-Z pyramid.
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
             image);
 
@@ -368,17 +369,30 @@ namespace brdfa {
     /// <param name="gpipeline"></param>
      void createFramebuffers(SwapChain& swapchain, Commander& commander, const Device& device, const GPipeline& gpipeline) {
 
-        createColorResources(swapchain.colorImage, commander, device, swapchain);
+        bool multisampled = device.msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        bool colorUsed = sceneColorAttachment(gpipeline, device);
+        if (colorUsed)
+            createColorResources(swapchain.colorImage, commander, device, swapchain, !multisampled);
         createDepthResources(swapchain.depthImage, commander, device, swapchain);
 
+        /*Governed with MSAA, the scene resolves into an image of its own instead of the swapchain image (see createRenderPass).*/
+        bool offscreenResolve = gpipeline.scaled && multisampled;
+        if (offscreenResolve) {
+            createImage(commander, device, swapchain.extent.width, swapchain.extent.height, 1, VK_SAMPLE_COUNT_1_BIT, swapchain.format,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                swapchain.sceneImage);
+            swapchain.sceneImage.view = createImageView(swapchain.sceneImage.obj, device.device, swapchain.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+
 
         swapchain.framebuffers.resize(swapchain.imageViews.size());
         for (size_t i = 0; i < swapchain.imageViews.size(); i++) {
-            std::array<VkImageView, 3> attachments = {
+            std::vector<VkImageView> attachments = {
                 swapchain.colorImage.view,
                 swapchain.depthImage.view,
-                swapchain.imageViews[i]
+                offscreenResolve ? swapchain.sceneImage.view : swapchain.imageViews[i]
             };
+            if (!colorUsed) attachments = { swapchain.imageViews[i], swapchain.depthImage.view };
 
             VkFramebufferCreateInfo framebufferInfo{};
             framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -448,6 +462,7 @@ namespace brdfa {
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         createInfo.presentMode = presentMode;
+        swapchain.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
 
         if (vkCreateSwapchainKHR(device.device, &createInfo, nullptr, &swapchain.swapChain) != VK_SUCCESS) {
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <helpers/functions.hpp>
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+
+// --------------------------------- Uniform Arena ---------------------------------
+//  The camera block lives in one persistently mapped buffer, bound with a dynamic offset. Each swapchain image owns a
+//  region of it, so a region is only written once the previous frame of that image is done. The per object data is
+//  not in here: it is a record of the geometry arena's draw record table (see DrawRecord).
+
+namespace brdfa {
+
+    static VkDeviceSize alignUp(const VkDeviceSize& size, const VkDeviceSize& alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+
+    /// <summary>
+    /// Creates the buffer of the arena and maps it. The content must be written again afterwards.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="commander"></param>
+    /// <param name="device"></param>
+    /// <param name="frameCount">Number of frame regions (swapchain images)</param>
+    void createUniformArena(UniformArena& arena, Commander& commander, const Device& device, const uint32_t& frameCount) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
+
+        arena.frameSize = alignUp(sizeof(CameraUniforms), alignment);
+        arena.frameCount = frameCount;
+
+        createBuffer(
+            commander, device, arena.frameSize * arena.frameCount,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            arena.buffer);
+
+        void* data;
+        if (vkMapMemory(device.device, arena.buffer.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("ERROR: failed to map the uniform arena!");
+        }
+        arena.mapped = static_cast<uint8_t*>(data);
+    }
+
+
+    /// <summary>
+    /// Unmaps and destroys the buffer of the arena.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="device"></param>
+    void destroyUniformArena(UniformArena& arena, const Device& device) {
+        if (arena.mapped == nullptr) return;
+        vkUnmapMemory(device.device, arena.buffer.memory);
+        vkDestroyBuffer(device.device, arena.buffer.obj, nullptr);
+        vkFreeMemory(device.device, arena.buffer.memory, nullptr);
+        arena.mapped = nullptr;
+    }
+
+
+    /// <summary>
+    /// Offset of the camera block of a frame region.
+    /// </summary>
+    uint32_t cameraUniformOffset(const UniformArena& arena, const uint32_t& frame) {
+        return static_cast<uint32_t>(arena.frameSize * frame);
+    }
+
+
+    /// <summary>
+    /// Writes the camera block of a frame region.
+    /// </summary>
+    /// <param name="arena"></param>
+    /// <param name="frame"></param>
+    /// <param name="camera"></param>
+    void writeCameraUniforms(UniformArena& arena, const uint32_t& frame, const CameraUniforms& camera) {
+        memcpy(arena.mapped + cameraUniformOffset(arena, frame), &camera, sizeof(CameraUniforms));
+    }
+
+
+
+    /// <summary>
+    /// Packs the per draw data of a mesh. Written into the draw record table by recordDrawData(), so any change of the fields
+    /// read here must bump Mesh::drawVersion.
+    /// </summary>
+    /// <param name="mesh"></param>
+    /// <returns></returns>
+    DrawRecord drawRecord(Mesh& mesh) {
+        DrawRecord record{};
+        record.model = mesh.getFinalTransformation();
+        record.params0 = glm::vec4(mesh.params.extra012, mesh.params.extra345.x);
+        record.params1 = glm::vec4(mesh.params.extra345.y, mesh.params.extra345.z, mesh.params.extra678.x, mesh.params.extra678.y);
+        record.param8 = mesh.params.extra678.z;
+        record.samples = mesh.samples;
+        record.batch = mesh.batchIndex;
+        record.material = mesh.materialSlot * MATERIAL_RECORD_SIZE;
+        return record;
+    }
+
+
+
+    /*Object block of the former uniform path: one uniform block per object and frame region, the normal matrix computed on the CPU.*/
+    struct UniformObjectBlock {
+        alignas(16) glm::mat4           model;
+        alignas(16) glm::mat4           normal;
+        alignas(16) glm::vec3           render_opt;
+        uint32_t                        material;
+        Parameters                      params;
+    };
+
+
+    /// <summary>
+    /// Compares the CPU time and memory spent per frame on the per object data: a uniform block per object and frame region written
+    /// into a mapped arena (aligned for dynamic offsets) against the packed draw records, written once for all the frames. Every
+    /// object is considered changed, which is the worst case of both. Runs on the calling thread; no window or device is needed.
+    /// </summary>
+    /// <returns>Process exit code</returns>
+    int benchmarkObjectData() {
+        const VkDeviceSize alignment = 256;                     // Largest minUniformBufferOffsetAlignment in the wild.
+        const uint32_t frameCount = 3;
+        const int repeats = 50;
+        const std::array<size_t, 3> objectCounts = { 1, 100, 10000 };
+
+        auto elapsedUs = [](const std::chrono::high_resolution_clock::time_point& start) {
+            return std::chrono::duration<float, std::chrono::microseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+        };
+        auto median = [](std::vector<float>& times) {
+            std::sort(times.begin(), times.end());
+            return times[times.size() / 2];
+        };
+
+        printf("%-10s %14s %14s %16s %16s\n", "Objects", "uniform us", "record us", "uniform bytes", "record bytes");
+        for (const size_t& count : objectCounts) {
+            std::vector<Mesh> meshes(count);
+            for (size_t i = 0; i < count; i++) {
+                meshes[i].uid = static_cast<uint32_t>(i + 1);
+                meshes[i].translation = glm::vec3(float(i % 100), float(i / 100), 0.0f);
+                meshes[i].rotation = glm::vec3(float(i % 360), 0.0f, 0.0f);
+                meshes[i].params.extra012 = glm::vec3(0.25f, 0.5f, 0.75f);
+            }
+
+            VkDeviceSize blockSize = alignUp(sizeof(UniformObjectBlock), alignment);
+            std::vector<uint8_t> arena(blockSize * count * frameCount);
+            std::vector<DrawRecord> records(count);
+
+            std::vector<float> uniformTimes, recordTimes;
+            for (int r = 0; r < repeats; r++) {
+                uint32_t frame = r % frameCount;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (size_t i = 0; i < count; i++) {
+                    UniformObjectBlock block{};
+                    block.model = meshes[i].getFinalTransformation();
+                    block.normal = glm::mat4(glm::transpose(glm::inverse(glm::mat3(block.model))));
+                    block.render_opt = glm::vec3(meshes[i].extra[0], meshes[i].extra[1], static_cast<float>(meshes[i].samples));
+                    block.material = static_cast<uint32_t>(i) * MATERIAL_RECORD_SIZE;
+                    block.params = meshes[i].params;
+                    memcpy(arena.data() + blockSize * (frame * count + i), &block, sizeof(UniformObjectBlock));
+                }
+                uniformTimes.push_back(elapsedUs(start));
+
+                start = std::chrono::high_resolution_clock::now();
+                for (size_t i = 0; i < count; i++) {
+                    records[i] = drawRecord(meshes[i]);
+                }
+                recordTimes.push_back(elapsedUs(start));
+            }
+
+            printf("%-10zu %14.1f %14.1f %16zu %16zu\n", count, median(uniformTimes), median(recordTimes),
+                static_cast<size_t>(arena.size()), count * sizeof(DrawRecord));
+        }
+        printf("\nuniform bytes: arena of %u frame regions. record bytes: the draw record table, updated in place by the frame's command buffer.\n", frameCount);
+        printf("Neither re-records a command buffer: the draws of a batch read the records through their instances.\n");
+        return 0;
+    }
+
+}
@@ -3,9 +3,11 @@
 #include <imgui/imgui.h>
 
 #include "brdfa_engine.hpp"
+#include <helpers/functions.hpp>
 
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
 #define WINDOW_HEIGHT 600
 
@@ -15,6 +17,51 @@
 #define HOT_LOAD "--hot-load"
 #define HL "-hl"
 
+#define NO_BINDLESS "--no-bindless"
+#define NB "-nb"
+
+#define DEFERRED "--deferred"
+#define DF "-df"
+
+#define ANTI_ALIASING "--anti-aliasing"
+#define AA "-aa"
+
+#define FRAME_TARGET "--frame-target"
+#define FT "-ft"
+
+#define ADAPTIVE "--adaptive"
+#define AS "-as"
+
+#define HEADLESS "--headless"
+#define HD "-hd"
+
+#define SCENE "--scene"
+#define SC "-sc"
+
+#define BRDFS "--brdfs"
+#define BR "-br"
+
+#define CAMERA "--camera"
+#define CAM "-cam"
+
+#define SAMPLES "--samples"
+#define SP "-sp"
+
+#define FRAMES "--frames"
+#define FR "-fr"
+
+#define OUTPUT "--output"
+#define OUT "-o"
+
+#define SIZE "--size"
+#define SZ "-sz"
+
+#define COMPILE_BENCHMARK "--compile-benchmark"
+#define CB "-cb"
+
+#define OBJECT_BENCHMARK "--object-benchmark"
+#define OB "-ob"
+
 /// <summary>
 /// Used to print the help menu when the -h or --help commands are passed.
 /// </summary>
@@ -24,6 +71,36 @@ void printHelp() {
         HOT_LOAD, HL);
     printf("\t%s, %s\t\t Used to disable cache loading. The engine will not load the data that was cached during the previous engine execution.\n",
         NO_CACHE_LOAD, NCL);
+    printf("\t%s, %s\t\t\t Keeps the four fixed texture bindings per object even if the GPU supports bindless textures (descriptor indexing).\n",
+        NO_BINDLESS, NB);
+    printf("\t%s, %s\t\t\t Deferred shading: the meshes are laid into a G-buffer first, and each BRDF is evaluated once per pixel in a full screen pass.\n",
+        DEFERRED, DF);
+    printf("\t%s, %s <mode>\t Initial anti-aliasing mode: off, msaa2, msaa4 (default), msaa8 or fxaa. Can be changed in the Logs window.\n",
+        ANTI_ALIASING, AA);
+    printf("\t%s, %s <ms>\t\t Starts the frame-time governor at the given frame time: the render scale, then the light samples per frame, are lowered to hold it.\n",
+        FRAME_TARGET, FT);
+    printf("\t%s, %s\t\t\t Starts with adaptive sampling: the light samples go to the pixels whose estimated error is over the target, until they converge.\n",
+        ADAPTIVE, AS);
+    printf("\t%s, %s\t\t\t Renders without a window nor a swapchain (also with a software driver such as lavapipe, picked through VK_ICD_FILENAMES), saves one PNG per BRDF and exits.\n",
+        HEADLESS, HD);
+    printf("\t%s, %s <model> <texture>\t Headless: object of the scene and its texture (paths relative to the project).\n",
+        SCENE, SC);
+    printf("\t%s, %s <a,b,...>\t Headless: BRDFs rendered, comma separated. All the loaded ones by default.\n",
+        BRDFS, BR);
+    printf("\t%s, %s <ex,ey,ez,tx,ty,tz>\t Headless: camera position and the point it looks at.\n",
+        CAMERA, CAM);
+    printf("\t%s, %s <n>\t\t Headless: light samples of the object.\n",
+        SAMPLES, SP);
+    printf("\t%s, %s <n>\t\t Headless: frames rendered per BRDF, the last one is saved (default 4).\n",
+        FRAMES, FR);
+    printf("\t%s, %s <dir>\t\t Headless: directory of the images (default res/headless).\n",
+        OUTPUT, OUT);
+    printf("\t%s, %s <w>x<h>\t\t Window size, or image size when headless.\n",
+        SIZE, SZ);
+    printf("\t%s, %s\t\t Compiles all the BRDFs against main.frag, prints the timings and exits (no window is opened).\n",
+        COMPILE_BENCHMARK, CB);
+    printf("\t%s, %s\t\t Times the per object data (uniform blocks against push constants) for 1, 100 and 10000 objects and exits.\n",
+        OBJECT_BENCHMARK, OB);
 
 }
 
@@ -44,20 +121,100 @@ int main(int argc, char** argv) {
         }
     }
 
+    /*Benchmarks. Run without the engine.*/
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], COMPILE_BENCHMARK) == 0 || strcmp(argv[i], CB) == 0) {
+            return brdfa::benchmarkBRDFCompilation();
+        }
+        if (strcmp(argv[i], OBJECT_BENCHMARK) == 0 || strcmp(argv[i], OB) == 0) {
+            return brdfa::benchmarkObjectData();
+        }
+    }
+
     /*ENGIN Configuration*/
     brdfa::BRDFAEngineConfiguration conf;
     conf.height = WINDOW_HEIGHT;
     conf.width = static_cast<uint16_t>(WINDOW_HEIGHT / (9.0 / 16.0));
     conf.hot_load = false;
     conf.no_cache_load = false;
+    conf.no_bindless = false;
+    conf.deferred = false;
     conf.validationLayersEnabled = false;
     for (int i = 0; i < argc; i++) {
         conf.hot_load = (strcmp(argv[i], "--hot-load") == 0) ? true : conf.hot_load;
         conf.no_cache_load = (strcmp(argv[i], "--no-cache-load") == 0) ? true : conf.no_cache_load;
+        conf.no_bindless = (strcmp(argv[i], NO_BINDLESS) == 0 || strcmp(argv[i], NB) == 0) ? true : conf.no_bindless;
+        conf.deferred = (strcmp(argv[i], DEFERRED) == 0 || strcmp(argv[i], DF) == 0) ? true : conf.deferred;
+        conf.adaptiveSampling = (strcmp(argv[i], ADAPTIVE) == 0 || strcmp(argv[i], AS) == 0) ? true : conf.adaptiveSampling;
+        if ((strcmp(argv[i], ANTI_ALIASING) == 0 || strcmp(argv[i], AA) == 0) && i + 1 < argc) {
+            if (!brdfa::parseAntiAliasing(argv[++i], conf.antiAliasing))
+                printf("[WARNING]: Unknown anti-aliasing mode \"%s\". Using %s.\n", argv[i], brdfa::antiAliasingName(conf.antiAliasing));
+        }
+        if ((strcmp(argv[i], FRAME_TARGET) == 0 || strcmp(argv[i], FT) == 0) && i + 1 < argc) {
+            conf.frameTarget = static_cast<float>(atof(argv[++i]));
+            if (conf.frameTarget <= 0.0f)
+                printf("[WARNING]: Invalid frame target \"%s\". The governor stays off.\n", argv[i]);
+        }
+
+        /*Headless job.*/
+        conf.headless = (strcmp(argv[i], HEADLESS) == 0 || strcmp(argv[i], HD) == 0) ? true : conf.headless;
+        if ((strcmp(argv[i], SCENE) == 0 || strcmp(argv[i], SC) == 0) && i + 2 < argc) {
+            conf.job.model = argv[++i];
+            conf.job.texture = argv[++i];
+        }
+        if ((strcmp(argv[i], BRDFS) == 0 || strcmp(argv[i], BR) == 0) && i + 1 < argc) {
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                if (end > start) conf.job.brdfs.push_back(list.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+        if ((strcmp(argv[i], CAMERA) == 0 || strcmp(argv[i], CAM) == 0) && i + 1 < argc) {
+            glm::vec3 eye, target;
+            if (sscanf(argv[++i], "%f,%f,%f,%f,%f,%f", &eye.x, &eye.y, &eye.z, &target.x, &target.y, &target.z) == 6) {
+                conf.job.eye = eye;
+                conf.job.target = target;
+            }
+            else {
+                printf("[WARNING]: Invalid camera \"%s\". Expected ex,ey,ez,tx,ty,tz.\n", argv[i]);
+            }
+        }
+        if ((strcmp(argv[i], SAMPLES) == 0 || strcmp(argv[i], SP) == 0) && i + 1 < argc) {
+            conf.job.samples = std::max(0, atoi(argv[++i]));
+        }
+        if ((strcmp(argv[i], FRAMES) == 0 || strcmp(argv[i], FR) == 0) && i + 1 < argc) {
+            conf.job.frames = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+        }
+        if ((strcmp(argv[i], OUTPUT) == 0 || strcmp(argv[i], OUT) == 0) && i + 1 < argc) {
+            conf.job.outputDir = argv[++i];
+        }
+        if ((strcmp(argv[i], SIZE) == 0 || strcmp(argv[i], SZ) == 0) && i + 1 < argc) {
+            unsigned int w = 0, h = 0;
+            if (sscanf(argv[++i], "%ux%u", &w, &h) == 2 && w > 0 && h > 0 && w <= 8192 && h <= 8192) {
+                conf.width = static_cast<uint16_t>(w);
+                conf.height = static_cast<uint16_t>(h);
+            }
+            else {
+                printf("[WARNING]: Invalid size \"%s\". Expected <width>x<height>.\n", argv[i]);
+            }
+        }
     }
 
     /*Engin initialziation*/
     brdfa::BRDFA_Engine analyzerEngine(conf);
+
+    /*Headless: renders the job and exits, there is no update loop.*/
+    if (conf.headless) {
+        if (!analyzerEngine.init())
+            return 1;
+        int code = analyzerEngine.runHeadless();
+        analyzerEngine.close();
+        return code;
+    }
+
     analyzerEngine.init();
     
     /*The Engine update loop*/